@@ -260,12 +260,7 @@ int QCamera2HardwareInterface::msg_type_enabled(struct camera_device *device, in
         return BAD_VALUE;
     }
     hw->lockAPI();
-    qcamera_api_result_t apiResult;
-    ret = hw->processAPI(QCAMERA_SM_EVT_MSG_TYPE_ENABLED, (void *)&msg_type);
-    if (ret == NO_ERROR) {
-        hw->waitAPIResult(QCAMERA_SM_EVT_MSG_TYPE_ENABLED, &apiResult);
-        ret = apiResult.enabled;
-    }
+    ret = hw->processQueryAPI(QCAMERA_SM_EVT_MSG_TYPE_ENABLED, (void *)&msg_type);
     hw->unlockAPI();
 
    return ret;
@@ -368,12 +363,7 @@ int QCamera2HardwareInterface::preview_enabled(struct camera_device *device)
     }
 
     hw->lockAPI();
-    qcamera_api_result_t apiResult;
-    ret = hw->processAPI(QCAMERA_SM_EVT_PREVIEW_ENABLED, NULL);
-    if (ret == NO_ERROR) {
-        hw->waitAPIResult(QCAMERA_SM_EVT_PREVIEW_ENABLED, &apiResult);
-        ret = apiResult.enabled;
-    }
+    ret = hw->processQueryAPI(QCAMERA_SM_EVT_PREVIEW_ENABLED, NULL);
     hw->unlockAPI();
 
     return ret;
@@ -503,12 +493,7 @@ int QCamera2HardwareInterface::recording_enabled(struct camera_device *device)
         return BAD_VALUE;
     }
     hw->lockAPI();
-    qcamera_api_result_t apiResult;
-    ret = hw->processAPI(QCAMERA_SM_EVT_RECORDING_ENABLED, NULL);
-    if (ret == NO_ERROR) {
-        hw->waitAPIResult(QCAMERA_SM_EVT_RECORDING_ENABLED, &apiResult);
-        ret = apiResult.enabled;
-    }
+    ret = hw->processQueryAPI(QCAMERA_SM_EVT_RECORDING_ENABLED, NULL);
     hw->unlockAPI();
 
     return ret;
@@ -1064,6 +1049,7 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
       m_postprocessor(this),
       m_thermalAdapter(QCameraThermalAdapter::getInstance()),
       m_cbNotifier(this),
+      m_bStaticExifValid(false),
       m_bPreviewStarted(false),
       m_bRecordStarted(false),
       m_currentFocusState(CAM_AF_SCANNING),
@@ -2164,6 +2150,7 @@ int QCamera2HardwareInterface::setCallBacks(camera_notify_callback notify_cb,
     mDataCbTimestamp = data_cb_timestamp;
     mGetMemory       = get_memory;
     mCallbackCookie  = user;
+    m_previewCbPool.setCallbacks(get_memory, user);
     m_cbNotifier.setCallbacks(notify_cb, data_cb, data_cb_timestamp, user);
     return NO_ERROR;
 }
@@ -4173,6 +4160,7 @@ int QCamera2HardwareInterface::dump(int fd)
     dprintf(fd, "StoreMetaDataInFrame: %d \n", mStoreMetaDataInFrame);
     dprintf(fd, "\n Configuration: %s", mParameters.dump().string());
     dprintf(fd, "\n State Information: %s", m_stateMachine.dump().string());
+    dprintf(fd, "\n Callback Notifier: %s", m_cbNotifier.dump().string());
     dprintf(fd, "\n Camera HAL information End \n");
 
     /* send UPDATE_DEBUG_LEVEL to the backend so that they can read the
@@ -4205,6 +4193,42 @@ int QCamera2HardwareInterface::processAPI(qcamera_sm_evt_enum_t api, void *api_p
     return ret;
 }
 
+/*===========================================================================
+ * FUNCTION   : processQueryAPI
+ *
+ * DESCRIPTION: answer state query API calls from upper layer directly,
+ *              without going through statemachine thread when the current
+ *              state allows it. Caller must hold the API lock.
+ *
+ * PARAMETERS :
+ *   @api         : query API to be processed
+ *   @api_payload : ptr to API payload if any
+ *
+ * RETURN     : enabled flag of the query, DEAD_OBJECT if statemachine
+ *              is not active
+ *==========================================================================*/
+int QCamera2HardwareInterface::processQueryAPI(qcamera_sm_evt_enum_t api,
+        void *api_payload)
+{
+    int ret = DEAD_OBJECT;
+
+    if (m_smThreadActive) {
+        int enabled = 0;
+        if (m_stateMachine.procQueryAPI(api, api_payload, enabled)) {
+            ret = enabled;
+        } else {
+            qcamera_api_result_t apiResult;
+            ret = processAPI(api, api_payload);
+            if (ret == NO_ERROR) {
+                waitAPIResult(api, &apiResult);
+                ret = apiResult.enabled;
+            }
+        }
+    }
+
+    return ret;
+}
+
 /*===========================================================================
  * FUNCTION   : processEvt
  *
@@ -6116,6 +6140,7 @@ int32_t QCamera2HardwareInterface::addChannel(qcamera_ch_type_enum_t ch_type)
 int32_t QCamera2HardwareInterface::delChannel(qcamera_ch_type_enum_t ch_type,
                                               bool destroy)
 {
+    releasePreviewCbMappings(ch_type);
     if (m_channels[ch_type] != NULL) {
         if (destroy) {
             delete m_channels[ch_type];
@@ -6128,6 +6153,27 @@ int32_t QCamera2HardwareInterface::delChannel(qcamera_ch_type_enum_t ch_type,
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : releasePreviewCbMappings
+ *
+ * DESCRIPTION: drop the preview callback mappings of preview stream buffers
+ *              before a channel carrying them is stopped or deleted. A later
+ *              preview may reuse the same buffer index and fd.
+ *
+ * PARAMETERS :
+ *   @ch_type : channel type
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::releasePreviewCbMappings(
+        qcamera_ch_type_enum_t ch_type)
+{
+    if ((QCAMERA_CH_TYPE_PREVIEW == ch_type) ||
+            (QCAMERA_CH_TYPE_ZSL == ch_type)) {
+        m_previewCbPool.clear();
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : startChannel
  *
@@ -6171,6 +6217,7 @@ int32_t QCamera2HardwareInterface::stopChannel(qcamera_ch_type_enum_t ch_type)
     if (m_channels[ch_type] != NULL) {
         rc = m_channels[ch_type]->stop();
     }
+    releasePreviewCbMappings(ch_type);
 
     return rc;
 }
@@ -7181,6 +7228,45 @@ uint32_t QCamera2HardwareInterface::getJpegQuality()
     return quality;
 }
 
+/*===========================================================================
+ * FUNCTION   : buildStaticExifData
+ *
+ * DESCRIPTION: build the exif tags that stay the same for every picture
+ *              taken while the camera is open. Called with m_parm_lock held.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::buildStaticExifData()
+{
+#ifdef ENABLE_MODEL_INFO_EXIF
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("ro.product.manufacturer", value, "QCOM-AA") > 0) {
+        m_staticExif.addEntry(EXIFTAGID_MAKE, EXIF_ASCII,
+                (uint32_t)(strlen(value) + 1), (void *)value);
+    } else {
+        ALOGE("%s: getExifMaker failed", __func__);
+    }
+
+    if (property_get("ro.product.model", value, "QCAM-AA") > 0) {
+        m_staticExif.addEntry(EXIFTAGID_MODEL, EXIF_ASCII,
+                (uint32_t)(strlen(value) + 1), (void *)value);
+    } else {
+        ALOGE("%s: getExifModel failed", __func__);
+    }
+
+    if (property_get("ro.build.description", value, "QCAM-AA") > 0) {
+        m_staticExif.addEntry(EXIFTAGID_SOFTWARE, EXIF_ASCII,
+                (uint32_t)(strlen(value) + 1), (void *)value);
+    } else {
+        ALOGE("%s: getExifSoftware failed", __func__);
+    }
+
+#endif
+}
+
 /*===========================================================================
  * FUNCTION   : getExifData
  *
@@ -7320,31 +7406,11 @@ QCameraExif *QCamera2HardwareInterface::getExifData()
         ALOGE("%s: getExifGpsDataTimeStamp failed", __func__);
     }
 
-#ifdef ENABLE_MODEL_INFO_EXIF
-
-    char value[PROPERTY_VALUE_MAX];
-    if (property_get("ro.product.manufacturer", value, "QCOM-AA") > 0) {
-        exif->addEntry(EXIFTAGID_MAKE, EXIF_ASCII,
-                (uint32_t)(strlen(value) + 1), (void *)value);
-    } else {
-        ALOGE("%s: getExifMaker failed", __func__);
-    }
-
-    if (property_get("ro.product.model", value, "QCAM-AA") > 0) {
-        exif->addEntry(EXIFTAGID_MODEL, EXIF_ASCII,
-                (uint32_t)(strlen(value) + 1), (void *)value);
-    } else {
-        ALOGE("%s: getExifModel failed", __func__);
-    }
-
-    if (property_get("ro.build.description", value, "QCAM-AA") > 0) {
-        exif->addEntry(EXIFTAGID_SOFTWARE, EXIF_ASCII,
-                (uint32_t)(strlen(value) + 1), (void *)value);
-    } else {
-        ALOGE("%s: getExifSoftware failed", __func__);
+    if (!m_bStaticExifValid) {
+        buildStaticExifData();
+        m_bStaticExifValid = true;
     }
-
-#endif
+    exif->addEntries(m_staticExif);
 
     if (mParameters.useJpegExifRotation()) {
         int16_t orientation;
@@ -7518,14 +7584,11 @@ void *QCamera2HardwareInterface::defferedWorkRoutine(void *obj)
     cmdThread->setName("CAM_defrdWrk");
 
     do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
-                        __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
+        ret = cmdThread->waitCmd();
+        if (ret != NO_ERROR) {
+            ALOGE("%s: waitCmd error (%d)", __func__, ret);
+            return NULL;
+        }
 
         // we got notified about new cmd avail in cmd queue
         camera_cmd_type_t cmd = cmdThread->getCmd();
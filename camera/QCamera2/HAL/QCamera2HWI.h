@@ -126,6 +126,7 @@ typedef struct {
 #define QCAMERA_ION_USE_CACHE   true
 #define QCAMERA_ION_USE_NOCACHE false
 #define MAX_ONGOING_JOBS 25
+#define QCAMERA_CB_MAX_PLANES 3
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
@@ -156,16 +157,27 @@ typedef struct {
     camera_release_callback  release_cb; // release callback
 } qcamera_callback_argm_t;
 
+typedef enum {
+    QCAMERA_CB_LANE_CONTROL,   // notify events: shutter, focus, errors
+    QCAMERA_CB_LANE_SNAPSHOT,  // still capture data
+    QCAMERA_CB_LANE_STREAMING, // preview, metadata and video data
+    QCAMERA_CB_LANE_MAX
+} qcamera_cb_lane_t;
+
+typedef struct {
+    uint32_t enqueued;  // callbacks queued to the lane
+    uint32_t dropped;   // stale callbacks replaced by a newer one
+    int      maxDepth;  // highest number of pending callbacks seen
+} qcamera_cb_lane_stats_t;
+
+typedef struct {
+    int32_t  msg_type;  // msg type to coalesce
+    uint32_t matched;   // number of pending callbacks removed
+} qcamera_cb_coalesce_t;
+
 class QCameraCbNotifier {
 public:
-    QCameraCbNotifier(QCamera2HardwareInterface *parent) :
-                          mNotifyCb (NULL),
-                          mDataCb (NULL),
-                          mDataCbTimestamp (NULL),
-                          mCallbackCookie (NULL),
-                          mParent (parent),
-                          mDataQ(releaseNotifications, this),
-                          mActive(false){}
+    QCameraCbNotifier(QCamera2HardwareInterface *parent);
 
     virtual ~QCameraCbNotifier();
 
@@ -177,12 +189,18 @@ public:
     virtual int32_t startSnapshots();
     virtual void stopSnapshots();
     virtual void exit();
+    virtual String8 dump();
     static void * cbNotifyRoutine(void * data);
     static void releaseNotifications(void *data, void *user_data);
     static bool matchSnapshotNotifications(void *data, void *user_data);
     static bool matchPreviewNotifications(void *data, void *user_data);
+    static bool matchCoalescedNotifications(void *data, void *user_data,
+                                            void *match_data);
     virtual int32_t flushPreviewNotifications();
 private:
+    static qcamera_cb_lane_t getLane(const qcamera_callback_argm_t &cbArgs);
+    static bool isCoalescable(const qcamera_callback_argm_t &cbArgs);
+    qcamera_callback_argm_t *dequeueNext();
 
     camera_notify_callback         mNotifyCb;
     camera_data_callback           mDataCb;
@@ -190,7 +208,13 @@ private:
     void                          *mCallbackCookie;
     QCamera2HardwareInterface     *mParent;
 
-    QCameraQueue     mDataQ;
+    // one queue per lane, drained in lane order by mProcTh
+    QCameraQueue     mCtrlQ;
+    QCameraQueue     mSnapshotQ;
+    QCameraQueue     mStreamQ;
+    QCameraQueue    *mLaneQ[QCAMERA_CB_LANE_MAX];
+    qcamera_cb_lane_stats_t mLaneStats[QCAMERA_CB_LANE_MAX];
+    pthread_mutex_t  mStatsLock;
     QCameraCmdThread mProcTh;
     bool             mActive;
 };
@@ -310,6 +334,7 @@ private:
     int closeCamera();
 
     int processAPI(qcamera_sm_evt_enum_t api, void *api_payload);
+    int processQueryAPI(qcamera_sm_evt_enum_t api, void *api_payload);
     int processEvt(qcamera_sm_evt_enum_t evt, void *evt_payload);
     int processSyncEvt(qcamera_sm_evt_enum_t evt, void *evt_payload);
     void lockAPI();
@@ -352,6 +377,7 @@ private:
     inline bool getCancelAutoFocus(){ return mCancelAutoFocus; }
     inline void setCancelAutoFocus(bool flag){ mCancelAutoFocus = flag; }
     QCameraExif *getExifData();
+    void buildStaticExifData();
     cam_sensor_t getSensorType();
 
     int32_t processAutoFocusEvent(cam_auto_focus_data_t &focus_data);
@@ -375,6 +401,10 @@ private:
 
     int32_t sendPreviewCallback(QCameraStream *stream,
             QCameraGrallocMemory *memory, uint32_t idx);
+    static void compactYuv420Frame(uint8_t *dst, const uint8_t *src,
+            int32_t width, int32_t height, uint32_t numPlanes,
+            const int32_t *srcStride, const int32_t *srcScanline,
+            const int32_t *dstStride, const int32_t *dstScanline);
     int32_t selectScene(QCameraChannel *pChannel,
             mm_camera_super_buf_t *recvd_frame);
 
@@ -382,6 +412,7 @@ private:
     int32_t startChannel(qcamera_ch_type_enum_t ch_type);
     int32_t stopChannel(qcamera_ch_type_enum_t ch_type);
     int32_t delChannel(qcamera_ch_type_enum_t ch_type, bool destroy = true);
+    void releasePreviewCbMappings(qcamera_ch_type_enum_t ch_type);
     int32_t addPreviewChannel();
     int32_t addSnapshotChannel();
     int32_t addVideoChannel();
@@ -523,6 +554,7 @@ private:
     bool m_smThreadActive;
     QCameraPostProcessor m_postprocessor; // post processor
     QCameraThermalAdapter &m_thermalAdapter;
+    QCameraPreviewCbPool m_previewCbPool; // must outlive m_cbNotifier
     QCameraCbNotifier m_cbNotifier;
     QCameraPerfLock m_perfLock;
     pthread_mutex_t m_lock;
@@ -536,6 +568,11 @@ private:
 
     pthread_mutex_t m_parm_lock;
 
+    // exif tags that do not change while the camera is open,
+    // built once under m_parm_lock and shared by every jpeg job
+    QCameraExif m_staticExif;
+    bool m_bStaticExifValid;
+
     QCameraChannel *m_channels[QCAMERA_CH_TYPE_MAX]; // array holding channel ptr
 
     bool m_bPreviewStarted;             //flag indicates first preview frame callback is received
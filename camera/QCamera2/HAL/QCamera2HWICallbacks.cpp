@@ -39,6 +39,10 @@
 #include <QComOMXMetadata.h>
 #include "QCamera2HWI.h"
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace qcamera {
 
 /*===========================================================================
@@ -617,6 +621,93 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
     return;
 }
 
+/*===========================================================================
+ * FUNCTION   : copyPlaneRow
+ *
+ * DESCRIPTION: copy one row of an image plane
+ *
+ * PARAMETERS :
+ *   @dst     : destination row
+ *   @src     : source row
+ *   @len     : number of bytes to copy
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static inline void copyPlaneRow(uint8_t *dst, const uint8_t *src, size_t len)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    while (len >= 64) {
+        uint8x16_t v0 = vld1q_u8(src);
+        uint8x16_t v1 = vld1q_u8(src + 16);
+        uint8x16_t v2 = vld1q_u8(src + 32);
+        uint8x16_t v3 = vld1q_u8(src + 48);
+        vst1q_u8(dst, v0);
+        vst1q_u8(dst + 16, v1);
+        vst1q_u8(dst + 32, v2);
+        vst1q_u8(dst + 48, v3);
+        src += 64;
+        dst += 64;
+        len -= 64;
+    }
+#endif
+    if (len > 0) {
+        memcpy(dst, src, len);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : compactYuv420Frame
+ *
+ * DESCRIPTION: strip stride/scanline padding from a YUV 4:2:0 frame. Luma
+ *              and chroma rows are copied in one pass so that every source
+ *              line is touched only once per output line pair.
+ *
+ * PARAMETERS :
+ *   @dst         : destination buffer
+ *   @src         : source buffer
+ *   @width       : frame width
+ *   @height      : frame height
+ *   @numPlanes   : 2 for NV12/NV21, 3 for YV12
+ *   @srcStride   : source plane strides
+ *   @srcScanline : source plane scanlines
+ *   @dstStride   : destination plane strides
+ *   @dstScanline : destination plane scanlines
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::compactYuv420Frame(uint8_t *dst,
+        const uint8_t *src, int32_t width, int32_t height, uint32_t numPlanes,
+        const int32_t *srcStride, const int32_t *srcScanline,
+        const int32_t *dstStride, const int32_t *dstScanline)
+{
+    const uint8_t *srcPlane[QCAMERA_CB_MAX_PLANES];
+    uint8_t *dstPlane[QCAMERA_CB_MAX_PLANES];
+    size_t lumaLen = (size_t)width;
+    size_t chromaLen = (numPlanes == 2) ? (size_t)width : (size_t)(width / 2);
+
+    srcPlane[0] = src;
+    dstPlane[0] = dst;
+    for (uint32_t p = 1; p < numPlanes; p++) {
+        srcPlane[p] = srcPlane[p - 1] + srcStride[p - 1] * srcScanline[p - 1];
+        dstPlane[p] = dstPlane[p - 1] + dstStride[p - 1] * dstScanline[p - 1];
+    }
+
+    for (int32_t i = 0; i < height / 2; i++) {
+        copyPlaneRow(dstPlane[0] + (2 * i) * dstStride[0],
+                srcPlane[0] + (2 * i) * srcStride[0], lumaLen);
+        copyPlaneRow(dstPlane[0] + (2 * i + 1) * dstStride[0],
+                srcPlane[0] + (2 * i + 1) * srcStride[0], lumaLen);
+        for (uint32_t p = 1; p < numPlanes; p++) {
+            copyPlaneRow(dstPlane[p] + i * dstStride[p],
+                    srcPlane[p] + i * srcStride[p], chromaLen);
+        }
+    }
+    if (height & 1) {
+        copyPlaneRow(dstPlane[0] + (height - 1) * dstStride[0],
+                srcPlane[0] + (height - 1) * srcStride[0], lumaLen);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : sendPreviewCallback
  *
@@ -634,31 +725,20 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
 int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
         QCameraGrallocMemory *memory, uint32_t idx)
 {
-    camera_memory_t *previewMem = NULL;
     camera_memory_t *data = NULL;
     camera_memory_t *dataToApp = NULL;
+    camera_release_callback releaseCb = QCameraPreviewCbPool::releaseBuffer;
+    void *releaseCookie = &m_previewCbPool;
     size_t previewBufSize = 0;
-    size_t previewBufSizeFromCallback = 0;
     cam_dimension_t preview_dim;
     cam_format_t previewFmt;
     int32_t rc = NO_ERROR;
-    int32_t yStride = 0;
-    int32_t yScanline = 0;
-    int32_t uvStride = 0;
-    int32_t uvScanline = 0;
-    int32_t uStride = 0;
-    int32_t uScanline = 0;
-    int32_t vStride = 0;
-    int32_t vScanline = 0;
-    int32_t yStrideToApp = 0;
-    int32_t uvStrideToApp = 0;
-    int32_t yScanlineToApp = 0;
-    int32_t uvScanlineToApp = 0;
-    int32_t srcOffset = 0;
-    int32_t dstOffset = 0;
-    int32_t srcBaseOffset = 0;
-    int32_t dstBaseOffset = 0;
-    int i;
+    int32_t srcStride[QCAMERA_CB_MAX_PLANES];
+    int32_t srcScanline[QCAMERA_CB_MAX_PLANES];
+    int32_t dstStride[QCAMERA_CB_MAX_PLANES];
+    int32_t dstScanline[QCAMERA_CB_MAX_PLANES];
+    uint32_t numPlanes = 0;
+    bool needCompact = false;
 
     if ((NULL == stream) || (NULL == memory)) {
         ALOGE("%s: Invalid preview callback input", __func__);
@@ -683,70 +763,66 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
         (previewFmt == CAM_FORMAT_YUV_420_NV12) ||
         (previewFmt == CAM_FORMAT_YUV_420_YV12)) {
         if(previewFmt == CAM_FORMAT_YUV_420_YV12) {
-            yStride = streamInfo->buf_planes.plane_info.mp[0].stride;
-            yScanline = streamInfo->buf_planes.plane_info.mp[0].scanline;
-            uStride = streamInfo->buf_planes.plane_info.mp[1].stride;
-            uScanline = streamInfo->buf_planes.plane_info.mp[1].scanline;
-            vStride = streamInfo->buf_planes.plane_info.mp[2].stride;
-            vScanline = streamInfo->buf_planes.plane_info.mp[2].scanline;
-
-            previewBufSize = (size_t)
-                    (yStride * yScanline + uStride * uScanline + vStride * vScanline);
-            previewBufSizeFromCallback = previewBufSize;
+            // Android YV12: 16 aligned luma and chroma strides
+            numPlanes = 3;
+            dstStride[0] = PAD_TO_SIZE(preview_dim.width, CAM_PAD_TO_16);
+            dstScanline[0] = preview_dim.height;
+            dstStride[1] = PAD_TO_SIZE(dstStride[0] / 2, CAM_PAD_TO_16);
+            dstScanline[1] = preview_dim.height / 2;
+            dstStride[2] = dstStride[1];
+            dstScanline[2] = dstScanline[1];
         } else {
-            yStride = streamInfo->buf_planes.plane_info.mp[0].stride;
-            yScanline = streamInfo->buf_planes.plane_info.mp[0].scanline;
-            uvStride = streamInfo->buf_planes.plane_info.mp[1].stride;
-            uvScanline = streamInfo->buf_planes.plane_info.mp[1].scanline;
-
-            yStrideToApp = preview_dim.width;
-            yScanlineToApp = preview_dim.height;
-            uvStrideToApp = yStrideToApp;
-            uvScanlineToApp = yScanlineToApp / 2;
-
-            previewBufSize = (size_t)
-                    ((yStrideToApp * yScanlineToApp) + (uvStrideToApp * uvScanlineToApp));
-
-            previewBufSizeFromCallback = (size_t)
-                    ((yStride * yScanline) + (uvStride * uvScanline));
+            numPlanes = 2;
+            dstStride[0] = preview_dim.width;
+            dstScanline[0] = preview_dim.height;
+            dstStride[1] = dstStride[0];
+            dstScanline[1] = preview_dim.height / 2;
         }
-        if(previewBufSize == previewBufSizeFromCallback) {
-            previewMem = mGetMemory(memory->getFd(idx),
-                       previewBufSize, 1, mCallbackCookie);
-            if (!previewMem || !previewMem->data) {
-                ALOGE("%s: mGetMemory failed.\n", __func__);
-                return NO_MEMORY;
-            } else {
-                data = previewMem;
+
+        for (uint32_t i = 0; i < numPlanes; i++) {
+            srcStride[i] = streamInfo->buf_planes.plane_info.mp[i].stride;
+            srcScanline[i] = streamInfo->buf_planes.plane_info.mp[i].scanline;
+            previewBufSize += (size_t)(dstStride[i] * dstScanline[i]);
+            if ((srcStride[i] != dstStride[i]) ||
+                    (srcScanline[i] != dstScanline[i])) {
+                needCompact = true;
             }
+        }
+
+        if (!needCompact) {
+            // Stream layout already matches the app layout, hand out a
+            // mapping of the stream buffer itself.
+            dataToApp = m_previewCbPool.getMappedBuffer(idx,
+                    memory->getFd(idx), previewBufSize);
         } else {
             data = memory->getMemory(idx, false);
-            dataToApp = mGetMemory(-1, previewBufSize, 1, mCallbackCookie);
+            if ((NULL == data) || (NULL == data->data)) {
+                ALOGE("%s: Invalid preview buffer %d", __func__, idx);
+                return BAD_VALUE;
+            }
+            dataToApp = m_previewCbPool.getCopyBuffer(previewBufSize);
+        }
+
+        if (NULL == dataToApp) {
+            // Pool exhausted by a slow app, fall back to one-off memory
+            dataToApp = mGetMemory(needCompact ? -1 : memory->getFd(idx),
+                    previewBufSize, 1, mCallbackCookie);
             if (!dataToApp || !dataToApp->data) {
                 ALOGE("%s: mGetMemory failed.\n", __func__);
+                if (dataToApp) {
+                    dataToApp->release(dataToApp);
+                }
                 return NO_MEMORY;
             }
+            releaseCb = releaseCameraMemory;
+            releaseCookie = NULL;
+        }
 
-            for (i = 0; i < preview_dim.height; i++) {
-                srcOffset = i * yStride;
-                dstOffset = i * yStrideToApp;
-
-                memcpy((unsigned char *) dataToApp->data + dstOffset,
-                        (unsigned char *) data->data + srcOffset,
-                        (size_t)yStrideToApp);
-            }
-
-            srcBaseOffset = yStride * yScanline;
-            dstBaseOffset = yStrideToApp * yScanlineToApp;
-
-            for (i = 0; i < preview_dim.height/2; i++) {
-                srcOffset = i * uvStride + srcBaseOffset;
-                dstOffset = i * uvStrideToApp + dstBaseOffset;
-
-                memcpy((unsigned char *) dataToApp->data + dstOffset,
-                        (unsigned char *) data->data + srcOffset,
-                        (size_t)yStrideToApp);
-            }
+        if (needCompact) {
+            compactYuv420Frame((uint8_t *)dataToApp->data,
+                    (const uint8_t *)data->data,
+                    preview_dim.width, preview_dim.height, numPlanes,
+                    srcStride, srcScanline, dstStride, dstScanline);
         }
     } else {
         data = memory->getMemory(idx, false);
@@ -757,27 +833,20 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
     memset(&cbArg, 0, sizeof(qcamera_callback_argm_t));
     cbArg.cb_type = QCAMERA_DATA_CALLBACK;
     cbArg.msg_type = CAMERA_MSG_PREVIEW_FRAME;
-    if (previewBufSize != 0 && previewBufSizeFromCallback != 0 &&
-            previewBufSize == previewBufSizeFromCallback) {
-        cbArg.data = data;
-    } else {
+    if (dataToApp) {
         cbArg.data = dataToApp;
-    }
-    if ( previewMem ) {
-        cbArg.user_data = previewMem;
-        cbArg.release_cb = releaseCameraMemory;
-    } else if (dataToApp) {
         cbArg.user_data = dataToApp;
-        cbArg.release_cb = releaseCameraMemory;
+        cbArg.cookie = releaseCookie;
+        cbArg.release_cb = releaseCb;
+    } else {
+        cbArg.data = data;
+        cbArg.cookie = this;
     }
-    cbArg.cookie = this;
     rc = m_cbNotifier.notifyCallback(cbArg);
     if (rc != NO_ERROR) {
         ALOGE("%s: fail sending notification", __func__);
-        if (previewMem) {
-            previewMem->release(previewMem);
-        } else if (dataToApp) {
-            dataToApp->release(dataToApp);
+        if (dataToApp) {
+            releaseCb(dataToApp, releaseCookie, rc);
         }
     }
 
@@ -2262,6 +2331,34 @@ void QCamera2HardwareInterface::debugShowPreviewFPS()
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : QCameraCbNotifier
+ *
+ * DESCRIPTION: Constructor of the callback notifier.
+ *
+ * PARAMETERS :
+ *   @parent  : ptr to HWI object
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraCbNotifier::QCameraCbNotifier(QCamera2HardwareInterface *parent) :
+        mNotifyCb (NULL),
+        mDataCb (NULL),
+        mDataCbTimestamp (NULL),
+        mCallbackCookie (NULL),
+        mParent (parent),
+        mCtrlQ(releaseNotifications, this),
+        mSnapshotQ(releaseNotifications, this),
+        mStreamQ(releaseNotifications, this),
+        mActive(false)
+{
+    mLaneQ[QCAMERA_CB_LANE_CONTROL] = &mCtrlQ;
+    mLaneQ[QCAMERA_CB_LANE_SNAPSHOT] = &mSnapshotQ;
+    mLaneQ[QCAMERA_CB_LANE_STREAMING] = &mStreamQ;
+    memset(mLaneStats, 0, sizeof(mLaneStats));
+    pthread_mutex_init(&mStatsLock, NULL);
+}
+
 /*===========================================================================
  * FUNCTION   : ~QCameraCbNotifier
  *
@@ -2273,6 +2370,7 @@ void QCamera2HardwareInterface::debugShowPreviewFPS()
  *==========================================================================*/
 QCameraCbNotifier::~QCameraCbNotifier()
 {
+    pthread_mutex_destroy(&mStatsLock);
 }
 
 /*===========================================================================
@@ -2365,6 +2463,113 @@ bool QCameraCbNotifier::matchPreviewNotifications(void *data,
     return false;
 }
 
+/*===========================================================================
+ * FUNCTION   : matchCoalescedNotifications
+ *
+ * DESCRIPTION: matches pending streaming callbacks superseded by a newer
+ *              callback of the same message type
+ *
+ * PARAMETERS :
+ *   @data       : data to match
+ *   @user_data  : context data
+ *   @match_data : ptr to qcamera_cb_coalesce_t
+ *
+ * RETURN     : bool match
+ *              true - match found
+ *              false- match not found
+ *==========================================================================*/
+bool QCameraCbNotifier::matchCoalescedNotifications(void *data,
+        void */*user_data*/, void *match_data)
+{
+    qcamera_callback_argm_t *arg = ( qcamera_callback_argm_t * ) data;
+    qcamera_cb_coalesce_t *coalesce = ( qcamera_cb_coalesce_t * ) match_data;
+    if ((NULL != arg) && (NULL != coalesce)) {
+        if ((QCAMERA_DATA_CALLBACK == arg->cb_type) &&
+                (coalesce->msg_type == arg->msg_type)) {
+            coalesce->matched++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*===========================================================================
+ * FUNCTION   : getLane
+ *
+ * DESCRIPTION: select the notifier lane for a callback. Control events are
+ *              delivered ahead of snapshot data, which in turn is delivered
+ *              ahead of streaming data.
+ *
+ * PARAMETERS :
+ *   @cbArgs  : callback arguments
+ *
+ * RETURN     : lane of the callback
+ *==========================================================================*/
+qcamera_cb_lane_t QCameraCbNotifier::getLane(const qcamera_callback_argm_t &cbArgs)
+{
+    switch (cbArgs.cb_type) {
+    case QCAMERA_NOTIFY_CALLBACK:
+        return QCAMERA_CB_LANE_CONTROL;
+    case QCAMERA_DATA_SNAPSHOT_CALLBACK:
+        return QCAMERA_CB_LANE_SNAPSHOT;
+    case QCAMERA_DATA_TIMESTAMP_CALLBACK:
+        return QCAMERA_CB_LANE_STREAMING;
+    case QCAMERA_DATA_CALLBACK:
+    default:
+        break;
+    }
+
+    switch (cbArgs.msg_type) {
+    case CAMERA_MSG_PREVIEW_FRAME:
+    case CAMERA_MSG_PREVIEW_METADATA:
+    case CAMERA_MSG_META_DATA:
+    case CAMERA_MSG_STATS_DATA:
+        return QCAMERA_CB_LANE_STREAMING;
+    default:
+        return QCAMERA_CB_LANE_SNAPSHOT;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : isCoalescable
+ *
+ * DESCRIPTION: check if only the latest pending callback of this kind
+ *              needs to reach the application
+ *
+ * PARAMETERS :
+ *   @cbArgs  : callback arguments
+ *
+ * RETURN     : true -- older pending callbacks can be dropped
+ *==========================================================================*/
+bool QCameraCbNotifier::isCoalescable(const qcamera_callback_argm_t &cbArgs)
+{
+    return (QCAMERA_DATA_CALLBACK == cbArgs.cb_type) &&
+            ((CAMERA_MSG_PREVIEW_FRAME == cbArgs.msg_type) ||
+             (CAMERA_MSG_PREVIEW_METADATA == cbArgs.msg_type));
+}
+
+/*===========================================================================
+ * FUNCTION   : dequeueNext
+ *
+ * DESCRIPTION: dequeue the next callback from the highest priority lane
+ *              that has one pending
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : callback arguments, NULL if all lanes are empty
+ *==========================================================================*/
+qcamera_callback_argm_t *QCameraCbNotifier::dequeueNext()
+{
+    qcamera_callback_argm_t *cb = NULL;
+
+    for (int lane = 0; (NULL == cb) && (lane < QCAMERA_CB_LANE_MAX); lane++) {
+        cb = (qcamera_callback_argm_t *)mLaneQ[lane]->dequeue();
+    }
+
+    return cb;
+}
+
 /*===========================================================================
  * FUNCTION   : cbNotifyRoutine
  *
@@ -2391,14 +2596,11 @@ void * QCameraCbNotifier::cbNotifyRoutine(void * data)
 
     CDBG("%s: E", __func__);
     do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                CDBG("%s: cam_sem_wait error (%s)",
-                           __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
+        ret = cmdThread->waitCmd();
+        if (ret != NO_ERROR) {
+            CDBG("%s: waitCmd error (%d)", __func__, ret);
+            return NULL;
+        }
 
         camera_cmd_type_t cmd = cmdThread->getCmd();
         CDBG("%s: get cmd %d", __func__, cmd);
@@ -2415,7 +2617,7 @@ void * QCameraCbNotifier::cbNotifyRoutine(void * data)
             break;
         case CAMERA_CMD_TYPE_STOP_DATA_PROC:
             {
-                pme->mDataQ.flushNodes(matchSnapshotNotifications);
+                pme->mSnapshotQ.flushNodes(matchSnapshotNotifications);
                 isSnapshotActive = FALSE;
 
                 numOfSnapshotExpected = 0;
@@ -2424,10 +2626,9 @@ void * QCameraCbNotifier::cbNotifyRoutine(void * data)
             break;
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
             {
-                qcamera_callback_argm_t *cb =
-                    (qcamera_callback_argm_t *)pme->mDataQ.dequeue();
-                cbStatus = NO_ERROR;
-                if (NULL != cb) {
+                qcamera_callback_argm_t *cb = NULL;
+                while (NULL != (cb = pme->dequeueNext())) {
+                    cbStatus = NO_ERROR;
                     CDBG("%s: cb type %d received",
                           __func__,
                           cb->cb_type);
@@ -2523,15 +2724,15 @@ void * QCameraCbNotifier::cbNotifyRoutine(void * data)
                         cb->release_cb(cb->user_data, cb->cookie, cbStatus);
                     }
                     delete cb;
-                } else {
-                    ALOGE("%s: invalid cb type passed", __func__);
                 }
             }
             break;
         case CAMERA_CMD_TYPE_EXIT:
             {
                 running = 0;
-                pme->mDataQ.flush();
+                for (int lane = 0; lane < QCAMERA_CB_LANE_MAX; lane++) {
+                    pme->mLaneQ[lane]->flush();
+                }
             }
             break;
         default:
@@ -2562,6 +2763,16 @@ int32_t QCameraCbNotifier::notifyCallback(qcamera_callback_argm_t &cbArgs)
         return UNKNOWN_ERROR;
     }
 
+    qcamera_cb_lane_t lane = getLane(cbArgs);
+    QCameraQueue *queue = mLaneQ[lane];
+    qcamera_cb_coalesce_t coalesce;
+    memset(&coalesce, 0, sizeof(qcamera_cb_coalesce_t));
+    if (isCoalescable(cbArgs)) {
+        // app is behind, only the latest frame is worth delivering
+        coalesce.msg_type = cbArgs.msg_type;
+        queue->flushNodes(matchCoalescedNotifications, &coalesce);
+    }
+
     qcamera_callback_argm_t *cbArg = new qcamera_callback_argm_t();
     if (NULL == cbArg) {
         ALOGE("%s: no mem for qcamera_callback_argm_t", __func__);
@@ -2570,7 +2781,13 @@ int32_t QCameraCbNotifier::notifyCallback(qcamera_callback_argm_t &cbArgs)
     memset(cbArg, 0, sizeof(qcamera_callback_argm_t));
     *cbArg = cbArgs;
 
-    if (mDataQ.enqueue((void *)cbArg)) {
+    if (queue->enqueue((void *)cbArg)) {
+        pthread_mutex_lock(&mStatsLock);
+        mLaneStats[lane].enqueued++;
+        mLaneStats[lane].dropped += coalesce.matched;
+        mLaneStats[lane].maxDepth =
+                MAX(mLaneStats[lane].maxDepth, queue->getCurrentSize());
+        pthread_mutex_unlock(&mStatsLock);
         return mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
     } else {
         ALOGE("%s: Error adding cb data into queue", __func__);
@@ -2608,6 +2825,8 @@ void QCameraCbNotifier::setCallbacks(camera_notify_callback notifyCb,
         mDataCbTimestamp = dataCbTimestamp;
         mCallbackCookie = callbackCookie;
         mActive = true;
+        // cbNotifyRoutine drains all lanes on every DO_NEXT_JOB
+        mProcTh.setCoalescing(true);
         mProcTh.launch(cbNotifyRoutine, this);
     } else {
         ALOGE("%s : Camera callback notifier already initialized!",
@@ -2634,7 +2853,7 @@ int32_t QCameraCbNotifier::flushPreviewNotifications()
         return UNKNOWN_ERROR;
     }
 
-    mDataQ.flushNodes(matchPreviewNotifications);
+    mStreamQ.flushNodes(matchPreviewNotifications);
 
     return NO_ERROR;
 }
@@ -2669,4 +2888,34 @@ void QCameraCbNotifier::stopSnapshots()
     mProcTh.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC, FALSE, TRUE);
 }
 
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: Composes a string with the per lane queue statistics
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : Formatted string
+ *==========================================================================*/
+String8 QCameraCbNotifier::dump()
+{
+    static const char *laneNames[QCAMERA_CB_LANE_MAX] = {
+        "control", "snapshot", "streaming"
+    };
+    String8 str("\n");
+    char s[128];
+
+    pthread_mutex_lock(&mStatsLock);
+    for (int lane = 0; lane < QCAMERA_CB_LANE_MAX; lane++) {
+        snprintf(s, 128, "%s lane: depth %d max %d enqueued %u dropped %u\n",
+                laneNames[lane], mLaneQ[lane]->getCurrentSize(),
+                mLaneStats[lane].maxDepth, mLaneStats[lane].enqueued,
+                mLaneStats[lane].dropped);
+        str += s;
+    }
+    pthread_mutex_unlock(&mStatsLock);
+
+    return str;
+}
+
 }; // namespace qcamera
@@ -718,6 +718,296 @@ int QCameraMemoryPool::allocateBuffer(
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : QCameraPreviewCbPool
+ *
+ * DESCRIPTION: default constructor of QCameraPreviewCbPool
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraPreviewCbPool::QCameraPreviewCbPool()
+    : mGetMemory(NULL),
+      mCallbackCookie(NULL)
+{
+    memset(mCopyBufs, 0, sizeof(mCopyBufs));
+    memset(mMappedBufs, 0, sizeof(mMappedBufs));
+    pthread_mutex_init(&mLock, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraPreviewCbPool
+ *
+ * DESCRIPTION: deconstructor of QCameraPreviewCbPool
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraPreviewCbPool::~QCameraPreviewCbPool()
+{
+    pthread_mutex_lock(&mLock);
+    for (int i = 0; i < QCAMERA_PREVIEW_CB_POOL_SIZE; i++) {
+        releaseEntryLocked(mCopyBufs[i]);
+    }
+    for (int i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
+        releaseEntryLocked(mMappedBufs[i]);
+    }
+    pthread_mutex_unlock(&mLock);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : setCallbacks
+ *
+ * DESCRIPTION: set the framework memory allocator used by the pool
+ *
+ * PARAMETERS :
+ *   @getMemory : camera memory request ops table
+ *   @cbCookie  : camera control block ptr
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraPreviewCbPool::setCallbacks(camera_request_memory getMemory,
+        void *cbCookie)
+{
+    pthread_mutex_lock(&mLock);
+    mGetMemory = getMemory;
+    mCallbackCookie = cbCookie;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseEntryLocked
+ *
+ * DESCRIPTION: release framework memory held by a pool entry
+ *
+ * PARAMETERS :
+ *   @entry   : pool entry
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraPreviewCbPool::releaseEntryLocked(struct QCameraCbBufInfo &entry)
+{
+    if (NULL != entry.mem) {
+        entry.mem->release(entry.mem);
+    }
+    memset(&entry, 0, sizeof(entry));
+}
+
+/*===========================================================================
+ * FUNCTION   : getCopyBuffer
+ *
+ * DESCRIPTION: get an idle buffer of the requested size, allocating one
+ *              from the framework only if no idle buffer fits
+ *
+ * PARAMETERS :
+ *   @size    : size of the buffer
+ *
+ * RETURN     : camera memory ptr, NULL if all pool buffers are in use
+ *              or allocation fails. The buffer is returned to the pool
+ *              through releaseBuffer.
+ *==========================================================================*/
+camera_memory_t *QCameraPreviewCbPool::getCopyBuffer(size_t size)
+{
+    camera_memory_t *mem = NULL;
+    int freeIdx = -1;
+
+    pthread_mutex_lock(&mLock);
+
+    for (int i = 0; i < QCAMERA_PREVIEW_CB_POOL_SIZE; i++) {
+        struct QCameraCbBufInfo &entry = mCopyBufs[i];
+        if (NULL == entry.mem) {
+            if (freeIdx < 0) {
+                freeIdx = i;
+            }
+        } else if (!entry.stale && (0 == entry.refCnt)) {
+            if (entry.size == size) {
+                entry.refCnt = 1;
+                mem = entry.mem;
+                break;
+            }
+            if (freeIdx < 0) {
+                freeIdx = i;
+            }
+        }
+    }
+
+    if ((NULL == mem) && (0 <= freeIdx) && (NULL != mGetMemory)) {
+        struct QCameraCbBufInfo &entry = mCopyBufs[freeIdx];
+        releaseEntryLocked(entry);
+        mem = mGetMemory(-1, size, 1, mCallbackCookie);
+        if ((NULL != mem) && (NULL != mem->data)) {
+            entry.mem = mem;
+            entry.fd = -1;
+            entry.size = size;
+            entry.refCnt = 1;
+        } else {
+            ALOGE("%s: mGetMemory failed", __func__);
+            if (NULL != mem) {
+                mem->release(mem);
+            }
+            mem = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&mLock);
+
+    return mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : getMappedBuffer
+ *
+ * DESCRIPTION: get framework mapping of a stream buffer. The mapping is
+ *              created the first time a buffer index is seen and reused
+ *              until the pool is cleared.
+ *
+ * PARAMETERS :
+ *   @index   : index of the stream buffer
+ *   @fd      : fd of the stream buffer
+ *   @size    : size visible to the application
+ *
+ * RETURN     : camera memory ptr, NULL if the mapping is not available.
+ *              The buffer is returned to the pool through releaseBuffer.
+ *==========================================================================*/
+camera_memory_t *QCameraPreviewCbPool::getMappedBuffer(uint32_t index,
+        int fd, size_t size)
+{
+    camera_memory_t *mem = NULL;
+
+    if (index >= MM_CAMERA_MAX_NUM_FRAMES) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mLock);
+
+    struct QCameraCbBufInfo &entry = mMappedBufs[index];
+    if ((NULL != entry.mem) && !entry.stale &&
+            (entry.fd == fd) && (entry.size == size)) {
+        entry.refCnt++;
+        mem = entry.mem;
+    } else if ((0 == entry.refCnt) && (NULL != mGetMemory)) {
+        releaseEntryLocked(entry);
+        mem = mGetMemory(fd, size, 1, mCallbackCookie);
+        if ((NULL != mem) && (NULL != mem->data)) {
+            entry.mem = mem;
+            entry.fd = fd;
+            entry.size = size;
+            entry.refCnt = 1;
+        } else {
+            ALOGE("%s: mGetMemory failed", __func__);
+            if (NULL != mem) {
+                mem->release(mem);
+            }
+            mem = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&mLock);
+
+    return mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : putBuffer
+ *
+ * DESCRIPTION: return a buffer to the pool
+ *
+ * PARAMETERS :
+ *   @mem     : camera memory ptr obtained from the pool
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraPreviewCbPool::putBuffer(camera_memory_t *mem)
+{
+    struct QCameraCbBufInfo *entry = NULL;
+
+    pthread_mutex_lock(&mLock);
+
+    for (int i = 0; (NULL == entry) && (i < QCAMERA_PREVIEW_CB_POOL_SIZE); i++) {
+        if (mCopyBufs[i].mem == mem) {
+            entry = &mCopyBufs[i];
+        }
+    }
+    for (int i = 0; (NULL == entry) && (i < MM_CAMERA_MAX_NUM_FRAMES); i++) {
+        if (mMappedBufs[i].mem == mem) {
+            entry = &mMappedBufs[i];
+        }
+    }
+
+    if (NULL == entry) {
+        ALOGE("%s: buffer %p does not belong to the pool", __func__, mem);
+        mem->release(mem);
+    } else if (entry->refCnt > 0) {
+        entry->refCnt--;
+        if ((0 == entry->refCnt) && entry->stale) {
+            releaseEntryLocked(*entry);
+        }
+    }
+
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : clear
+ *
+ * DESCRIPTION: release all idle buffers. Buffers still owned by pending
+ *              callbacks are released when they are returned.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraPreviewCbPool::clear()
+{
+    pthread_mutex_lock(&mLock);
+
+    for (int i = 0; i < QCAMERA_PREVIEW_CB_POOL_SIZE; i++) {
+        if (0 == mCopyBufs[i].refCnt) {
+            releaseEntryLocked(mCopyBufs[i]);
+        } else {
+            mCopyBufs[i].stale = true;
+        }
+    }
+    for (int i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
+        if (0 == mMappedBufs[i].refCnt) {
+            releaseEntryLocked(mMappedBufs[i]);
+        } else {
+            mMappedBufs[i].stale = true;
+        }
+    }
+
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseBuffer
+ *
+ * DESCRIPTION: callback release function returning a buffer to the pool
+ *
+ * PARAMETERS :
+ *   @data    : camera memory ptr
+ *   @cookie  : pool ptr
+ *   @cbStatus: callback status
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraPreviewCbPool::releaseBuffer(void *data, void *cookie,
+        int32_t /*cbStatus*/)
+{
+    QCameraPreviewCbPool *pool = (QCameraPreviewCbPool *)cookie;
+    camera_memory_t *mem = (camera_memory_t *)data;
+
+    if ((NULL == pool) || (NULL == mem)) {
+        ALOGE("%s: Invalid buffer %p pool %p", __func__, mem, pool);
+        return;
+    }
+
+    pool->putBuffer(mem);
+}
+
 /*===========================================================================
  * FUNCTION   : QCameraHeapMemory
  *
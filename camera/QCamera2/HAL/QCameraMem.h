@@ -146,6 +146,47 @@ protected:
     pthread_mutex_t mLock;
 };
 
+#define QCAMERA_PREVIEW_CB_POOL_SIZE 4
+
+// Framework memory handed out with preview data callbacks. Buffers go
+// back to the pool from the notifier release callback instead of being
+// requested from the framework for every frame.
+class QCameraPreviewCbPool {
+
+public:
+
+    QCameraPreviewCbPool();
+    virtual ~QCameraPreviewCbPool();
+
+    void setCallbacks(camera_request_memory getMemory, void *cbCookie);
+    // Buffer to compact a padded stream frame into
+    camera_memory_t *getCopyBuffer(size_t size);
+    // Framework mapping of a stream buffer already in app layout
+    camera_memory_t *getMappedBuffer(uint32_t index, int fd, size_t size);
+    void clear();
+
+    static void releaseBuffer(void *data, void *cookie, int32_t cbStatus);
+
+protected:
+
+    struct QCameraCbBufInfo {
+        camera_memory_t *mem;
+        int fd;
+        size_t size;
+        int refCnt;
+        bool stale;
+    };
+
+    void putBuffer(camera_memory_t *mem);
+    static void releaseEntryLocked(struct QCameraCbBufInfo &entry);
+
+    camera_request_memory mGetMemory;
+    void *mCallbackCookie;
+    struct QCameraCbBufInfo mCopyBufs[QCAMERA_PREVIEW_CB_POOL_SIZE];
+    struct QCameraCbBufInfo mMappedBufs[MM_CAMERA_MAX_NUM_FRAMES];
+    pthread_mutex_t mLock;
+};
+
 // Internal heap memory is used for memories used internally
 // They are allocated from /dev/ion.
 class QCameraHeapMemory : public QCameraMemory {
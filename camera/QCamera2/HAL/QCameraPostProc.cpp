@@ -74,21 +74,24 @@ QCameraPostProcessor::QCameraPostProcessor(QCamera2HardwareInterface *cam_ctrl)
       m_inputPPQ(releasePPInputData, this),
       m_ongoingPPQ(releaseOngoingPPData, this),
       m_inputJpegQ(releaseJpegData, this),
-      m_ongoingJpegQ(releaseJpegData, this),
+      m_ongoingJpegQ(releaseJpegData, this, jpegJobKey),
       m_inputRawQ(releaseRawData, this),
       mSaveFrmCnt(0),
       mUseSaveProc(false),
       mUseJpegBurst(false),
       mJpegMemOpt(true),
       m_JpegOutputMemCount(0),
+      m_JpegOutputBusyMask(0),
       mNewJpegSessionNeeded(true),
       m_bufCountPPQ(0),
       m_PPindex(0)
 {
     memset(&mJpegHandle, 0, sizeof(mJpegHandle));
     memset(&m_pJpegOutputMem, 0, sizeof(m_pJpegOutputMem));
+    memset(m_JpegOutputJobId, 0, sizeof(m_JpegOutputJobId));
     memset(mPPChannels, 0, sizeof(mPPChannels));
     m_DataMem = NULL;
+    pthread_mutex_init(&m_JpegOutputLock, NULL);
 }
 
 /*===========================================================================
@@ -103,6 +106,7 @@ QCameraPostProcessor::QCameraPostProcessor(QCamera2HardwareInterface *cam_ctrl)
 QCameraPostProcessor::~QCameraPostProcessor()
 {
     FREE_JPEG_OUTPUT_BUFFER(m_pJpegOutputMem,m_JpegOutputMemCount);
+    pthread_mutex_destroy(&m_JpegOutputLock);
     if (m_pJpegExifObj != NULL) {
         delete m_pJpegExifObj;
         m_pJpegExifObj = NULL;
@@ -156,6 +160,9 @@ int32_t QCameraPostProcessor::init(jpeg_encode_callback_t jpeg_cb, void *user_da
         return UNKNOWN_ERROR;
     }
 
+    // both routines drain their input queues on every DO_NEXT_JOB
+    m_dataProcTh.setCoalescing(true);
+    m_saveProcTh.setCoalescing(true);
     m_dataProcTh.launch(dataProcessRoutine, this);
     m_saveProcTh.launch(dataSaveRoutine, this);
 
@@ -574,6 +581,9 @@ int32_t QCameraPostProcessor::getJpegEncodingConfig(mm_jpeg_encode_params_t& enc
         encode_parm.num_dst_bufs = encode_parm.num_src_bufs;
     }
     m_JpegOutputMemCount = (uint32_t)encode_parm.num_dst_bufs;
+    pthread_mutex_lock(&m_JpegOutputLock);
+    m_JpegOutputBusyMask = 0;
+    pthread_mutex_unlock(&m_JpegOutputLock);
     for (uint32_t i = 0; i < m_JpegOutputMemCount; i++) {
         if (m_pJpegOutputMem[i] != NULL)
           free(m_pJpegOutputMem[i]);
@@ -934,7 +944,7 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
         }
     } else {
         // Release jpeg job data
-        m_ongoingJpegQ.flushNodes(matchJobId, (void*)&evt->jobId);
+        m_ongoingJpegQ.flushNodesByKey(evt->jobId);
 
         if (m_inputPPQ.getCurrentSize() > 0) {
             m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
@@ -967,6 +977,7 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
             pthread_mutex_lock(&m_parent->m_int_lock);
             pthread_cond_signal(&m_parent->m_int_cond);
             pthread_mutex_unlock(&m_parent->m_int_lock);
+            releaseJpegOutputBuf(evt->jobId);
             m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
             return rc;
         }
@@ -981,6 +992,9 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
                 goto end;
             }
             memcpy(jpeg_mem->data, evt->out_data.buf_vaddr, evt->out_data.buf_filled_len);
+            // the next burst frame can be encoded into this buffer while
+            // the current one is delivered
+            releaseJpegOutputBuf(evt->jobId);
         } else {
             jpeg_out  = (omx_jpeg_ouput_buf_t*) evt->out_data.buf_vaddr;
             jpeg_mem = (camera_memory_t *)jpeg_out->mem_hdl;
@@ -999,6 +1013,7 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
         m_parent->setOutputImageCount(m_parent->getOutputImageCount() + 1);
 
 end:
+        releaseJpegOutputBuf(evt->jobId);
         if (rc != NO_ERROR) {
             // send error msg to upper layer
             sendEvtNotify(CAMERA_MSG_ERROR,
@@ -1221,9 +1236,10 @@ int32_t QCameraPostProcessor::processPPData(mm_camera_super_buf_t *frame)
  *
  * RETURN     : ptr to a jpeg job struct. NULL if not found.
  *
- * NOTE       : Currently only one job is sending to mm-jpeg-interface for jpeg
- *              encoding. Therefore simply dequeue from the ongoing Jpeg Queue
- *              will serve the purpose to find the jpeg job.
+ * NOTE       : Several jobs can be in flight with burst encoding, so the
+ *              ongoing Jpeg queue is looked up by job ID. A job that completes
+ *              before its ID was recorded is still keyed 0; the oldest such
+ *              job is the one that was started first.
  *==========================================================================*/
 qcamera_jpeg_data_t *QCameraPostProcessor::findJpegJobByJobId(uint32_t jobId)
 {
@@ -1233,8 +1249,11 @@ qcamera_jpeg_data_t *QCameraPostProcessor::findJpegJobByJobId(uint32_t jobId)
         return NULL;
     }
 
-    // currely only one jpeg job ongoing, so simply dequeue the head
-    job = (qcamera_jpeg_data_t *)m_ongoingJpegQ.dequeue();
+    job = (qcamera_jpeg_data_t *)m_ongoingJpegQ.dequeueByKey(jobId);
+    if (job == NULL) {
+        // encode finished before start_job returned the ID
+        job = (qcamera_jpeg_data_t *)m_ongoingJpegQ.dequeueByKey(0);
+    }
     return job;
 }
 
@@ -1895,9 +1914,18 @@ int32_t QCameraPostProcessor::encodeData(qcamera_jpeg_data_t *jpeg_job_data,
     if (mJpegMemOpt) {
         jpg_job.encode_job.dst_index = jpg_job.encode_job.src_index;
     } else if (mUseJpegBurst) {
+        // picked from the output ring right before the job is started
         jpg_job.encode_job.dst_index = -1;
     }
 
+    // let a single shot overtake pending burst frames in the encoder
+    if (m_parent->isLongshotEnabled() ||
+            (m_parent->numOfSnapshotsExpected() > 1)) {
+        jpg_job.encode_job.priority = MM_JPEG_JOB_PRIO_BURST;
+    } else {
+        jpg_job.encode_job.priority = MM_JPEG_JOB_PRIO_SINGLE;
+    }
+
     cam_dimension_t src_dim;
     memset(&src_dim, 0, sizeof(cam_dimension_t));
     main_stream->getFrameDimension(src_dim);
@@ -2130,10 +2158,34 @@ int32_t QCameraPostProcessor::encodeData(qcamera_jpeg_data_t *jpeg_job_data,
     }
 
     CDBG_HIGH("[KPI Perf] %s : PROFILE_JPEG_JOB_START", __func__);
-    ret = mJpegHandle.start_job(&jpg_job, &jobId);
+    if (!mJpegMemOpt && mUseJpegBurst) {
+        // the ring lock is held until the job id is known, so that the
+        // jpeg event of this job cannot release the buffer before
+        pthread_mutex_lock(&m_JpegOutputLock);
+        int32_t dst_index = reserveJpegOutputBuf();
+        if (dst_index < 0) {
+            // canEncodeBurstFrame holds jobs back while the ring is full.
+            // Never let mm-jpeg pick one of its own buffers, the ring
+            // would not know that buffer is in use.
+            pthread_mutex_unlock(&m_JpegOutputLock);
+            ALOGE("%s: no jpeg output buffer reserved, fail the job", __func__);
+            return NO_MEMORY;
+        }
+        jpg_job.encode_job.dst_index = dst_index;
+        ret = mJpegHandle.start_job(&jpg_job, &jobId);
+        if (ret == NO_ERROR) {
+            m_JpegOutputJobId[dst_index] = jobId;
+        } else {
+            m_JpegOutputBusyMask &= ~(1U << dst_index);
+        }
+        pthread_mutex_unlock(&m_JpegOutputLock);
+    } else {
+        ret = mJpegHandle.start_job(&jpg_job, &jobId);
+    }
     if (ret == NO_ERROR) {
         // remember job info
         jpeg_job_data->jobId = jobId;
+        m_ongoingJpegQ.updateKey(jpeg_job_data);
     }
 
     return ret;
@@ -2307,14 +2359,11 @@ void *QCameraPostProcessor::dataSaveRoutine(void *data)
 
     CDBG_HIGH("%s: E", __func__);
     do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
-                           __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
+        ret = cmdThread->waitCmd();
+        if (ret != NO_ERROR) {
+            ALOGE("%s: waitCmd error (%d)", __func__, ret);
+            return NULL;
+        }
 
         // we got notified about new cmd avail in cmd queue
         camera_cmd_type_t cmd = cmdThread->getCmd();
@@ -2340,69 +2389,67 @@ void *QCameraPostProcessor::dataSaveRoutine(void *data)
             {
                 CDBG_HIGH("%s: Do next job, active is %d", __func__, is_active);
 
-                qcamera_jpeg_evt_payload_t *job_data = (qcamera_jpeg_evt_payload_t *) pme->m_inputSaveQ.dequeue();
-                if (job_data == NULL) {
-                    ALOGE("%s: Invalid jpeg event data", __func__);
-                    continue;
-                }
-
-                pme->m_ongoingJpegQ.flushNodes(matchJobId, (void*)&job_data->jobId);
-
-                CDBG_HIGH("[KPI Perf] %s : jpeg job %d", __func__, job_data->jobId);
+                qcamera_jpeg_evt_payload_t *job_data = NULL;
+                while (NULL != (job_data =
+                        (qcamera_jpeg_evt_payload_t *)pme->m_inputSaveQ.dequeue())) {
+                    pme->m_ongoingJpegQ.flushNodesByKey(job_data->jobId);
+
+                    CDBG_HIGH("[KPI Perf] %s : jpeg job %d", __func__, job_data->jobId);
+
+                    if (is_active == TRUE) {
+                        memset(saveName, '\0', sizeof(saveName));
+                        snprintf(saveName,
+                                 sizeof(saveName),
+                                 QCameraPostProcessor::STORE_LOCATION,
+                                 pme->mSaveFrmCnt);
+
+                        int file_fd = open(saveName, O_RDWR | O_CREAT, 0655);
+                        if (file_fd >= 0) {
+                            ssize_t written_len = write(file_fd, job_data->out_data.buf_vaddr,
+                                    job_data->out_data.buf_filled_len);
+                            if ((ssize_t)job_data->out_data.buf_filled_len != written_len) {
+                                ALOGE("%s: Failed save complete data %zd bytes "
+                                      "written instead of %d bytes!",
+                                      __func__, written_len,
+                                      job_data->out_data.buf_filled_len);
+                            } else {
+                                CDBG_HIGH("%s: written number of bytes %zd\n",
+                                    __func__, written_len);
+                            }
 
-                if (is_active == TRUE) {
-                    memset(saveName, '\0', sizeof(saveName));
-                    snprintf(saveName,
-                             sizeof(saveName),
-                             QCameraPostProcessor::STORE_LOCATION,
-                             pme->mSaveFrmCnt);
-
-                    int file_fd = open(saveName, O_RDWR | O_CREAT, 0655);
-                    if (file_fd >= 0) {
-                        ssize_t written_len = write(file_fd, job_data->out_data.buf_vaddr,
-                                job_data->out_data.buf_filled_len);
-                        if ((ssize_t)job_data->out_data.buf_filled_len != written_len) {
-                            ALOGE("%s: Failed save complete data %zd bytes "
-                                  "written instead of %d bytes!",
-                                  __func__, written_len,
-                                  job_data->out_data.buf_filled_len);
+                            close(file_fd);
                         } else {
-                            CDBG_HIGH("%s: written number of bytes %zd\n",
-                                __func__, written_len);
+                            ALOGE("%s: fail t open file for saving", __func__);
                         }
+                        pme->mSaveFrmCnt++;
 
-                        close(file_fd);
-                    } else {
-                        ALOGE("%s: fail t open file for saving", __func__);
-                    }
-                    pme->mSaveFrmCnt++;
-
-                    camera_memory_t* jpeg_mem = pme->m_parent->mGetMemory(-1,
-                                                         strlen(saveName),
-                                                         1,
-                                                         pme->m_parent->mCallbackCookie);
-                    if (NULL == jpeg_mem) {
-                        ret = NO_MEMORY;
-                        ALOGE("%s : getMemory for jpeg, ret = NO_MEMORY", __func__);
-                        goto end;
+                        camera_memory_t* jpeg_mem = pme->m_parent->mGetMemory(-1,
+                                                             strlen(saveName),
+                                                             1,
+                                                             pme->m_parent->mCallbackCookie);
+                        if (NULL == jpeg_mem) {
+                            ret = NO_MEMORY;
+                            ALOGE("%s : getMemory for jpeg, ret = NO_MEMORY", __func__);
+                            goto end;
+                        }
+                        memcpy(jpeg_mem->data, saveName, strlen(saveName));
+
+                        CDBG_HIGH("%s : Calling upperlayer callback to store JPEG image", __func__);
+                        qcamera_release_data_t release_data;
+                        memset(&release_data, 0, sizeof(qcamera_release_data_t));
+                        release_data.data = jpeg_mem;
+                        release_data.unlinkFile = true;
+                        CDBG_HIGH("[KPI Perf] %s: PROFILE_JPEG_CB ",__func__);
+                        ret = pme->sendDataNotify(CAMERA_MSG_COMPRESSED_IMAGE,
+                                            jpeg_mem,
+                                            0,
+                                            NULL,
+                                            &release_data);
                     }
-                    memcpy(jpeg_mem->data, saveName, strlen(saveName));
-
-                    CDBG_HIGH("%s : Calling upperlayer callback to store JPEG image", __func__);
-                    qcamera_release_data_t release_data;
-                    memset(&release_data, 0, sizeof(qcamera_release_data_t));
-                    release_data.data = jpeg_mem;
-                    release_data.unlinkFile = true;
-                    CDBG_HIGH("[KPI Perf] %s: PROFILE_JPEG_CB ",__func__);
-                    ret = pme->sendDataNotify(CAMERA_MSG_COMPRESSED_IMAGE,
-                                        jpeg_mem,
-                                        0,
-                                        NULL,
-                                        &release_data);
-                }
 
 end:
-                free(job_data);
+                    free(job_data);
+                }
             }
             break;
         case CAMERA_CMD_TYPE_EXIT:
@@ -2440,14 +2487,11 @@ void *QCameraPostProcessor::dataProcessRoutine(void *data)
 
     CDBG_HIGH("%s: E", __func__);
     do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
-                           __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
+        ret = cmdThread->waitCmd();
+        if (ret != NO_ERROR) {
+            ALOGE("%s: waitCmd error (%d)", __func__, ret);
+            return NULL;
+        }
 
         // we got notified about new cmd avail in cmd queue
         camera_cmd_type_t cmd = cmdThread->getCmd();
@@ -2498,6 +2542,9 @@ void *QCameraPostProcessor::dataProcessRoutine(void *data)
                 // free jpeg out buf and exif obj
                 FREE_JPEG_OUTPUT_BUFFER(pme->m_pJpegOutputMem,
                     pme->m_JpegOutputMemCount);
+                pthread_mutex_lock(&pme->m_JpegOutputLock);
+                pme->m_JpegOutputBusyMask = 0;
+                pthread_mutex_unlock(&pme->m_JpegOutputLock);
 
                 if (pme->m_pJpegExifObj != NULL) {
                     delete pme->m_pJpegExifObj;
@@ -2526,68 +2573,84 @@ void *QCameraPostProcessor::dataProcessRoutine(void *data)
             {
                 CDBG_HIGH("%s: Do next job, active is %d", __func__, is_active);
                 if (is_active == TRUE) {
-                    qcamera_jpeg_data_t *jpeg_job =
-                        (qcamera_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
-
-                    if (NULL != jpeg_job) {
-                        // To avoid any race conditions,
-                        // sync any stream specific parameters here.
-                        pme->syncStreamParams(jpeg_job->src_frame, NULL);
-
-                        // add into ongoing jpeg job Q
-                        if (pme->m_ongoingJpegQ.enqueue((void *)jpeg_job)) {
-                            ret = pme->encodeData(jpeg_job,
-                                      pme->mNewJpegSessionNeeded);
-                            if (NO_ERROR != ret) {
-                                // dequeue the last one
-                                pme->m_ongoingJpegQ.dequeue(false);
+                    // DO_NEXT_JOB is coalesced, keep going while any of the
+                    // input queues made progress
+                    bool bProgress;
+                    do {
+                        bProgress = false;
+                        // burst frames wait here until the pipeline has room
+                        qcamera_jpeg_data_t *jpeg_job = NULL;
+                        if (pme->canEncodeBurstFrame()) {
+                            jpeg_job = (qcamera_jpeg_data_t *)
+                                    pme->m_inputJpegQ.dequeue();
+                        }
+
+                        if (NULL != jpeg_job) {
+                            bProgress = true;
+                            // To avoid any race conditions,
+                            // sync any stream specific parameters here.
+                            pme->syncStreamParams(jpeg_job->src_frame, NULL);
+
+                            // add into ongoing jpeg job Q
+                            if (pme->m_ongoingJpegQ.enqueue((void *)jpeg_job)) {
+                                ret = pme->encodeData(jpeg_job,
+                                          pme->mNewJpegSessionNeeded);
+                                if (NO_ERROR != ret) {
+                                    // dequeue the last one
+                                    pme->m_ongoingJpegQ.dequeue(false);
+                                    pme->releaseJpegJobData(jpeg_job);
+                                    free(jpeg_job);
+                                    jpeg_job = NULL;
+                                    pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
+                                }
+                            } else {
+                                CDBG_HIGH("%s : m_ongoingJpegQ is not active!!!", __func__);
                                 pme->releaseJpegJobData(jpeg_job);
                                 free(jpeg_job);
                                 jpeg_job = NULL;
-                                pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
                             }
-                        } else {
-                            CDBG_HIGH("%s : m_ongoingJpegQ is not active!!!", __func__);
-                            pme->releaseJpegJobData(jpeg_job);
-                            free(jpeg_job);
-                            jpeg_job = NULL;
                         }
-                    }
 
 
-                    // process raw data if any
-                    mm_camera_super_buf_t *super_buf =
-                        (mm_camera_super_buf_t *)pme->m_inputRawQ.dequeue();
+                        // process raw data if any
+                        mm_camera_super_buf_t *super_buf =
+                            (mm_camera_super_buf_t *)pme->m_inputRawQ.dequeue();
+
+                        if (NULL != super_buf) {
+                            bProgress = true;
+                            //play shutter sound
+                            pme->m_parent->playShutter();
+                            ret = pme->processRawImageImpl(super_buf);
+                            if (NO_ERROR != ret) {
+                                pme->releaseSuperBuf(super_buf);
+                                free(super_buf);
+                                pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
+                            }
+                        }
 
-                    if (NULL != super_buf) {
-                        //play shutter sound
-                        pme->m_parent->playShutter();
-                        ret = pme->processRawImageImpl(super_buf);
+                        int ppPending = pme->m_inputPPQ.getCurrentSize();
+                        ret = pme->doReprocess();
                         if (NO_ERROR != ret) {
-                            pme->releaseSuperBuf(super_buf);
-                            free(super_buf);
                             pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
+                        } else {
+                            ret = pme->stopCapture();
                         }
-                    }
-
-                    ret = pme->doReprocess();
-                    if (NO_ERROR != ret) {
-                        pme->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
-                    } else {
-                        ret = pme->stopCapture();
-                    }
+                        if (pme->m_inputPPQ.getCurrentSize() < ppPending) {
+                            bProgress = true;
+                        }
+                    } while (bProgress);
 
                 } else {
                     // not active, simply return buf and do no op
-                    qcamera_jpeg_data_t *jpeg_data =
-                        (qcamera_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
-                    if (NULL != jpeg_data) {
+                    qcamera_jpeg_data_t *jpeg_data = NULL;
+                    while (NULL != (jpeg_data =
+                            (qcamera_jpeg_data_t *)pme->m_inputJpegQ.dequeue())) {
                         pme->releaseJpegJobData(jpeg_data);
                         free(jpeg_data);
                     }
-                    mm_camera_super_buf_t *super_buf =
-                        (mm_camera_super_buf_t *)pme->m_inputRawQ.dequeue();
-                    if (NULL != super_buf) {
+                    mm_camera_super_buf_t *super_buf = NULL;
+                    while (NULL != (super_buf =
+                            (mm_camera_super_buf_t *)pme->m_inputRawQ.dequeue())) {
                         pme->releaseSuperBuf(super_buf);
                         free(super_buf);
                     }
@@ -2914,11 +2977,126 @@ int32_t QCameraPostProcessor::setYUVFrameInfo(mm_camera_super_buf_t *recvd_frame
     return BAD_VALUE;
 }
 
-bool QCameraPostProcessor::matchJobId(void *data, void *, void *match_data)
+/*===========================================================================
+ * FUNCTION   : jpegJobKey
+ *
+ * DESCRIPTION: key function of the ongoing jpeg queue, indexes jobs by
+ *              jpeg job ID
+ *
+ * PARAMETERS :
+ *   @data      : ptr to qcamera_jpeg_data_t
+ *   @user_data : user data ptr (not used)
+ *
+ * RETURN     : jpeg job ID
+ *==========================================================================*/
+uint32_t QCameraPostProcessor::jpegJobKey(void *data, void *)
+{
+    return ((qcamera_jpeg_data_t *) data)->jobId;
+}
+
+/*===========================================================================
+ * FUNCTION   : getJpegBurstDepth
+ *
+ * DESCRIPTION: number of burst frames that may be in mm-jpeg at once.
+ *              Fewer frames are encoded in parallel when the device
+ *              is hot.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : number of jobs
+ *==========================================================================*/
+uint32_t QCameraPostProcessor::getJpegBurstDepth()
+{
+    switch (m_parent->mThermalLevel) {
+    case QCAMERA_THERMAL_NO_ADJUSTMENT:
+        return MAX_JPEG_BURST_INFLIGHT;
+    case QCAMERA_THERMAL_SLIGHT_ADJUSTMENT:
+        return MAX_JPEG_BURST_INFLIGHT - 1;
+    default:
+        return 1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : canEncodeBurstFrame
+ *
+ * DESCRIPTION: check whether the next jpeg job can be sent to mm-jpeg.
+ *              Outside of burst mode jobs are never held back.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : true if the job can be started
+ *==========================================================================*/
+bool QCameraPostProcessor::canEncodeBurstFrame()
 {
-  qcamera_jpeg_data_t * job = (qcamera_jpeg_data_t *) data;
-  uint32_t job_id = *((uint32_t *) match_data);
-  return job->jobId == job_id;
+    if (!mUseJpegBurst) {
+        return true;
+    }
+    if ((uint32_t)m_ongoingJpegQ.getCurrentSize() >= getJpegBurstDepth()) {
+        return false;
+    }
+    if (mJpegMemOpt) {
+        return true;
+    }
+
+    // the ring holds MAX_JPEG_BURST buffers at most
+    pthread_mutex_lock(&m_JpegOutputLock);
+    uint32_t allMask = (1U << m_JpegOutputMemCount) - 1;
+    bool bAvailable = (m_JpegOutputMemCount == 0) ||
+            ((m_JpegOutputBusyMask & allMask) != allMask);
+    pthread_mutex_unlock(&m_JpegOutputLock);
+    return bAvailable;
+}
+
+/*===========================================================================
+ * FUNCTION   : reserveJpegOutputBuf
+ *
+ * DESCRIPTION: take a free buffer of the burst output ring. Must be called
+ *              with m_JpegOutputLock held.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : buffer index, -1 if all buffers are in use
+ *==========================================================================*/
+int32_t QCameraPostProcessor::reserveJpegOutputBuf()
+{
+    for (uint32_t i = 0; i < m_JpegOutputMemCount; i++) {
+        if (!(m_JpegOutputBusyMask & (1U << i))) {
+            m_JpegOutputBusyMask |= (1U << i);
+            m_JpegOutputJobId[i] = 0;
+            return (int32_t)i;
+        }
+    }
+    ALOGE("%s: no free jpeg output buffer", __func__);
+    return -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseJpegOutputBuf
+ *
+ * DESCRIPTION: return the burst output buffer of a jpeg job to the ring
+ *
+ * PARAMETERS :
+ *   @jobId   : jpeg job id
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraPostProcessor::releaseJpegOutputBuf(uint32_t jobId)
+{
+    if (mJpegMemOpt || !mUseJpegBurst) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_JpegOutputLock);
+    for (uint32_t i = 0; i < m_JpegOutputMemCount; i++) {
+        if ((m_JpegOutputBusyMask & (1U << i)) &&
+                (m_JpegOutputJobId[i] == jobId)) {
+            m_JpegOutputBusyMask &= ~(1U << i);
+            m_JpegOutputJobId[i] = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_JpegOutputLock);
 }
 
 /*===========================================================================
@@ -2956,7 +3134,9 @@ int QCameraPostProcessor::getJpegMemory(omx_jpeg_ouput_buf_t *out_buf)
  * RETURN     : None
  *==========================================================================*/
 QCameraExif::QCameraExif()
-    : m_nNumEntries(0)
+    : m_nNumEntries(0),
+      m_nSharedMask(0),
+      m_nArenaUsed(0)
 {
     memset(m_Entries, 0, sizeof(m_Entries));
 }
@@ -2973,81 +3153,110 @@ QCameraExif::QCameraExif()
 QCameraExif::~QCameraExif()
 {
     for (uint32_t i = 0; i < m_nNumEntries; i++) {
-        switch (m_Entries[i].tag_entry.type) {
-        case EXIF_BYTE:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._bytes != NULL) {
-                    free(m_Entries[i].tag_entry.data._bytes);
-                    m_Entries[i].tag_entry.data._bytes = NULL;
-                }
-            }
-            break;
-        case EXIF_ASCII:
-            {
-                if (m_Entries[i].tag_entry.data._ascii != NULL) {
-                    free(m_Entries[i].tag_entry.data._ascii);
-                    m_Entries[i].tag_entry.data._ascii = NULL;
-                }
-            }
-            break;
-        case EXIF_SHORT:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._shorts != NULL) {
-                    free(m_Entries[i].tag_entry.data._shorts);
-                    m_Entries[i].tag_entry.data._shorts = NULL;
-                }
-            }
-            break;
-        case EXIF_LONG:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._longs != NULL) {
-                    free(m_Entries[i].tag_entry.data._longs);
-                    m_Entries[i].tag_entry.data._longs = NULL;
-                }
-            }
-            break;
-        case EXIF_RATIONAL:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._rats != NULL) {
-                    free(m_Entries[i].tag_entry.data._rats);
-                    m_Entries[i].tag_entry.data._rats = NULL;
-                }
-            }
-            break;
-        case EXIF_UNDEFINED:
-            {
-                if (m_Entries[i].tag_entry.data._undefined != NULL) {
-                    free(m_Entries[i].tag_entry.data._undefined);
-                    m_Entries[i].tag_entry.data._undefined = NULL;
-                }
-            }
-            break;
-        case EXIF_SLONG:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._slongs != NULL) {
-                    free(m_Entries[i].tag_entry.data._slongs);
-                    m_Entries[i].tag_entry.data._slongs = NULL;
-                }
-            }
-            break;
-        case EXIF_SRATIONAL:
-            {
-                if (m_Entries[i].tag_entry.count > 1 &&
-                    m_Entries[i].tag_entry.data._srats != NULL) {
-                    free(m_Entries[i].tag_entry.data._srats);
-                    m_Entries[i].tag_entry.data._srats = NULL;
-                }
-            }
-            break;
+        if (!(m_nSharedMask & (1U << i))) {
+            releasePayload(m_Entries[i]);
         }
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : allocPayload
+ *
+ * DESCRIPTION: allocate the payload of a tag from the arena of the table,
+ *              falling back to the heap once the arena is used up
+ *
+ * PARAMETERS :
+ *   @size    : payload size in bytes
+ *
+ * RETURN     : payload address, NULL if out of memory
+ *==========================================================================*/
+void *QCameraExif::allocPayload(size_t size)
+{
+    size_t offset = (m_nArenaUsed + 7) & ~(size_t)7;
+    if ((offset <= sizeof(m_Arena)) && (size <= sizeof(m_Arena) - offset)) {
+        m_nArenaUsed = offset + size;
+        return (uint8_t *)m_Arena + offset;
+    }
+    return malloc(size);
+}
+
+/*===========================================================================
+ * FUNCTION   : releasePayload
+ *
+ * DESCRIPTION: free the payload of a tag if it did not fit in the arena
+ *
+ * PARAMETERS :
+ *   @entry   : exif tag
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraExif::releasePayload(QEXIF_INFO_DATA &entry)
+{
+    void *payload = NULL;
+    bool array = (entry.tag_entry.count > 1);
+
+    switch (entry.tag_entry.type) {
+    case EXIF_ASCII:
+        payload = entry.tag_entry.data._ascii;
+        break;
+    case EXIF_UNDEFINED:
+        payload = entry.tag_entry.data._undefined;
+        break;
+    case EXIF_BYTE:
+        payload = array ? entry.tag_entry.data._bytes : NULL;
+        break;
+    case EXIF_SHORT:
+        payload = array ? entry.tag_entry.data._shorts : NULL;
+        break;
+    case EXIF_LONG:
+        payload = array ? entry.tag_entry.data._longs : NULL;
+        break;
+    case EXIF_RATIONAL:
+        payload = array ? entry.tag_entry.data._rats : NULL;
+        break;
+    case EXIF_SLONG:
+        payload = array ? entry.tag_entry.data._slongs : NULL;
+        break;
+    case EXIF_SRATIONAL:
+        payload = array ? entry.tag_entry.data._srats : NULL;
+        break;
+    }
+
+    uint8_t *arena = (uint8_t *)m_Arena;
+    if ((payload != NULL) && (((uint8_t *)payload < arena) ||
+            ((uint8_t *)payload >= arena + sizeof(m_Arena)))) {
+        free(payload);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : addEntries
+ *
+ * DESCRIPTION: add the tags of another table without copying their payload.
+ *              The source table must outlive this one.
+ *
+ * PARAMETERS :
+ *   @src     : table to add the tags from
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraExif::addEntries(const QCameraExif &src)
+{
+    if (m_nNumEntries + src.m_nNumEntries > MAX_EXIF_TABLE_ENTRIES) {
+        ALOGE("%s: Number of entries exceeded limit", __func__);
+        return NO_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < src.m_nNumEntries; i++) {
+        m_Entries[m_nNumEntries] = src.m_Entries[i];
+        m_nSharedMask |= (1U << m_nNumEntries);
+        m_nNumEntries++;
+    }
+    return NO_ERROR;
+}
+
 /*===========================================================================
  * FUNCTION   : addEntry
  *
@@ -3082,7 +3291,7 @@ int32_t QCameraExif::addEntry(exif_tag_id_t tagid,
     case EXIF_BYTE:
         {
             if (count > 1) {
-                uint8_t *values = (uint8_t *)malloc(count);
+                uint8_t *values = (uint8_t *)allocPayload(count);
                 if (values == NULL) {
                     ALOGE("%s: No memory for byte array", __func__);
                     rc = NO_MEMORY;
@@ -3098,7 +3307,7 @@ int32_t QCameraExif::addEntry(exif_tag_id_t tagid,
     case EXIF_ASCII:
         {
             char *str = NULL;
-            str = (char *)malloc(count + 1);
+            str = (char *)allocPayload(count + 1);
             if (str == NULL) {
                 ALOGE("%s: No memory for ascii string", __func__);
                 rc = NO_MEMORY;
@@ -3112,7 +3321,7 @@ int32_t QCameraExif::addEntry(exif_tag_id_t tagid,
     case EXIF_SHORT:
         {
             if (count > 1) {
-                uint16_t *values = (uint16_t *)malloc(count * sizeof(uint16_t));
+                uint16_t *values = (uint16_t *)allocPayload(count * sizeof(uint16_t));
                 if (values == NULL) {
                     ALOGE("%s: No memory for short array", __func__);
                     rc = NO_MEMORY;
@@ -3128,7 +3337,7 @@ int32_t QCameraExif::addEntry(exif_tag_id_t tagid,
     case EXIF_LONG:
         {
             if (count > 1) {
-                uint32_t *values = (uint32_t *)malloc(count * sizeof(uint32_t));
+                uint32_t *values = (uint32_t *)allocPayload(count * sizeof(uint32_t));
                 if (values == NULL) {
                     ALOGE("%s: No memory for long array", __func__);
                     rc = NO_MEMORY;
@@ -3144,7 +3353,7 @@ int32_t QCameraExif::addEntry(exif_tag_id_t tagid,
     case EXIF_RATIONAL:
         {
             if (count > 1) {
-                rat_t *values = (rat_t *)malloc(count * sizeof(rat_t));
+                rat_t *values = (rat_t *)allocPayload(count * sizeof(rat_t));
                 if (values == NULL) {
                     ALOGE("%s: No memory for rational array", __func__);
                     rc = NO_MEMORY;
@@ -3159,7 +3368,7 @@ int32_t QCameraExif::addEntry(exif_tag_id_t tagid,
         break;
     case EXIF_UNDEFINED:
         {
-            uint8_t *values = (uint8_t *)malloc(count);
+            uint8_t *values = (uint8_t *)allocPayload(count);
             if (values == NULL) {
                 ALOGE("%s: No memory for undefined array", __func__);
                 rc = NO_MEMORY;
@@ -3172,7 +3381,7 @@ int32_t QCameraExif::addEntry(exif_tag_id_t tagid,
     case EXIF_SLONG:
         {
             if (count > 1) {
-                int32_t *values = (int32_t *)malloc(count * sizeof(int32_t));
+                int32_t *values = (int32_t *)allocPayload(count * sizeof(int32_t));
                 if (values == NULL) {
                     ALOGE("%s: No memory for signed long array", __func__);
                     rc = NO_MEMORY;
@@ -3188,7 +3397,7 @@ int32_t QCameraExif::addEntry(exif_tag_id_t tagid,
     case EXIF_SRATIONAL:
         {
             if (count > 1) {
-                srat_t *values = (srat_t *)malloc(count * sizeof(srat_t));
+                srat_t *values = (srat_t *)allocPayload(count * sizeof(srat_t));
                 if (values == NULL) {
                     ALOGE("%s: No memory for signed rational array", __func__);
                     rc = NO_MEMORY;
@@ -36,7 +36,12 @@ extern "C" {
 }
 #include "QCamera2HWI.h"
 
-#define MAX_JPEG_BURST 2
+// output ring of burst mode: encodes in flight in mm-jpeg plus
+// frames still being copied out by the state machine thread
+#define MAX_JPEG_BURST 4
+// burst frames handed to mm-jpeg at once: the concurrent encodes plus
+// one staged so that the next encode starts as soon as one completes
+#define MAX_JPEG_BURST_INFLIGHT 3
 
 namespace qcamera {
 
@@ -96,6 +101,7 @@ typedef struct {
 } qcamera_data_argm_t;
 
 #define MAX_EXIF_TABLE_ENTRIES 17
+#define EXIF_ARENA_SIZE 1024
 class QCameraExif
 {
 public:
@@ -106,12 +112,19 @@ public:
                      exif_tag_type_t type,
                      uint32_t count,
                      void *data);
+    int32_t addEntries(const QCameraExif &src);
     uint32_t getNumOfEntries() {return m_nNumEntries;};
     QEXIF_INFO_DATA *getEntries() {return m_Entries;};
 
 private:
+    void *allocPayload(size_t size);
+    void releasePayload(QEXIF_INFO_DATA &entry);
+
     QEXIF_INFO_DATA m_Entries[MAX_EXIF_TABLE_ENTRIES];  // exif tags for JPEG encoder
     uint32_t  m_nNumEntries;                            // number of valid entries
+    uint32_t  m_nSharedMask;                            // entries referencing another table's payload
+    uint64_t  m_Arena[EXIF_ARENA_SIZE / sizeof(uint64_t)]; // tag payloads
+    size_t    m_nArenaUsed;                             // bytes used in m_Arena
 };
 
 class QCameraPostProcessor
@@ -174,12 +187,17 @@ private:
     static void *dataSaveRoutine(void *data);
 
     int32_t setYUVFrameInfo(mm_camera_super_buf_t *recvd_frame);
-    static bool matchJobId(void *data, void *user_data, void *match_data);
+    static uint32_t jpegJobKey(void *data, void *user_data);
     static int getJpegMemory(omx_jpeg_ouput_buf_t *out_buf);
 
     int32_t doReprocess();
     int32_t stopCapture();
 
+    uint32_t getJpegBurstDepth();
+    bool canEncodeBurstFrame();
+    int32_t reserveJpegOutputBuf();
+    void releaseJpegOutputBuf(uint32_t jobId);
+
 private:
     QCamera2HardwareInterface *m_parent;
     jpeg_encode_callback_t     mJpegCB;
@@ -213,6 +231,9 @@ private:
     bool mUseJpegBurst;                 // use jpeg burst encoding mode
     bool mJpegMemOpt;
     uint32_t   m_JpegOutputMemCount;
+    uint32_t   m_JpegOutputBusyMask;    // burst output buffers owned by a job
+    uint32_t   m_JpegOutputJobId[MM_JPEG_MAX_BUF]; // job owning each buffer
+    pthread_mutex_t m_JpegOutputLock;   // protects the burst output ring
     uint8_t mNewJpegSessionNeeded;
     int32_t m_bufCountPPQ;
     Vector<mm_camera_buf_def_t *> m_InputMetadata; // store input metadata buffers for AOST cases
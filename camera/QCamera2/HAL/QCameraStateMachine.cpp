@@ -62,26 +62,32 @@ void *QCameraStateMachine::smEvtProcRoutine(void *data)
             }
         } while (ret != 0);
 
-        // we got notified about new cmd avail in cmd queue
-        // first check API cmd queue
-        qcamera_sm_cmd_t *node = (qcamera_sm_cmd_t *)pme->api_queue.dequeue();
-        if (node == NULL) {
-            // no API cmd, then check evt cmd queue
-            node = (qcamera_sm_cmd_t *)pme->evt_queue.dequeue();
-        }
-        if (node != NULL) {
-            switch (node->cmd) {
+        // we got notified about new cmd avail in cmd queue. A producer
+        // may post after a later one already published its slot, so
+        // drain everything available on each wakeup.
+        qcamera_sm_cmd_t node;
+        while (running) {
+            // first check API cmd queue
+            bool found = pme->api_queue.pop(node);
+            if (!found) {
+                // no API cmd, then check evt cmd queue
+                found = pme->evt_queue.pop(node);
+            }
+            if (!found) {
+                break;
+            }
+            switch (node.cmd) {
             case QCAMERA_SM_CMD_TYPE_API:
-                pme->stateMachine(node->evt, node->evt_payload);
+                pme->stateMachine(node.evt, node.evt_payload);
                 // API is in a way sync call, so evt_payload is managed by HWI
                 // no need to free payload for API
                 break;
             case QCAMERA_SM_CMD_TYPE_EVT:
-                pme->stateMachine(node->evt, node->evt_payload);
+                pme->stateMachine(node.evt, node.evt_payload);
 
                 // EVT is async call, so payload need to be free after use
-                free(node->evt_payload);
-                node->evt_payload = NULL;
+                free(node.evt_payload);
+                node.evt_payload = NULL;
                 break;
             case QCAMERA_SM_CMD_TYPE_EXIT:
                 running = 0;
@@ -89,8 +95,6 @@ void *QCameraStateMachine::smEvtProcRoutine(void *data)
             default:
                 break;
             }
-            free(node);
-            node = NULL;
         }
     } while (running);
     CDBG_HIGH("%s: X", __func__);
@@ -108,8 +112,8 @@ void *QCameraStateMachine::smEvtProcRoutine(void *data)
  * RETURN     : none
  *==========================================================================*/
 QCameraStateMachine::QCameraStateMachine(QCamera2HardwareInterface *ctrl) :
-    api_queue(),
-    evt_queue()
+    api_queue(QCAMERA_SM_API_RING_SIZE),
+    evt_queue(QCAMERA_SM_EVT_RING_SIZE)
 {
     m_parent = ctrl;
     m_state = QCAMERA_SM_STATE_PREVIEW_STOPPED;
@@ -150,19 +154,8 @@ QCameraStateMachine::~QCameraStateMachine()
 void QCameraStateMachine::releaseThread()
 {
     if (cmd_pid != 0) {
-        qcamera_sm_cmd_t *node =
-            (qcamera_sm_cmd_t *)malloc(sizeof(qcamera_sm_cmd_t));
-        if (NULL != node) {
-            memset(node, 0, sizeof(qcamera_sm_cmd_t));
-            node->cmd = QCAMERA_SM_CMD_TYPE_EXIT;
-
-            if (api_queue.enqueue((void *)node)) {
-                cam_sem_post(&cmd_sem);
-            } else {
-                free(node);
-                node = NULL;
-            }
-
+        if (NO_ERROR == enqueueCmd(api_queue, QCAMERA_SM_CMD_TYPE_EXIT,
+                QCAMERA_SM_EVT_MAX, NULL)) {
             /* wait until cmd thread exits */
             if (pthread_join(cmd_pid, NULL) != 0) {
                 CDBG_HIGH("%s: pthread dead already\n", __func__);
@@ -213,24 +206,65 @@ int32_t QCameraStateMachine::applyDelayedMsgs()
 int32_t QCameraStateMachine::procAPI(qcamera_sm_evt_enum_t evt,
                                      void *api_payload)
 {
-    qcamera_sm_cmd_t *node =
-        (qcamera_sm_cmd_t *)malloc(sizeof(qcamera_sm_cmd_t));
-    if (NULL == node) {
-        ALOGE("%s: No memory for qcamera_sm_cmd_t", __func__);
-        return NO_MEMORY;
-    }
+    return enqueueCmd(api_queue, QCAMERA_SM_CMD_TYPE_API, evt, api_payload);
+}
 
-    memset(node, 0, sizeof(qcamera_sm_cmd_t));
-    node->cmd = QCAMERA_SM_CMD_TYPE_API;
-    node->evt = evt;
-    node->evt_payload = api_payload;
-    if (api_queue.enqueue((void *)node)) {
-        cam_sem_post(&cmd_sem);
-        return NO_ERROR;
-    } else {
-        free(node);
-        return UNKNOWN_ERROR;
+/*===========================================================================
+ * FUNCTION   : procQueryAPI
+ *
+ * DESCRIPTION: answer a query API in the caller context, without a round
+ *              trip through the statemachine thread. In PREVIEWING state the
+ *              MSG_TYPE_ENABLED and PREVIEW_ENABLED handlers also consult
+ *              and apply the preview messages delayed during ZSL snapshot,
+ *              which is owned by the statemachine thread, so those queries
+ *              are left to the thread. Caller must hold the API lock so that
+ *              no state changing API is in flight.
+ *
+ * PARAMETERS :
+ *   @evt          : query API: MSG_TYPE_ENABLED, PREVIEW_ENABLED
+ *                   or RECORDING_ENABLED
+ *   @api_payload  : API payload. Can be NULL if not needed.
+ *   @enabled      : enabled flag of the query (output)
+ *
+ * RETURN     : true if the query was answered, false if it has to be
+ *              processed by the statemachine thread
+ *==========================================================================*/
+bool QCameraStateMachine::procQueryAPI(qcamera_sm_evt_enum_t evt,
+                                       void *api_payload,
+                                       int &enabled)
+{
+    qcamera_state_enum_t state = m_state;
+    enabled = 0;
+
+    switch (evt) {
+    case QCAMERA_SM_EVT_MSG_TYPE_ENABLED:
+        if (QCAMERA_SM_STATE_PREVIEWING == state) {
+            return false;
+        }
+        // query is rejected while preparing snapshot
+        if ((QCAMERA_SM_STATE_PREPARE_SNAPSHOT != state) &&
+                (NULL != api_payload)) {
+            enabled = m_parent->msgTypeEnabled(*((int32_t *)api_payload));
+        }
+        break;
+    case QCAMERA_SM_EVT_PREVIEW_ENABLED:
+        if (QCAMERA_SM_STATE_PREVIEWING == state) {
+            return false;
+        }
+        enabled = (QCAMERA_SM_STATE_PREVIEW_READY == state) ||
+                (QCAMERA_SM_STATE_VIDEO_PIC_TAKING == state) ||
+                (QCAMERA_SM_STATE_PREVIEW_PIC_TAKING == state);
+        break;
+    case QCAMERA_SM_EVT_RECORDING_ENABLED:
+        enabled = (QCAMERA_SM_STATE_RECORDING == state) ||
+                (QCAMERA_SM_STATE_VIDEO_PIC_TAKING == state);
+        break;
+    default:
+        ALOGE("%s: evt %d is not a query API", __func__, evt);
+        break;
     }
+
+    return true;
 }
 
 /*===========================================================================
@@ -250,26 +284,183 @@ int32_t QCameraStateMachine::procAPI(qcamera_sm_evt_enum_t evt,
 int32_t QCameraStateMachine::procEvt(qcamera_sm_evt_enum_t evt,
                                      void *evt_payload)
 {
-    qcamera_sm_cmd_t *node =
-        (qcamera_sm_cmd_t *)malloc(sizeof(qcamera_sm_cmd_t));
-    if (NULL == node) {
-        ALOGE("%s: No memory for qcamera_sm_cmd_t", __func__);
+    return enqueueCmd(evt_queue, QCAMERA_SM_CMD_TYPE_EVT, evt, evt_payload);
+}
+
+/*===========================================================================
+ * FUNCTION   : enqueueCmd
+ *
+ * DESCRIPTION: put a command into a ring and wake up statemachine thread.
+ *
+ * PARAMETERS :
+ *   @ring     : command ring
+ *   @cmd      : command type
+ *   @evt      : event to be processed
+ *   @payload  : event payload. Can be NULL if not needed.
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraStateMachine::enqueueCmd(QCameraSMCmdRing &ring,
+        qcamera_sm_cmd_type_t cmd, qcamera_sm_evt_enum_t evt, void *payload)
+{
+    qcamera_sm_cmd_t node;
+    memset(&node, 0, sizeof(qcamera_sm_cmd_t));
+    node.cmd = cmd;
+    node.evt = evt;
+    node.evt_payload = payload;
+
+    if (!ring.push(node)) {
+        ALOGE("%s: No memory for cmd %d evt %d", __func__, cmd, evt);
         return NO_MEMORY;
     }
 
-    memset(node, 0, sizeof(qcamera_sm_cmd_t));
-    node->cmd = QCAMERA_SM_CMD_TYPE_EVT;
-    node->evt = evt;
-    node->evt_payload = evt_payload;
-    if (evt_queue.enqueue((void *)node)) {
-        cam_sem_post(&cmd_sem);
-        return NO_ERROR;
-    } else {
-        free(node);
-        return UNKNOWN_ERROR;
+    cam_sem_post(&cmd_sem);
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraSMCmdRing
+ *
+ * DESCRIPTION: constructor of QCameraSMCmdRing
+ *
+ * PARAMETERS :
+ *   @size    : number of slots, must be power of 2
+ *
+ * RETURN     : none
+ *==========================================================================*/
+QCameraStateMachine::QCameraSMCmdRing::QCameraSMCmdRing(uint32_t size) :
+    m_slots(NULL),
+    m_mask(size - 1),
+    m_enqPos(0),
+    m_deqPos(0)
+{
+    m_slots = new cmd_slot_t[size];
+    for (uint32_t i = 0; i < size; i++) {
+        memset(&m_slots[i].cmd, 0, sizeof(qcamera_sm_cmd_t));
+        m_slots[i].seq = i;
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : ~QCameraSMCmdRing
+ *
+ * DESCRIPTION: desctructor of QCameraSMCmdRing
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+QCameraStateMachine::QCameraSMCmdRing::~QCameraSMCmdRing()
+{
+    delete [] m_slots;
+}
+
+/*===========================================================================
+ * FUNCTION   : push
+ *
+ * DESCRIPTION: queue a command. Safe to be called from multiple threads.
+ *              Once commands spilled to the overflow queue, newer ones
+ *              follow them there until the statemachine thread drained it,
+ *              so that commands stay in order.
+ *
+ * PARAMETERS :
+ *   @cmd     : command to be copied
+ *
+ * RETURN     : true -- success; false -- out of memory
+ *==========================================================================*/
+bool QCameraStateMachine::QCameraSMCmdRing::push(const qcamera_sm_cmd_t &cmd)
+{
+    if (m_overflow.isEmpty() && pushSlot(cmd)) {
+        return true;
+    }
+    return m_overflow.enqueue(cmd);
+}
+
+/*===========================================================================
+ * FUNCTION   : pop
+ *
+ * DESCRIPTION: take the oldest command. Must only be called from
+ *              statemachine thread.
+ *
+ * PARAMETERS :
+ *   @cmd     : [out] command
+ *
+ * RETURN     : true -- success; false -- no command queued
+ *==========================================================================*/
+bool QCameraStateMachine::QCameraSMCmdRing::pop(qcamera_sm_cmd_t &cmd)
+{
+    if (popSlot(cmd)) {
+        return true;
+    }
+    return m_overflow.dequeue(cmd);
+}
+
+/*===========================================================================
+ * FUNCTION   : pushSlot
+ *
+ * DESCRIPTION: copy a command into the next free slot. Safe to be called
+ *              from multiple threads.
+ *
+ * PARAMETERS :
+ *   @cmd     : command to be copied
+ *
+ * RETURN     : true -- success; false -- ring is full
+ *==========================================================================*/
+bool QCameraStateMachine::QCameraSMCmdRing::pushSlot(const qcamera_sm_cmd_t &cmd)
+{
+    cmd_slot_t *slot = NULL;
+    uint32_t pos = __atomic_load_n(&m_enqPos, __ATOMIC_RELAXED);
+
+    for (;;) {
+        slot = &m_slots[pos & m_mask];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&m_enqPos, &pos, pos + 1, true,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = __atomic_load_n(&m_enqPos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->cmd = cmd;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : popSlot
+ *
+ * DESCRIPTION: take the oldest command out of the ring. Must only be
+ *              called from statemachine thread.
+ *
+ * PARAMETERS :
+ *   @cmd     : [out] command
+ *
+ * RETURN     : true -- success; false -- ring is empty
+ *==========================================================================*/
+bool QCameraStateMachine::QCameraSMCmdRing::popSlot(qcamera_sm_cmd_t &cmd)
+{
+    uint32_t pos = m_deqPos;
+    cmd_slot_t *slot = &m_slots[pos & m_mask];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if ((int32_t)(seq - (pos + 1)) < 0) {
+        return false;
+    }
+
+    cmd = slot->cmd;
+    m_deqPos = pos + 1;
+    __atomic_store_n(&slot->seq, pos + m_mask + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
 /*===========================================================================
  * FUNCTION   : stateMachine
  *
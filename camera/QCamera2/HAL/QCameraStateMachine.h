@@ -44,6 +44,9 @@ namespace qcamera {
 
 class QCamera2HardwareInterface;
 
+#define QCAMERA_SM_API_RING_SIZE 16   // APIs are serialized by the API lock
+#define QCAMERA_SM_EVT_RING_SIZE 256  // must be power of 2
+
 typedef enum {
     /*******BEGIN OF: API EVT*********/
     QCAMERA_SM_EVT_SET_PREVIEW_WINDOW = 1,   // set preview window
@@ -178,6 +181,8 @@ public:
     virtual ~QCameraStateMachine();
     int32_t procAPI(qcamera_sm_evt_enum_t evt, void *api_payload);
     int32_t procEvt(qcamera_sm_evt_enum_t evt, void *evt_payload);
+    bool procQueryAPI(qcamera_sm_evt_enum_t evt, void *api_payload,
+            int &enabled);
 
     bool isPreviewRunning(); // check if preview is running
     bool isPreviewReady(); // check if preview is ready
@@ -215,6 +220,33 @@ private:
         void *evt_payload;                          // ptr to payload
     } qcamera_sm_cmd_t;
 
+    // Multi-producer/single-consumer ring of commands stored inline in
+    // pre-allocated slots. Producers claim a slot with a CAS on the enqueue
+    // position, each slot sequence number publishes the slot to the state
+    // machine thread. Commands that find the ring full spill over to an
+    // unbounded queue, so no command is ever dropped.
+    class QCameraSMCmdRing {
+    public:
+        QCameraSMCmdRing(uint32_t size);
+        ~QCameraSMCmdRing();
+        bool push(const qcamera_sm_cmd_t &cmd);
+        bool pop(qcamera_sm_cmd_t &cmd);
+    private:
+        typedef struct {
+            uint32_t seq;
+            qcamera_sm_cmd_t cmd;
+        } cmd_slot_t;
+
+        bool pushSlot(const qcamera_sm_cmd_t &cmd);
+        bool popSlot(qcamera_sm_cmd_t &cmd);
+
+        cmd_slot_t *m_slots;
+        uint32_t m_mask;
+        uint32_t m_enqPos;
+        uint32_t m_deqPos;
+        QCameraQueueT<qcamera_sm_cmd_t> m_overflow; // cmds the ring had no room for
+    };
+
     int32_t stateMachine(qcamera_sm_evt_enum_t evt, void *payload);
     int32_t procEvtPreviewStoppedState(qcamera_sm_evt_enum_t evt, void *payload);
     int32_t procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt, void *payload);
@@ -229,11 +261,13 @@ private:
     static void *smEvtProcRoutine(void *data);
 
     int32_t applyDelayedMsgs();
+    int32_t enqueueCmd(QCameraSMCmdRing &ring, qcamera_sm_cmd_type_t cmd,
+            qcamera_sm_evt_enum_t evt, void *payload);
 
     QCamera2HardwareInterface *m_parent;  // ptr to HWI
-    qcamera_state_enum_t m_state;         // statemachine state
-    QCameraQueue api_queue;               // cmd queue for APIs
-    QCameraQueue evt_queue;               // cmd queue for evt from mm-camera-intf/mm-jpeg-intf
+    volatile qcamera_state_enum_t m_state; // statemachine state, read by query fast path
+    QCameraSMCmdRing api_queue;           // cmd ring for APIs
+    QCameraSMCmdRing evt_queue;           // cmd ring for evt from mm-camera-intf/mm-jpeg-intf
     pthread_t cmd_pid;                    // cmd thread ID
     cam_semaphore_t cmd_sem;              // semaphore for cmd thread
     bool m_bDelayPreviewMsgs;             // Delay preview callback enable during ZSL snapshot
@@ -750,6 +750,8 @@ int32_t QCameraStream::start()
 {
     int32_t rc = 0;
     mDataQ.init();
+    // dataProcRoutine drains mDataQ on every DO_NEXT_JOB
+    mProcTh.setCoalescing(true);
     rc = mProcTh.launch(dataProcRoutine, this);
     if (rc == NO_ERROR) {
         m_bActive = true;
@@ -943,14 +945,11 @@ void *QCameraStream::dataProcRoutine(void *data)
 
     CDBG("%s: E", __func__);
     do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
-                      __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
+        ret = cmdThread->waitCmd();
+        if (ret != NO_ERROR) {
+            ALOGE("%s: waitCmd error (%d)", __func__, ret);
+            return NULL;
+        }
 
         // we got notified about new cmd avail in cmd queue
         camera_cmd_type_t cmd = cmdThread->getCmd();
@@ -958,9 +957,9 @@ void *QCameraStream::dataProcRoutine(void *data)
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
             {
                 CDBG_HIGH("%s: Do next job", __func__);
-                mm_camera_super_buf_t *frame =
-                    (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
-                if (NULL != frame) {
+                mm_camera_super_buf_t *frame = NULL;
+                while (NULL != (frame =
+                        (mm_camera_super_buf_t *)pme->mDataQ.dequeue())) {
                     if (pme->mDataCB != NULL) {
                         pme->mDataCB(frame, pme, pme->mUserData);
                     } else {
@@ -479,9 +479,14 @@ void QCamera3Channel::dumpYUV(mm_camera_buf_def_t *frame, cam_dimension_t dim,
     snprintf(buf, sizeof(buf), QCAMERA_DUMP_FRM_LOCATION"%d_%d_%d_%dx%d.yuv",
             name, counter, frame->frame_idx, dim.width, dim.height);
     counter++;
+    void *data = frame->buffer;
+    if ((NULL == data) && (NULL != frame->mem_info)) {
+        // buffer not CPU mapped yet
+        data = ((QCamera3Memory *)frame->mem_info)->getPtr(frame->buf_idx);
+    }
     int file_fd = open(buf, O_RDWR| O_CREAT, 0644);
     if (file_fd >= 0) {
-        ssize_t written_len = write(file_fd, frame->buffer, offset.frame_len);
+        ssize_t written_len = write(file_fd, data, offset.frame_len);
         ALOGE("%s: written number of bytes %zd", __func__, written_len);
         close(file_fd);
     } else {
@@ -523,7 +528,7 @@ QCamera3ProcessingChannel::QCamera3ProcessingChannel(uint32_t cam_handle,
             QCamera3Channel(cam_handle, channel_handle, cam_ops, cb_routine,
                     paddingInfo, postprocess_mask, userData, numBuffers),
             m_postprocessor(this),
-            mMemory(numBuffers),
+            mMemory(numBuffers, true, true),
             mCamera3Stream(stream),
             mNumBufs(CAM_MAX_NUM_BUFS_PER_STREAM),
             mStreamType(stream_type),
@@ -1663,6 +1668,7 @@ QCamera3MetadataChannel::QCamera3MetadataChannel(uint32_t cam_handle,
                                 userData, numBuffers),
                         mMemory(NULL)
 {
+    memset(mBufRefCnt, 0, sizeof(mBufRefCnt));
 }
 
 QCamera3MetadataChannel::~QCamera3MetadataChannel()
@@ -1720,11 +1726,91 @@ void QCamera3MetadataChannel::streamCbRoutine(
         ALOGE("%s: super_frame is not valid", __func__);
         return;
     }
+    uint32_t bufIdx = super_frame->bufs[0]->buf_idx;
+    if (bufIdx < CAM_MAX_NUM_BUFS_PER_STREAM) {
+        Mutex::Autolock lock(mBufRefLock);
+        mBufRefCnt[bufIdx] = 1;
+    }
     if (mChannelCB) {
         mChannelCB(super_frame, NULL, requestNumber, false, mUserData);
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : addBufRef
+ *
+ * DESCRIPTION: take one more reference on a metadata buffer for another
+ *              consumer. Each reference is dropped with bufDone.
+ *
+ * PARAMETERS :
+ * @recvd_frame : metadata frame
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3MetadataChannel::addBufRef(mm_camera_super_buf_t *recvd_frame)
+{
+    if ((NULL == recvd_frame) || (NULL == recvd_frame->bufs[0]) ||
+            (recvd_frame->bufs[0]->buf_idx >= CAM_MAX_NUM_BUFS_PER_STREAM)) {
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock lock(mBufRefLock);
+    mBufRefCnt[recvd_frame->bufs[0]->buf_idx]++;
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : isBufShared
+ *
+ * DESCRIPTION: whether more than one consumer holds the metadata buffer, in
+ *              which case it must not be modified in place
+ *
+ * PARAMETERS :
+ * @bufIdx : metadata buffer index
+ *
+ * RETURN     : true if the buffer is shared
+ *==========================================================================*/
+bool QCamera3MetadataChannel::isBufShared(uint32_t bufIdx)
+{
+    if (bufIdx >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+        return false;
+    }
+
+    Mutex::Autolock lock(mBufRefLock);
+    return (mBufRefCnt[bufIdx] > 1);
+}
+
+/*===========================================================================
+ * FUNCTION   : bufDone
+ *
+ * DESCRIPTION: drop a reference on a metadata buffer and return it to the
+ *              stream once the last consumer is done with it
+ *
+ * PARAMETERS :
+ * @recvd_frame : metadata frame
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3MetadataChannel::bufDone(mm_camera_super_buf_t *recvd_frame)
+{
+    if ((NULL != recvd_frame) && (NULL != recvd_frame->bufs[0]) &&
+            (recvd_frame->bufs[0]->buf_idx < CAM_MAX_NUM_BUFS_PER_STREAM)) {
+        Mutex::Autolock lock(mBufRefLock);
+        uint32_t &refCnt = mBufRefCnt[recvd_frame->bufs[0]->buf_idx];
+        if (refCnt > 1) {
+            refCnt--;
+            return NO_ERROR;
+        }
+        refCnt = 0;
+    }
+
+    return QCamera3Channel::bufDone(recvd_frame);
+}
+
 QCamera3StreamMem* QCamera3MetadataChannel::getStreamBufs(uint32_t len)
 {
     int rc;
@@ -2486,16 +2572,19 @@ int32_t QCamera3YUVChannel::request(buffer_handle_t *buffer,
             mFreeHeapBufferList.erase(mFreeHeapBufferList.begin());
         }
 
-        /* Configure and start postproc if necessary */
-        reprocess_config_t reproc_cfg;
-        cam_dimension_t dim;
-        memset(&reproc_cfg, 0, sizeof(reprocess_config_t));
-        memset(&dim, 0, sizeof(dim));
-        mStreams[0]->getFrameDimension(dim);
-        setReprocConfig(reproc_cfg, NULL, metadata, mStreamFormat, dim);
-
-        // Start postprocessor without input buffer
-        startPostProc(reproc_cfg);
+        /* Configure and start postproc once, the reprocess stream then stays
+         * up and later frames are handed over by buffer index */
+        if (!mPostProcStarted) {
+            reprocess_config_t reproc_cfg;
+            cam_dimension_t dim;
+            memset(&reproc_cfg, 0, sizeof(reprocess_config_t));
+            memset(&dim, 0, sizeof(dim));
+            mStreams[0]->getFrameDimension(dim);
+            setReprocConfig(reproc_cfg, NULL, metadata, mStreamFormat, dim);
+
+            // Start postprocessor without input buffer
+            startPostProc(reproc_cfg);
+        }
 
         CDBG("%s: erasing %d", __func__, bufIdx);
 
@@ -3250,7 +3339,7 @@ void QCamera3PicChannel::streamCbRoutine(mm_camera_super_buf_t *super_frame,
 QCamera3StreamMem* QCamera3PicChannel::getStreamBufs(uint32_t len)
 {
 
-    mYuvMemory = new QCamera3StreamMem(mCamera3Stream->max_buffers, false);
+    mYuvMemory = new QCamera3StreamMem(mCamera3Stream->max_buffers, false, true);
     if (!mYuvMemory) {
         ALOGE("%s: unable to create metadata memory", __func__);
         return NULL;
@@ -3412,7 +3501,9 @@ QCamera3ReprocessChannel::QCamera3ReprocessChannel(uint32_t cam_handle,
                     ((QCamera3ProcessingChannel *)ch_hdl)->getNumBuffers()
                               + (MAX_REPROCESS_PIPELINE_STAGES - 1)),
     inputChHandle(ch_hdl),
-    mOfflineBuffersIndex(-1),
+    mOfflineSlotSeq(0),
+    mKeepOfflineMaps(true),
+    mMetaCopyMemory(NULL),
     mFrameLen(0),
     mReprocessType(REPROCESS_TYPE_NONE),
     m_pSrcChannel(NULL),
@@ -3421,8 +3512,19 @@ QCamera3ReprocessChannel::QCamera3ReprocessChannel(uint32_t cam_handle,
     mGrallocMemory(0)
 {
     memset(mSrcStreamHandles, 0, sizeof(mSrcStreamHandles));
-    mOfflineBuffersIndex = mNumBuffers -1;
-    mOfflineMetaIndex = (int32_t) (2*mNumBuffers -1);
+
+    OfflineSlot slot;
+    memset(&slot, 0, sizeof(slot));
+    slot.fd = -1;
+    for (uint32_t i = 0; i < mNumBuffers; i++) {
+        mOfflineSlots.push_back(slot);
+        mOfflineMetaSlots.push_back(slot);
+    }
+
+    char prop[PROPERTY_VALUE_MAX];
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.reproc.keepmap", prop, "1");
+    mKeepOfflineMaps = (atoi(prop) > 0);
 }
 
 
@@ -3622,7 +3724,7 @@ void QCamera3ReprocessChannel::streamCbRoutine(mm_camera_super_buf_t *super_fram
 QCamera3StreamMem* QCamera3ReprocessChannel::getStreamBufs(uint32_t len)
 {
     if (mReprocessType == REPROCESS_TYPE_JPEG) {
-        mMemory = new QCamera3StreamMem(mNumBuffers, false);
+        mMemory = new QCamera3StreamMem(mNumBuffers, false, true);
         if (!mMemory) {
             ALOGE("%s: unable to create reproc memory", __func__);
             return NULL;
@@ -3680,6 +3782,12 @@ QCamera3ReprocessChannel::~QCamera3ReprocessChannel()
         m_handle = 0;
     }
     m_numStreams = 0;
+
+    if (mMetaCopyMemory) {
+        mMetaCopyMemory->deallocate();
+        delete mMetaCopyMemory;
+        mMetaCopyMemory = NULL;
+    }
 }
 
 /*===========================================================================
@@ -3787,12 +3895,139 @@ QCamera3Stream * QCamera3ReprocessChannel::getSrcStreamBySrcHandle(uint32_t srcH
     return pStream;
 }
 
+/*===========================================================================
+ * FUNCTION   : mapOfflineBuf
+ *
+ * DESCRIPTION: Map an offline input or metadata buffer to a backend slot.
+ *              Buffers that are kept mapped are looked up by fd first so
+ *              that a recycled source buffer is handed over by slot index
+ *              without another map. Otherwise a free slot, or the least
+ *              recently used idle kept one, is (re)mapped. Note that
+ *              mOfflineBuffersLock is held when this function is called.
+ *
+ * PARAMETERS :
+ *   @slots  : input or metadata slot table
+ *   @base   : backend index of the first slot in the table
+ *   @type   : mapping type
+ *   @stream : reprocess stream the buffer is mapped to
+ *   @buf    : buffer to be mapped
+ *   @keep   : whether the mapping stays after the reprocess is done
+ *   @index  : backend index the buffer is mapped at
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3ReprocessChannel::mapOfflineBuf(Vector<OfflineSlot> &slots,
+        uint32_t base, cam_mapping_buf_type type, QCamera3Stream *stream,
+        const mm_camera_buf_def_t &buf, bool keep, uint32_t &index)
+{
+    int32_t rc = NO_ERROR;
+    ssize_t found = -1;
+
+    if (keep) {
+        for (size_t i = 0; i < slots.size(); i++) {
+            const OfflineSlot &slot = slots[i];
+            if (slot.mapped && slot.keep && (slot.stream == stream) &&
+                    (slot.fd == buf.fd) && (slot.mem_info == buf.mem_info) &&
+                    (slot.buf_idx == buf.buf_idx)) {
+                OfflineSlot &hit = slots.editItemAt(i);
+                hit.refCount++;
+                hit.lastUse = ++mOfflineSlotSeq;
+                index = base + (uint32_t)i;
+                return NO_ERROR;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < slots.size(); i++) {
+        const OfflineSlot &slot = slots[i];
+        if (!slot.mapped) {
+            found = (ssize_t)i;
+            break;
+        }
+        if (!slot.refCount && ((found < 0) ||
+                (slot.lastUse < slots[(size_t)found].lastUse))) {
+            found = (ssize_t)i;
+        }
+    }
+    if (found < 0) {
+        ALOGE("%s: No free offline buffer slot", __func__);
+        return NO_MEMORY;
+    }
+
+    OfflineSlot &slot = slots.editItemAt((size_t)found);
+    index = base + (uint32_t)found;
+    if (slot.mapped) {
+        rc = slot.stream->unmapBuf(type, index, -1);
+        if (NO_ERROR != rc) {
+            ALOGE("%s: Error during offline buffer unmap %d", __func__, rc);
+        }
+        slot.mapped = false;
+    }
+
+    rc = stream->mapBuf(type, index, -1, buf.fd, buf.frame_len);
+    if (NO_ERROR != rc) {
+        return rc;
+    }
+    slot.stream = stream;
+    slot.fd = buf.fd;
+    slot.mem_info = buf.mem_info;
+    slot.buf_idx = buf.buf_idx;
+    slot.refCount = 1;
+    slot.lastUse = ++mOfflineSlotSeq;
+    slot.mapped = true;
+    slot.keep = keep;
+    CDBG("%s: Mapped buffer type %d with index %d", __func__, type, index);
+
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseOfflineBuf
+ *
+ * DESCRIPTION: Drop a reference to an offline buffer slot and unmap it unless
+ *              it is kept mapped. Note that mOfflineBuffersLock is held when
+ *              this function is called.
+ *
+ * PARAMETERS :
+ *   @slots : input or metadata slot table
+ *   @base  : backend index of the first slot in the table
+ *   @buf   : offline buffer to be released
+ *   @all   : unmap regardless of the keep flag
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3ReprocessChannel::releaseOfflineBuf(Vector<OfflineSlot> &slots,
+        uint32_t base, const OfflineBuffer &buf, bool all)
+{
+    if ((buf.index < base) || ((buf.index - base) >= slots.size())) {
+        return;
+    }
+
+    OfflineSlot &slot = slots.editItemAt(buf.index - base);
+    if (slot.refCount) {
+        slot.refCount--;
+    }
+    if (slot.mapped && (all || (!slot.keep && !slot.refCount))) {
+        int32_t rc = slot.stream->unmapBuf(buf.type, buf.index, -1);
+        if (NO_ERROR != rc) {
+            ALOGE("%s: Error during offline buffer unmap %d", __func__, rc);
+        }
+        CDBG("%s: Unmapped buffer with index %d", __func__, buf.index);
+        slot.mapped = false;
+        slot.refCount = 0;
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : unmapOfflineBuffers
  *
- * DESCRIPTION: Unmaps offline buffers
+ * DESCRIPTION: Release the offline buffers of the oldest reprocess request,
+ *              or unmap all of them including the ones that are kept mapped
  *
- * PARAMETERS : none
+ * PARAMETERS :
+ *   @all : unmap all offline buffers
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
@@ -3801,58 +4036,144 @@ QCamera3Stream * QCamera3ReprocessChannel::getSrcStreamBySrcHandle(uint32_t srcH
 int32_t QCamera3ReprocessChannel::unmapOfflineBuffers(bool all)
 {
     int rc = NO_ERROR;
-    if (!mOfflineBuffers.empty()) {
-        QCamera3Stream *stream = NULL;
-        List<OfflineBuffer>::iterator it = mOfflineBuffers.begin();
-        for (; it != mOfflineBuffers.end(); it++) {
-           stream = (*it).stream;
-           if (NULL != stream) {
-               rc = stream->unmapBuf((*it).type,
-                                     (*it).index,
-                                        -1);
-               if (NO_ERROR != rc) {
-                   ALOGE("%s: Error during offline buffer unmap %d",
-                         __func__, rc);
-               }
-               CDBG("%s: Unmapped buffer with index %d", __func__, (*it).index);
-           }
-           if (!all) {
-               mOfflineBuffers.erase(it);
-               break;
-           }
+    Mutex::Autolock lock(mOfflineBuffersLock);
+
+    if (all) {
+        OfflineBuffer buf;
+        for (size_t i = 0; i < mOfflineSlots.size(); i++) {
+            buf.stream = mOfflineSlots[i].stream;
+            buf.type = CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF;
+            buf.index = (uint32_t)i;
+            releaseOfflineBuf(mOfflineSlots, 0, buf, true);
         }
-        if (all) {
-           mOfflineBuffers.clear();
+        for (size_t i = 0; i < mOfflineMetaSlots.size(); i++) {
+            buf.stream = mOfflineMetaSlots[i].stream;
+            buf.type = CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF;
+            buf.index = mNumBuffers + (uint32_t)i;
+            releaseOfflineBuf(mOfflineMetaSlots, mNumBuffers, buf, true);
         }
+        mOfflineBuffers.clear();
+        mOfflineMetaBuffers.clear();
+        return rc;
     }
 
+    if (!mOfflineBuffers.empty()) {
+        List<OfflineBuffer>::iterator it = mOfflineBuffers.begin();
+        releaseOfflineBuf(mOfflineSlots, 0, *it, false);
+        mOfflineBuffers.erase(it);
+    }
     if (!mOfflineMetaBuffers.empty()) {
-        QCamera3Stream *stream = NULL;
         List<OfflineBuffer>::iterator it = mOfflineMetaBuffers.begin();
-        for (; it != mOfflineMetaBuffers.end(); it++) {
-           stream = (*it).stream;
-           if (NULL != stream) {
-               rc = stream->unmapBuf((*it).type,
-                                     (*it).index,
-                                        -1);
-               if (NO_ERROR != rc) {
-                   ALOGE("%s: Error during offline buffer unmap %d",
-                         __func__, rc);
-               }
-               CDBG("%s: Unmapped meta buffer with index %d", __func__, (*it).index);
-           }
-           if (!all) {
-               mOfflineMetaBuffers.erase(it);
-               break;
-           }
-        }
-        if (all) {
-           mOfflineMetaBuffers.clear();
+        uint32_t slot = (*it).index - mNumBuffers;
+        if (slot < mOfflineMetaSlots.size()) {
+            releaseMetaCopyLocked(mOfflineMetaSlots[slot].fd);
         }
+        releaseOfflineBuf(mOfflineMetaSlots, mNumBuffers, *it, false);
+        mOfflineMetaBuffers.erase(it);
     }
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : getMetaCopy
+ *
+ * DESCRIPTION: Copy a metadata buffer into a private buffer of this channel
+ *              so that it can be modified while other consumers still read
+ *              the original
+ *
+ * PARAMETERS :
+ *   @src : shared metadata buffer
+ *   @dst : private copy
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3ReprocessChannel::getMetaCopy(const mm_camera_buf_def_t &src,
+        mm_camera_buf_def_t &dst)
+{
+    Mutex::Autolock lock(mOfflineBuffersLock);
+    uint32_t idx;
+
+    if (NULL == mMetaCopyMemory) {
+        mMetaCopyMemory = new QCamera3HeapMemory(mNumBuffers);
+        if (NULL == mMetaCopyMemory) {
+            ALOGE("%s: unable to create metadata copy memory", __func__);
+            return NO_MEMORY;
+        }
+    }
+    if (mFreeMetaCopies.empty()) {
+        int rc = mMetaCopyMemory->allocateOne(sizeof(metadata_buffer_t));
+        if (rc < 0) {
+            ALOGE("%s: Failed allocating metadata copy", __func__);
+            return NO_MEMORY;
+        }
+        idx = (uint32_t)rc;
+    } else {
+        idx = *(mFreeMetaCopies.begin());
+        mFreeMetaCopies.erase(mFreeMetaCopies.begin());
+    }
+
+    memcpy(mMetaCopyMemory->getPtr(idx), src.buffer, sizeof(metadata_buffer_t));
+    mMetaCopyMemory->cleanCache(idx);
+    mMetaCopiesInUse.push_back(idx);
+
+    dst = src;
+    dst.buf_idx = idx;
+    dst.fd = mMetaCopyMemory->getFd(idx);
+    dst.buffer = mMetaCopyMemory->getPtr(idx);
+    dst.frame_len = (size_t)mMetaCopyMemory->getSize(idx);
+    dst.mem_info = (void *)mMetaCopyMemory;
+    CDBG("%s: metadata buffer %d copied to %d", __func__, src.buf_idx, idx);
+
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseMetaCopyLocked
+ *
+ * DESCRIPTION: Return a private metadata copy to the free list if fd belongs
+ *              to one. Note that mOfflineBuffersLock is held when this
+ *              function is called.
+ *
+ * PARAMETERS :
+ *   @fd : fd of the metadata buffer sent for reprocess
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3ReprocessChannel::releaseMetaCopyLocked(int fd)
+{
+    if ((NULL == mMetaCopyMemory) || (fd < 0)) {
+        return;
+    }
+
+    for (List<uint32_t>::iterator it = mMetaCopiesInUse.begin();
+            it != mMetaCopiesInUse.end(); it++) {
+        if (mMetaCopyMemory->getFd(*it) == fd) {
+            mFreeMetaCopies.push_back(*it);
+            mMetaCopiesInUse.erase(it);
+            break;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseMetaCopy
+ *
+ * DESCRIPTION: Return the private metadata copy of a reprocess request that
+ *              could not be queued
+ *
+ * PARAMETERS :
+ *   @meta_buf : metadata buffer of the request
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3ReprocessChannel::releaseMetaCopy(const mm_camera_buf_def_t &meta_buf)
+{
+    Mutex::Autolock lock(mOfflineBuffersLock);
+    releaseMetaCopyLocked(meta_buf.fd);
+}
+
 /*===========================================================================
  * FUNCTION   : bufDone
  *
@@ -3914,6 +4235,18 @@ int32_t QCamera3ReprocessChannel::overrideMetadata(qcamera_hal3_pp_buffer_t *pp_
         return BAD_VALUE;
     }
 
+    // Entries below are rewritten for the reprocess stream. Work on a
+    // private copy if other consumers still read the metadata buffer.
+    mm_camera_buf_def_t reproc_meta_buf = *meta_buffer;
+    if ((NULL != m_pMetaChannel) && ((QCamera3MetadataChannel *)m_pMetaChannel)->
+            isBufShared(meta_buffer->buf_idx)) {
+        rc = getMetaCopy(*meta_buffer, reproc_meta_buf);
+        if (NO_ERROR != rc) {
+            return rc;
+        }
+        meta = (metadata_buffer_t *)reproc_meta_buf.buffer;
+    }
+
     for (uint32_t i = 0; i < frame->num_bufs; i++) {
         QCamera3Stream *pStream = getStreamBySrcHandle(frame->bufs[i]->stream_id);
         QCamera3Stream *pSrcStream = getSrcStreamBySrcHandle(frame->bufs[i]->stream_id);
@@ -4000,7 +4333,7 @@ int32_t QCamera3ReprocessChannel::overrideMetadata(qcamera_hal3_pp_buffer_t *pp_
             }
 
             fwk_frame.input_buffer = *frame->bufs[i];
-            fwk_frame.metadata_buffer = *meta_buffer;
+            fwk_frame.metadata_buffer = reproc_meta_buf;
             fwk_frame.output_buffer = pp_buffer->output;
             break;
         } else {
@@ -4094,16 +4427,21 @@ int32_t QCamera3ReprocessChannel::overrideFwkMetadata(
  *
  * PARAMETERS :
  *   @frame     : input frame for reprocessing
+ *   @keepMapped: input and metadata buffers are recycled HAL buffers and can
+ *                stay mapped to the reprocess stream across requests
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
- int32_t QCamera3ReprocessChannel::doReprocessOffline(qcamera_fwk_input_pp_data_t *frame)
+ int32_t QCamera3ReprocessChannel::doReprocessOffline(qcamera_fwk_input_pp_data_t *frame,
+        bool keepMapped)
 {
     int32_t rc = 0;
     int index;
     OfflineBuffer mappedBuffer;
+    uint32_t buf_idx = 0;
+    uint32_t meta_buf_idx = 0;
 
     if (m_numStreams < 1) {
         ALOGE("%s: No reprocess stream is created", __func__);
@@ -4120,7 +4458,9 @@ int32_t QCamera3ReprocessChannel::overrideFwkMetadata(
         return BAD_VALUE;
     }
 
-    if (NULL == frame->input_buffer.buffer) {
+    // The backend maps the input buffer by fd, it need not be CPU mapped
+    if ((NULL == frame->input_buffer.buffer) &&
+            (NULL == frame->input_buffer.mem_info)) {
         ALOGE("%s: No input buffer available", __func__);
         return BAD_VALUE;
     }
@@ -4194,42 +4534,30 @@ int32_t QCamera3ReprocessChannel::overrideFwkMetadata(
         }
     }
 
-    int32_t max_idx = (int32_t) (mNumBuffers - 1);
-    //loop back the indices if max burst count reached
-    if (mOfflineBuffersIndex == max_idx) {
-       mOfflineBuffersIndex = -1;
-    }
-    uint32_t buf_idx = (uint32_t)(mOfflineBuffersIndex + 1);
-    rc = pStream->mapBuf(
-            CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF,
-            buf_idx, -1,
-            frame->input_buffer.fd, frame->input_buffer.frame_len);
-    if (NO_ERROR == rc) {
-        mappedBuffer.index = buf_idx;
-        mappedBuffer.stream = pStream;
-        mappedBuffer.type = CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF;
-        mOfflineBuffers.push_back(mappedBuffer);
-        mOfflineBuffersIndex = (int32_t)buf_idx;
-        CDBG("%s: Mapped buffer with index %d", __func__, mOfflineBuffersIndex);
-    }
-
-    max_idx = (int32_t) ((mNumBuffers * 2) - 1);
-    //loop back the indices if max burst count reached
-    if (mOfflineMetaIndex == max_idx) {
-       mOfflineMetaIndex = (int32_t) (mNumBuffers - 1);
-    }
-    uint32_t meta_buf_idx = (uint32_t)(mOfflineMetaIndex + 1);
-    rc |= pStream->mapBuf(
-            CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF,
-            meta_buf_idx, -1,
-            frame->metadata_buffer.fd, frame->metadata_buffer.frame_len);
-    if (NO_ERROR == rc) {
-        mappedBuffer.index = meta_buf_idx;
-        mappedBuffer.stream = pStream;
-        mappedBuffer.type = CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF;
-        mOfflineMetaBuffers.push_back(mappedBuffer);
-        mOfflineMetaIndex = (int32_t)meta_buf_idx;
-        CDBG("%s: Mapped meta buffer with index %d", __func__, mOfflineMetaIndex);
+    keepMapped = keepMapped && mKeepOfflineMaps;
+    {
+        Mutex::Autolock lock(mOfflineBuffersLock);
+        rc = mapOfflineBuf(mOfflineSlots, 0,
+                CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF, pStream,
+                frame->input_buffer, keepMapped, buf_idx);
+        if (NO_ERROR == rc) {
+            rc = mapOfflineBuf(mOfflineMetaSlots, mNumBuffers,
+                    CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF, pStream,
+                    frame->metadata_buffer, keepMapped, meta_buf_idx);
+            mappedBuffer.index = buf_idx;
+            mappedBuffer.stream = pStream;
+            mappedBuffer.type = CAM_MAPPING_BUF_TYPE_OFFLINE_INPUT_BUF;
+            if (NO_ERROR == rc) {
+                mOfflineBuffers.push_back(mappedBuffer);
+                mappedBuffer.index = meta_buf_idx;
+                mappedBuffer.type = CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF;
+                mOfflineMetaBuffers.push_back(mappedBuffer);
+                CDBG("%s: Input buffer at index %d, meta buffer at index %d",
+                        __func__, buf_idx, meta_buf_idx);
+            } else {
+                releaseOfflineBuf(mOfflineSlots, 0, mappedBuffer, false);
+            }
+        }
     }
 
     if (rc == NO_ERROR) {
@@ -4472,7 +4800,7 @@ void QCamera3SupportChannel::streamCbRoutine(
 QCamera3StreamMem* QCamera3SupportChannel::getStreamBufs(uint32_t len)
 {
     int rc;
-    mMemory = new QCamera3StreamMem(mNumBuffers);
+    mMemory = new QCamera3StreamMem(mNumBuffers, true, true);
     if (!mMemory) {
         ALOGE("%s: unable to create heap memory", __func__);
         return NULL;
@@ -93,6 +93,7 @@ public:
     uint32_t getMyHandle() const {return m_handle;};
     uint32_t getNumOfStreams() const {return m_numStreams;};
     uint32_t getNumBuffers() const {return mNumBuffers;};
+    bool isActive() const {return m_bIsActive;};
     QCamera3Stream *getStreamByIndex(uint32_t index);
 
     static void streamCbRoutine(mm_camera_super_buf_t *super_frame,
@@ -289,8 +290,16 @@ public:
     virtual int32_t registerBuffer(buffer_handle_t * /*buffer*/, cam_is_type_t /*isType*/)
             { return NO_ERROR; };
 
+    // A metadata buffer can be shared read-only by the result path and
+    // several postprocessors. It goes back to the stream on the last bufDone.
+    int32_t bufDone(mm_camera_super_buf_t *recvd_frame);
+    int32_t addBufRef(mm_camera_super_buf_t *recvd_frame);
+    bool isBufShared(uint32_t bufIdx);
+
 private:
     QCamera3StreamMem *mMemory;
+    Mutex mBufRefLock;
+    uint32_t mBufRefCnt[CAM_MAX_NUM_BUFS_PER_STREAM];
 };
 
 /* QCamera3RawChannel is for opaqueu/cross-platform raw stream containing
@@ -498,7 +507,8 @@ public:
     // offline reprocess
     virtual int32_t start();
     virtual int32_t stop();
-    int32_t doReprocessOffline(qcamera_fwk_input_pp_data_t *frame);
+    int32_t doReprocessOffline(qcamera_fwk_input_pp_data_t *frame,
+            bool keepMapped = false);
     int32_t doReprocess(int buf_fd, size_t buf_length, int32_t &ret_val,
                         mm_camera_super_buf_t *meta_buf);
     int32_t overrideMetadata(qcamera_hal3_pp_buffer_t *pp_buffer,
@@ -510,6 +520,7 @@ public:
     virtual void putStreamBufs();
     virtual int32_t initialize(cam_is_type_t isType);
     int32_t unmapOfflineBuffers(bool all);
+    void releaseMetaCopy(const mm_camera_buf_def_t &meta_buf);
     int32_t bufDone(mm_camera_super_buf_t *recvd_frame);
     virtual void streamCbRoutine(mm_camera_super_buf_t *super_frame,
                             QCamera3Stream *stream);
@@ -533,10 +544,39 @@ private:
         uint32_t index;
     } OfflineBuffer;
 
+    // Backend mapping slot of an offline input or metadata buffer
+    typedef struct {
+        QCamera3Stream *stream;
+        int fd;
+        // buffers may not be CPU mapped, they are told apart by their
+        // memory object and index instead of the frame pointer
+        void *mem_info;
+        uint32_t buf_idx;
+        uint32_t refCount;
+        uint32_t lastUse;
+        bool mapped;
+        bool keep; // stays mapped after the reprocess is done
+    } OfflineSlot;
+
+    int32_t mapOfflineBuf(android::Vector<OfflineSlot> &slots, uint32_t base,
+            cam_mapping_buf_type type, QCamera3Stream *stream,
+            const mm_camera_buf_def_t &buf, bool keep, uint32_t &index);
+    void releaseOfflineBuf(android::Vector<OfflineSlot> &slots, uint32_t base,
+            const OfflineBuffer &buf, bool all);
+    int32_t getMetaCopy(const mm_camera_buf_def_t &src, mm_camera_buf_def_t &dst);
+    void releaseMetaCopyLocked(int fd);
+
     android::List<OfflineBuffer> mOfflineBuffers;
     android::List<OfflineBuffer> mOfflineMetaBuffers;
-    int32_t mOfflineBuffersIndex;
-    int32_t mOfflineMetaIndex;
+    android::Vector<OfflineSlot> mOfflineSlots;
+    android::Vector<OfflineSlot> mOfflineMetaSlots;
+    uint32_t mOfflineSlotSeq;
+    bool mKeepOfflineMaps;
+    Mutex mOfflineBuffersLock;
+    // Private copies of shared metadata buffers that need to be modified
+    QCamera3HeapMemory *mMetaCopyMemory;
+    List<uint32_t> mFreeMetaCopies;
+    List<uint32_t> mMetaCopiesInUse;
     uint32_t mFrameLen;
     Mutex mFreeBuffersLock; // Lock for free heap buffers
     List<int32_t> mFreeBufferList; // Free heap buffers list
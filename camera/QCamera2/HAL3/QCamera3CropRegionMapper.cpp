@@ -51,7 +51,9 @@ QCamera3CropRegionMapper::QCamera3CropRegionMapper()
         : mSensorW(0),
           mSensorH(0),
           mActiveArrayW(0),
-          mActiveArrayH(0)
+          mActiveArrayH(0),
+          mScaleX(0),
+          mScaleY(0)
 {
 }
 
@@ -103,6 +105,11 @@ void QCamera3CropRegionMapper::update(uint32_t active_array_w,
     mActiveArrayW = active_array_w;
     mActiveArrayH = active_array_h;
 
+    // Round the factors up. With coordinates inside the sensor output, the
+    // error stays below 1/sensor_w so the result matches x * A / S exactly.
+    mScaleX = (((uint64_t)active_array_w << 32) + sensor_w - 1) / sensor_w;
+    mScaleY = (((uint64_t)active_array_h << 32) + sensor_h - 1) / sensor_h;
+
     ALOGI("%s: active_array: %d x %d, sensor size %d x %d", __func__,
             mActiveArrayW, mActiveArrayH, mSensorW, mSensorH);
 }
@@ -265,4 +272,113 @@ void QCamera3CropRegionMapper::toSensor(uint32_t& x, uint32_t& y)
     y = y * mSensorH / mActiveArrayH;
 }
 
+/*===========================================================================
+ * FUNCTION   : toActiveArray
+ *
+ * DESCRIPTION: Map rectangle from sensor output space to active array space
+ *              and convert it to a framework region
+ *
+ * PARAMETERS :
+ *   @rect   : rectangle in sensor output space
+ *   @region : [xmin, ymin, xmax, ymax] in active array space
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3CropRegionMapper::toActiveArray(const cam_rect_t& rect,
+        int32_t* region)
+{
+    int32_t left = rect.left;
+    int32_t top = rect.top;
+    int32_t width = rect.width;
+    int32_t height = rect.height;
+
+    if (mScaleX == 0 || mScaleY == 0) {
+        ALOGE("%s: sensor/active array sizes are not initialized!", __func__);
+    } else {
+        left = scaleToActiveArray(left, mScaleX);
+        top = scaleToActiveArray(top, mScaleY);
+        width = scaleToActiveArray(width, mScaleX);
+        height = scaleToActiveArray(height, mScaleY);
+        boundToSize(left, top, width, height, mActiveArrayW, mActiveArrayH);
+    }
+
+    region[0] = left;
+    region[1] = top;
+    region[2] = left + width;
+    region[3] = top + height;
+}
+
+/*===========================================================================
+ * FUNCTION   : pointToActiveArray
+ *
+ * DESCRIPTION: Map co-ordinate from sensor output space to active array space
+ *              into a framework landmark pair
+ *
+ * PARAMETERS :
+ *   @pt  : co-ordinate in sensor output space
+ *   @out : [x, y] in active array space
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3CropRegionMapper::pointToActiveArray(const cam_coordinate_type_t& pt,
+        int32_t* out)
+{
+    if ((pt.x > static_cast<uint32_t>(mSensorW)) ||
+            (pt.y > static_cast<uint32_t>(mSensorH))) {
+        ALOGE("%s: invalid co-ordinate (%d, %d) in (0, 0, %d, %d) space",
+                __func__, pt.x, pt.y, mSensorW, mSensorH);
+        out[0] = (int32_t)pt.x;
+        out[1] = (int32_t)pt.y;
+        return;
+    }
+    out[0] = (int32_t)(((uint64_t)pt.x * mScaleX) >> 32);
+    out[1] = (int32_t)(((uint64_t)pt.y * mScaleY) >> 32);
+}
+
+/*===========================================================================
+ * FUNCTION   : facesToActiveArray
+ *
+ * DESCRIPTION: Map face rectangles and landmarks from sensor output space to
+ *              active array space in one pass
+ *
+ * PARAMETERS :
+ *   @faces     : detected faces in sensor output space
+ *   @num_faces : number of faces
+ *   @rects     : 4 entries per face, [xmin, ymin, xmax, ymax]
+ *   @landmarks : 6 entries per face, eyes and mouth centers. NULL if
+ *                landmarks are not reported
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3CropRegionMapper::facesToActiveArray(
+        const cam_face_detection_info_t* faces, size_t num_faces,
+        int32_t* rects, int32_t* landmarks)
+{
+    bool valid = (mScaleX != 0 && mScaleY != 0);
+    if (!valid) {
+        ALOGE("%s: sensor/active array sizes are not initialized!", __func__);
+    }
+
+    for (size_t i = 0; i < num_faces; i++) {
+        toActiveArray(faces[i].face_boundary, rects + i * 4);
+        if (NULL == landmarks) {
+            continue;
+        }
+
+        int32_t* lm = landmarks + i * 6;
+        if (valid) {
+            pointToActiveArray(faces[i].left_eye_center, lm);
+            pointToActiveArray(faces[i].right_eye_center, lm + 2);
+            pointToActiveArray(faces[i].mouth_center, lm + 4);
+        } else {
+            lm[0] = (int32_t)faces[i].left_eye_center.x;
+            lm[1] = (int32_t)faces[i].left_eye_center.y;
+            lm[2] = (int32_t)faces[i].right_eye_center.x;
+            lm[3] = (int32_t)faces[i].right_eye_center.y;
+            lm[4] = (int32_t)faces[i].mouth_center.x;
+            lm[5] = (int32_t)faces[i].mouth_center.y;
+        }
+    }
+}
+
 }; //end namespace android
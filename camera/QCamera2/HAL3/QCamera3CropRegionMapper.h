@@ -52,10 +52,27 @@ public:
     void toActiveArray(uint32_t& x, uint32_t& y);
     void toSensor(uint32_t& x, uint32_t& y);
 
+    /* Result path helpers, write framework [xmin, ymin, xmax, ymax] regions
+     * and landmarks without modifying the HAL metadata */
+    void toActiveArray(const cam_rect_t& rect, int32_t* region);
+    void facesToActiveArray(const cam_face_detection_info_t* faces,
+            size_t num_faces, int32_t* rects, int32_t* landmarks);
+
 private:
     /* sensor output size */
     int32_t mSensorW, mSensorH;
     int32_t mActiveArrayW, mActiveArrayH;
+    /* sensor to active array scale factors in Q32 fixed point */
+    uint64_t mScaleX, mScaleY;
+
+    inline int32_t scaleToActiveArray(int32_t v, uint64_t scale) {
+        // Truncate toward zero like the integer division it replaces
+        if (v < 0) {
+            return -(int32_t)(((uint64_t)(-(int64_t)v) * scale) >> 32);
+        }
+        return (int32_t)(((uint64_t)v * scale) >> 32);
+    }
+    void pointToActiveArray(const cam_coordinate_type_t& pt, int32_t* out);
 
     void boundToSize(int32_t& left, int32_t& top, int32_t& width,
             int32_t& height, int32_t bound_w, int32_t bound_h);
@@ -48,6 +48,10 @@ namespace qcamera {
 #define IS_USAGE_ZSL(usage)  (((usage) & (GRALLOC_USAGE_HW_CAMERA_ZSL)) \
         == (GRALLOC_USAGE_HW_CAMERA_ZSL))
 
+/* Batch containers a batch mode stream keeps on top of the ones needed for
+ * full batches, so that partially filled HFR batches can be queued */
+#define MAX_HFR_PARTIAL_BATCHES (4)
+
 class QCamera3Channel;
 class QCamera3ProcessingChannel;
 
@@ -81,6 +81,16 @@ namespace qcamera {
 #define PREVIEW_FPS_FOR_HFR    (30)
 #define DEFAULT_VIDEO_FPS      (30.0)
 #define MAX_HFR_BATCH_SIZE     (8)
+/* Video requests sent as single frame batches right after configure so that
+ * the first preview frames are not held back until a full batch is formed */
+#define HFR_BATCH_WARMUP_FRAMES (3)
+/* A batch should fill within one preview frame interval and its metadata
+ * should be back within the latency budget, otherwise the depth is reduced */
+#define HFR_BATCH_FILL_BUDGET_NS    ((nsecs_t)(NSEC_PER_SEC / PREVIEW_FPS_FOR_HFR))
+#define HFR_BATCH_LATENCY_BUDGET_NS (6 * HFR_BATCH_FILL_BUDGET_NS)
+#define HFR_BATCH_EWMA_SHIFT        (3)
+/* Number of stream configuration plans kept per camera session */
+#define MAX_STREAM_CONFIG_PLANS     (4)
 #define REGIONS_TUPLE_COUNT    5
 #define HDR_PLUS_PERF_TIME_OUT  (7000) // milliseconds
 
@@ -98,6 +108,8 @@ namespace qcamera {
 
 cam_capability_t *gCamCapability[MM_CAMERA_MAX_NUM_SENSORS];
 const camera_metadata_t *gStaticMetadata[MM_CAMERA_MAX_NUM_SENSORS];
+// Default request templates, built once per camera and shared across opens
+camera_metadata_t *gDefaultMetadata[MM_CAMERA_MAX_NUM_SENSORS][CAMERA3_TEMPLATE_COUNT];
 static pthread_mutex_t gCamLock = PTHREAD_MUTEX_INITIALIZER;
 volatile uint32_t gCamHal3LogLevel = 1;
 
@@ -336,6 +348,8 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
       m_bEisSupportedSize(false),
       m_bEisEnable(false),
       m_MobicatMask(0),
+      mStreamConfigPlanValid(false),
+      mReuseChannels(true),
       mMinProcessedFrameDuration(0),
       mMinJpegFrameDuration(0),
       mMinRawFrameDuration(0),
@@ -346,6 +360,15 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
       mHybridAeEnable(0),
       mBatchSize(0),
       mToBeQueuedVidBufs(0),
+      mHFRBatchDepth(0),
+      mHFRAdaptiveBatch(true),
+      mHFRWarmupFrames(0),
+      mHFRLastRequestTs(0),
+      mHFRRequestInterval(0),
+      mHFRResultLatency(0),
+      mHFRBatchesFormed(0),
+      mHFRBatchesPartial(0),
+      mHFRBatchesFlushed(0),
       mHFRVideoFps(DEFAULT_VIDEO_FPS),
       mOpMode(CAMERA3_STREAM_CONFIGURATION_NORMAL_MODE),
       mFirstFrameNumberInBatch(0),
@@ -371,9 +394,6 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
     mCurrentRequestId = -1;
     pthread_mutex_init(&mMutex, NULL);
 
-    for (size_t i = 0; i < CAMERA3_TEMPLATE_COUNT; i++)
-        mDefaultMetadata[i] = NULL;
-
     // Getting system props of different kinds
     char prop[PROPERTY_VALUE_MAX];
     memset(prop, 0, sizeof(prop));
@@ -393,6 +413,30 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
     property_get("persist.camera.tnr.video", prop, "1");
     m_bTnrVideo = (uint8_t)atoi(prop);
 
+    m_CdsPreference = getCdsPreference();
+
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.hfr.adaptive_batch", prop, "1");
+    mHFRAdaptiveBatch = (atoi(prop) > 0);
+
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.reuse_channels", prop, "1");
+    mReuseChannels = (atoi(prop) > 0);
+    memset(&mStreamConfigPlan, 0, sizeof(mStreamConfigPlan));
+
+    // 0 or 1 worker runs all channel steps on the calling thread
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.chan_workers", prop, "3");
+    mNumChannelWorkers = (uint32_t)MIN(MAX(atoi(prop), 0), MAX_CHANNEL_WORKERS);
+    mChannelWorkersLaunched = false;
+    for (uint32_t i = 0; i < MAX_CHANNEL_WORKERS; i++) {
+        mChannelWorkers[i].hw = this;
+    }
+    pthread_mutex_init(&mChannelRunLock, NULL);
+    pthread_mutex_init(&mChannelStepLogLock, NULL);
+
+    setThermalLevel(QCAMERA_THERMAL_NO_ADJUSTMENT);
+
     mPendingBuffersMap.num_buffers = 0;
     mPendingBuffersMap.last_frame_number = -1;
 }
@@ -476,6 +520,7 @@ QCamera3HardwareInterface::~QCamera3HardwareInterface()
         delete mMetadataChannel;
         mMetadataChannel = NULL;
     }
+    exitChannelWorkers();
 
     /* Clean up all channels */
     if (mCameraInitialized) {
@@ -522,22 +567,22 @@ QCamera3HardwareInterface::~QCamera3HardwareInterface()
     if (mCameraOpened)
         closeCamera();
 
+    QCamera3GrallocMemory::flushImportCache();
+
     mPendingBuffersMap.mPendingBufferList.clear();
     mPendingReprocessResultList.clear();
     for (pendingRequestIterator i = mPendingRequestsList.begin();
             i != mPendingRequestsList.end();) {
         i = erasePendingRequest(i);
     }
-    for (size_t i = 0; i < CAMERA3_TEMPLATE_COUNT; i++)
-        if (mDefaultMetadata[i])
-            free_camera_metadata(mDefaultMetadata[i]);
-
     m_perfLock.lock_rel();
     m_perfLock.lock_deinit();
 
     pthread_cond_destroy(&mRequestCond);
 
     pthread_mutex_destroy(&mMutex);
+    pthread_mutex_destroy(&mChannelRunLock);
+    pthread_mutex_destroy(&mChannelStepLogLock);
 
     if (hasPendingBuffers) {
         ALOGE("%s: Not all buffers were returned. Notified the camera daemon process to restart."
@@ -649,6 +694,9 @@ int QCamera3HardwareInterface::openCamera(struct hw_device_t **hw_device)
     rc = openCamera();
     if (rc == 0) {
         *hw_device = &mCameraDevice.common;
+        if (QCameraThermalAdapter::getInstance().init(this) != 0) {
+            ALOGE("%s: Init thermal adapter failed", __func__);
+        }
     } else
         *hw_device = NULL;
 
@@ -721,6 +769,9 @@ int QCamera3HardwareInterface::closeCamera()
     ATRACE_CALL();
     int rc = NO_ERROR;
 
+    QCameraThermalAdapter::getInstance().deinit();
+    resetHFRBatchState();
+
     rc = mCameraHandle->ops->close_camera(mCameraHandle->camera_handle);
     mCameraHandle = NULL;
     mCameraOpened = false;
@@ -1014,17 +1065,22 @@ bool QCamera3HardwareInterface::isSupportChannelNeeded(
 /*==============================================================================
  * FUNCTION   : getSensorOutputSize
  *
- * DESCRIPTION: Get sensor output size based on current stream configuratoin
+ * DESCRIPTION: Get sensor output size based on current stream configuratoin.
+ *              The size is cached in the stream configuration plan, so it is
+ *              only queried from the backend the first time a plan starts
+ *              with a given sensor mode key.
  *
  * PARAMETERS :
  *   @sensor_dim : sensor output dimension (output)
+ *   @sensor_mode_key : first request settings the sensor mode depends on
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *
  *==========================================================================*/
-int32_t QCamera3HardwareInterface::getSensorOutputSize(cam_dimension_t &sensor_dim)
+int32_t QCamera3HardwareInterface::getSensorOutputSize(cam_dimension_t &sensor_dim,
+        const int32_t *sensor_mode_key)
 {
     int32_t rc = NO_ERROR;
 
@@ -1051,6 +1107,15 @@ int32_t QCamera3HardwareInterface::getSensorOutputSize(cam_dimension_t &sensor_d
         return rc;
     }
 
+    size_t keySize = sizeof(mStreamConfigPlan.sensor_mode_key);
+    if (mStreamConfigPlanValid && mStreamConfigPlan.sensor_dim_valid &&
+            !memcmp(mStreamConfigPlan.sensor_mode_key, sensor_mode_key, keySize)) {
+        sensor_dim = mStreamConfigPlan.sensor_dim;
+        CDBG_HIGH("%s: cached sensor output dimension = %d x %d", __func__,
+                sensor_dim.width, sensor_dim.height);
+        return rc;
+    }
+
     clear_metadata_buffer(mParameters);
     ADD_GET_PARAM_ENTRY_TO_BATCH(mParameters, CAM_INTF_PARM_RAW_DIMENSION);
 
@@ -1064,6 +1129,18 @@ int32_t QCamera3HardwareInterface::getSensorOutputSize(cam_dimension_t &sensor_d
     READ_PARAM_ENTRY(mParameters, CAM_INTF_PARM_RAW_DIMENSION, sensor_dim);
     ALOGI("%s: sensor output dimension = %d x %d", __func__, sensor_dim.width, sensor_dim.height);
 
+    if (mStreamConfigPlanValid) {
+        mStreamConfigPlan.sensor_dim_valid = true;
+        memcpy(mStreamConfigPlan.sensor_mode_key, sensor_mode_key, keySize);
+        mStreamConfigPlan.sensor_dim = sensor_dim;
+        for (size_t i = 0; i < mStreamConfigPlans.size(); i++) {
+            if (isSamePlanKey(mStreamConfigPlans[i], mStreamConfigPlan)) {
+                mStreamConfigPlans.editItemAt(i) = mStreamConfigPlan;
+                break;
+            }
+        }
+    }
+
     return rc;
 }
 
@@ -1130,93 +1207,234 @@ int QCamera3HardwareInterface::configureStreams(
 }
 
 /*===========================================================================
- * FUNCTION   : configureStreamsPerfLocked
+ * FUNCTION   : getStreamConfigKey
  *
- * DESCRIPTION: configureStreams while perfLock is held.
+ * DESCRIPTION: Fill in the stream parameters a stream configuration plan is
+ *              derived from
  *
  * PARAMETERS :
- *   @stream_list : streams to be configured
+ *   @stream : framework stream
+ *   @key    : stream key (output)
  *
- * RETURN     : int32_t type of status
- *              NO_ERROR  -- success
- *              none-zero failure code
+ * RETURN     : none
  *==========================================================================*/
-int QCamera3HardwareInterface::configureStreamsPerfLocked(
-        camera3_stream_configuration_t *streamList)
+void QCamera3HardwareInterface::getStreamConfigKey(const camera3_stream_t *stream,
+        stream_config_key_t &key)
 {
-    ATRACE_CALL();
-    int rc = 0;
+    key.stream_type = stream->stream_type;
+    key.format = stream->format;
+    key.width = stream->width;
+    key.height = stream->height;
+    key.rotation = stream->rotation;
+    key.usage = stream->usage;
+}
 
-    // Sanity check stream_list
-    if (streamList == NULL) {
-        ALOGE("%s: NULL stream configuration", __func__);
-        return BAD_VALUE;
+/*===========================================================================
+ * FUNCTION   : compareStreamConfigKey
+ *
+ * DESCRIPTION: Order stream keys so that a stream list can be normalized
+ *
+ * PARAMETERS :
+ *   @a : first stream key
+ *   @b : second stream key
+ *
+ * RETURN     : negative, zero or positive like memcmp
+ *==========================================================================*/
+int QCamera3HardwareInterface::compareStreamConfigKey(const stream_config_key_t &a,
+        const stream_config_key_t &b)
+{
+    if (a.stream_type != b.stream_type)
+        return (a.stream_type < b.stream_type) ? -1 : 1;
+    if (a.format != b.format)
+        return (a.format < b.format) ? -1 : 1;
+    if (a.width != b.width)
+        return (a.width < b.width) ? -1 : 1;
+    if (a.height != b.height)
+        return (a.height < b.height) ? -1 : 1;
+    if (a.rotation != b.rotation)
+        return (a.rotation < b.rotation) ? -1 : 1;
+    if (a.usage != b.usage)
+        return (a.usage < b.usage) ? -1 : 1;
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : isSamePlanKey
+ *
+ * DESCRIPTION: Check whether two plans were derived from the same normalized
+ *              stream list
+ *
+ * PARAMETERS :
+ *   @a : first plan
+ *   @b : second plan
+ *
+ * RETURN     : true if the stream lists match
+ *==========================================================================*/
+bool QCamera3HardwareInterface::isSamePlanKey(const stream_config_plan_t &a,
+        const stream_config_plan_t &b)
+{
+    if ((a.op_mode != b.op_mode) || (a.num_streams != b.num_streams)) {
+        return false;
     }
-    if (streamList->streams == NULL) {
-        ALOGE("%s: NULL stream list", __func__);
-        return BAD_VALUE;
+    for (size_t i = 0; i < a.num_streams; i++) {
+        if (compareStreamConfigKey(a.keys[i], b.keys[i])) {
+            return false;
+        }
     }
+    return true;
+}
 
-    if (streamList->num_streams < 1) {
-        ALOGE("%s: Bad number of streams requested: %d", __func__,
-                streamList->num_streams);
-        return BAD_VALUE;
-    }
+/*===========================================================================
+ * FUNCTION   : isSameSessionMode
+ *
+ * DESCRIPTION: Check whether channels created for one plan may be kept for
+ *              the other at all. Whether a channel is kept is then decided
+ *              per stream. HFR sessions never keep channels since the batch
+ *              size is only known at the first request.
+ *
+ * PARAMETERS :
+ *   @a : first plan
+ *   @b : second plan
+ *
+ * RETURN     : true if both plans use the same, non HFR, operation mode
+ *==========================================================================*/
+bool QCamera3HardwareInterface::isSameSessionMode(const stream_config_plan_t &a,
+        const stream_config_plan_t &b)
+{
+    return (a.op_mode != CAMERA3_STREAM_CONFIGURATION_CONSTRAINED_HIGH_SPEED_MODE) &&
+            (a.op_mode == b.op_mode);
+}
 
-    if (streamList->num_streams >= MAX_NUM_STREAMS) {
-        ALOGE("%s: Maximum number of streams %d exceeded: %d", __func__,
-                MAX_NUM_STREAMS, streamList->num_streams);
-        return BAD_VALUE;
-    }
+/*===========================================================================
+ * FUNCTION   : isSameChannelConfig
+ *
+ * DESCRIPTION: Check whether a channel created with one set of backend stream
+ *              parameters can serve a stream that needs the other
+ *
+ * PARAMETERS :
+ *   @a : first channel config
+ *   @b : second channel config
+ *
+ * RETURN     : true if the configs match
+ *==========================================================================*/
+bool QCamera3HardwareInterface::isSameChannelConfig(
+        const stream_channel_config_t &a, const stream_channel_config_t &b)
+{
+    return (a.stream_type == b.stream_type) &&
+            (a.postprocess_mask == b.postprocess_mask) &&
+            (a.stream_size.width == b.stream_size.width) &&
+            (a.stream_size.height == b.stream_size.height) &&
+            (a.is_type == b.is_type) &&
+            (a.num_buffers == b.num_buffers) &&
+            (a.is_4k_video == b.is_4k_video) &&
+            (a.is_zsl == b.is_zsl);
+}
 
-    rc = validateUsageFlags(streamList);
-    if (rc != NO_ERROR) {
-        return rc;
+/*===========================================================================
+ * FUNCTION   : deleteStreamChannel
+ *
+ * DESCRIPTION: Delete the channel of a stream so that it is recreated
+ *
+ * PARAMETERS :
+ *   @streamInfo : stream whose channel is deleted
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3HardwareInterface::deleteStreamChannel(stream_info_t *streamInfo)
+{
+    QCamera3ProcessingChannel *channel =
+            (QCamera3ProcessingChannel*)streamInfo->stream->priv;
+    if (channel == (QCamera3ProcessingChannel*)mPictureChannel) {
+        mPictureChannel = NULL;
     }
+    if (channel == (QCamera3ProcessingChannel*)mRawChannel) {
+        mRawChannel = NULL;
+    }
+    delete channel;
+    streamInfo->stream->priv = NULL;
+    streamInfo->channel = NULL;
+}
 
-    mOpMode = streamList->operation_mode;
-    CDBG("%s: mOpMode: %d", __func__, mOpMode);
-
-    /* first invalidate all the steams in the mStreamList
-     * if they appear again, they will be validated */
-    for (List<stream_info_t*>::iterator it = mStreamInfo.begin();
-            it != mStreamInfo.end(); it++) {
-        QCamera3ProcessingChannel *channel = (QCamera3ProcessingChannel*)(*it)->stream->priv;
-        if (channel) {
-          channel->stop();
+/*===========================================================================
+ * FUNCTION   : getStreamConfigPlan
+ *
+ * DESCRIPTION: Look up the plan of a stream list in the plan cache, or derive
+ *              and cache it
+ *
+ * PARAMETERS :
+ *   @streamList : streams to be configured
+ *   @plan       : plan for the stream list (output)
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCamera3HardwareInterface::getStreamConfigPlan(
+        camera3_stream_configuration_t *streamList, stream_config_plan_t &plan)
+{
+    memset(&plan, 0, sizeof(plan));
+    plan.op_mode = streamList->operation_mode;
+    plan.num_streams = streamList->num_streams;
+    for (size_t i = 0; i < plan.num_streams; i++) {
+        stream_config_key_t key;
+        getStreamConfigKey(streamList->streams[i], key);
+        // Insertion sort, the list is at most MAX_NUM_STREAMS long
+        size_t j = i;
+        while ((j > 0) && (compareStreamConfigKey(plan.keys[j - 1], key) > 0)) {
+            plan.keys[j] = plan.keys[j - 1];
+            j--;
+        }
+        plan.keys[j] = key;
+    }
+
+    for (size_t i = 0; i < mStreamConfigPlans.size(); i++) {
+        if (isSamePlanKey(mStreamConfigPlans[i], plan)) {
+            plan = mStreamConfigPlans[i];
+            if (i) {
+                mStreamConfigPlans.removeAt(i);
+                mStreamConfigPlans.insertAt(plan, 0);
+            }
+            CDBG_HIGH("%s: Using cached stream configuration plan", __func__);
+            return NO_ERROR;
         }
-        (*it)->status = INVALID;
     }
 
-    if (mRawDumpChannel) {
-        mRawDumpChannel->stop();
-        delete mRawDumpChannel;
-        mRawDumpChannel = NULL;
+    int rc = deriveStreamConfigPlan(streamList, plan);
+    if (rc != NO_ERROR) {
+        return rc;
     }
 
-    if (mSupportChannel)
-        mSupportChannel->stop();
-
-    if (mAnalysisChannel) {
-        mAnalysisChannel->stop();
-    }
-    if (mMetadataChannel) {
-        /* If content of mStreamInfo is not 0, there is metadata stream */
-        mMetadataChannel->stop();
-    }
-    if (mChannelHandle) {
-        mCameraHandle->ops->stop_channel(mCameraHandle->camera_handle,
-                mChannelHandle);
-        ALOGI("%s: stopping channel %d", __func__, mChannelHandle);
+    if (mStreamConfigPlans.size() >= MAX_STREAM_CONFIG_PLANS) {
+        mStreamConfigPlans.removeAt(mStreamConfigPlans.size() - 1);
     }
+    mStreamConfigPlans.insertAt(plan, 0);
+    return NO_ERROR;
+}
 
-    pthread_mutex_lock(&mMutex);
+/*===========================================================================
+ * FUNCTION   : deriveStreamConfigPlan
+ *
+ * DESCRIPTION: Classify and validate a stream list, and derive the session
+ *              layout channels are created from
+ *
+ * PARAMETERS :
+ *   @streamList : streams to be configured
+ *   @plan       : plan to be filled in. Key fields are already set.
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCamera3HardwareInterface::deriveStreamConfigPlan(
+        camera3_stream_configuration_t *streamList, stream_config_plan_t &plan)
+{
+    int rc = NO_ERROR;
 
     /* Check whether we have video stream */
-    m_bIs4KVideo = false;
-    m_bIsVideo = false;
-    m_bEisSupportedSize = false;
-    m_bTnrEnabled = false;
+    bool is4KVideo = false;
+    bool isVideo = false;
+    bool eisSupportedSize = false;
+    bool tnrEnabled = false;
     bool isZsl = false;
     uint32_t videoWidth = 0U;
     uint32_t videoHeight = 0U;
@@ -1234,7 +1452,6 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     bool bUseCommonFeatureMask = false;
     uint32_t commonFeatureMask = 0;
     maxViewfinderSize = gCamCapability[mCameraId]->max_viewfinder_size;
-    camera3_stream_t *inputStream = NULL;
     bool isJpeg = false;
     cam_dimension_t jpegSize = {0, 0};
 
@@ -1246,8 +1463,6 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     uint32_t maxEisWidth = 0;
     uint32_t maxEisHeight = 0;
 
-    memset(&mInputStreamInfo, 0, sizeof(mInputStreamInfo));
-
     size_t count = IS_TYPE_MAX;
     count = MIN(gCamCapability[mCameraId]->supported_is_types_cnt, count);
     for (size_t i = 0; i < count; i++) {
@@ -1278,7 +1493,7 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     property_get("persist.camera.eis.enable", eis_prop, "0");
     eis_prop_set = (uint8_t)atoi(eis_prop);
 
-    m_bEisEnable = eis_prop_set && (!oisSupported && eisSupported) &&
+    bool eisEnable = eis_prop_set && (!oisSupported && eisSupported) &&
             (mOpMode != CAMERA3_STREAM_CONFIGURATION_CONSTRAINED_HIGH_SPEED_MODE);
 
     /* stream configurations */
@@ -1293,9 +1508,6 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
                 newStream->stream_type == CAMERA3_STREAM_INPUT){
             isZsl = true;
         }
-        if (newStream->stream_type == CAMERA3_STREAM_INPUT){
-            inputStream = newStream;
-        }
 
         if (newStream->format == HAL_PIXEL_FORMAT_BLOB) {
             isJpeg = true;
@@ -1308,15 +1520,15 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
 
         if ((HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED == newStream->format) &&
                 (newStream->usage & private_handle_t::PRIV_FLAGS_VIDEO_ENCODER)) {
-            m_bIsVideo = true;
+            isVideo = true;
             videoWidth = newStream->width;
             videoHeight = newStream->height;
             if ((VIDEO_4K_WIDTH <= newStream->width) &&
                     (VIDEO_4K_HEIGHT <= newStream->height)) {
-                m_bIs4KVideo = true;
+                is4KVideo = true;
             }
-            m_bEisSupportedSize = (newStream->width <= maxEisWidth) &&
-                                  (newStream->height <= maxEisHeight);
+            eisSupportedSize = (newStream->width <= maxEisWidth) &&
+                               (newStream->height <= maxEisHeight);
         }
         if (newStream->stream_type == CAMERA3_STREAM_BIDIRECTIONAL ||
                 newStream->stream_type == CAMERA3_STREAM_OUTPUT) {
@@ -1381,16 +1593,16 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     }
 
     if (gCamCapability[mCameraId]->position == CAM_POSITION_FRONT ||
-        !m_bIsVideo) {
-        m_bEisEnable = false;
+        !isVideo) {
+        eisEnable = false;
     }
 
     /* Logic to enable/disable TNR based on specific config size/etc.*/
-    if ((m_bTnrPreview || m_bTnrVideo) && m_bIsVideo &&
+    if ((m_bTnrPreview || m_bTnrVideo) && isVideo &&
             ((videoWidth == 1920 && videoHeight == 1080) ||
             (videoWidth == 1280 && videoHeight == 720)) &&
             (mOpMode != CAMERA3_STREAM_CONFIGURATION_CONSTRAINED_HIGH_SPEED_MODE))
-        m_bTnrEnabled = true;
+        tnrEnabled = true;
 
     /* Check if num_streams is sane */
     if (stallStreamCnt > MAX_STALLING_STREAMS ||
@@ -1398,20 +1610,17 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
             processedStreamCnt > MAX_PROCESSED_STREAMS) {
         ALOGE("%s: Invalid stream configu: stall: %d, raw: %d, processed %d",
                 __func__, stallStreamCnt, rawStreamCnt, processedStreamCnt);
-        pthread_mutex_unlock(&mMutex);
         return -EINVAL;
     }
     /* Check whether we have zsl stream or 4k video case */
-    if (isZsl && m_bIsVideo) {
+    if (isZsl && isVideo) {
         ALOGE("%s: Currently invalid configuration ZSL&Video!", __func__);
-        pthread_mutex_unlock(&mMutex);
         return -EINVAL;
     }
     /* Check if stream sizes are sane */
     if (numStreamsOnEncoder > 2) {
         ALOGE("%s: Number of streams on ISP encoder path exceeds limits of 2",
                 __func__);
-        pthread_mutex_unlock(&mMutex);
         return -EINVAL;
     } else if (1 < numStreamsOnEncoder){
         bUseCommonFeatureMask = true;
@@ -1420,10 +1629,9 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     }
 
     /* Check if BLOB size is greater than 4k in 4k recording case */
-    if (m_bIs4KVideo && bJpegExceeds4K) {
+    if (is4KVideo && bJpegExceeds4K) {
         ALOGE("%s: HAL doesn't support Blob size greater than 4k in 4k recording",
                 __func__);
-        pthread_mutex_unlock(&mMutex);
         return -EINVAL;
     }
 
@@ -1438,7 +1646,6 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     if (!isZsl && bJpegOnEncoder && bJpegExceeds4K && bUseCommonFeatureMask) {
         ALOGE("%s: Blob size greater than 4k and multiple streams are on encoder output",
                 __func__);
-        pthread_mutex_unlock(&mMutex);
         return -EINVAL;
     }
 
@@ -1460,103 +1667,256 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     }
     if (rc != NO_ERROR) {
         ALOGE("%s: Invalid stream configuration requested!", __func__);
-        pthread_mutex_unlock(&mMutex);
         return rc;
     }
 
-    camera3_stream_t *zslStream = NULL; //Only use this for size and not actual handle!
-    camera3_stream_t *jpegStream = NULL;
-    for (size_t i = 0; i < streamList->num_streams; i++) {
-        camera3_stream_t *newStream = streamList->streams[i];
-        CDBG_HIGH("%s: newStream type = %d, stream format = %d "
-                "stream size : %d x %d, stream rotation = %d",
-                __func__, newStream->stream_type, newStream->format,
-                newStream->width, newStream->height, newStream->rotation);
-        //if the stream is in the mStreamList validate it
-        bool stream_exists = false;
-        for (List<stream_info_t*>::iterator it=mStreamInfo.begin();
-                it != mStreamInfo.end(); it++) {
-            if ((*it)->stream == newStream) {
-                QCamera3ProcessingChannel *channel =
-                    (QCamera3ProcessingChannel*)(*it)->stream->priv;
-                stream_exists = true;
-                if (channel)
-                    delete channel;
-                (*it)->status = VALID;
-                (*it)->stream->priv = NULL;
-                (*it)->channel = NULL;
-            }
-        }
-        if (!stream_exists && newStream->stream_type != CAMERA3_STREAM_INPUT) {
-            //new stream
-            stream_info_t* stream_info;
-            stream_info = (stream_info_t* )malloc(sizeof(stream_info_t));
-            if (!stream_info) {
-               ALOGE("%s: Could not allocate stream info", __func__);
-               rc = -ENOMEM;
-               pthread_mutex_unlock(&mMutex);
-               return rc;
-            }
-            stream_info->stream = newStream;
-            stream_info->status = VALID;
-            stream_info->channel = NULL;
-            mStreamInfo.push_back(stream_info);
-        }
-        /* Covers Opaque ZSL and API1 F/W ZSL */
-        if (IS_USAGE_ZSL(newStream->usage)
-                || newStream->stream_type == CAMERA3_STREAM_BIDIRECTIONAL ) {
-            if (zslStream != NULL) {
-                ALOGE("%s: Multiple input/reprocess streams requested!", __func__);
-                pthread_mutex_unlock(&mMutex);
-                return BAD_VALUE;
-            }
-            zslStream = newStream;
-        }
-        /* Covers YUV reprocess */
-        if (inputStream != NULL) {
-            if (newStream->stream_type == CAMERA3_STREAM_OUTPUT
-                    && newStream->format == HAL_PIXEL_FORMAT_YCbCr_420_888
-                    && inputStream->format == HAL_PIXEL_FORMAT_YCbCr_420_888
-                    && inputStream->width == newStream->width
-                    && inputStream->height == newStream->height) {
-                if (zslStream != NULL) {
-                    /* This scenario indicates multiple YUV streams with same size
-                     * as input stream have been requested, since zsl stream handle
-                     * is solely use for the purpose of overriding the size of streams
-                     * which share h/w streams we will just make a guess here as to
-                     * which of the stream is a ZSL stream, this will be refactored
-                     * once we make generic logic for streams sharing encoder output
-                     */
-                    CDBG_HIGH("%s: Warning, Multiple ip/reprocess streams requested!", __func__);
-                }
-                zslStream = newStream;
-            }
-        }
-        if (newStream->format == HAL_PIXEL_FORMAT_BLOB) {
-            jpegStream = newStream;
-        }
-    }
+    plan.is_4k_video = is4KVideo;
+    plan.is_video = isVideo;
+    plan.eis_supported_size = eisSupportedSize;
+    plan.eis_enable = eisEnable;
+    plan.tnr_enabled = tnrEnabled;
+    plan.is_zsl = isZsl;
+    plan.use_common_feature_mask = bUseCommonFeatureMask;
+    plan.common_feature_mask = commonFeatureMask;
+    plan.yuv888_override_jpeg = bYuv888OverrideJpeg;
+    plan.large_yuv888_size = largeYuv888Size;
+    plan.video_size.width = (int32_t)videoWidth;
+    plan.video_size.height = (int32_t)videoHeight;
 
-    /* If a zsl stream is set, we know that we have configured at least one input or
-       bidirectional stream */
-    if (NULL != zslStream) {
-        mInputStreamInfo.dim.width = (int32_t)zslStream->width;
-        mInputStreamInfo.dim.height = (int32_t)zslStream->height;
-        mInputStreamInfo.format = zslStream->format;
-        mInputStreamInfo.usage = zslStream->usage;
-        CDBG("%s: Input stream configured! %d x %d, format %d, usage %d",
-                __func__, mInputStreamInfo.dim.width,
-                mInputStreamInfo.dim.height,
-                mInputStreamInfo.format, mInputStreamInfo.usage);
-    }
+    return NO_ERROR;
+}
 
-    cleanAndSortStreamInfo();
-    if (mMetadataChannel) {
-        delete mMetadataChannel;
-        mMetadataChannel = NULL;
-    }
-    if (mSupportChannel) {
-        delete mSupportChannel;
+/*===========================================================================
+ * FUNCTION   : configureStreamsPerfLocked
+ *
+ * DESCRIPTION: configureStreams while perfLock is held.
+ *
+ * PARAMETERS :
+ *   @stream_list : streams to be configured
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCamera3HardwareInterface::configureStreamsPerfLocked(
+        camera3_stream_configuration_t *streamList)
+{
+    ATRACE_CALL();
+    int rc = 0;
+
+    // Sanity check stream_list
+    if (streamList == NULL) {
+        ALOGE("%s: NULL stream configuration", __func__);
+        return BAD_VALUE;
+    }
+    if (streamList->streams == NULL) {
+        ALOGE("%s: NULL stream list", __func__);
+        return BAD_VALUE;
+    }
+
+    if (streamList->num_streams < 1) {
+        ALOGE("%s: Bad number of streams requested: %d", __func__,
+                streamList->num_streams);
+        return BAD_VALUE;
+    }
+
+    if (streamList->num_streams >= MAX_NUM_STREAMS) {
+        ALOGE("%s: Maximum number of streams %d exceeded: %d", __func__,
+                MAX_NUM_STREAMS, streamList->num_streams);
+        return BAD_VALUE;
+    }
+
+    rc = validateUsageFlags(streamList);
+    if (rc != NO_ERROR) {
+        return rc;
+    }
+
+    mOpMode = streamList->operation_mode;
+    CDBG("%s: mOpMode: %d", __func__, mOpMode);
+
+    /* first invalidate all the steams in the mStreamList
+     * if they appear again, they will be validated */
+    mStoppedChannels.clear();
+    for (List<stream_info_t*>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+        QCamera3ProcessingChannel *channel = (QCamera3ProcessingChannel*)(*it)->stream->priv;
+        if (channel) {
+          channel->stop();
+        }
+        (*it)->status = INVALID;
+    }
+
+    if (mRawDumpChannel) {
+        mRawDumpChannel->stop();
+        delete mRawDumpChannel;
+        mRawDumpChannel = NULL;
+    }
+
+    if (mSupportChannel)
+        mSupportChannel->stop();
+
+    if (mAnalysisChannel) {
+        mAnalysisChannel->stop();
+    }
+    if (mMetadataChannel) {
+        /* If content of mStreamInfo is not 0, there is metadata stream */
+        mMetadataChannel->stop();
+    }
+    if (mChannelHandle) {
+        mCameraHandle->ops->stop_channel(mCameraHandle->camera_handle,
+                mChannelHandle);
+        ALOGI("%s: stopping channel %d", __func__, mChannelHandle);
+    }
+
+    pthread_mutex_lock(&mMutex);
+
+    InputStreamInfo prevInputStreamInfo = mInputStreamInfo;
+    memset(&mInputStreamInfo, 0, sizeof(mInputStreamInfo));
+
+    stream_config_plan_t plan;
+    rc = getStreamConfigPlan(streamList, plan);
+    if (rc != NO_ERROR) {
+        pthread_mutex_unlock(&mMutex);
+        return rc;
+    }
+
+    /* Check whether we have video stream */
+    m_bIs4KVideo = plan.is_4k_video;
+    m_bIsVideo = plan.is_video;
+    m_bEisSupportedSize = plan.eis_supported_size;
+    m_bEisEnable = plan.eis_enable;
+    m_bTnrEnabled = plan.tnr_enabled;
+    bool isZsl = plan.is_zsl;
+    uint32_t videoWidth = (uint32_t)plan.video_size.width;
+    uint32_t videoHeight = (uint32_t)plan.video_size.height;
+    bool bYuv888OverrideJpeg = plan.yuv888_override_jpeg;
+    cam_dimension_t largeYuv888Size = plan.large_yuv888_size;
+    bool bUseCommonFeatureMask = plan.use_common_feature_mask;
+    uint32_t commonFeatureMask = plan.common_feature_mask;
+    cam_dimension_t maxViewfinderSize = gCamCapability[mCameraId]->max_viewfinder_size;
+    camera3_stream_t *inputStream = NULL;
+    for (size_t i = 0; i < streamList->num_streams; i++) {
+        if (streamList->streams[i]->stream_type == CAMERA3_STREAM_INPUT) {
+            inputStream = streamList->streams[i];
+        }
+    }
+
+    camera3_stream_t *zslStream = NULL; //Only use this for size and not actual handle!
+    camera3_stream_t *jpegStream = NULL;
+    for (size_t i = 0; i < streamList->num_streams; i++) {
+        camera3_stream_t *newStream = streamList->streams[i];
+        CDBG_HIGH("%s: newStream type = %d, stream format = %d "
+                "stream size : %d x %d, stream rotation = %d",
+                __func__, newStream->stream_type, newStream->format,
+                newStream->width, newStream->height, newStream->rotation);
+        //if the stream is in the mStreamList validate it
+        bool stream_exists = false;
+        for (List<stream_info_t*>::iterator it=mStreamInfo.begin();
+                it != mStreamInfo.end(); it++) {
+            if ((*it)->stream == newStream) {
+                // Its channel is either kept or recreated below
+                stream_exists = true;
+                (*it)->status = VALID;
+            }
+        }
+        if (!stream_exists && newStream->stream_type != CAMERA3_STREAM_INPUT) {
+            //new stream
+            stream_info_t* stream_info;
+            stream_info = (stream_info_t* )malloc(sizeof(stream_info_t));
+            if (!stream_info) {
+               ALOGE("%s: Could not allocate stream info", __func__);
+               rc = -ENOMEM;
+               pthread_mutex_unlock(&mMutex);
+               return rc;
+            }
+            stream_info->stream = newStream;
+            stream_info->status = VALID;
+            stream_info->channel = NULL;
+            mStreamInfo.push_back(stream_info);
+        }
+        /* Covers Opaque ZSL and API1 F/W ZSL */
+        if (IS_USAGE_ZSL(newStream->usage)
+                || newStream->stream_type == CAMERA3_STREAM_BIDIRECTIONAL ) {
+            if (zslStream != NULL) {
+                ALOGE("%s: Multiple input/reprocess streams requested!", __func__);
+                pthread_mutex_unlock(&mMutex);
+                return BAD_VALUE;
+            }
+            zslStream = newStream;
+        }
+        /* Covers YUV reprocess */
+        if (inputStream != NULL) {
+            if (newStream->stream_type == CAMERA3_STREAM_OUTPUT
+                    && newStream->format == HAL_PIXEL_FORMAT_YCbCr_420_888
+                    && inputStream->format == HAL_PIXEL_FORMAT_YCbCr_420_888
+                    && inputStream->width == newStream->width
+                    && inputStream->height == newStream->height) {
+                if (zslStream != NULL) {
+                    /* This scenario indicates multiple YUV streams with same size
+                     * as input stream have been requested, since zsl stream handle
+                     * is solely use for the purpose of overriding the size of streams
+                     * which share h/w streams we will just make a guess here as to
+                     * which of the stream is a ZSL stream, this will be refactored
+                     * once we make generic logic for streams sharing encoder output
+                     */
+                    CDBG_HIGH("%s: Warning, Multiple ip/reprocess streams requested!", __func__);
+                }
+                zslStream = newStream;
+            }
+        }
+        if (newStream->format == HAL_PIXEL_FORMAT_BLOB) {
+            jpegStream = newStream;
+        }
+    }
+
+    /* If a zsl stream is set, we know that we have configured at least one input or
+       bidirectional stream */
+    if (NULL != zslStream) {
+        mInputStreamInfo.dim.width = (int32_t)zslStream->width;
+        mInputStreamInfo.dim.height = (int32_t)zslStream->height;
+        mInputStreamInfo.format = zslStream->format;
+        mInputStreamInfo.usage = zslStream->usage;
+        CDBG("%s: Input stream configured! %d x %d, format %d, usage %d",
+                __func__, mInputStreamInfo.dim.width,
+                mInputStreamInfo.dim.height,
+                mInputStreamInfo.format, mInputStreamInfo.usage);
+    }
+
+    /* Channels of retained streams whose stream did not change are kept
+     * for now. Once the backend parameters of each stream are known under
+     * the new plan, channels created with different ones are recreated. */
+    bool reuseChannels = mReuseChannels && mStreamConfigPlanValid &&
+            (NULL != mMetadataChannel) &&
+            isSameSessionMode(mStreamConfigPlan, plan) &&
+            !memcmp(&prevInputStreamInfo, &mInputStreamInfo,
+                    sizeof(mInputStreamInfo));
+    size_t keptChannels = 0;
+    for (List<stream_info_t*>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+        QCamera3ProcessingChannel *channel =
+                (QCamera3ProcessingChannel*)(*it)->stream->priv;
+        if (((*it)->status != VALID) || (NULL == channel)) {
+            continue;
+        }
+        stream_config_key_t key;
+        getStreamConfigKey((*it)->stream, key);
+        if (reuseChannels && !compareStreamConfigKey(key, (*it)->key)) {
+            keptChannels++;
+            continue;
+        }
+        deleteStreamChannel(*it);
+    }
+    CDBG_HIGH("%s: %zu channels may be kept from previous configuration",
+            __func__, keptChannels);
+
+    cleanAndSortStreamInfo();
+    // Kept channels refer to the metadata channel
+    if (mMetadataChannel && !keptChannels) {
+        delete mMetadataChannel;
+        mMetadataChannel = NULL;
+    }
+    if (mSupportChannel) {
+        delete mSupportChannel;
         mSupportChannel = NULL;
     }
 
@@ -1571,22 +1931,24 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     }
 
     //Create metadata channel and initialize it
-    mMetadataChannel = new QCamera3MetadataChannel(mCameraHandle->camera_handle,
-                    mChannelHandle, mCameraHandle->ops, captureResultCb,
-                    &gCamCapability[mCameraId]->padding_info, CAM_QCOM_FEATURE_NONE, this);
     if (mMetadataChannel == NULL) {
-        ALOGE("%s: failed to allocate metadata channel", __func__);
-        rc = -ENOMEM;
-        pthread_mutex_unlock(&mMutex);
-        return rc;
-    }
-    rc = mMetadataChannel->initialize(IS_TYPE_NONE);
-    if (rc < 0) {
-        ALOGE("%s: metadata channel initialization failed", __func__);
-        delete mMetadataChannel;
-        mMetadataChannel = NULL;
-        pthread_mutex_unlock(&mMutex);
-        return rc;
+        mMetadataChannel = new QCamera3MetadataChannel(mCameraHandle->camera_handle,
+                        mChannelHandle, mCameraHandle->ops, captureResultCb,
+                        &gCamCapability[mCameraId]->padding_info, CAM_QCOM_FEATURE_NONE, this);
+        if (mMetadataChannel == NULL) {
+            ALOGE("%s: failed to allocate metadata channel", __func__);
+            rc = -ENOMEM;
+            pthread_mutex_unlock(&mMutex);
+            return rc;
+        }
+        rc = mMetadataChannel->initialize(IS_TYPE_NONE);
+        if (rc < 0) {
+            ALOGE("%s: metadata channel initialization failed", __func__);
+            delete mMetadataChannel;
+            mMetadataChannel = NULL;
+            pthread_mutex_unlock(&mMutex);
+            return rc;
+        }
     }
 
     // Create analysis stream all the time, even when h/w support is not available
@@ -1610,11 +1972,14 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     }
 
     bool isRawStreamRequested = false;
+    bool setEis = m_bEisEnable && m_bEisSupportedSize;
     memset(&mStreamConfigInfo, 0, sizeof(cam_stream_size_info_t));
     /* Allocate channel objects for the requested streams */
     for (size_t i = 0; i < streamList->num_streams; i++) {
         camera3_stream_t *newStream = streamList->streams[i];
         uint32_t stream_usage = newStream->usage;
+        stream_config_key_t streamKey;
+        getStreamConfigKey(newStream, streamKey);
         mStreamConfigInfo.stream_sizes[mStreamConfigInfo.num_streams].width = (int32_t)newStream->width;
         mStreamConfigInfo.stream_sizes[mStreamConfigInfo.num_streams].height = (int32_t)newStream->height;
         if ((newStream->stream_type == CAMERA3_STREAM_BIDIRECTIONAL
@@ -1731,38 +2096,72 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
 
         }
 
-        if (newStream->priv == NULL) {
-            //New stream, construct channel
-            switch (newStream->stream_type) {
-            case CAMERA3_STREAM_INPUT:
-                newStream->usage |= GRALLOC_USAGE_HW_CAMERA_READ;
-                newStream->usage |= GRALLOC_USAGE_HW_CAMERA_WRITE;//WR for inplace algo's
-                break;
-            case CAMERA3_STREAM_BIDIRECTIONAL:
-                newStream->usage |= GRALLOC_USAGE_HW_CAMERA_READ |
-                    GRALLOC_USAGE_HW_CAMERA_WRITE;
-                break;
-            case CAMERA3_STREAM_OUTPUT:
-                /* For video encoding stream, set read/write rarely
-                 * flag so that they may be set to un-cached */
-                if (newStream->usage & GRALLOC_USAGE_HW_VIDEO_ENCODER)
-                    newStream->usage |=
-                         (GRALLOC_USAGE_SW_READ_RARELY |
-                         GRALLOC_USAGE_SW_WRITE_RARELY |
-                         GRALLOC_USAGE_HW_CAMERA_WRITE);
-                else if (IS_USAGE_ZSL(newStream->usage))
-                    CDBG("%s: ZSL usage flag skipping", __func__);
-                else if (newStream == zslStream
-                        || newStream->format == HAL_PIXEL_FORMAT_YCbCr_420_888) {
-                    newStream->usage |= GRALLOC_USAGE_HW_CAMERA_ZSL;
-                } else
-                    newStream->usage |= GRALLOC_USAGE_HW_CAMERA_WRITE;
-                break;
-            default:
-                ALOGE("%s: Invalid stream_type %d", __func__, newStream->stream_type);
+        stream_info_t *streamInfo = NULL;
+        for (List<stream_info_t*>::iterator it=mStreamInfo.begin();
+                it != mStreamInfo.end(); it++) {
+            if ((*it)->stream == newStream) {
+                streamInfo = *it;
                 break;
             }
+        }
+        stream_channel_config_t chConfig;
+        memset(&chConfig, 0, sizeof(chConfig));
+        chConfig.stream_type = (cam_stream_type_t)
+                mStreamConfigInfo.type[mStreamConfigInfo.num_streams];
+        chConfig.postprocess_mask =
+                mStreamConfigInfo.postprocess_mask[mStreamConfigInfo.num_streams];
+        chConfig.stream_size =
+                mStreamConfigInfo.stream_sizes[mStreamConfigInfo.num_streams];
+        // Same IS type choice as at the first request
+        chConfig.is_type = (setEis &&
+                ((CAM_STREAM_TYPE_PREVIEW == chConfig.stream_type) ||
+                (CAM_STREAM_TYPE_VIDEO == chConfig.stream_type))) ?
+                IS_TYPE_EIS_2_0 : IS_TYPE_NONE;
+        if (newStream->format == HAL_PIXEL_FORMAT_BLOB) {
+            chConfig.num_buffers = m_bIsVideo ? 1 : MAX_INFLIGHT_BLOB;
+            chConfig.is_4k_video = m_bIs4KVideo;
+            chConfig.is_zsl = isZsl;
+        }
+        if ((newStream->priv != NULL) && (streamInfo != NULL) &&
+                !isSameChannelConfig(chConfig, streamInfo->config)) {
+            CDBG_HIGH("%s: Recreating channel of stream %p", __func__, newStream);
+            deleteStreamChannel(streamInfo);
+        }
+
+        // Usage flags are set on kept streams too, the framework resets
+        // them on every configuration
+        switch (newStream->stream_type) {
+        case CAMERA3_STREAM_INPUT:
+            newStream->usage |= GRALLOC_USAGE_HW_CAMERA_READ;
+            newStream->usage |= GRALLOC_USAGE_HW_CAMERA_WRITE;//WR for inplace algo's
+            break;
+        case CAMERA3_STREAM_BIDIRECTIONAL:
+            newStream->usage |= GRALLOC_USAGE_HW_CAMERA_READ |
+                GRALLOC_USAGE_HW_CAMERA_WRITE;
+            break;
+        case CAMERA3_STREAM_OUTPUT:
+            /* For video encoding stream, set read/write rarely
+             * flag so that they may be set to un-cached */
+            if (newStream->usage & GRALLOC_USAGE_HW_VIDEO_ENCODER)
+                newStream->usage |=
+                     (GRALLOC_USAGE_SW_READ_RARELY |
+                     GRALLOC_USAGE_SW_WRITE_RARELY |
+                     GRALLOC_USAGE_HW_CAMERA_WRITE);
+            else if (IS_USAGE_ZSL(newStream->usage))
+                CDBG("%s: ZSL usage flag skipping", __func__);
+            else if (newStream == zslStream
+                    || newStream->format == HAL_PIXEL_FORMAT_YCbCr_420_888) {
+                newStream->usage |= GRALLOC_USAGE_HW_CAMERA_ZSL;
+            } else
+                newStream->usage |= GRALLOC_USAGE_HW_CAMERA_WRITE;
+            break;
+        default:
+            ALOGE("%s: Invalid stream_type %d", __func__, newStream->stream_type);
+            break;
+        }
 
+        if (newStream->priv == NULL) {
+            //New stream, construct channel
             if (newStream->stream_type == CAMERA3_STREAM_OUTPUT ||
                     newStream->stream_type == CAMERA3_STREAM_BIDIRECTIONAL) {
                 QCamera3ProcessingChannel *channel = NULL;
@@ -1895,16 +2294,15 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
                 return -EINVAL;
             }
 
-            for (List<stream_info_t*>::iterator it=mStreamInfo.begin();
-                    it != mStreamInfo.end(); it++) {
-                if ((*it)->stream == newStream) {
-                    (*it)->channel = (QCamera3ProcessingChannel*) newStream->priv;
-                    break;
-                }
+            if (streamInfo != NULL) {
+                streamInfo->channel = (QCamera3ProcessingChannel*) newStream->priv;
+                streamInfo->key = streamKey;
+                streamInfo->config = chConfig;
             }
         } else {
-            // Channel already exists for this stream
-            // Do nothing for now
+            // Channel kept from the previous configuration
+            newStream->max_buffers =
+                    ((QCamera3ProcessingChannel*) newStream->priv)->getNumBuffers();
         }
 
     /* Do not add entries for input stream in metastream info
@@ -2032,6 +2430,9 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     //Get min frame duration for this streams configuration
     deriveMinFrameDuration();
 
+    mStreamConfigPlan = plan;
+    mStreamConfigPlanValid = true;
+
     /* Turn on video hint only if video stream is configured */
 
     pthread_mutex_unlock(&mMutex);
@@ -2379,6 +2780,7 @@ void QCamera3HardwareInterface::handleBatchMetadata(
         frameNumDiff = last_frame_number + 1 -
                 first_frame_number;
         mPendingBatchMap.removeItem(last_frame_number);
+        updateHFRBatchLatency(last_frame_number);
 
         CDBG_HIGH("%s:        frm: valid: %d frm_num: %d - %d",
                 __func__, frame_number_valid,
@@ -2690,21 +3092,17 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
 
             i->timestamp = capture_time;
 
-            // Find channel requiring metadata, meaning internal offline postprocess
-            // is needed.
-            //TODO: for now, we don't support two streams requiring metadata at the same time.
-            // (because we are not making copies, and metadata buffer is not reference counted.
-            bool internalPproc = false;
+            // Find channels requiring metadata, meaning internal offline
+            // postprocess is needed.
+            Vector<QCamera3ProcessingChannel *> ppChannels;
             for (pendingBufferIterator iter = i->buffers.begin();
                     iter != i->buffers.end(); iter++) {
                 if (iter->need_metadata) {
-                    internalPproc = true;
-                    QCamera3ProcessingChannel *channel =
-                            (QCamera3ProcessingChannel *)iter->stream->priv;
-                    channel->queueReprocMetadata(metadata_buf);
-                    break;
+                    ppChannels.push_back(
+                            (QCamera3ProcessingChannel *)iter->stream->priv);
                 }
             }
+            bool internalPproc = !ppChannels.isEmpty();
 
             result.result = translateFromHalMetadata(metadata,
                     i->timestamp, i->request_id, i->jpegMetadata, i->pipeline_depth,
@@ -2737,6 +3135,28 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
                     mMetadataChannel->bufDone(metadata_buf);
                     free(metadata_buf);
                 }
+            } else {
+                // Hand the metadata buffer over to the postprocessors read-only.
+                // Every consumer gets its own super buf and reference, all taken
+                // before the first one is queued. A consumer left without one
+                // still gets a NULL entry, so that its postprocessor fails the
+                // frame instead of waiting for metadata forever.
+                Vector<mm_camera_super_buf_t *> ppMetaBufs;
+                ppMetaBufs.push_back(metadata_buf);
+                for (size_t k = 1; k < ppChannels.size(); k++) {
+                    mm_camera_super_buf_t *ppMetaBuf = (mm_camera_super_buf_t *)
+                            malloc(sizeof(mm_camera_super_buf_t));
+                    if (NULL == ppMetaBuf) {
+                        ALOGE("%s: No memory for metadata super buf", __func__);
+                    } else {
+                        *ppMetaBuf = *metadata_buf;
+                        mMetadataChannel->addBufRef(ppMetaBuf);
+                    }
+                    ppMetaBufs.push_back(ppMetaBuf);
+                }
+                for (size_t k = 0; k < ppMetaBufs.size(); k++) {
+                    ppChannels[k]->queueReprocMetadata(ppMetaBufs[k]);
+                }
             }
         }
         if (!result.result) {
@@ -3273,29 +3693,191 @@ void QCamera3HardwareInterface::unblockRequestIfNecessary()
    pthread_cond_signal(&mRequestCond);
 }
 
-
 /*===========================================================================
- * FUNCTION   : processCaptureRequest
+ * FUNCTION   : resetHFRBatchState
  *
- * DESCRIPTION: process a capture request from camera service
+ * DESCRIPTION: Log the HFR batch statistics of the previous session and
+ *              restart batch depth adaptation. Note that mMutex is held when
+ *              this function is called from processCaptureRequest.
  *
- * PARAMETERS :
- *   @request : request from framework to process
+ * PARAMETERS : None
  *
- * RETURN     :
+ * RETURN     : None
  *
  *==========================================================================*/
-int QCamera3HardwareInterface::processCaptureRequest(
-                    camera3_capture_request_t *request)
+void QCamera3HardwareInterface::resetHFRBatchState()
 {
-    ATRACE_CALL();
-    int rc = NO_ERROR;
-    int32_t request_id;
-    CameraMetadata meta;
-    uint32_t minInFlightRequests = MIN_INFLIGHT_REQUESTS;
-    uint32_t maxInFlightRequests = MAX_INFLIGHT_REQUESTS;
-    bool isVidBufRequested = false;
-    camera3_stream_buffer_t *pInputBuffer = NULL;
+    if (mHFRBatchesFormed || mHFRBatchesPartial || mHFRBatchesFlushed) {
+        CDBG_HIGH("%s: HFR batches formed: %d partial: %d flushed: %d "
+                "request interval: %lld ns result latency: %lld ns",
+                __func__, mHFRBatchesFormed, mHFRBatchesPartial,
+                mHFRBatchesFlushed, (long long)mHFRRequestInterval,
+                (long long)mHFRResultLatency);
+    }
+    mHFRBatchesFormed = 0;
+    mHFRBatchesPartial = 0;
+    mHFRBatchesFlushed = 0;
+    mHFRWarmupFrames = HFR_BATCH_WARMUP_FRAMES;
+    mHFRBatchDepth = mBatchSize;
+    mHFRLastRequestTs = 0;
+    mHFRRequestInterval = 0;
+    mHFRResultLatency = 0;
+    mPendingVideoBatches.clear();
+}
+
+/*===========================================================================
+ * FUNCTION   : getHFRBatchDepth
+ *
+ * DESCRIPTION: Pick the number of video buffers the next HFR batch is closed
+ *              at. Right after configure single frame batches are sent so
+ *              that preview starts without waiting for a full batch. After
+ *              that the depth follows the request cadence, grows by at most
+ *              one frame per batch and shrinks when the result latency goes
+ *              over budget. Under thermal pressure full batches are used to
+ *              cut down per batch overhead. Partial batches still take a
+ *              whole container in the stream, so only a few of them are
+ *              allowed in flight. Note that mMutex is held when this
+ *              function is called.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : batch depth, 1 <= depth <= mBatchSize
+ *
+ *==========================================================================*/
+uint8_t QCamera3HardwareInterface::getHFRBatchDepth()
+{
+    nsecs_t now = systemTime(CLOCK_MONOTONIC);
+    if (mHFRLastRequestTs && mHFRBatchDepth) {
+        nsecs_t interval = (now - mHFRLastRequestTs) / mHFRBatchDepth;
+        if (!mHFRRequestInterval) {
+            mHFRRequestInterval = interval;
+        } else {
+            mHFRRequestInterval +=
+                    (interval - mHFRRequestInterval) >> HFR_BATCH_EWMA_SHIFT;
+        }
+    }
+    mHFRLastRequestTs = now;
+
+    if (!mHFRAdaptiveBatch) {
+        return mBatchSize;
+    }
+
+    // Keep one spare container for a partial batch whose metadata has
+    // come back before its buffers
+    uint32_t partialInFlight = 0;
+    for (size_t i = 0; i < mPendingVideoBatches.size(); i++) {
+        if (mPendingVideoBatches.valueAt(i).depth < mBatchSize) {
+            partialInFlight++;
+        }
+    }
+    if (partialInFlight + 1 >= MAX_HFR_PARTIAL_BATCHES) {
+        return mBatchSize;
+    }
+
+    if (mHFRWarmupFrames) {
+        mHFRWarmupFrames--;
+        return 1;
+    }
+
+    if (*getThermalLevel() >= QCAMERA_THERMAL_SLIGHT_ADJUSTMENT) {
+        return mBatchSize;
+    }
+
+    uint32_t depth = mBatchSize;
+    if (mHFRRequestInterval > 0) {
+        uint32_t cadence =
+                (uint32_t)(HFR_BATCH_FILL_BUDGET_NS / mHFRRequestInterval);
+        depth = MIN(depth, MAX(cadence, 1U));
+    }
+    depth = MIN(depth, (uint32_t)mHFRBatchDepth + 1);
+    if ((mHFRResultLatency > HFR_BATCH_LATENCY_BUDGET_NS) &&
+            (mHFRBatchDepth > 1)) {
+        depth = MIN(depth, (uint32_t)mHFRBatchDepth - 1);
+    }
+
+    return (uint8_t)MAX(depth, 1U);
+}
+
+/*===========================================================================
+ * FUNCTION   : updateHFRBatchLatency
+ *
+ * DESCRIPTION: Account the time from queueing a video batch to receiving its
+ *              metadata. Batches older than the completed one are dropped as
+ *              well since their metadata will not come back. Note that mMutex
+ *              is held when this function is called.
+ *
+ * PARAMETERS :
+ *   @last_frame_number : last frame number of the completed batch
+ *
+ * RETURN     : None
+ *
+ *==========================================================================*/
+void QCamera3HardwareInterface::updateHFRBatchLatency(uint32_t last_frame_number)
+{
+    ssize_t idx = mPendingVideoBatches.indexOfKey(last_frame_number);
+    if (idx >= 0) {
+        nsecs_t latency = systemTime(CLOCK_MONOTONIC) -
+                mPendingVideoBatches.valueAt(idx).queued_ts;
+        if (!mHFRResultLatency) {
+            mHFRResultLatency = latency;
+        } else {
+            mHFRResultLatency +=
+                    (latency - mHFRResultLatency) >> HFR_BATCH_EWMA_SHIFT;
+        }
+    }
+    while (mPendingVideoBatches.size() &&
+            (mPendingVideoBatches.keyAt(0) <= last_frame_number)) {
+        mPendingVideoBatches.removeItemsAt(0);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : thermalEvtHandle
+ *
+ * DESCRIPTION: routine to handle thermal event notification. The level is
+ *              latched by the thermal adapter and sampled at the start of
+ *              every HFR video batch.
+ *
+ * PARAMETERS :
+ *   @level      : thermal level
+ *   @userdata   : userdata passed in during registration
+ *   @data       : opaque data from thermal client
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCamera3HardwareInterface::thermalEvtHandle(
+        qcamera_thermal_level_enum_t *level, void *userdata, void *data)
+{
+    CDBG_HIGH("%s: level = %d, userdata = %p, data = %p",
+            __func__, *level, userdata, data);
+    return NO_ERROR;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : processCaptureRequest
+ *
+ * DESCRIPTION: process a capture request from camera service
+ *
+ * PARAMETERS :
+ *   @request : request from framework to process
+ *
+ * RETURN     :
+ *
+ *==========================================================================*/
+int QCamera3HardwareInterface::processCaptureRequest(
+                    camera3_capture_request_t *request)
+{
+    ATRACE_CALL();
+    int rc = NO_ERROR;
+    int32_t request_id;
+    CameraMetadata meta;
+    uint32_t minInFlightRequests = MIN_INFLIGHT_REQUESTS;
+    uint32_t maxInFlightRequests = MAX_INFLIGHT_REQUESTS;
+    bool isVidBufRequested = false;
+    camera3_stream_buffer_t *pInputBuffer = NULL;
 
     pthread_mutex_lock(&mMutex);
 
@@ -3416,9 +3998,21 @@ int QCamera3HardwareInterface::processCaptureRequest(
         mCameraHandle->ops->set_parms(mCameraHandle->camera_handle,
                     mParameters);
 
+        int32_t sensorModeKey[SENSOR_MODE_KEY_CNT] = {0, 0, -1, -1};
+        if (meta.exists(ANDROID_CONTROL_AE_TARGET_FPS_RANGE)) {
+            sensorModeKey[0] = meta.find(ANDROID_CONTROL_AE_TARGET_FPS_RANGE).data.i32[0];
+            sensorModeKey[1] = meta.find(ANDROID_CONTROL_AE_TARGET_FPS_RANGE).data.i32[1];
+        }
+        if (meta.exists(ANDROID_CONTROL_MODE)) {
+            sensorModeKey[2] = meta.find(ANDROID_CONTROL_MODE).data.u8[0];
+        }
+        if (meta.exists(ANDROID_CONTROL_SCENE_MODE)) {
+            sensorModeKey[3] = meta.find(ANDROID_CONTROL_SCENE_MODE).data.u8[0];
+        }
+
         cam_dimension_t sensor_dim;
         memset(&sensor_dim, 0, sizeof(sensor_dim));
-        rc = getSensorOutputSize(sensor_dim);
+        rc = getSensorOutputSize(sensor_dim, sensorModeKey);
         if (rc != NO_ERROR) {
             ALOGE("%s: Failed to get sensor output size", __func__);
             pthread_mutex_unlock(&mMutex);
@@ -3448,48 +4042,6 @@ int QCamera3HardwareInterface::processCaptureRequest(
             }
         }
 
-        //First initialize all streams
-        for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
-            it != mStreamInfo.end(); it++) {
-            QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
-            if ((((1U << CAM_STREAM_TYPE_VIDEO) == channel->getStreamTypeMask()) ||
-               ((1U << CAM_STREAM_TYPE_PREVIEW) == channel->getStreamTypeMask())) &&
-               setEis)
-                rc = channel->initialize(is_type);
-            else {
-                rc = channel->initialize(IS_TYPE_NONE);
-            }
-            if (NO_ERROR != rc) {
-                ALOGE("%s : Channel initialization failed %d", __func__, rc);
-                pthread_mutex_unlock(&mMutex);
-                goto error_exit;
-            }
-        }
-
-        if (mRawDumpChannel) {
-            rc = mRawDumpChannel->initialize(IS_TYPE_NONE);
-            if (rc != NO_ERROR) {
-                ALOGE("%s: Error: Raw Dump Channel init failed", __func__);
-                pthread_mutex_unlock(&mMutex);
-                goto error_exit;
-            }
-        }
-        if (mSupportChannel) {
-            rc = mSupportChannel->initialize(IS_TYPE_NONE);
-            if (rc < 0) {
-                ALOGE("%s: Support channel initialization failed", __func__);
-                pthread_mutex_unlock(&mMutex);
-                goto error_exit;
-            }
-        }
-        if (mAnalysisChannel) {
-            rc = mAnalysisChannel->initialize(IS_TYPE_NONE);
-            if (rc < 0) {
-                ALOGE("%s: Analysis channel initialization failed", __func__);
-                pthread_mutex_unlock(&mMutex);
-                goto error_exit;
-            }
-        }
         if (mDummyBatchChannel) {
             rc = mDummyBatchChannel->setBatchSize(mBatchSize);
             if (rc < 0) {
@@ -3497,96 +4049,29 @@ int QCamera3HardwareInterface::processCaptureRequest(
                 pthread_mutex_unlock(&mMutex);
                 goto error_exit;
             }
-            rc = mDummyBatchChannel->initialize(is_type);
-            if (rc < 0) {
-                ALOGE("%s: mDummyBatchChannel initialization failed", __func__);
-                pthread_mutex_unlock(&mMutex);
-                goto error_exit;
-            }
         }
 
-        // Set bundle info
-        rc = setBundleInfo();
-        if (rc < 0) {
-            ALOGE("%s: setBundleInfo failed %d", __func__, rc);
+        //First initialize all streams, then set bundle info
+        rc = initStreamChannels(setEis, is_type);
+        if (NO_ERROR != rc) {
+            ALOGE("%s : Channel initialization failed %d", __func__, rc);
             pthread_mutex_unlock(&mMutex);
             goto error_exit;
         }
 
         //Then start them.
-        CDBG_HIGH("%s: Start META Channel", __func__);
-        rc = mMetadataChannel->start();
+        rc = startAllChannels();
         if (rc < 0) {
-            ALOGE("%s: META channel start failed", __func__);
+            ALOGE("%s: startAllChannels failed %d", __func__, rc);
             pthread_mutex_unlock(&mMutex);
             goto error_exit;
         }
 
-        if (mAnalysisChannel) {
-            rc = mAnalysisChannel->start();
-            if (rc < 0) {
-                ALOGE("%s: Analysis channel start failed", __func__);
-                mMetadataChannel->stop();
-                pthread_mutex_unlock(&mMutex);
-                goto error_exit;
-            }
-        }
-
-        if (mSupportChannel) {
-            rc = mSupportChannel->start();
-            if (rc < 0) {
-                ALOGE("%s: Support channel start failed", __func__);
-                mMetadataChannel->stop();
-                /* Although support and analysis are mutually exclusive today
-                   adding it in anycase for future proofing */
-                if (mAnalysisChannel) {
-                    mAnalysisChannel->stop();
-                }
-                pthread_mutex_unlock(&mMutex);
-                goto error_exit;
-            }
-        }
-        for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
-            it != mStreamInfo.end(); it++) {
-            QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
-            CDBG_HIGH("%s: Start Processing Channel mask=%d",
-                    __func__, channel->getStreamTypeMask());
-            rc = channel->start();
-            if (rc < 0) {
-                ALOGE("%s: channel start failed", __func__);
-                pthread_mutex_unlock(&mMutex);
-                goto error_exit;
-            }
-        }
-
-        if (mRawDumpChannel) {
-            CDBG("%s: Starting raw dump stream",__func__);
-            rc = mRawDumpChannel->start();
-            if (rc != NO_ERROR) {
-                ALOGE("%s: Error Starting Raw Dump Channel", __func__);
-                for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
-                      it != mStreamInfo.end(); it++) {
-                    QCamera3Channel *channel =
-                        (QCamera3Channel *)(*it)->stream->priv;
-                    ALOGE("%s: Stopping Processing Channel mask=%d", __func__,
-                        channel->getStreamTypeMask());
-                    channel->stop();
-                }
-                if (mSupportChannel)
-                    mSupportChannel->stop();
-                if (mAnalysisChannel) {
-                    mAnalysisChannel->stop();
-                }
-                mMetadataChannel->stop();
-                pthread_mutex_unlock(&mMutex);
-                goto error_exit;
-            }
-        }
-
         if (mChannelHandle) {
-
-            rc = mCameraHandle->ops->start_channel(mCameraHandle->camera_handle,
-                    mChannelHandle);
+            channel_step_t commit;
+            size_t cnt = 0;
+            addChannelStep(&commit, cnt, CHANNEL_STEP_COMMIT, NULL);
+            rc = runChannelSteps(&commit, cnt);
             if (rc != NO_ERROR) {
                 ALOGE("%s: start_channel failed %d", __func__, rc);
                 pthread_mutex_unlock(&mMutex);
@@ -3605,6 +4090,7 @@ no_error:
         mWokenUpByDaemon = false;
         mPendingLiveRequest = 0;
         mFirstConfiguration = false;
+        resetHFRBatchState();
         enablePowerHint();
     }
 
@@ -3697,6 +4183,9 @@ no_error:
             if (!mToBeQueuedVidBufs) {
                 //start of the batch
                 mFirstFrameNumberInBatch = request->frame_number;
+                if (isVidBufRequested) {
+                    mHFRBatchDepth = getHFRBatchDepth();
+                }
             }
             if(ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters,
                 CAM_INTF_META_FRAME_NUMBER, request->frame_number)) {
@@ -3883,7 +4372,7 @@ no_error:
             if (((1U << CAM_STREAM_TYPE_VIDEO) == channel->getStreamTypeMask())
                     && mBatchSize) {
                 mToBeQueuedVidBufs++;
-                if (mToBeQueuedVidBufs == mBatchSize) {
+                if (mToBeQueuedVidBufs == mHFRBatchDepth) {
                     channel->queueBatchBuf();
                 }
             }
@@ -3896,14 +4385,7 @@ no_error:
         pendingBufferIter++;
     }
 
-    //If 2 streams have need_metadata set to true, fail the request, unless
-    //we copy/reference count the metadata buffer
-    if (streams_need_metadata > 1) {
-        ALOGE("%s: not supporting request in which two streams requires"
-                " 2 HAL metadata for reprocessing", __func__);
-        pthread_mutex_unlock(&mMutex);
-        return -EINVAL;
-    }
+    CDBG("%s: %d streams need metadata", __func__, streams_need_metadata);
 
     if(request->input_buffer == NULL) {
         /* Set the parameters to backend:
@@ -3913,15 +4395,26 @@ no_error:
          */
         if (!mBatchSize ||
            (mBatchSize && !isVidBufRequested) ||
-           (mBatchSize && isVidBufRequested && (mToBeQueuedVidBufs == mBatchSize))) {
-            CDBG("%s: set_parms  batchSz: %d IsVidBufReq: %d vidBufTobeQd: %d ",
-                    __func__, mBatchSize, isVidBufRequested,
+           (mBatchSize && isVidBufRequested && (mToBeQueuedVidBufs == mHFRBatchDepth))) {
+            CDBG("%s: set_parms  batchSz: %d depth: %d IsVidBufReq: %d vidBufTobeQd: %d ",
+                    __func__, mBatchSize, mHFRBatchDepth, isVidBufRequested,
                     mToBeQueuedVidBufs);
             rc = mCameraHandle->ops->set_parms(mCameraHandle->camera_handle,
                     mParameters);
             if (rc < 0) {
                 ALOGE("%s: set_parms failed", __func__);
             }
+            if (mBatchSize && isVidBufRequested) {
+                PendingVideoBatchInfo batchInfo;
+                batchInfo.queued_ts = systemTime(CLOCK_MONOTONIC);
+                batchInfo.depth = mToBeQueuedVidBufs;
+                mPendingVideoBatches.add(frameNumber, batchInfo);
+                if (mToBeQueuedVidBufs < mBatchSize) {
+                    mHFRBatchesPartial++;
+                } else {
+                    mHFRBatchesFormed++;
+                }
+            }
             /* reset to zero coz, the batch is queued */
             mToBeQueuedVidBufs = 0;
             mPendingBatchMap.add(frameNumber, mFirstFrameNumberInBatch);
@@ -4031,6 +4524,25 @@ void QCamera3HardwareInterface::dump(int fd)
     }
     dprintf(fd, "-------+-----------\n");
 
+    static const char *phaseNames[CHANNEL_PHASE_MAX] = {"init", "start", "stop"};
+    static const char *stepNames[] = {"init", "start", "stop", "bundle", "commit"};
+    pthread_mutex_lock(&mChannelStepLogLock);
+    dprintf(fd, "\nChannel steps of last bring-up/tear-down, workers: %u\n",
+            mNumChannelWorkers);
+    dprintf(fd, "-------+--------+-----------------------+----------+-----\n");
+    dprintf(fd, " Phase | Step   | Channel               | Time(us) | rc  \n");
+    dprintf(fd, "-------+--------+-----------------------+----------+-----\n");
+    for (uint32_t p = 0; p < CHANNEL_PHASE_MAX; p++) {
+        for (size_t i = 0; i < mChannelStepLog[p].size(); i++) {
+            const channel_step_t &step = mChannelStepLog[p][i];
+            dprintf(fd, " %5s | %6s | %21s | %8lld | %3d \n", phaseNames[p],
+                    stepNames[step.op], step.name,
+                    (long long)(step.duration / 1000), step.rc);
+        }
+    }
+    dprintf(fd, "-------+--------+-----------------------+----------+-----\n");
+    pthread_mutex_unlock(&mChannelStepLogLock);
+
     dprintf(fd, "\n Camera HAL3 information End \n");
 
     /* use dumpsys media.camera as trigger to send update debug level event */
@@ -4063,6 +4575,11 @@ int QCamera3HardwareInterface::flush()
     }
 
     mFlush = true;
+    if (mBatchSize && mToBeQueuedVidBufs) {
+        /* The staged video buffers stay with the stream and complete the
+         * next batch */
+        mHFRBatchesFlushed++;
+    }
     pthread_mutex_unlock(&mMutex);
 
     rc = stopAllChannels();
@@ -4095,11 +4612,12 @@ int QCamera3HardwareInterface::flush()
         pthread_mutex_unlock(&mMutex);
         return rc;
     }
+    mPendingVideoBatches.clear();
 
     mFlush = false;
 
-    // Start the Streams/Channels
-    rc = startAllChannels();
+    // Restart the Streams/Channels that were running
+    rc = startAllChannels(true);
     if (rc < 0) {
         ALOGE("%s: startAllChannels failed", __func__);
         pthread_mutex_unlock(&mMutex);
@@ -4584,33 +5102,16 @@ QCamera3HardwareInterface::translateFromHalMetadata(
                     uint8_t faceScores[MAX_ROI];
                     int32_t faceRectangles[MAX_ROI * 4];
                     int32_t faceLandmarks[MAX_ROI * 6];
-                    size_t j = 0, k = 0;
+                    bool fullMode = (fwk_faceDetectMode ==
+                            ANDROID_STATISTICS_FACE_DETECT_MODE_FULL);
 
                     for (size_t i = 0; i < numFaces; i++) {
                         faceScores[i] = (uint8_t)faceDetectionInfo->faces[i].score;
-                        // Adjust crop region from sensor output coordinate system to active
-                        // array coordinate system.
-                        cam_rect_t& rect = faceDetectionInfo->faces[i].face_boundary;
-                        mCropRegionMapper.toActiveArray(rect.left, rect.top,
-                                rect.width, rect.height);
-
-                        convertToRegions(faceDetectionInfo->faces[i].face_boundary,
-                                faceRectangles+j, -1);
-
-                        // Map the co-ordinate sensor output coordinate system to active
-                        // array coordinate system.
-                        cam_face_detection_info_t& face = faceDetectionInfo->faces[i];
-                        mCropRegionMapper.toActiveArray(face.left_eye_center.x,
-                                face.left_eye_center.y);
-                        mCropRegionMapper.toActiveArray(face.right_eye_center.x,
-                                face.right_eye_center.y);
-                        mCropRegionMapper.toActiveArray(face.mouth_center.x,
-                                face.mouth_center.y);
-
-                        convertLandmarks(faceDetectionInfo->faces[i], faceLandmarks+k);
-                        j+= 4;
-                        k+= 6;
                     }
+                    // Map rectangles, and landmarks if reported, from sensor
+                    // output coordinate system to active array coordinate system.
+                    mCropRegionMapper.facesToActiveArray(faceDetectionInfo->faces,
+                            numFaces, faceRectangles, fullMode ? faceLandmarks : NULL);
                     if (numFaces <= 0) {
                         memset(faceIds, 0, sizeof(int32_t) * MAX_ROI);
                         memset(faceScores, 0, sizeof(uint8_t) * MAX_ROI);
@@ -4622,8 +5123,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
                             numFaces);
                     camMetadata.update(ANDROID_STATISTICS_FACE_RECTANGLES,
                             faceRectangles, numFaces * 4U);
-                    if (fwk_faceDetectMode ==
-                            ANDROID_STATISTICS_FACE_DETECT_MODE_FULL) {
+                    if (fullMode) {
                         camMetadata.update(ANDROID_STATISTICS_FACE_IDS, faceIds, numFaces);
                         camMetadata.update(ANDROID_STATISTICS_FACE_LANDMARKS,
                                 faceLandmarks, numFaces * 6U);
@@ -4900,10 +5400,8 @@ QCamera3HardwareInterface::translateFromHalMetadata(
         int32_t aeRegions[REGIONS_TUPLE_COUNT];
         // Adjust crop region from sensor output coordinate system to active
         // array coordinate system.
-        mCropRegionMapper.toActiveArray(hAeRegions->rect.left, hAeRegions->rect.top,
-                hAeRegions->rect.width, hAeRegions->rect.height);
-
-        convertToRegions(hAeRegions->rect, aeRegions, hAeRegions->weight);
+        mCropRegionMapper.toActiveArray(hAeRegions->rect, aeRegions);
+        aeRegions[4] = hAeRegions->weight;
         camMetadata.update(ANDROID_CONTROL_AE_REGIONS, aeRegions,
                 REGIONS_TUPLE_COUNT);
         CDBG("%s: Metadata : ANDROID_CONTROL_AE_REGIONS: FWK: [%d,%d,%d,%d] HAL: [%d,%d,%d,%d]",
@@ -4948,10 +5446,8 @@ QCamera3HardwareInterface::translateFromHalMetadata(
         int32_t afRegions[REGIONS_TUPLE_COUNT];
         // Adjust crop region from sensor output coordinate system to active
         // array coordinate system.
-        mCropRegionMapper.toActiveArray(hAfRegions->rect.left, hAfRegions->rect.top,
-                hAfRegions->rect.width, hAfRegions->rect.height);
-
-        convertToRegions(hAfRegions->rect, afRegions, hAfRegions->weight);
+        mCropRegionMapper.toActiveArray(hAfRegions->rect, afRegions);
+        afRegions[4] = hAfRegions->weight;
         camMetadata.update(ANDROID_CONTROL_AF_REGIONS, afRegions,
                 REGIONS_TUPLE_COUNT);
         CDBG("%s: Metadata : ANDROID_CONTROL_AF_REGIONS: FWK: [%d,%d,%d,%d] HAL: [%d,%d,%d,%d]",
@@ -5654,27 +6150,6 @@ bool QCamera3HardwareInterface::resetIfNeededROI(cam_area_t* roi,
     return true;
 }
 
-/*===========================================================================
- * FUNCTION   : convertLandmarks
- *
- * DESCRIPTION: helper method to extract the landmarks from face detection info
- *
- * PARAMETERS :
- *   @face   : cam_rect_t struct to convert
- *   @landmarks : int32_t destination array
- *
- *
- *==========================================================================*/
-void QCamera3HardwareInterface::convertLandmarks(cam_face_detection_info_t face, int32_t *landmarks)
-{
-    landmarks[0] = (int32_t)face.left_eye_center.x;
-    landmarks[1] = (int32_t)face.left_eye_center.y;
-    landmarks[2] = (int32_t)face.right_eye_center.x;
-    landmarks[3] = (int32_t)face.right_eye_center.y;
-    landmarks[4] = (int32_t)face.mouth_center.x;
-    landmarks[5] = (int32_t)face.mouth_center.y;
-}
-
 #define DATA_PTR(MEM_OBJ,INDEX) MEM_OBJ->getPtr( INDEX )
 /*===========================================================================
  * FUNCTION   : initCapabilities
@@ -7336,10 +7811,34 @@ int QCamera3HardwareInterface::getCamInfo(uint32_t cameraId,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : getCdsPreference
+ *
+ * DESCRIPTION: query default CDS mode
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : CDS mode set by persist.camera.CDS, auto if invalid
+ *==========================================================================*/
+cam_cds_mode_type_t QCamera3HardwareInterface::getCdsPreference()
+{
+    char prop[PROPERTY_VALUE_MAX];
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.CDS", prop, "Auto");
+    cam_cds_mode_type_t cds_mode = lookupProp(CDS_MAP,
+            METADATA_MAP_SIZE(CDS_MAP), prop);
+    if (CAM_CDS_MODE_MAX == cds_mode) {
+        cds_mode = CAM_CDS_MODE_AUTO;
+    }
+    return cds_mode;
+}
+
 /*===========================================================================
  * FUNCTION   : translateCapabilityToMetadata
  *
- * DESCRIPTION: translate the capability into camera_metadata_t
+ * DESCRIPTION: translate the capability into camera_metadata_t. Templates
+ *              are built on first use per camera and kept for the lifetime
+ *              of the process like the static metadata.
  *
  * PARAMETERS : type of the request
  *
@@ -7350,8 +7849,16 @@ int QCamera3HardwareInterface::getCamInfo(uint32_t cameraId,
  *==========================================================================*/
 camera_metadata_t* QCamera3HardwareInterface::translateCapabilityToMetadata(int type)
 {
-    if (mDefaultMetadata[type] != NULL) {
-        return mDefaultMetadata[type];
+    if ((type < CAMERA3_TEMPLATE_PREVIEW) || (type >= CAMERA3_TEMPLATE_COUNT)) {
+        ALOGE("%s: Invalid template type %d", __func__, type);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&gCamLock);
+    camera_metadata_t *fwk_settings = gDefaultMetadata[mCameraId][type];
+    pthread_mutex_unlock(&gCamLock);
+    if (fwk_settings != NULL) {
+        return fwk_settings;
     }
     //first time we are handling this request
     //fill up the metadata structure using the wrapper class
@@ -7727,15 +8234,7 @@ camera_metadata_t* QCamera3HardwareInterface::translateCapabilityToMetadata(int
     }
 
     /* CDS default */
-    char prop[PROPERTY_VALUE_MAX];
-    memset(prop, 0, sizeof(prop));
-    property_get("persist.camera.CDS", prop, "Auto");
-    cam_cds_mode_type_t cds_mode = CAM_CDS_MODE_AUTO;
-    cds_mode = lookupProp(CDS_MAP, METADATA_MAP_SIZE(CDS_MAP), prop);
-    if (CAM_CDS_MODE_MAX == cds_mode) {
-        cds_mode = CAM_CDS_MODE_AUTO;
-    }
-    m_CdsPreference = cds_mode;
+    cam_cds_mode_type_t cds_mode = m_CdsPreference;
 
     /* Disabling CDS in templates which have TNR enabled*/
     if (tnr_enable)
@@ -7747,9 +8246,25 @@ camera_metadata_t* QCamera3HardwareInterface::translateCapabilityToMetadata(int
     /* hybrid ae */
     settings.update(NEXUS_EXPERIMENTAL_2016_HYBRID_AE_ENABLE, &hybrid_ae, 1);
 
-    mDefaultMetadata[type] = settings.release();
+    fwk_settings = settings.release();
+    // Trim the spare capacity left by the incremental updates
+    camera_metadata_t *compact = clone_camera_metadata(fwk_settings);
+    if (NULL != compact) {
+        free_camera_metadata(fwk_settings);
+        fwk_settings = compact;
+    }
+
+    pthread_mutex_lock(&gCamLock);
+    if (NULL == gDefaultMetadata[mCameraId][type]) {
+        gDefaultMetadata[mCameraId][type] = fwk_settings;
+    } else {
+        // Built concurrently by another instance of the same camera
+        free_camera_metadata(fwk_settings);
+        fwk_settings = gDefaultMetadata[mCameraId][type];
+    }
+    pthread_mutex_unlock(&gCamLock);
 
-    return mDefaultMetadata[type];
+    return fwk_settings;
 }
 
 /*===========================================================================
@@ -9593,7 +10108,7 @@ int32_t QCamera3HardwareInterface::dynamicUpdateMetaStreamInfo()
                 __func__);
     }
 
-    rc = startAllChannels();
+    rc = startAllChannels(true);
     if (rc < 0) {
         ALOGE("%s: startAllChannels failed", __func__);
         return rc;
@@ -9606,7 +10121,10 @@ int32_t QCamera3HardwareInterface::dynamicUpdateMetaStreamInfo()
 /*===========================================================================
  * FUNCTION   : stopAllChannels
  *
- * DESCRIPTION: This function stops (equivalent to stream-off) all channels
+ * DESCRIPTION: This function stops (equivalent to stream-off) all channels.
+ *              Image channels are stopped in parallel, the metadata channel
+ *              is stopped last. Image channels that were active are
+ *              remembered so that startAllChannels can restart just those.
  *
  * PARAMETERS : None
  *
@@ -9617,29 +10135,41 @@ int32_t QCamera3HardwareInterface::dynamicUpdateMetaStreamInfo()
 int32_t QCamera3HardwareInterface::stopAllChannels()
 {
     int32_t rc = NO_ERROR;
+    channel_step_t steps[MAX_CHANNEL_STEPS];
+    size_t cnt = 0;
+
+    clearChannelStepLog(CHANNEL_PHASE_STOP);
+    mStoppedChannels.clear();
 
     // Stop the Streams/Channels
     for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
         it != mStreamInfo.end(); it++) {
         QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
-        if (channel != nullptr) {
-            channel->stop();
+        if ((channel != nullptr) && channel->isActive()) {
+            addChannelStep(steps, cnt, CHANNEL_STEP_STOP, channel);
         }
         (*it)->status = INVALID;
     }
 
-    if (mSupportChannel) {
-        mSupportChannel->stop();
+    if (mSupportChannel && mSupportChannel->isActive()) {
+        addChannelStep(steps, cnt, CHANNEL_STEP_STOP, mSupportChannel);
     }
-    if (mAnalysisChannel) {
-        mAnalysisChannel->stop();
+    if (mAnalysisChannel && mAnalysisChannel->isActive()) {
+        addChannelStep(steps, cnt, CHANNEL_STEP_STOP, mAnalysisChannel);
     }
-    if (mRawDumpChannel) {
-        mRawDumpChannel->stop();
+    if (mRawDumpChannel && mRawDumpChannel->isActive()) {
+        addChannelStep(steps, cnt, CHANNEL_STEP_STOP, mRawDumpChannel);
     }
+    runChannelSteps(steps, cnt);
+    for (size_t i = 0; i < cnt; i++) {
+        mStoppedChannels.push_back(steps[i].channel);
+    }
+
     if (mMetadataChannel) {
         /* If content of mStreamInfo is not 0, there is metadata stream */
-        mMetadataChannel->stop();
+        cnt = 0;
+        addChannelStep(steps, cnt, CHANNEL_STEP_STOP, mMetadataChannel);
+        runChannelSteps(steps, cnt);
     }
 
     CDBG("%s:%d All channels stopped", __func__, __LINE__);
@@ -9649,230 +10179,660 @@ int32_t QCamera3HardwareInterface::stopAllChannels()
 /*===========================================================================
  * FUNCTION   : startAllChannels
  *
- * DESCRIPTION: This function starts (equivalent to stream-on) all channels
+ * DESCRIPTION: This function starts (equivalent to stream-on) all channels.
+ *              The metadata channel is started first, the image channels
+ *              are then started in parallel. If any of them fails, the ones
+ *              already started are stopped again.
  *
- * PARAMETERS : None
+ * PARAMETERS :
+ *   @stoppedOnly : only restart the image channels that were active when
+ *                  stopAllChannels was last called
  *
  * RETURN     : NO_ERROR on success
  *              Error codes on failure
  *
  *==========================================================================*/
-int32_t QCamera3HardwareInterface::startAllChannels()
+int32_t QCamera3HardwareInterface::startAllChannels(bool stoppedOnly)
 {
     int32_t rc = NO_ERROR;
+    channel_step_t steps[MAX_CHANNEL_STEPS];
+    size_t cnt = 0;
 
     CDBG("%s: Start all channels ", __func__);
+    clearChannelStepLog(CHANNEL_PHASE_START);
+
     // Start the Streams/Channels
     if (mMetadataChannel) {
         /* If content of mStreamInfo is not 0, there is metadata stream */
-        rc = mMetadataChannel->start();
+        addChannelStep(steps, cnt, CHANNEL_STEP_START, mMetadataChannel);
+        rc = runChannelSteps(steps, cnt);
         if (rc < 0) {
             ALOGE("%s: META channel start failed", __func__);
             return rc;
         }
     }
+
+    cnt = 0;
+    if (stoppedOnly) {
+        for (size_t i = 0; i < mStoppedChannels.size(); i++) {
+            addChannelStep(steps, cnt, CHANNEL_STEP_START, mStoppedChannels[i]);
+        }
+    } else {
+        for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+            QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
+            addChannelStep(steps, cnt, CHANNEL_STEP_START, channel);
+        }
+        if (mAnalysisChannel) {
+            addChannelStep(steps, cnt, CHANNEL_STEP_START, mAnalysisChannel);
+        }
+        if (mSupportChannel) {
+            addChannelStep(steps, cnt, CHANNEL_STEP_START, mSupportChannel);
+        }
+        if (mRawDumpChannel) {
+            addChannelStep(steps, cnt, CHANNEL_STEP_START, mRawDumpChannel);
+        }
+    }
+    mStoppedChannels.clear();
+    rc = runChannelSteps(steps, cnt);
+    if (rc < 0) {
+        ALOGE("%s: channel start failed %d", __func__, rc);
+        channel_step_t stopSteps[MAX_CHANNEL_STEPS];
+        size_t started = 0;
+        for (size_t i = 0; i < cnt; i++) {
+            if (NO_ERROR == steps[i].rc) {
+                addChannelStep(stopSteps, started, CHANNEL_STEP_STOP,
+                        steps[i].channel);
+            }
+        }
+        runChannelSteps(stopSteps, started);
+        if (mMetadataChannel) {
+            started = 0;
+            addChannelStep(stopSteps, started, CHANNEL_STEP_STOP,
+                    mMetadataChannel);
+            runChannelSteps(stopSteps, started);
+        }
+        return rc;
+    }
+
+    CDBG("%s:%d All channels started", __func__, __LINE__);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : initStreamChannels
+ *
+ * DESCRIPTION: Initialize all image channels in parallel, then set the bundle
+ *              info on them. The metadata channel is initialized when the
+ *              streams are configured.
+ *
+ * PARAMETERS :
+ *   @setEis  : whether EIS is applied to preview and video channels
+ *   @is_type : image stabilization type of preview and video channels
+ *
+ * RETURN     : NO_ERROR on success
+ *              Error codes on failure
+ *==========================================================================*/
+int32_t QCamera3HardwareInterface::initStreamChannels(bool setEis,
+        cam_is_type_t is_type)
+{
+    int32_t rc = NO_ERROR;
+    channel_step_t steps[MAX_CHANNEL_STEPS];
+    size_t cnt = 0;
+
+    clearChannelStepLog(CHANNEL_PHASE_INIT);
+
     for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
         it != mStreamInfo.end(); it++) {
         QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
-        rc = channel->start();
-        if (rc < 0) {
-            ALOGE("%s: channel start failed", __func__);
-            return rc;
+        if ((((1U << CAM_STREAM_TYPE_VIDEO) == channel->getStreamTypeMask()) ||
+           ((1U << CAM_STREAM_TYPE_PREVIEW) == channel->getStreamTypeMask())) &&
+           setEis)
+            addChannelStep(steps, cnt, CHANNEL_STEP_INIT, channel, is_type);
+        else {
+            addChannelStep(steps, cnt, CHANNEL_STEP_INIT, channel);
         }
     }
-    if (mAnalysisChannel) {
-        mAnalysisChannel->start();
+    if (mRawDumpChannel) {
+        addChannelStep(steps, cnt, CHANNEL_STEP_INIT, mRawDumpChannel);
     }
     if (mSupportChannel) {
-        rc = mSupportChannel->start();
-        if (rc < 0) {
-            ALOGE("%s: Support channel start failed", __func__);
-            return rc;
-        }
+        addChannelStep(steps, cnt, CHANNEL_STEP_INIT, mSupportChannel);
     }
-    if (mRawDumpChannel) {
-        rc = mRawDumpChannel->start();
-        if (rc < 0) {
-            ALOGE("%s: RAW dump channel start failed", __func__);
-            return rc;
-        }
+    if (mAnalysisChannel) {
+        addChannelStep(steps, cnt, CHANNEL_STEP_INIT, mAnalysisChannel);
+    }
+    if (mDummyBatchChannel) {
+        addChannelStep(steps, cnt, CHANNEL_STEP_INIT, mDummyBatchChannel, is_type);
+    }
+    rc = runChannelSteps(steps, cnt);
+    if (rc != NO_ERROR) {
+        return rc;
     }
 
-    CDBG("%s:%d All channels started", __func__, __LINE__);
-    return rc;
+    // Bundle info needs the stream handles of all channels
+    cnt = 0;
+    addChannelStep(steps, cnt, CHANNEL_STEP_BUNDLE, NULL);
+    return runChannelSteps(steps, cnt);
 }
 
 /*===========================================================================
- * FUNCTION   : notifyErrorForPendingRequests
+ * FUNCTION   : addChannelStep
  *
- * DESCRIPTION: This function sends error for all the pending requests/buffers
+ * DESCRIPTION: Append a step to a list of channel steps
  *
- * PARAMETERS : None
+ * PARAMETERS :
+ *   @steps   : step list of MAX_CHANNEL_STEPS entries
+ *   @cnt     : number of steps in the list, incremented on success
+ *   @op      : step operation
+ *   @channel : channel the step operates on, NULL for bundle wide steps
+ *   @is_type : image stabilization type for INIT steps
  *
- * RETURN     : Error codes
- *              NO_ERROR on success
+ * RETURN     : NO_ERROR on success
+ *              NO_MEMORY if the step list is full
+ *==========================================================================*/
+int32_t QCamera3HardwareInterface::addChannelStep(channel_step_t *steps,
+        size_t &cnt, channel_step_op_t op, QCamera3Channel *channel,
+        cam_is_type_t is_type)
+{
+    if (cnt >= MAX_CHANNEL_STEPS) {
+        ALOGE("%s: Too many channel steps, dropping step %d", __func__, op);
+        return NO_MEMORY;
+    }
+
+    channel_step_t &step = steps[cnt++];
+    step.op = op;
+    step.channel = channel;
+    step.is_type = is_type;
+    getChannelStepName(channel, step.name, sizeof(step.name));
+    step.rc = NO_ERROR;
+    step.duration = 0;
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : runChannelSteps
+ *
+ * DESCRIPTION: Run a list of independent channel steps and wait for all of
+ *              them. The calling thread runs steps itself, and for more than
+ *              one step wakes workers of the pool to claim the rest. Runs
+ *              are independent of each other, so no lock is held while the
+ *              steps execute. Step results and durations are appended to the
+ *              step log.
+ *
+ * PARAMETERS :
+ *   @steps : steps to be run, rc and duration are filled in
+ *   @cnt   : number of steps
  *
+ * RETURN     : NO_ERROR if all steps succeeded
+ *              rc of the first failed step otherwise
  *==========================================================================*/
-int32_t QCamera3HardwareInterface::notifyErrorForPendingRequests()
+int32_t QCamera3HardwareInterface::runChannelSteps(channel_step_t *steps,
+        size_t cnt)
 {
     int32_t rc = NO_ERROR;
-    unsigned int frameNum = 0;
-    camera3_capture_result_t result;
-    camera3_stream_buffer_t *pStream_Buf = NULL;
-    FlushMap flushMap;
-
-    memset(&result, 0, sizeof(camera3_capture_result_t));
+    channel_run_t run;
+    uint32_t queued = 0;
 
-    if (mPendingRequestsList.size() > 0) {
-        pendingRequestIterator i = mPendingRequestsList.begin();
-        frameNum = i->frame_number;
-    } else {
-        /* There might still be pending buffers even though there are
-         no pending requests. Setting the frameNum to MAX so that
-         all the buffers with smaller frame numbers are returned */
-        frameNum = UINT_MAX;
+    if (0 == cnt) {
+        return rc;
     }
 
-    CDBG_HIGH("%s: Oldest frame num on  mPendingRequestsList = %d",
-      __func__, frameNum);
+    run.steps = steps;
+    run.cnt = cnt;
+    run.next = 0;
+    cam_sem_init(&run.done, 0);
 
-    // Go through the pending buffers and group them depending
-    // on frame number
-    for (List<PendingBufferInfo>::iterator k =
-            mPendingBuffersMap.mPendingBufferList.begin();
-            k != mPendingBuffersMap.mPendingBufferList.end();) {
-
-        if (k->frame_number < frameNum) {
-            ssize_t idx = flushMap.indexOfKey(k->frame_number);
-            if (idx == NAME_NOT_FOUND) {
-                Vector<PendingBufferInfo> pending;
-                pending.add(*k);
-                flushMap.add(k->frame_number, pending);
-            } else {
-                Vector<PendingBufferInfo> &pending =
-                        flushMap.editValueFor(k->frame_number);
-                pending.add(*k);
+    if (cnt > 1) {
+        pthread_mutex_lock(&mChannelRunLock);
+        if (NO_ERROR == launchChannelWorkers()) {
+            queued = (uint32_t)MIN(cnt - 1, mNumChannelWorkers);
+            for (uint32_t i = 0; i < queued; i++) {
+                mChannelRuns.push_back(&run);
             }
+        }
+        pthread_mutex_unlock(&mChannelRunLock);
+        for (uint32_t i = 0; i < queued; i++) {
+            mChannelWorkers[i].thread.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB,
+                    FALSE, FALSE);
+        }
+    }
 
-            mPendingBuffersMap.num_buffers--;
-            k = mPendingBuffersMap.mPendingBufferList.erase(k);
+    drainChannelRun(&run);
+
+    // Workers busy with other runs may not have picked this one up. Take
+    // those entries back, then wait for the workers that did.
+    uint32_t taken = queued;
+    pthread_mutex_lock(&mChannelRunLock);
+    for (List<channel_run_t *>::iterator it = mChannelRuns.begin();
+            it != mChannelRuns.end();) {
+        if (*it == &run) {
+            it = mChannelRuns.erase(it);
+            taken--;
         } else {
-            k++;
+            it++;
         }
     }
+    pthread_mutex_unlock(&mChannelRunLock);
+    for (uint32_t i = 0; i < taken; i++) {
+        cam_sem_wait(&run.done);
+    }
+    cam_sem_destroy(&run.done);
+
+    pthread_mutex_lock(&mChannelStepLogLock);
+    for (size_t i = 0; i < cnt; i++) {
+        mChannelStepLog[getChannelStepPhase(steps[i].op)].push_back(steps[i]);
+    }
+    pthread_mutex_unlock(&mChannelStepLogLock);
 
-    for (size_t iFlush = 0; iFlush < flushMap.size(); iFlush++) {
-        uint32_t frame_number = flushMap.keyAt(iFlush);
-        const Vector<PendingBufferInfo> &pending = flushMap.valueAt(iFlush);
+    for (size_t i = 0; i < cnt; i++) {
+        if (NO_ERROR != steps[i].rc) {
+            ALOGE("%s: Step %d on %s channel failed %d", __func__,
+                    steps[i].op, steps[i].name, steps[i].rc);
+            if (NO_ERROR == rc) {
+                rc = steps[i].rc;
+            }
+        }
+    }
 
-        // Send Error notify to frameworks for each buffer for which
-        // metadata buffer is already sent
-        CDBG_HIGH("%s: Sending ERROR BUFFER for frame %d number of buffer %d",
-          __func__, frame_number, pending.size());
+    return rc;
+}
 
-        pStream_Buf = new camera3_stream_buffer_t[pending.size()];
-        if (NULL == pStream_Buf) {
-            ALOGE("%s: No memory for pending buffers array", __func__);
-            return NO_MEMORY;
+/*===========================================================================
+ * FUNCTION   : drainChannelRun
+ *
+ * DESCRIPTION: Claim and run steps of a run until none is left
+ *
+ * PARAMETERS :
+ *   @run : run to take steps from
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::drainChannelRun(channel_run_t *run)
+{
+    while (true) {
+        size_t idx;
+        pthread_mutex_lock(&mChannelRunLock);
+        idx = run->next;
+        if (idx < run->cnt) {
+            run->next++;
+        }
+        pthread_mutex_unlock(&mChannelRunLock);
+        if (idx >= run->cnt) {
+            break;
         }
-        memset(pStream_Buf, 0, sizeof(camera3_stream_buffer_t)*pending.size());
+        executeChannelStep(run->steps[idx]);
+    }
+}
 
-        for (size_t j = 0; j < pending.size(); j++) {
-            const PendingBufferInfo &info = pending.itemAt(j);
-            camera3_notify_msg_t notify_msg;
-            memset(&notify_msg, 0, sizeof(camera3_notify_msg_t));
-            notify_msg.type = CAMERA3_MSG_ERROR;
-            notify_msg.message.error.error_code = CAMERA3_MSG_ERROR_BUFFER;
-            notify_msg.message.error.error_stream = info.stream;
-            notify_msg.message.error.frame_number = frame_number;
-            pStream_Buf[j].acquire_fence = -1;
-            pStream_Buf[j].release_fence = -1;
-            pStream_Buf[j].buffer = info.buffer;
-            pStream_Buf[j].status = CAMERA3_BUFFER_STATUS_ERROR;
-            pStream_Buf[j].stream = info.stream;
-            mCallbackOps->notify(mCallbackOps, &notify_msg);
-            CDBG_HIGH("%s: notify frame_number = %d stream %p", __func__,
-                    frame_number, info.stream);
+/*===========================================================================
+ * FUNCTION   : dequeueChannelRun
+ *
+ * DESCRIPTION: Take the oldest run waiting for a worker
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : run to help with, NULL if there is none
+ *==========================================================================*/
+channel_run_t *QCamera3HardwareInterface::dequeueChannelRun()
+{
+    channel_run_t *run = NULL;
+
+    pthread_mutex_lock(&mChannelRunLock);
+    if (!mChannelRuns.empty()) {
+        run = *mChannelRuns.begin();
+        mChannelRuns.erase(mChannelRuns.begin());
+    }
+    pthread_mutex_unlock(&mChannelRunLock);
+    return run;
+}
+
+/*===========================================================================
+ * FUNCTION   : executeChannelStep
+ *
+ * DESCRIPTION: Run one channel step and time it
+ *
+ * PARAMETERS :
+ *   @step : step to be run, rc and duration are filled in
+ *
+ * RETURN     : rc of the step
+ *==========================================================================*/
+int32_t QCamera3HardwareInterface::executeChannelStep(channel_step_t &step)
+{
+    nsecs_t start = systemTime(CLOCK_MONOTONIC);
+
+    switch (step.op) {
+    case CHANNEL_STEP_INIT:
+        step.rc = step.channel->initialize(step.is_type);
+        break;
+    case CHANNEL_STEP_START:
+        step.rc = step.channel->start();
+        break;
+    case CHANNEL_STEP_STOP:
+        step.rc = step.channel->stop();
+        break;
+    case CHANNEL_STEP_BUNDLE:
+        step.rc = setBundleInfo();
+        break;
+    case CHANNEL_STEP_COMMIT:
+        step.rc = mCameraHandle->ops->start_channel(mCameraHandle->camera_handle,
+                mChannelHandle);
+        break;
+    default:
+        step.rc = BAD_VALUE;
+        break;
+    }
+
+    step.duration = systemTime(CLOCK_MONOTONIC) - start;
+    CDBG("%s: Step %d on %s channel took %lld us, rc %d", __func__, step.op,
+            step.name, (long long)(step.duration / 1000), step.rc);
+    return step.rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : getChannelStepName
+ *
+ * DESCRIPTION: Name a channel for the step logs and dump. Stream channels
+ *              are named after their stream type and postprocess mask.
+ *
+ * PARAMETERS :
+ *   @channel : channel of the step, NULL for bundle wide steps
+ *   @name    : buffer the name is written to
+ *   @len     : size of the buffer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::getChannelStepName(QCamera3Channel *channel,
+        char *name, size_t len)
+{
+    static const char *streamTypeNames[CAM_STREAM_TYPE_MAX] = {
+        "default", "preview", "postview", "snapshot", "video", "callback",
+        "impl def", "metadata", "raw", "offline", "parm", "analysis"};
+
+    if (NULL == channel) {
+        strlcpy(name, "bundle", len);
+    } else if (channel == mMetadataChannel) {
+        strlcpy(name, "metadata", len);
+    } else if (channel == mAnalysisChannel) {
+        strlcpy(name, "analysis", len);
+    } else if (channel == mSupportChannel) {
+        strlcpy(name, "support", len);
+    } else if (channel == mRawDumpChannel) {
+        strlcpy(name, "raw dump", len);
+    } else if (channel == mDummyBatchChannel) {
+        strlcpy(name, "dummy batch", len);
+    } else {
+        strlcpy(name, "stream", len);
+        for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
+                it != mStreamInfo.end(); it++) {
+            if ((*it)->stream->priv == channel) {
+                cam_stream_type_t type = (*it)->config.stream_type;
+                snprintf(name, len, "%s 0x%x",
+                        (type < CAM_STREAM_TYPE_MAX) ?
+                        streamTypeNames[type] : "stream",
+                        (*it)->config.postprocess_mask);
+                break;
+            }
         }
+    }
+}
 
-        result.result = NULL;
-        result.frame_number = frame_number;
-        result.num_output_buffers = (uint32_t)pending.size();
-        result.output_buffers = pStream_Buf;
-        mCallbackOps->process_capture_result(mCallbackOps, &result);
+/*===========================================================================
+ * FUNCTION   : launchChannelWorkers
+ *
+ * DESCRIPTION: Launch the channel worker pool on first use. Note that
+ *              mChannelRunLock is held when this function is called.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : NO_ERROR if the pool is running
+ *              INVALID_OPERATION if steps run on the calling thread
+ *==========================================================================*/
+int32_t QCamera3HardwareInterface::launchChannelWorkers()
+{
+    if (mNumChannelWorkers <= 1) {
+        return INVALID_OPERATION;
+    }
+    if (!mChannelWorkersLaunched) {
+        for (uint32_t i = 0; i < mNumChannelWorkers; i++) {
+            mChannelWorkers[i].thread.launch(channelWorkerRoutine,
+                    &mChannelWorkers[i]);
+        }
+        mChannelWorkersLaunched = true;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : exitChannelWorkers
+ *
+ * DESCRIPTION: Exit the channel worker pool
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::exitChannelWorkers()
+{
+    bool launched;
 
-        delete [] pStream_Buf;
+    // Workers take mChannelRunLock, so they are joined without it
+    pthread_mutex_lock(&mChannelRunLock);
+    launched = mChannelWorkersLaunched;
+    mChannelWorkersLaunched = false;
+    pthread_mutex_unlock(&mChannelRunLock);
+    if (launched) {
+        for (uint32_t i = 0; i < mNumChannelWorkers; i++) {
+            mChannelWorkers[i].thread.exit();
+        }
     }
+}
 
-    CDBG_HIGH("%s:Sending ERROR REQUEST for all pending requests", __func__);
+/*===========================================================================
+ * FUNCTION   : channelWorkerRoutine
+ *
+ * DESCRIPTION: Channel worker thread, helps with queued channel step runs
+ *
+ * PARAMETERS :
+ *   @data : channel worker the thread belongs to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCamera3HardwareInterface::channelWorkerRoutine(void *data)
+{
+    int running = 1;
+    int ret;
+    channel_worker_t *worker = (channel_worker_t *)data;
+    QCamera3HardwareInterface *hw = worker->hw;
+    QCameraCmdThread *cmdThread = &worker->thread;
+    cmdThread->setName("cam_chan_work");
 
-    flushMap.clear();
-    for (List<PendingBufferInfo>::iterator k =
-            mPendingBuffersMap.mPendingBufferList.begin();
-            k != mPendingBuffersMap.mPendingBufferList.end();) {
-        ssize_t idx = flushMap.indexOfKey(k->frame_number);
-        if (idx == NAME_NOT_FOUND) {
-            Vector<PendingBufferInfo> pending;
-            pending.add(*k);
-            flushMap.add(k->frame_number, pending);
-        } else {
-            Vector<PendingBufferInfo> &pending =
-                    flushMap.editValueFor(k->frame_number);
-            pending.add(*k);
+    CDBG("%s: E", __func__);
+    do {
+        ret = cmdThread->waitCmd();
+        if (ret != NO_ERROR) {
+            ALOGE("%s: waitCmd error (%d)", __func__, ret);
+            return NULL;
+        }
+
+        camera_cmd_type_t cmd = cmdThread->getCmd();
+        switch (cmd) {
+        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
+            {
+                channel_run_t *run = NULL;
+                while (NULL != (run = hw->dequeueChannelRun())) {
+                    hw->drainChannelRun(run);
+                    cam_sem_post(&run->done);
+                }
+            }
+            break;
+        case CAMERA_CMD_TYPE_EXIT:
+            CDBG_HIGH("%s: Exit", __func__);
+            running = 0;
+            break;
+        default:
+            break;
         }
+    } while (running);
+    CDBG("%s: X", __func__);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : clearChannelStepLog
+ *
+ * DESCRIPTION: Drop the step timings of a phase before it is run again
+ *
+ * PARAMETERS :
+ *   @phase : bring-up or tear-down phase
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::clearChannelStepLog(channel_phase_t phase)
+{
+    pthread_mutex_lock(&mChannelStepLogLock);
+    mChannelStepLog[phase].clear();
+    pthread_mutex_unlock(&mChannelStepLogLock);
+}
 
-        mPendingBuffersMap.num_buffers--;
-        k = mPendingBuffersMap.mPendingBufferList.erase(k);
+/*===========================================================================
+ * FUNCTION   : getChannelStepPhase
+ *
+ * DESCRIPTION: Phase the timing of a channel step is reported in
+ *
+ * PARAMETERS :
+ *   @op : step operation
+ *
+ * RETURN     : channel phase
+ *==========================================================================*/
+channel_phase_t QCamera3HardwareInterface::getChannelStepPhase(
+        channel_step_op_t op)
+{
+    switch (op) {
+    case CHANNEL_STEP_INIT:
+    case CHANNEL_STEP_BUNDLE:
+        return CHANNEL_PHASE_INIT;
+    case CHANNEL_STEP_STOP:
+        return CHANNEL_PHASE_STOP;
+    case CHANNEL_STEP_START:
+    case CHANNEL_STEP_COMMIT:
+    default:
+        return CHANNEL_PHASE_START;
     }
+}
 
-    pendingRequestIterator i = mPendingRequestsList.begin(); //make sure i is at the beginning
+/*===========================================================================
+ * FUNCTION   : notifyErrorForPendingRequests
+ *
+ * DESCRIPTION: This function sends error for all the pending requests/buffers.
+ *              Pending buffers are appended in frame number order, so the
+ *              buffers of a frame are adjacent and are returned in one pass
+ *              together with the matching pending request.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : Error codes
+ *              NO_ERROR on success
+ *
+ *==========================================================================*/
+int32_t QCamera3HardwareInterface::notifyErrorForPendingRequests()
+{
+    int32_t rc = NO_ERROR;
+    camera3_capture_result_t result;
+    camera3_notify_msg_t notify_msg;
+    camera3_stream_buffer_t streamBufs[MAX_NUM_STREAMS];
+    pendingRequestIterator req = mPendingRequestsList.begin();
+    List<PendingBufferInfo>::iterator k =
+            mPendingBuffersMap.mPendingBufferList.begin();
+
+    /* Buffers older than the oldest pending request belong to requests
+     * whose metadata was already sent */
+    uint32_t oldestFrameNum = (req != mPendingRequestsList.end()) ?
+            req->frame_number : UINT_MAX;
+    CDBG_HIGH("%s: Oldest frame num on  mPendingRequestsList = %d",
+      __func__, oldestFrameNum);
+
+    while (k != mPendingBuffersMap.mPendingBufferList.end()) {
+        uint32_t frame_number = k->frame_number;
+        bool requestError = (frame_number >= oldestFrameNum);
+        camera3_stream_buffer_t *inputBuffer = NULL;
+
+        if (requestError) {
+            /* Pending requests before this frame have no buffers left, only
+             * their result metadata is missing */
+            while ((req != mPendingRequestsList.end()) &&
+                    (req->frame_number < frame_number)) {
+                req = notifyErrorForRequestResult(req);
+            }
+            if ((req != mPendingRequestsList.end()) &&
+                    (req->frame_number == frame_number)) {
+                inputBuffer = req->input_buffer;
+            }
+
+            CDBG_HIGH("%s:Sending ERROR REQUEST for frame %d",
+                    __func__, frame_number);
+            memset(&notify_msg, 0, sizeof(camera3_notify_msg_t));
+            notify_msg.type = CAMERA3_MSG_ERROR;
+            notify_msg.message.error.error_code = CAMERA3_MSG_ERROR_REQUEST;
+            notify_msg.message.error.error_stream = NULL;
+            notify_msg.message.error.frame_number = frame_number;
+            mCallbackOps->notify(mCallbackOps, &notify_msg);
+        }
 
-    // Go through the pending requests info and send error request to framework
-    for (size_t iFlush = 0; iFlush < flushMap.size(); iFlush++) {
-        uint32_t frame_number = flushMap.keyAt(iFlush);
-        const Vector<PendingBufferInfo> &pending = flushMap.valueAt(iFlush);
-        CDBG_HIGH("%s:Sending ERROR REQUEST for frame %d",
-              __func__, frame_number);
+        size_t cnt = 0;
+        while ((k != mPendingBuffersMap.mPendingBufferList.end()) &&
+                (k->frame_number == frame_number)) {
+            if (!requestError) {
+                // Send Error notify to frameworks for each buffer for which
+                // metadata buffer is already sent
+                memset(&notify_msg, 0, sizeof(camera3_notify_msg_t));
+                notify_msg.type = CAMERA3_MSG_ERROR;
+                notify_msg.message.error.error_code = CAMERA3_MSG_ERROR_BUFFER;
+                notify_msg.message.error.error_stream = k->stream;
+                notify_msg.message.error.frame_number = frame_number;
+                mCallbackOps->notify(mCallbackOps, &notify_msg);
+                CDBG_HIGH("%s: notify frame_number = %d stream %p", __func__,
+                        frame_number, k->stream);
+            }
 
-        // Send shutter notify to frameworks
-        camera3_notify_msg_t notify_msg;
-        memset(&notify_msg, 0, sizeof(camera3_notify_msg_t));
-        notify_msg.type = CAMERA3_MSG_ERROR;
-        notify_msg.message.error.error_code = CAMERA3_MSG_ERROR_REQUEST;
-        notify_msg.message.error.error_stream = NULL;
-        notify_msg.message.error.frame_number = frame_number;
-        mCallbackOps->notify(mCallbackOps, &notify_msg);
+            streamBufs[cnt].acquire_fence = -1;
+            streamBufs[cnt].release_fence = -1;
+            streamBufs[cnt].buffer = k->buffer;
+            streamBufs[cnt].status = CAMERA3_BUFFER_STATUS_ERROR;
+            streamBufs[cnt].stream = k->stream;
+            cnt++;
+            mPendingBuffersMap.num_buffers--;
+            k = mPendingBuffersMap.mPendingBufferList.erase(k);
 
-        pStream_Buf = new camera3_stream_buffer_t[pending.size()];
-        if (NULL == pStream_Buf) {
-            ALOGE("%s: No memory for pending buffers array", __func__);
-            return NO_MEMORY;
+            if ((cnt == MAX_NUM_STREAMS) ||
+                    (k == mPendingBuffersMap.mPendingBufferList.end()) ||
+                    (k->frame_number != frame_number)) {
+                memset(&result, 0, sizeof(camera3_capture_result_t));
+                result.result = NULL;
+                result.frame_number = frame_number;
+                result.input_buffer = inputBuffer;
+                result.num_output_buffers = (uint32_t)cnt;
+                result.output_buffers = streamBufs;
+                mCallbackOps->process_capture_result(mCallbackOps, &result);
+                inputBuffer = NULL;
+                cnt = 0;
+            }
         }
-        memset(pStream_Buf, 0, sizeof(camera3_stream_buffer_t)*pending.size());
 
-        for (size_t j = 0; j < pending.size(); j++) {
-            const PendingBufferInfo &info = pending.itemAt(j);
-            pStream_Buf[j].acquire_fence = -1;
-            pStream_Buf[j].release_fence = -1;
-            pStream_Buf[j].buffer = info.buffer;
-            pStream_Buf[j].status = CAMERA3_BUFFER_STATUS_ERROR;
-            pStream_Buf[j].stream = info.stream;
+        if (requestError && (req != mPendingRequestsList.end()) &&
+                (req->frame_number == frame_number)) {
+            req = erasePendingRequest(req);
         }
+    }
 
-        result.input_buffer = i->input_buffer;
-        result.num_output_buffers = (uint32_t)pending.size();
-        result.output_buffers = pStream_Buf;
-        result.result = NULL;
-        result.frame_number = frame_number;
-        mCallbackOps->process_capture_result(mCallbackOps, &result);
-        delete [] pStream_Buf;
-        i = erasePendingRequest(i);
+    // Remaining pending requests have no buffers left either
+    while (req != mPendingRequestsList.end()) {
+        req = notifyErrorForRequestResult(req);
     }
 
     /* Reset pending frame Drop list and requests list */
     mPendingFrameDropList.clear();
 
-    flushMap.clear();
     mPendingBuffersMap.num_buffers = 0;
     mPendingBuffersMap.mPendingBufferList.clear();
     mPendingReprocessResultList.clear();
@@ -9881,6 +10841,62 @@ int32_t QCamera3HardwareInterface::notifyErrorForPendingRequests()
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : notifyErrorForRequestResult
+ *
+ * DESCRIPTION: Send error for a pending request without pending buffers, only
+ *              its result metadata is missing. The input buffer of a
+ *              reprocess request is returned, together with the reprocess
+ *              output if that was cached waiting for earlier requests.
+ *
+ * PARAMETERS :
+ *   @req : pending request to be erased
+ *
+ * RETURN     : iterator pointing to the next request
+ *==========================================================================*/
+QCamera3HardwareInterface::pendingRequestIterator
+        QCamera3HardwareInterface::notifyErrorForRequestResult(
+        pendingRequestIterator req)
+{
+    camera3_notify_msg_t notify_msg;
+    camera3_stream_buffer_t *outputBuffer = NULL;
+    List<PendingReprocessResult>::iterator j =
+            mPendingReprocessResultList.begin();
+
+    for (; j != mPendingReprocessResultList.end(); j++) {
+        if (j->frame_number == req->frame_number) {
+            // Shutter of the reprocess was delayed along with its output
+            mCallbackOps->notify(mCallbackOps, &j->notify_msg);
+            outputBuffer = &j->buffer;
+            break;
+        }
+    }
+
+    memset(&notify_msg, 0, sizeof(camera3_notify_msg_t));
+    notify_msg.type = CAMERA3_MSG_ERROR;
+    notify_msg.message.error.error_code = CAMERA3_MSG_ERROR_RESULT;
+    notify_msg.message.error.frame_number = req->frame_number;
+    mCallbackOps->notify(mCallbackOps, &notify_msg);
+
+    if ((NULL != req->input_buffer) || (NULL != outputBuffer)) {
+        camera3_capture_result_t result;
+        memset(&result, 0, sizeof(camera3_capture_result_t));
+        result.result = NULL;
+        result.frame_number = req->frame_number;
+        result.input_buffer = req->input_buffer;
+        result.num_output_buffers = (NULL != outputBuffer) ? 1 : 0;
+        result.output_buffers = outputBuffer;
+        mCallbackOps->process_capture_result(mCallbackOps, &result);
+        CDBG_HIGH("%s: Returned input and %d reprocess buffers of frame %d",
+                __func__, result.num_output_buffers, req->frame_number);
+    }
+
+    if (NULL != outputBuffer) {
+        mPendingReprocessResultList.erase(j);
+    }
+    return erasePendingRequest(req);
+}
+
 bool QCamera3HardwareInterface::isOnEncoder(
         const cam_dimension_t max_viewfinder_size,
         uint32_t width, uint32_t height)
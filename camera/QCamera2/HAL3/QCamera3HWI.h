@@ -39,6 +39,7 @@
 #include "QCamera3Channel.h"
 #include "QCamera3CropRegionMapper.h"
 #include "QCameraPerf.h"
+#include "QCameraThermalAdapter.h"
 
 extern "C" {
 #include <mm_camera_interface.h>
@@ -93,15 +94,106 @@ class QCamera3PicChannel;
 class QCamera3HeapMemory;
 class QCamera3Exif;
 
+/* Stream parameters a stream configuration plan is derived from */
+typedef struct {
+    int stream_type;
+    int format;
+    uint32_t width;
+    uint32_t height;
+    int rotation;
+    uint32_t usage;
+} stream_config_key_t;
+
+/* Backend stream parameters a channel is created and initialized with */
+typedef struct {
+    cam_stream_type_t stream_type;
+    uint32_t postprocess_mask;
+    cam_dimension_t stream_size;
+    cam_is_type_t is_type;
+    /* snapshot channel only */
+    uint32_t num_buffers;
+    bool is_4k_video;
+    bool is_zsl;
+} stream_channel_config_t;
+
 typedef struct {
     camera3_stream_t *stream;
     camera3_stream_buffer_set_t buffer_set;
     stream_status_t status;
     int registered;
     QCamera3ProcessingChannel *channel;
+    /* stream parameters the channel was created with */
+    stream_config_key_t key;
+    stream_channel_config_t config;
 } stream_info_t;
 
-class QCamera3HardwareInterface {
+/* Sensor mode inputs of the first request: fps range, control and scene mode */
+#define SENSOR_MODE_KEY_CNT 4
+
+/* Session layout derived from a stream list by configureStreams */
+typedef struct {
+    /* normalized stream list, sorted by key */
+    uint32_t op_mode;
+    size_t num_streams;
+    stream_config_key_t keys[MAX_NUM_STREAMS];
+    /* derived layout */
+    bool is_4k_video;
+    bool is_video;
+    bool eis_supported_size;
+    bool eis_enable;
+    bool tnr_enabled;
+    bool is_zsl;
+    bool use_common_feature_mask;
+    uint32_t common_feature_mask;
+    bool yuv888_override_jpeg;
+    cam_dimension_t large_yuv888_size;
+    cam_dimension_t video_size;
+    /* sensor output size of the last session started with this layout */
+    bool sensor_dim_valid;
+    int32_t sensor_mode_key[SENSOR_MODE_KEY_CNT];
+    cam_dimension_t sensor_dim;
+} stream_config_plan_t;
+
+/* Channel bring-up and tear-down steps run on the channel worker pool */
+typedef enum {
+    CHANNEL_STEP_INIT,     /* initialize channel streams */
+    CHANNEL_STEP_START,    /* start channel stream threads */
+    CHANNEL_STEP_STOP,     /* stop channel and its postprocessor */
+    CHANNEL_STEP_BUNDLE,   /* set bundle info on all channels */
+    CHANNEL_STEP_COMMIT,   /* stream-on the bundled backend channel */
+} channel_step_op_t;
+
+/* Phases the step timings are reported in */
+typedef enum {
+    CHANNEL_PHASE_INIT,    /* INIT and BUNDLE steps */
+    CHANNEL_PHASE_START,   /* START and COMMIT steps */
+    CHANNEL_PHASE_STOP,    /* STOP steps */
+    CHANNEL_PHASE_MAX
+} channel_phase_t;
+
+typedef struct {
+    channel_step_op_t op;
+    QCamera3Channel *channel;
+    cam_is_type_t is_type;
+    char name[32];
+    int32_t rc;
+    nsecs_t duration;
+} channel_step_t;
+
+/* One runChannelSteps call, shared by the caller and the workers it wakes */
+typedef struct {
+    channel_step_t *steps;
+    size_t cnt;
+    size_t next;              /* next unclaimed step */
+    cam_semaphore_t done;     /* posted by each worker leaving the run */
+} channel_run_t;
+
+#define MAX_CHANNEL_WORKERS 3
+/* One step per stream channel, plus metadata, analysis, support, raw dump,
+ * dummy batch, bundle and commit steps */
+#define MAX_CHANNEL_STEPS (MAX_NUM_STREAMS + 7)
+
+class QCamera3HardwareInterface : public QCameraThermalCallback {
 public:
     /* static variable and functions accessed by camera service */
     static camera3_device_ops_t mCameraOps;
@@ -126,6 +218,7 @@ public:
                                           void *user_data);
     int openCamera(struct hw_device_t **hw_device);
     camera_metadata_t* translateCapabilityToMetadata(int type);
+    cam_cds_mode_type_t getCdsPreference();
 
     static int getCamInfo(uint32_t cameraId, struct camera_info *info);
     static int initCapabilities(uint32_t cameraId);
@@ -144,7 +237,6 @@ public:
     static void convertFromRegions(cam_area_t &roi, const camera_metadata_t *settings,
                                    uint32_t tag);
     static bool resetIfNeededROI(cam_area_t* roi, const cam_crop_region_t* scalerCropRegion);
-    static void convertLandmarks(cam_face_detection_info_t face, int32_t* landmarks);
     static int32_t getScalarFormat(int32_t format);
     static int32_t getSensorSensitivity(int32_t iso_mode);
 
@@ -218,6 +310,10 @@ public:
     void sendDynamicBlackLevel(float blacklevel[4], uint32_t frame_number);
     void sendDynamicBlackLevelWithLock(float blacklevel[4], uint32_t frame_number);
 
+    // Implementation of QCameraThermalCallback
+    virtual int thermalEvtHandle(qcamera_thermal_level_enum_t *level,
+            void *userdata, void *data);
+
 private:
 
     int openCamera();
@@ -246,11 +342,29 @@ private:
     void handleInputBufferWithLock(camera3_stream_buffer_t *buffer,
             uint32_t frame_number);
     void unblockRequestIfNecessary();
+    void resetHFRBatchState();
+    uint8_t getHFRBatchDepth();
+    void updateHFRBatchLatency(uint32_t last_frame_number);
     void dumpMetadataToFile(tuning_params_t &meta, uint32_t &dumpFrameCount,
             bool enabled, const char *type, uint32_t frameNumber);
     static void getLogLevel();
 
     void cleanAndSortStreamInfo();
+    static void getStreamConfigKey(const camera3_stream_t *stream,
+            stream_config_key_t &key);
+    static int compareStreamConfigKey(const stream_config_key_t &a,
+            const stream_config_key_t &b);
+    bool isSamePlanKey(const stream_config_plan_t &a,
+            const stream_config_plan_t &b);
+    bool isSameSessionMode(const stream_config_plan_t &a,
+            const stream_config_plan_t &b);
+    static bool isSameChannelConfig(const stream_channel_config_t &a,
+            const stream_channel_config_t &b);
+    void deleteStreamChannel(stream_info_t *streamInfo);
+    int deriveStreamConfigPlan(camera3_stream_configuration_t *streamList,
+            stream_config_plan_t &plan);
+    int getStreamConfigPlan(camera3_stream_configuration_t *streamList,
+            stream_config_plan_t &plan);
     void extractJpegMetadata(CameraMetadata& jpegMetadata,
             const camera3_capture_request_t *request);
 
@@ -267,10 +381,25 @@ private:
 
     void enablePowerHint();
     void disablePowerHint();
-    int32_t getSensorOutputSize(cam_dimension_t &sensor_dim);
+    int32_t getSensorOutputSize(cam_dimension_t &sensor_dim,
+            const int32_t *sensor_mode_key);
     int32_t dynamicUpdateMetaStreamInfo();
-    int32_t startAllChannels();
+    int32_t startAllChannels(bool stoppedOnly = false);
     int32_t stopAllChannels();
+    int32_t initStreamChannels(bool setEis, cam_is_type_t is_type);
+    int32_t addChannelStep(channel_step_t *steps, size_t &cnt,
+            channel_step_op_t op, QCamera3Channel *channel,
+            cam_is_type_t is_type = IS_TYPE_NONE);
+    int32_t runChannelSteps(channel_step_t *steps, size_t cnt);
+    int32_t executeChannelStep(channel_step_t &step);
+    void getChannelStepName(QCamera3Channel *channel, char *name, size_t len);
+    channel_run_t *dequeueChannelRun();
+    void drainChannelRun(channel_run_t *run);
+    int32_t launchChannelWorkers();
+    void exitChannelWorkers();
+    void clearChannelStepLog(channel_phase_t phase);
+    static channel_phase_t getChannelStepPhase(channel_step_op_t op);
+    static void *channelWorkerRoutine(void *data);
     int32_t notifyErrorForPendingRequests();
     int32_t getReprocessibleOutputStreamId(uint32_t &id);
 
@@ -285,7 +414,6 @@ private:
     mm_camera_vtbl_t  *mCameraHandle;
     bool               mCameraOpened;
     bool               mCameraInitialized;
-    camera_metadata_t *mDefaultMetadata[CAMERA3_TEMPLATE_COUNT];
     const camera3_callback_ops_t *mCallbackOps;
 
     QCamera3MetadataChannel *mMetadataChannel;
@@ -385,7 +513,6 @@ private:
         uint32_t frame_number;
     } PendingReprocessResult;
 
-    typedef KeyedVector<uint32_t, Vector<PendingBufferInfo> > FlushMap;
     typedef List<QCamera3HardwareInterface::PendingRequestInfo>::iterator
             pendingRequestIterator;
     typedef List<QCamera3HardwareInterface::RequestedBufferInfo>::iterator
@@ -398,12 +525,27 @@ private:
      * batch as value for that key */
     KeyedVector<uint32_t, uint32_t> mPendingBatchMap;
 
+    // Video batch queued to the backend in HFR mode
+    typedef struct {
+        nsecs_t queued_ts;
+        uint8_t depth;
+    } PendingVideoBatchInfo;
+    /* Use last frame number of the video batch as key */
+    KeyedVector<uint32_t, PendingVideoBatchInfo> mPendingVideoBatches;
+
     PendingBuffersMap mPendingBuffersMap;
     pthread_cond_t mRequestCond;
     uint32_t mPendingLiveRequest;
     bool mWokenUpByDaemon;
     int32_t mCurrentRequestId;
     cam_stream_size_info_t mStreamConfigInfo;
+    /* Most recently used stream configuration plans first */
+    Vector<stream_config_plan_t> mStreamConfigPlans;
+    /* Plan of the current stream configuration */
+    stream_config_plan_t mStreamConfigPlan;
+    bool mStreamConfigPlanValid;
+    /* Keep channels of retained streams across configureStreams */
+    bool mReuseChannels;
 
     //mutex for serialized access to camera3_device_ops_t functions
     pthread_mutex_t mMutex;
@@ -425,6 +567,17 @@ private:
     uint8_t mBatchSize;
     // Used only in batch mode
     uint8_t mToBeQueuedVidBufs;
+    /* Number of video buffers the batch being formed is closed at,
+     * 1 <= mHFRBatchDepth <= mBatchSize */
+    uint8_t mHFRBatchDepth;
+    bool mHFRAdaptiveBatch;
+    uint32_t mHFRWarmupFrames;
+    nsecs_t mHFRLastRequestTs;
+    nsecs_t mHFRRequestInterval;
+    nsecs_t mHFRResultLatency;
+    uint32_t mHFRBatchesFormed;
+    uint32_t mHFRBatchesPartial;
+    uint32_t mHFRBatchesFlushed;
     // Fixed video fps
     float mHFRVideoFps;
     uint8_t mOpMode;
@@ -441,6 +594,25 @@ private:
     bool mPowerHintEnabled;
     int32_t mLastCustIntentFrmNum;
 
+    /* Worker pool running independent channel steps in parallel */
+    typedef struct {
+        QCameraCmdThread thread;
+        QCamera3HardwareInterface *hw;
+    } channel_worker_t;
+    channel_worker_t mChannelWorkers[MAX_CHANNEL_WORKERS];
+    uint32_t mNumChannelWorkers;
+    bool mChannelWorkersLaunched;
+    /* Guards mChannelRuns, step claiming and the pool state. Only held for
+     * bookkeeping, never while a step runs or a run is waited for */
+    pthread_mutex_t mChannelRunLock;
+    List<channel_run_t *> mChannelRuns;
+    /* Guards the step log, taken by dump() */
+    pthread_mutex_t mChannelStepLogLock;
+    /* Step timings of the last channel bring-up and tear-down, for dump() */
+    Vector<channel_step_t> mChannelStepLog[CHANNEL_PHASE_MAX];
+    /* Image channels that were active when stopAllChannels was last called */
+    Vector<QCamera3Channel *> mStoppedChannels;
+
     static const QCameraMap<camera_metadata_enum_android_control_effect_mode_t,
             cam_effect_mode_type> EFFECT_MODES_MAP[];
     static const QCameraMap<camera_metadata_enum_android_control_awb_mode_t,
@@ -473,6 +645,8 @@ private:
     static const QCameraPropMap CDS_MAP[];
 
     pendingRequestIterator erasePendingRequest(pendingRequestIterator i);
+    pendingRequestIterator notifyErrorForRequestResult(
+            pendingRequestIterator req);
 };
 
 }; // namespace qcamera
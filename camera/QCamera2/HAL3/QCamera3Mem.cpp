@@ -116,6 +116,12 @@ int QCamera3Memory::cacheOpsInternal(uint32_t index, unsigned int cmd, void *vad
         return BAD_INDEX;
     }
 
+    if (NULL == vaddr) {
+        // never CPU mapped, nothing of it can be in the caches
+        CDBG("%s: buffer %d not mapped, skip cache op", __func__, index);
+        return OK;
+    }
+
     memset(&cache_inv_data, 0, sizeof(cache_inv_data));
     memset(&custom_data, 0, sizeof(custom_data));
     cache_inv_data.vaddr = vaddr;
@@ -230,7 +236,8 @@ int32_t QCamera3Memory::getBufDef(const cam_frame_len_offset_t &offset,
     bufDef.frame_len = mMemInfo[index].size;
     bufDef.mem_info = (void *)this;
     bufDef.planes_buf.num_planes = (int8_t)offset.num_planes;
-    bufDef.buffer = getPtrLocked(index);
+    // do not force a CPU mapping of buffers that are mapped on demand
+    bufDef.buffer = mPtr[index];
     bufDef.buf_idx = (uint8_t)index;
 
     /* Plane 0 needs to be set separately. Set other planes in a loop */
@@ -255,12 +262,14 @@ int32_t QCamera3Memory::getBufDef(const cam_frame_len_offset_t &offset,
  *
  * DESCRIPTION: constructor of QCamera3HeapMemory for ion memory used internally in HAL
  *
- * PARAMETERS : none
+ * PARAMETERS :
+ *   @maxCnt      : max number of buffers
+ *   @mapOnDemand : CPU map buffers on first getPtr() instead of at allocation
  *
  * RETURN     : none
  *==========================================================================*/
-QCamera3HeapMemory::QCamera3HeapMemory(uint32_t maxCnt)
-    : QCamera3Memory()
+QCamera3HeapMemory::QCamera3HeapMemory(uint32_t maxCnt, bool mapOnDemand)
+    : QCamera3Memory(), mMapOnDemand(mapOnDemand)
 {
     mMaxCnt = MIN(maxCnt, MM_CAMERA_MAX_NUM_FRAMES);
     for (uint32_t i = 0; i < mMaxCnt; i ++)
@@ -393,6 +402,19 @@ void *QCamera3HeapMemory::getPtrLocked(uint32_t index)
         ALOGE("index out of bound");
         return (void *)BAD_INDEX;
     }
+    if (NULL == mPtr[index]) {
+        void *vaddr = mmap(NULL,
+                    mMemInfo[index].size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED,
+                    mMemInfo[index].fd, 0);
+        if (vaddr == MAP_FAILED) {
+            ALOGE("%s: mmap failed for buffer %d", __func__, index);
+            return NULL;
+        }
+        CDBG("%s: mapped buffer %d on demand", __func__, index);
+        mPtr[index] = vaddr;
+    }
     return mPtr[index];
 }
 
@@ -502,6 +524,7 @@ int32_t QCamera3HeapMemory::getBufferIndex(uint32_t frameNumber)
  *==========================================================================*/
 void *QCamera3HeapMemory::getPtr(uint32_t index)
 {
+    Mutex::Autolock lock(mLock);
     return getPtrLocked(index);
 }
 
@@ -537,6 +560,9 @@ int QCamera3HeapMemory::allocate(size_t size)
             ALOGE("AllocateIonMemory failed");
             goto ALLOC_FAILED;
         }
+        if (mMapOnDemand) {
+            continue;
+        }
 
         void *vaddr = mmap(NULL,
                     mMemInfo[i].size,
@@ -557,8 +583,10 @@ int QCamera3HeapMemory::allocate(size_t size)
 
 ALLOC_FAILED:
     for (uint32_t j = 0; j < i; j++) {
-        munmap(mPtr[j], mMemInfo[j].size);
-        mPtr[j] = NULL;
+        if (mPtr[j] != NULL) {
+            munmap(mPtr[j], mMemInfo[j].size);
+            mPtr[j] = NULL;
+        }
         deallocOneBuffer(mMemInfo[j]);
     }
     return NO_MEMORY;
@@ -596,17 +624,19 @@ int QCamera3HeapMemory::allocateOne(size_t size)
         return NO_MEMORY;
     }
 
-    void *vaddr = mmap(NULL,
-                mMemInfo[mBufferCount].size,
-                PROT_READ | PROT_WRITE,
-                MAP_SHARED,
-                mMemInfo[mBufferCount].fd, 0);
-    if (vaddr == MAP_FAILED) {
-        deallocOneBuffer(mMemInfo[mBufferCount]);
-        ALOGE("%s: mmap failed for buffer", __func__);
-        return NO_MEMORY;
-    } else
-        mPtr[mBufferCount] = vaddr;
+    if (!mMapOnDemand) {
+        void *vaddr = mmap(NULL,
+                    mMemInfo[mBufferCount].size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED,
+                    mMemInfo[mBufferCount].fd, 0);
+        if (vaddr == MAP_FAILED) {
+            deallocOneBuffer(mMemInfo[mBufferCount]);
+            ALOGE("%s: mmap failed for buffer", __func__);
+            return NO_MEMORY;
+        } else
+            mPtr[mBufferCount] = vaddr;
+    }
 
     if (rc == 0)
         mBufferCount += 1;
@@ -626,8 +656,10 @@ int QCamera3HeapMemory::allocateOne(size_t size)
 void QCamera3HeapMemory::deallocate()
 {
     for (uint32_t i = 0; i < mBufferCount; i++) {
-        munmap(mPtr[i], mMemInfo[i].size);
-        mPtr[i] = NULL;
+        if (mPtr[i] != NULL) {
+            munmap(mPtr[i], mMemInfo[i].size);
+            mPtr[i] = NULL;
+        }
         deallocOneBuffer(mMemInfo[i]);
         mCurrentFrameNumbers[i] = -1;
     }
@@ -688,6 +720,256 @@ int QCamera3HeapMemory::getMatchBufIndex(void * /*object*/)
     return -1;
 }
 
+#define GRALLOC_CACHE_HASH_SIZE 64
+#define GRALLOC_CACHE_MAX_IDLE  16
+
+Mutex QCamera3GrallocCache::sLock;
+int QCamera3GrallocCache::sIonFd = -1;
+QCamera3GrallocCache::Entry *QCamera3GrallocCache::sHash[GRALLOC_CACHE_HASH_SIZE];
+QCamera3GrallocCache::Entry QCamera3GrallocCache::sIdle =
+        { 0, 0, NULL, 0, NULL, &QCamera3GrallocCache::sIdle,
+          &QCamera3GrallocCache::sIdle };
+uint32_t QCamera3GrallocCache::sIdleCount = 0;
+
+/*===========================================================================
+ * FUNCTION   : hash
+ *
+ * DESCRIPTION: hash bucket of an ION handle
+ *
+ * PARAMETERS :
+ *   @handle  : ION handle in the cache's ION client
+ *
+ * RETURN     : bucket index
+ *==========================================================================*/
+uint32_t QCamera3GrallocCache::hash(ion_user_handle_t handle)
+{
+    return (uint32_t)((unsigned long)handle % GRALLOC_CACHE_HASH_SIZE);
+}
+
+/*===========================================================================
+ * FUNCTION   : acquire
+ *
+ * DESCRIPTION: import a gralloc buffer and return its cache entry. A buffer
+ *              imported before, in use or idle, gets its existing entry and
+ *              mapping back.
+ *
+ * PARAMETERS :
+ *   @fd      : dma-buf fd of the buffer
+ *   @size    : size of the buffer
+ *   @ionFd   : returns the ION client fd the entry handle belongs to
+ *
+ * RETURN     : cache entry. NULL if the import failed.
+ *==========================================================================*/
+QCamera3GrallocCache::Entry *QCamera3GrallocCache::acquire(int fd, size_t size,
+        int *ionFd)
+{
+    Mutex::Autolock lock(sLock);
+    struct ion_fd_data ion_info_fd;
+    struct ion_handle_data ion_handle;
+    Entry *entry = NULL;
+
+    if (sIonFd < 0) {
+        sIonFd = open("/dev/ion", O_RDONLY);
+        if (sIonFd < 0) {
+            ALOGE("%s: failed: could not open ion device", __func__);
+            return NULL;
+        }
+    }
+
+    memset(&ion_info_fd, 0, sizeof(ion_info_fd));
+    ion_info_fd.fd = fd;
+    if (ioctl(sIonFd, ION_IOC_IMPORT, &ion_info_fd) < 0) {
+        ALOGE("%s: ION import failed\n", __func__);
+        return NULL;
+    }
+
+    // importing a buffer the client already holds returns the same handle
+    for (entry = sHash[hash(ion_info_fd.handle)]; entry != NULL;
+            entry = entry->hashNext) {
+        if (entry->handle == ion_info_fd.handle) {
+            break;
+        }
+    }
+
+    if (entry != NULL) {
+        // the entry keeps a single reference on the handle
+        memset(&ion_handle, 0, sizeof(ion_handle));
+        ion_handle.handle = ion_info_fd.handle;
+        if (ioctl(sIonFd, ION_IOC_FREE, &ion_handle) < 0) {
+            ALOGE("%s: ion free failed", __func__);
+        }
+        if (0 == entry->refCount) {
+            entry->idlePrev->idleNext = entry->idleNext;
+            entry->idleNext->idlePrev = entry->idlePrev;
+            entry->idlePrev = entry->idleNext = entry;
+            sIdleCount--;
+        }
+        CDBG("%s: reusing import of fd %d handle %lx", __func__, fd,
+                (unsigned long)entry->handle);
+    } else {
+        entry = new Entry;
+        entry->handle = ion_info_fd.handle;
+        entry->size = size;
+        entry->vaddr = NULL;
+        entry->refCount = 0;
+        entry->idlePrev = entry->idleNext = entry;
+        entry->hashNext = sHash[hash(entry->handle)];
+        sHash[hash(entry->handle)] = entry;
+    }
+
+    entry->refCount++;
+    *ionFd = sIonFd;
+    return entry;
+}
+
+/*===========================================================================
+ * FUNCTION   : map
+ *
+ * DESCRIPTION: return the CPU mapping of a cache entry, mapping the buffer
+ *              on first use
+ *
+ * PARAMETERS :
+ *   @entry   : cache entry
+ *   @fd      : dma-buf fd of the buffer
+ *
+ * RETURN     : buffer ptr. NULL if the mmap failed.
+ *==========================================================================*/
+void *QCamera3GrallocCache::map(Entry *entry, int fd)
+{
+    Mutex::Autolock lock(sLock);
+    struct ion_flush_data cache_data;
+    struct ion_custom_data custom_data;
+    void *vaddr = NULL;
+
+    if (entry->vaddr != NULL) {
+        return entry->vaddr;
+    }
+
+    vaddr = mmap(NULL, entry->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (vaddr == MAP_FAILED) {
+        ALOGE("%s: mmap of fd %d failed: %s", __func__, fd, strerror(errno));
+        return NULL;
+    }
+
+    // cache maintenance is skipped while a buffer has no mapping
+    memset(&cache_data, 0, sizeof(cache_data));
+    memset(&custom_data, 0, sizeof(custom_data));
+    cache_data.vaddr = vaddr;
+    cache_data.fd = fd;
+    cache_data.handle = entry->handle;
+    cache_data.length = (unsigned int)entry->size;
+    custom_data.cmd = ION_IOC_CLEAN_INV_CACHES;
+    custom_data.arg = (unsigned long)&cache_data;
+    if (ioctl(sIonFd, ION_IOC_CUSTOM, &custom_data) < 0) {
+        ALOGE("%s: Cache clean/invalidate failed: %s", __func__,
+                strerror(errno));
+    }
+
+    entry->vaddr = vaddr;
+    return vaddr;
+}
+
+/*===========================================================================
+ * FUNCTION   : release
+ *
+ * DESCRIPTION: drop a reference on a cache entry. Unreferenced entries stay
+ *              imported and mapped until GRALLOC_CACHE_MAX_IDLE newer idle
+ *              entries push them out or the cache is flushed.
+ *
+ * PARAMETERS :
+ *   @entry   : cache entry
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3GrallocCache::release(Entry *entry)
+{
+    Mutex::Autolock lock(sLock);
+
+    if (0 == entry->refCount) {
+        ALOGE("%s: entry %p already released", __func__, entry);
+        return;
+    }
+    if (--entry->refCount > 0) {
+        return;
+    }
+
+    entry->idlePrev = sIdle.idlePrev;
+    entry->idleNext = &sIdle;
+    sIdle.idlePrev->idleNext = entry;
+    sIdle.idlePrev = entry;
+    sIdleCount++;
+
+    while (sIdleCount > GRALLOC_CACHE_MAX_IDLE) {
+        destroyLocked(sIdle.idleNext);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : flush
+ *
+ * DESCRIPTION: unmap and free all idle entries, and close the ION client
+ *              once no entry is left
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3GrallocCache::flush()
+{
+    Mutex::Autolock lock(sLock);
+
+    while (sIdle.idleNext != &sIdle) {
+        destroyLocked(sIdle.idleNext);
+    }
+
+    for (uint32_t i = 0; i < GRALLOC_CACHE_HASH_SIZE; i++) {
+        if (sHash[i] != NULL) {
+            return;
+        }
+    }
+    if (sIonFd >= 0) {
+        close(sIonFd);
+        sIonFd = -1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : destroyLocked
+ *
+ * DESCRIPTION: unmap and free an idle entry. 'sLock' must be held.
+ *
+ * PARAMETERS :
+ *   @entry   : idle cache entry
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3GrallocCache::destroyLocked(Entry *entry)
+{
+    struct ion_handle_data ion_handle;
+    Entry **pp = &sHash[hash(entry->handle)];
+
+    while (*pp != NULL && *pp != entry) {
+        pp = &(*pp)->hashNext;
+    }
+    if (*pp != NULL) {
+        *pp = entry->hashNext;
+    }
+
+    entry->idlePrev->idleNext = entry->idleNext;
+    entry->idleNext->idlePrev = entry->idlePrev;
+    sIdleCount--;
+
+    if (entry->vaddr != NULL) {
+        munmap(entry->vaddr, entry->size);
+    }
+    memset(&ion_handle, 0, sizeof(ion_handle));
+    ion_handle.handle = entry->handle;
+    if (ioctl(sIonFd, ION_IOC_FREE, &ion_handle) < 0) {
+        ALOGE("ion free failed");
+    }
+    delete entry;
+}
+
 /*===========================================================================
  * FUNCTION   : QCamera3GrallocMemory
  *
@@ -705,6 +987,10 @@ QCamera3GrallocMemory::QCamera3GrallocMemory(uint32_t startIdx)
     for (int i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i ++) {
         mBufferHandle[i] = NULL;
         mPrivateHandle[i] = NULL;
+        mImport[i] = NULL;
+        mPtr[i] = NULL;
+        mHashHead[i] = -1;
+        mHashNext[i] = -1;
     }
 }
 
@@ -721,6 +1007,59 @@ QCamera3GrallocMemory::~QCamera3GrallocMemory()
 {
 }
 
+/*===========================================================================
+ * FUNCTION   : flushImportCache
+ *
+ * DESCRIPTION: release gralloc buffers kept imported after unregistration
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3GrallocMemory::flushImportCache()
+{
+    QCamera3GrallocCache::flush();
+}
+
+/*===========================================================================
+ * FUNCTION   : handleHash
+ *
+ * DESCRIPTION: bucket of a framework buffer handle in the index lookup
+ *
+ * PARAMETERS :
+ *   @buffer  : buffer_handle_t pointer
+ *
+ * RETURN     : bucket index
+ *==========================================================================*/
+uint32_t QCamera3GrallocMemory::handleHash(buffer_handle_t *buffer)
+{
+    return (uint32_t)(((unsigned long)buffer >> 3) % MM_CAMERA_MAX_NUM_FRAMES);
+}
+
+/*===========================================================================
+ * FUNCTION   : hashRemoveLocked
+ *
+ * DESCRIPTION: drop a registered buffer from the index lookup. 'mLock' must
+ *              be held.
+ *
+ * PARAMETERS :
+ *   @idx     : index of the buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3GrallocMemory::hashRemoveLocked(uint32_t idx)
+{
+    int32_t *p = &mHashHead[handleHash(mBufferHandle[idx])];
+
+    while (*p >= 0 && *p != (int32_t)idx) {
+        p = &mHashNext[*p];
+    }
+    if (*p >= 0) {
+        *p = mHashNext[idx];
+    }
+    mHashNext[idx] = -1;
+}
+
 /*===========================================================================
  * FUNCTION   : registerBuffer
  *
@@ -738,15 +1077,13 @@ int QCamera3GrallocMemory::registerBuffer(buffer_handle_t *buffer,
         cam_stream_type_t type)
 {
     status_t ret = NO_ERROR;
-    struct ion_fd_data ion_info_fd;
-    void *vaddr = NULL;
     int32_t colorSpace = ITU_R_601_FR;
     int32_t idx = -1;
+    int ionFd = -1;
+    QCamera3GrallocCache::Entry *entry = NULL;
 
     CDBG("%s: E", __func__);
 
-    memset(&ion_info_fd, 0, sizeof(ion_info_fd));
-
     if (0 <= getMatchBufIndex((void *) buffer)) {
         ALOGV("%s: Buffer already registered", __func__);
         return ALREADY_EXISTS;
@@ -770,45 +1107,45 @@ int QCamera3GrallocMemory::registerBuffer(buffer_handle_t *buffer,
 
     setMetaData(mPrivateHandle[idx], UPDATE_COLOR_SPACE, &colorSpace);
 
-    mMemInfo[idx].main_ion_fd = open("/dev/ion", O_RDONLY);
-    if (mMemInfo[idx].main_ion_fd < 0) {
-        ALOGE("%s: failed: could not open ion device", __func__);
+    entry = QCamera3GrallocCache::acquire(mPrivateHandle[idx]->fd,
+            ( /* FIXME: Should update ION interface */ size_t)
+            mPrivateHandle[idx]->size, &ionFd);
+    if (entry == NULL) {
         ret = NO_MEMORY;
         goto end;
-    } else {
-        ion_info_fd.fd = mPrivateHandle[idx]->fd;
-        if (ioctl(mMemInfo[idx].main_ion_fd,
-                  ION_IOC_IMPORT, &ion_info_fd) < 0) {
-            ALOGE("%s: ION import failed\n", __func__);
-            close(mMemInfo[idx].main_ion_fd);
-            ret = NO_MEMORY;
-            goto end;
-        }
     }
     CDBG("%s: idx = %d, fd = %d, size = %d, offset = %d",
             __func__, idx, mPrivateHandle[idx]->fd,
             mPrivateHandle[idx]->size,
             mPrivateHandle[idx]->offset);
-    mMemInfo[idx].fd = mPrivateHandle[idx]->fd;
-    mMemInfo[idx].size =
-            ( /* FIXME: Should update ION interface */ size_t)
-            mPrivateHandle[idx]->size;
-    mMemInfo[idx].handle = ion_info_fd.handle;
-
-    vaddr = mmap(NULL,
-            mMemInfo[idx].size,
-            PROT_READ | PROT_WRITE,
-            MAP_SHARED,
-            mMemInfo[idx].fd, 0);
-    if (vaddr == MAP_FAILED) {
-        mMemInfo[idx].handle = 0;
-        ret = NO_MEMORY;
+
+    // Buffers are mapped on the first getPtr(), except raw ones whose frame
+    // buffer pointer the raw channel reads directly.
+    if (type == CAM_STREAM_TYPE_RAW) {
+        mPtr[idx] = QCamera3GrallocCache::map(entry, mPrivateHandle[idx]->fd);
+        if (mPtr[idx] == NULL) {
+            QCamera3GrallocCache::release(entry);
+            ret = NO_MEMORY;
+            goto end;
+        }
     } else {
-        mPtr[idx] = vaddr;
-        mBufferCount++;
+        mPtr[idx] = entry->vaddr;
     }
 
+    mMemInfo[idx].fd = mPrivateHandle[idx]->fd;
+    mMemInfo[idx].main_ion_fd = ionFd;
+    mMemInfo[idx].size = entry->size;
+    mMemInfo[idx].handle = entry->handle;
+    mImport[idx] = entry;
+    mHashNext[idx] = mHashHead[handleHash(buffer)];
+    mHashHead[handleHash(buffer)] = idx;
+    mBufferCount++;
+
 end:
+    if (ret != NO_ERROR) {
+        mBufferHandle[idx] = NULL;
+        mPrivateHandle[idx] = NULL;
+    }
     CDBG(" %s : X ",__func__);
     return ret;
 }
@@ -816,7 +1153,9 @@ end:
  * FUNCTION   : unregisterBufferLocked
  *
  * DESCRIPTION: Unregister buffer. Please note that this method has to be
- *              called with 'mLock' acquired.
+ *              called with 'mLock' acquired. The import and CPU mapping go
+ *              back to QCamera3GrallocCache for a later registration of the
+ *              same buffer.
  *
  * PARAMETERS :
  *   @idx     : unregister buffer at index 'idx'
@@ -827,17 +1166,13 @@ end:
  *==========================================================================*/
 int32_t QCamera3GrallocMemory::unregisterBufferLocked(size_t idx)
 {
-    munmap(mPtr[idx], mMemInfo[idx].size);
+    hashRemoveLocked(idx);
+    QCamera3GrallocCache::release(mImport[idx]);
+    mImport[idx] = NULL;
     mPtr[idx] = NULL;
 
-    struct ion_handle_data ion_handle;
-    memset(&ion_handle, 0, sizeof(ion_handle));
-    ion_handle.handle = mMemInfo[idx].handle;
-    if (ioctl(mMemInfo[idx].main_ion_fd, ION_IOC_FREE, &ion_handle) < 0) {
-        ALOGE("ion free failed");
-    }
-    close(mMemInfo[idx].main_ion_fd);
     memset(&mMemInfo[idx], 0, sizeof(struct QCamera3MemInfo));
+    mMemInfo[idx].fd = -1;
     mMemInfo[idx].main_ion_fd = -1;
     mBufferHandle[idx] = NULL;
     mPrivateHandle[idx] = NULL;
@@ -1045,7 +1380,9 @@ int QCamera3GrallocMemory::cacheOps(uint32_t index, unsigned int cmd)
         return BAD_INDEX;
     }
 
-    return cacheOpsInternal(index, cmd, mPtr[index]);
+    // the buffer may have been mapped through another registration
+    void *vaddr = (mImport[index] != NULL) ? mImport[index]->vaddr : NULL;
+    return cacheOpsInternal(index, cmd, vaddr);
 }
 
 /*===========================================================================
@@ -1068,7 +1405,7 @@ int QCamera3GrallocMemory::getMatchBufIndex(void *object)
     if (!key) {
         return BAD_VALUE;
     }
-    for (uint32_t i = mStartIdx; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
+    for (int32_t i = mHashHead[handleHash(key)]; i >= 0; i = mHashNext[i]) {
         if (mBufferHandle[i] == key) {
             index = (int)i;
             break;
@@ -1139,6 +1476,11 @@ void *QCamera3GrallocMemory::getPtrLocked(uint32_t index)
         return NULL;
     }
 
+    if (mPtr[index] == NULL) {
+        mPtr[index] = QCamera3GrallocCache::map(mImport[index],
+                mMemInfo[index].fd);
+    }
+
     return mPtr[index];
 }
 
@@ -99,7 +99,7 @@ protected:
 // parameters, metadata, and internal YUV data for jpeg encoding.
 class QCamera3HeapMemory : public QCamera3Memory {
 public:
-    QCamera3HeapMemory(uint32_t maxCnt);
+    QCamera3HeapMemory(uint32_t maxCnt, bool mapOnDemand = false);
     virtual ~QCamera3HeapMemory();
 
     int allocate(size_t size);
@@ -121,6 +121,41 @@ private:
             unsigned int heap_id, size_t size);
     void deallocOneBuffer(struct QCamera3MemInfo &memInfo);
     uint32_t mMaxCnt;
+    // CPU map buffers on first getPtr() instead of at allocation
+    bool mMapOnDemand;
+};
+
+// Process-wide cache of ION imports and CPU mappings of framework gralloc
+// buffers. Entries are keyed by the ION handle, which is unique per buffer
+// within the cache's ION client, and survive unregistration so that the
+// same BufferQueue buffers coming back after a stream reconfiguration are
+// not imported and mapped again.
+class QCamera3GrallocCache {
+public:
+    struct Entry {
+        ion_user_handle_t handle;
+        size_t size;
+        void *vaddr;
+        uint32_t refCount;
+        Entry *hashNext;
+        Entry *idlePrev;
+        Entry *idleNext;
+    };
+
+    static Entry *acquire(int fd, size_t size, int *ionFd);
+    static void *map(Entry *entry, int fd);
+    static void release(Entry *entry);
+    static void flush();
+
+private:
+    static void destroyLocked(Entry *entry);
+    static uint32_t hash(ion_user_handle_t handle);
+
+    static Mutex sLock;
+    static int sIonFd;
+    static Entry *sHash[];
+    static Entry sIdle;
+    static uint32_t sIdleCount;
 };
 
 // Gralloc Memory shared with frameworks
@@ -141,13 +176,20 @@ public:
     virtual int32_t getBufferIndex(uint32_t frameNumber);
 
     void *getBufferHandle(uint32_t index);
+    static void flushImportCache();
 protected:
     virtual void *getPtrLocked(uint32_t index);
 private:
     int32_t unregisterBufferLocked(size_t idx);
     int32_t getFreeIndexLocked();
+    static uint32_t handleHash(buffer_handle_t *buffer);
+    void hashRemoveLocked(uint32_t idx);
     buffer_handle_t *mBufferHandle[MM_CAMERA_MAX_NUM_FRAMES];
     struct private_handle_t *mPrivateHandle[MM_CAMERA_MAX_NUM_FRAMES];
+    QCamera3GrallocCache::Entry *mImport[MM_CAMERA_MAX_NUM_FRAMES];
+    // buffer_handle_t -> index chains, -1 terminated
+    int32_t mHashHead[MM_CAMERA_MAX_NUM_FRAMES];
+    int32_t mHashNext[MM_CAMERA_MAX_NUM_FRAMES];
 
     uint32_t mStartIdx;
 };
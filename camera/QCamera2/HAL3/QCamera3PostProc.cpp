@@ -73,7 +73,8 @@ QCamera3PostProcessor::QCamera3PostProcessor(QCamera3ProcessingChannel* ch_ctrl)
       m_inputJpegQ(releaseJpegData, this),
       m_ongoingJpegQ(releaseJpegData, this),
       m_inputMetaQ(releaseMetadata, this),
-      m_jpegSettingsQ(NULL, this)
+      m_jpegSettingsQ(NULL, this),
+      m_bStaticExifValid(false)
 {
     memset(&mJpegHandle, 0, sizeof(mJpegHandle));
     pthread_mutex_init(&mReprocJobLock, NULL);
@@ -330,6 +331,13 @@ int32_t QCamera3PostProcessor::getFWKJpegEncodeConfig(
     cam_frame_len_offset_t main_offset =
             frame->reproc_config.input_stream_plane_info.plane_info;
 
+    // framework input buffers are CPU mapped on demand
+    if ((NULL == frame->input_buffer.buffer) &&
+            (NULL != frame->input_buffer.mem_info)) {
+        frame->input_buffer.buffer = ((QCamera3Memory *)
+                frame->input_buffer.mem_info)->getPtr(frame->input_buffer.buf_idx);
+    }
+
     encode_parm.num_src_bufs = 1;
     encode_parm.src_main_buf[0].index = 0;
     encode_parm.src_main_buf[0].buf_size = frame->input_buffer.frame_len;
@@ -1166,6 +1174,7 @@ int32_t QCamera3PostProcessor::encodeFWKData(qcamera_hal3_jpeg_data_t *jpeg_job_
     jpg_job.encode_job.session_id = mJpegSessionId;
     jpg_job.encode_job.src_index = 0;
     jpg_job.encode_job.dst_index = 0;
+    jpg_job.encode_job.priority = MM_JPEG_JOB_PRIO_REPROCESS;
 
     cam_rect_t crop;
     memset(&crop, 0, sizeof(cam_rect_t));
@@ -1606,14 +1615,11 @@ void *QCamera3PostProcessor::dataProcessRoutine(void *data)
     cmdThread->setName("cam_data_proc");
 
     do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
-                           __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
+        ret = cmdThread->waitCmd();
+        if (ret != NO_ERROR) {
+            ALOGE("%s: waitCmd error (%d)", __func__, ret);
+            return NULL;
+        }
 
         // we got notified about new cmd avail in cmd queue
         camera_cmd_type_t cmd = cmdThread->getCmd();
@@ -1794,12 +1800,16 @@ void *QCamera3PostProcessor::dataProcessRoutine(void *data)
                                         pp_job->jpeg_settings,
                                         fwk_frame);
                                 if (NO_ERROR == ret) {
-                                    // add into ongoing PP job Q
+                                    // add into ongoing PP job Q. Input frames
+                                    // and metadata here are recycled HAL
+                                    // buffers, keep them mapped
                                     ret = pme->m_pReprocChannel->doReprocessOffline(
-                                            &fwk_frame);
+                                            &fwk_frame, true);
                                     if (NO_ERROR != ret) {
                                         // remove from ongoing PP job Q
                                         pme->m_ongoingPPQ.dequeue(false);
+                                        pme->m_pReprocChannel->releaseMetaCopy(
+                                                fwk_frame.metadata_buffer);
                                     }
                                 }
                             } else {
@@ -2226,6 +2236,43 @@ int32_t getExifExposureValue(srat_t* exposure_val, int32_t exposure_comp,
     return 0;
 }
 
+/*===========================================================================
+ * FUNCTION   : buildStaticExifData
+ *
+ * DESCRIPTION: build the exif tags that stay the same for every jpeg
+ *              encoded by this post processor
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3PostProcessor::buildStaticExifData()
+{
+#ifdef ENABLE_MODEL_INFO_EXIF
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("ro.product.manufacturer", value, "QCOM-AA") > 0) {
+        m_staticExif.addEntry(EXIFTAGID_MAKE, EXIF_ASCII,
+                (uint32_t)(strlen(value) + 1), (void *)value);
+    } else {
+        ALOGE("%s: getExifMaker failed", __func__);
+    }
+
+    if (property_get("ro.product.model", value, "QCAM-AA") > 0) {
+        m_staticExif.addEntry(EXIFTAGID_MODEL, EXIF_ASCII,
+                (uint32_t)(strlen(value) + 1), (void *)value);
+    } else {
+        ALOGE("%s: getExifModel failed", __func__);
+    }
+
+    if (property_get("ro.build.description", value, "QCAM-AA") > 0) {
+        m_staticExif.addEntry(EXIFTAGID_SOFTWARE, EXIF_ASCII,
+                (uint32_t)(strlen(value) + 1), (void *)value);
+    } else {
+        ALOGE("%s: getExifSoftware failed", __func__);
+    }
+#endif
+}
+
 /*===========================================================================
  * FUNCTION   : getExifData
  *
@@ -2422,30 +2469,13 @@ QCamera3Exif *QCamera3PostProcessor::getExifData(metadata_buffer_t *metadata,
 
     bool output_image_desc = true;
 
-#ifdef ENABLE_MODEL_INFO_EXIF
-
-    char value[PROPERTY_VALUE_MAX];
-    if (property_get("ro.product.manufacturer", value, "QCOM-AA") > 0) {
-        exif->addEntry(EXIFTAGID_MAKE, EXIF_ASCII,
-                (uint32_t)(strlen(value) + 1), (void *)value);
-    } else {
-        ALOGE("%s: getExifMaker failed", __func__);
-    }
-
-    if (property_get("ro.product.model", value, "QCAM-AA") > 0) {
-        exif->addEntry(EXIFTAGID_MODEL, EXIF_ASCII,
-                (uint32_t)(strlen(value) + 1), (void *)value);
-    } else {
-        ALOGE("%s: getExifModel failed", __func__);
-    }
-
-    if (property_get("ro.build.description", value, "QCAM-AA") > 0) {
-        exif->addEntry(EXIFTAGID_SOFTWARE, EXIF_ASCII,
-                (uint32_t)(strlen(value) + 1), (void *)value);
-    } else {
-        ALOGE("%s: getExifSoftware failed", __func__);
+    if (!m_bStaticExifValid) {
+        buildStaticExifData();
+        m_bStaticExifValid = true;
     }
+    exif->addEntries(m_staticExif);
 
+#ifdef ENABLE_MODEL_INFO_EXIF
     // Production sw should not enable image description field output
     output_image_desc = false;
 #endif
@@ -2470,7 +2500,9 @@ QCamera3Exif *QCamera3PostProcessor::getExifData(metadata_buffer_t *metadata,
  * RETURN     : None
  *==========================================================================*/
 QCamera3Exif::QCamera3Exif()
-    : m_nNumEntries(0)
+    : m_nNumEntries(0),
+      m_nSharedMask(0),
+      m_nArenaUsed(0)
 {
     memset(m_Entries, 0, sizeof(m_Entries));
 }
@@ -2487,84 +2519,110 @@ QCamera3Exif::QCamera3Exif()
 QCamera3Exif::~QCamera3Exif()
 {
     for (uint32_t i = 0; i < m_nNumEntries; i++) {
-        switch (m_Entries[i].tag_entry.type) {
-            case EXIF_BYTE:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._bytes != NULL) {
-                        free(m_Entries[i].tag_entry.data._bytes);
-                        m_Entries[i].tag_entry.data._bytes = NULL;
-                    }
-                }
-                break;
-            case EXIF_ASCII:
-                {
-                    if (m_Entries[i].tag_entry.data._ascii != NULL) {
-                        free(m_Entries[i].tag_entry.data._ascii);
-                        m_Entries[i].tag_entry.data._ascii = NULL;
-                    }
-                }
-                break;
-            case EXIF_SHORT:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._shorts != NULL) {
-                        free(m_Entries[i].tag_entry.data._shorts);
-                        m_Entries[i].tag_entry.data._shorts = NULL;
-                    }
-                }
-                break;
-            case EXIF_LONG:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._longs != NULL) {
-                        free(m_Entries[i].tag_entry.data._longs);
-                        m_Entries[i].tag_entry.data._longs = NULL;
-                    }
-                }
-                break;
-            case EXIF_RATIONAL:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._rats != NULL) {
-                        free(m_Entries[i].tag_entry.data._rats);
-                        m_Entries[i].tag_entry.data._rats = NULL;
-                    }
-                }
-                break;
-            case EXIF_UNDEFINED:
-                {
-                    if (m_Entries[i].tag_entry.data._undefined != NULL) {
-                        free(m_Entries[i].tag_entry.data._undefined);
-                        m_Entries[i].tag_entry.data._undefined = NULL;
-                    }
-                }
-                break;
-            case EXIF_SLONG:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._slongs != NULL) {
-                        free(m_Entries[i].tag_entry.data._slongs);
-                        m_Entries[i].tag_entry.data._slongs = NULL;
-                    }
-                }
-                break;
-            case EXIF_SRATIONAL:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._srats != NULL) {
-                        free(m_Entries[i].tag_entry.data._srats);
-                        m_Entries[i].tag_entry.data._srats = NULL;
-                    }
-                }
-                break;
-            default:
-                ALOGE("%s: Error, Unknown type",__func__);
-                break;
+        if (!(m_nSharedMask & (1U << i))) {
+            releasePayload(m_Entries[i]);
         }
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : allocPayload
+ *
+ * DESCRIPTION: allocate the payload of a tag from the arena of the table,
+ *              falling back to the heap once the arena is used up
+ *
+ * PARAMETERS :
+ *   @size    : payload size in bytes
+ *
+ * RETURN     : payload address, NULL if out of memory
+ *==========================================================================*/
+void *QCamera3Exif::allocPayload(size_t size)
+{
+    size_t offset = (m_nArenaUsed + 7) & ~(size_t)7;
+    if ((offset <= sizeof(m_Arena)) && (size <= sizeof(m_Arena) - offset)) {
+        m_nArenaUsed = offset + size;
+        return (uint8_t *)m_Arena + offset;
+    }
+    return malloc(size);
+}
+
+/*===========================================================================
+ * FUNCTION   : releasePayload
+ *
+ * DESCRIPTION: free the payload of a tag if it did not fit in the arena
+ *
+ * PARAMETERS :
+ *   @entry   : exif tag
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3Exif::releasePayload(QEXIF_INFO_DATA &entry)
+{
+    void *payload = NULL;
+    bool array = (entry.tag_entry.count > 1);
+
+    switch (entry.tag_entry.type) {
+        case EXIF_ASCII:
+            payload = entry.tag_entry.data._ascii;
+            break;
+        case EXIF_UNDEFINED:
+            payload = entry.tag_entry.data._undefined;
+            break;
+        case EXIF_BYTE:
+            payload = array ? entry.tag_entry.data._bytes : NULL;
+            break;
+        case EXIF_SHORT:
+            payload = array ? entry.tag_entry.data._shorts : NULL;
+            break;
+        case EXIF_LONG:
+            payload = array ? entry.tag_entry.data._longs : NULL;
+            break;
+        case EXIF_RATIONAL:
+            payload = array ? entry.tag_entry.data._rats : NULL;
+            break;
+        case EXIF_SLONG:
+            payload = array ? entry.tag_entry.data._slongs : NULL;
+            break;
+        case EXIF_SRATIONAL:
+            payload = array ? entry.tag_entry.data._srats : NULL;
+            break;
+    }
+
+    uint8_t *arena = (uint8_t *)m_Arena;
+    if ((payload != NULL) && (((uint8_t *)payload < arena) ||
+            ((uint8_t *)payload >= arena + sizeof(m_Arena)))) {
+        free(payload);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : addEntries
+ *
+ * DESCRIPTION: add the tags of another table without copying their payload.
+ *              The source table must outlive this one.
+ *
+ * PARAMETERS :
+ *   @src     : table to add the tags from
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Exif::addEntries(const QCamera3Exif &src)
+{
+    if (m_nNumEntries + src.m_nNumEntries > MAX_HAL3_EXIF_TABLE_ENTRIES) {
+        ALOGE("%s: Number of entries exceeded limit", __func__);
+        return NO_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < src.m_nNumEntries; i++) {
+        m_Entries[m_nNumEntries] = src.m_Entries[i];
+        m_nSharedMask |= (1U << m_nNumEntries);
+        m_nNumEntries++;
+    }
+    return NO_ERROR;
+}
+
 /*===========================================================================
  * FUNCTION   : addEntry
  *
@@ -2599,7 +2657,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
         case EXIF_BYTE:
             {
                 if (count > 1) {
-                    uint8_t *values = (uint8_t *)malloc(count);
+                    uint8_t *values = (uint8_t *)allocPayload(count);
                     if (values == NULL) {
                         ALOGE("%s: No memory for byte array", __func__);
                         rc = NO_MEMORY;
@@ -2616,7 +2674,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
         case EXIF_ASCII:
             {
                 char *str = NULL;
-                str = (char *)malloc(count + 1);
+                str = (char *)allocPayload(count + 1);
                 if (str == NULL) {
                     ALOGE("%s: No memory for ascii string", __func__);
                     rc = NO_MEMORY;
@@ -2631,7 +2689,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
             {
                 if (count > 1) {
                     uint16_t *values =
-                        (uint16_t *)malloc(count * sizeof(uint16_t));
+                        (uint16_t *)allocPayload(count * sizeof(uint16_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for short array", __func__);
                         rc = NO_MEMORY;
@@ -2649,7 +2707,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
             {
                 if (count > 1) {
                     uint32_t *values =
-                        (uint32_t *)malloc(count * sizeof(uint32_t));
+                        (uint32_t *)allocPayload(count * sizeof(uint32_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for long array", __func__);
                         rc = NO_MEMORY;
@@ -2666,7 +2724,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
         case EXIF_RATIONAL:
             {
                 if (count > 1) {
-                    rat_t *values = (rat_t *)malloc(count * sizeof(rat_t));
+                    rat_t *values = (rat_t *)allocPayload(count * sizeof(rat_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for rational array", __func__);
                         rc = NO_MEMORY;
@@ -2682,7 +2740,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
             break;
         case EXIF_UNDEFINED:
             {
-                uint8_t *values = (uint8_t *)malloc(count);
+                uint8_t *values = (uint8_t *)allocPayload(count);
                 if (values == NULL) {
                     ALOGE("%s: No memory for undefined array", __func__);
                     rc = NO_MEMORY;
@@ -2696,7 +2754,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
             {
                 if (count > 1) {
                     int32_t *values =
-                        (int32_t *)malloc(count * sizeof(int32_t));
+                        (int32_t *)allocPayload(count * sizeof(int32_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for signed long array", __func__);
                         rc = NO_MEMORY;
@@ -2713,7 +2771,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
         case EXIF_SRATIONAL:
             {
                 if (count > 1) {
-                    srat_t *values = (srat_t *)malloc(count * sizeof(srat_t));
+                    srat_t *values = (srat_t *)allocPayload(count * sizeof(srat_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for sign rational array",__func__);
                         rc = NO_MEMORY;
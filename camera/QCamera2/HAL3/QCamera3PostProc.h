@@ -89,6 +89,7 @@ typedef struct {
 } qcamera_hal3_pp_buffer_t;
 
 #define MAX_HAL3_EXIF_TABLE_ENTRIES 23
+#define HAL3_EXIF_ARENA_SIZE 1024
 class QCamera3Exif
 {
 public:
@@ -99,12 +100,19 @@ public:
                      exif_tag_type_t type,
                      uint32_t count,
                      void *data);
+    int32_t addEntries(const QCamera3Exif &src);
     uint32_t getNumOfEntries() {return m_nNumEntries;};
     QEXIF_INFO_DATA *getEntries() {return m_Entries;};
 
 private:
+    void *allocPayload(size_t size);
+    void releasePayload(QEXIF_INFO_DATA &entry);
+
     QEXIF_INFO_DATA m_Entries[MAX_HAL3_EXIF_TABLE_ENTRIES];  // exif tags for JPEG encoder
     uint32_t  m_nNumEntries;                            // number of valid entries
+    uint32_t  m_nSharedMask;                            // entries referencing another table's payload
+    uint64_t  m_Arena[HAL3_EXIF_ARENA_SIZE / sizeof(uint64_t)]; // tag payloads
+    size_t    m_nArenaUsed;                             // bytes used in m_Arena
 };
 
 class QCamera3PostProcessor
@@ -146,6 +154,7 @@ private:
             jpeg_settings_t *jpeg_settings);
     QCamera3Exif * getExifData(metadata_buffer_t *metadata,
             jpeg_settings_t *jpeg_settings);
+    void buildStaticExifData();
     int32_t encodeData(qcamera_hal3_jpeg_data_t *jpeg_job_data,
                        uint8_t &needNewSess);
     int32_t encodeFWKData(qcamera_hal3_jpeg_data_t *jpeg_job_data,
@@ -185,6 +194,11 @@ private:
     QCameraCmdThread m_dataProcTh;      // thread for data processing
 
     pthread_mutex_t mReprocJobLock;
+
+    // exif tags that are the same for every jpeg, built on first use
+    // by the data process thread
+    QCamera3Exif m_staticExif;
+    bool m_bStaticExifValid;
 };
 
 }; // namespace qcamera
@@ -379,7 +379,8 @@ int32_t QCamera3Stream::init(cam_stream_type_t streamType,
             goto err4;
         }
         else {
-            mNumBatchBufs = MAX_INFLIGHT_HFR_REQUESTS / batchSize;
+            mNumBatchBufs = MAX_INFLIGHT_HFR_REQUESTS / batchSize +
+                    MAX_HFR_PARTIAL_BATCHES;
             mStreamInfo->streaming_mode = CAM_STREAMING_MODE_BATCH;
             mStreamInfo->user_buf_info.frame_buf_cnt = batchSize;
             mStreamInfo->user_buf_info.size =
@@ -449,6 +450,8 @@ int32_t QCamera3Stream::start()
     mDataQ.init();
     if (mBatchSize)
         mFreeBatchBufQ.init();
+    // dataProcRoutine drains mDataQ on every DO_NEXT_JOB
+    mProcTh.setCoalescing(true);
     rc = mProcTh.launch(dataProcRoutine, this);
     return rc;
 }
@@ -556,14 +559,11 @@ void *QCamera3Stream::dataProcRoutine(void *data)
 
     CDBG("%s: E", __func__);
     do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                ALOGE("%s: cam_sem_wait error (%s)",
-                      __func__, strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
+        ret = cmdThread->waitCmd();
+        if (ret != NO_ERROR) {
+            ALOGE("%s: waitCmd error (%d)", __func__, ret);
+            return NULL;
+        }
 
         // we got notified about new cmd avail in cmd queue
         camera_cmd_type_t cmd = cmdThread->getCmd();
@@ -571,9 +571,9 @@ void *QCamera3Stream::dataProcRoutine(void *data)
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
             {
                 CDBG("%s: Do next job", __func__);
-                mm_camera_super_buf_t *frame =
-                    (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
-                if (NULL != frame) {
+                mm_camera_super_buf_t *frame = NULL;
+                while (NULL != (frame =
+                        (mm_camera_super_buf_t *)pme->mDataQ.dequeue())) {
                     if (UNLIKELY(frame->bufs[0]->buf_type ==
                             CAM_STREAM_BUF_TYPE_USERPTR)) {
                         pme->handleBatchBuffer(frame);
@@ -52,12 +52,17 @@ namespace qcamera {
  *
  * DESCRIPTION: default constructor of QCamera3StreamMem
  *
- * PARAMETERS : none
+ * PARAMETERS :
+ *   @maxHeapBuffer    : max number of heap buffers
+ *   @queueHeapBuffers : whether heap buffers are queued to the stream
+ *   @mapOnDemand      : CPU map heap buffers on first getPtr() only, for
+ *                       streams whose frames the HAL does not read directly
  *
  * RETURN     : None
  *==========================================================================*/
-QCamera3StreamMem::QCamera3StreamMem(uint32_t maxHeapBuffer, bool queueHeapBuffers) :
-        mHeapMem(maxHeapBuffer),
+QCamera3StreamMem::QCamera3StreamMem(uint32_t maxHeapBuffer, bool queueHeapBuffers,
+        bool mapOnDemand) :
+        mHeapMem(maxHeapBuffer, mapOnDemand),
         mGrallocMem(maxHeapBuffer),
         mMaxHeapBuffers(maxHeapBuffer),
         mQueueHeapBuffers(queueHeapBuffers)
@@ -46,7 +46,8 @@ namespace qcamera {
 
 class QCamera3StreamMem {
 public:
-    QCamera3StreamMem(uint32_t maxHeapBuffer, bool queueAll = true);
+    QCamera3StreamMem(uint32_t maxHeapBuffer, bool queueAll = true,
+            bool mapOnDemand = false);
     virtual ~QCamera3StreamMem();
 
     uint32_t getCnt();
@@ -197,6 +197,22 @@ typedef struct {
 
 } mm_jpeg_decode_params_t;
 
+/** mm_jpeg_job_priority_t:
+ *  @MM_JPEG_JOB_PRIO_SINGLE: single shot capture, the user is waiting
+ *  @MM_JPEG_JOB_PRIO_BURST: frame of a burst/longshot capture
+ *  @MM_JPEG_JOB_PRIO_THUMBNAIL: thumbnail only encode
+ *  @MM_JPEG_JOB_PRIO_REPROCESS: encode of a reprocessed input frame
+ *
+ *  Scheduling priority of an encode job, lower value is served first
+ **/
+typedef enum {
+  MM_JPEG_JOB_PRIO_SINGLE,
+  MM_JPEG_JOB_PRIO_BURST,
+  MM_JPEG_JOB_PRIO_THUMBNAIL,
+  MM_JPEG_JOB_PRIO_REPROCESS,
+  MM_JPEG_JOB_PRIO_MAX
+} mm_jpeg_job_priority_t;
+
 typedef struct {
   /* active indices of the buffers for encoding */
   int32_t src_index;
@@ -233,6 +249,9 @@ typedef struct {
   /* flag to enable/disable mobicat */
   uint8_t mobicat_mask;
 
+  /* scheduling priority, defaults to single shot */
+  mm_jpeg_job_priority_t priority;
+
 } mm_jpeg_encode_job_t;
 
 typedef struct {
@@ -304,6 +323,12 @@ typedef struct {
 
   /* close a jpeg client -- sync call */
   int (*close) (uint32_t clientHdl);
+
+  /* get a pooled ION output buffer of at least size bytes */
+  int (*get_buffer)(size_t size, mm_jpeg_buf_t *p_buf);
+
+  /* return a buffer from get_buffer to the pool */
+  int (*put_buffer)(mm_jpeg_buf_t *p_buf);
 } mm_jpegdec_ops_t;
 
 /* open a jpeg client -- sync call
@@ -239,4 +239,22 @@ LOCAL_MODULE_TAGS := tests
 
 include $(BUILD_NATIVE_TEST)
 
+# Build cam_queue_bench
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := src/cam_queue_bench.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../common \
+        $(LOCAL_PATH)/../../util
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_SHARED_LIBRARIES := liblog
+
+LOCAL_MODULE := cam_queue_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
 LOCAL_PATH := $(OLD_LOCAL_PATH)
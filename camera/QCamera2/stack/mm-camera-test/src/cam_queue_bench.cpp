@@ -0,0 +1,254 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_queue_bench"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+#include <sched.h>
+
+#include "QCameraQueueT.h"
+
+using namespace qcamera;
+
+#define NS_PER_S 1000000000
+
+#define NUM_PRODUCERS      4
+#define ITEMS_PER_PRODUCER 100000
+#define BATCH_SIZE         16
+#define BOUNDED_CAPACITY   64
+#define KEYED_DEPTH        256
+#define KEYED_ROUNDS       20000
+
+static inline int64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+// Reference queue with one heap node per entry, as the old QCameraQueue did
+class MallocQueue {
+public:
+    MallocQueue() : m_size(0) {
+        pthread_mutex_init(&m_lock, NULL);
+        cam_list_init(&m_head);
+    }
+    ~MallocQueue() {
+        uintptr_t data;
+        while (dequeue(data));
+        pthread_mutex_destroy(&m_lock);
+    }
+    bool enqueue(const uintptr_t &data) {
+        node_t *node = (node_t *)malloc(sizeof(node_t));
+        if (NULL == node) {
+            return false;
+        }
+        node->data = data;
+        pthread_mutex_lock(&m_lock);
+        cam_list_add_tail_node(&node->list, &m_head);
+        m_size++;
+        pthread_mutex_unlock(&m_lock);
+        return true;
+    }
+    bool enqueueWait(const uintptr_t &data) {
+        return enqueue(data);
+    }
+    bool dequeue(uintptr_t &data) {
+        node_t *node = NULL;
+        pthread_mutex_lock(&m_lock);
+        if (m_head.next != &m_head) {
+            node = member_of(m_head.next, node_t, list);
+            cam_list_del_node(&node->list);
+            m_size--;
+        }
+        pthread_mutex_unlock(&m_lock);
+        if (NULL == node) {
+            return false;
+        }
+        data = node->data;
+        free(node);
+        return true;
+    }
+    uint32_t dequeueAll(uintptr_t *items, uint32_t max_items) {
+        uint32_t count = 0;
+        while ((count < max_items) && dequeue(items[count])) {
+            count++;
+        }
+        return count;
+    }
+private:
+    typedef struct {
+        struct cam_list list;
+        uintptr_t data;
+    } node_t;
+    struct cam_list m_head;
+    uint32_t m_size;
+    pthread_mutex_t m_lock;
+};
+
+template <typename Q>
+struct bench_ctx_t {
+    Q *queue;
+    uintptr_t base;
+    bool wait;
+};
+
+template <typename Q>
+static void *producer(void *arg) {
+    bench_ctx_t<Q> *ctx = (bench_ctx_t<Q> *)arg;
+    for (uintptr_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+        uintptr_t v = ctx->base + i + 1;
+        if (ctx->wait) {
+            ctx->queue->enqueueWait(v);
+        } else {
+            while (!ctx->queue->enqueue(v)) {
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+
+// Run NUM_PRODUCERS producers against one consumer, returns ns per item.
+template <typename Q>
+static int64_t run_contention(Q &queue, bool wait, bool batched,
+        uint64_t &checksum) {
+    pthread_t tids[NUM_PRODUCERS];
+    bench_ctx_t<Q> ctx[NUM_PRODUCERS];
+    const uint64_t total = (uint64_t)NUM_PRODUCERS * ITEMS_PER_PRODUCER;
+    uint64_t received = 0;
+    uintptr_t items[BATCH_SIZE];
+
+    checksum = 0;
+    int64_t start = now_ns();
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        ctx[i].queue = &queue;
+        ctx[i].base = (uintptr_t)i * ITEMS_PER_PRODUCER;
+        ctx[i].wait = wait;
+        pthread_create(&tids[i], NULL, producer<Q>, &ctx[i]);
+    }
+    while (received < total) {
+        uint32_t n = batched ? queue.dequeueAll(items, BATCH_SIZE) :
+                (queue.dequeue(items[0]) ? 1 : 0);
+        if (0 == n) {
+            sched_yield();
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            checksum += items[i];
+        }
+        received += n;
+    }
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    return (now_ns() - start) / (int64_t)total;
+}
+
+static uint64_t expected_checksum() {
+    uint64_t n = (uint64_t)NUM_PRODUCERS * ITEMS_PER_PRODUCER;
+    return n * (n + 1) / 2;
+}
+
+static uint32_t item_key(const uintptr_t &data, void *) {
+    return (uint32_t)data;
+}
+
+static bool match_item(const uintptr_t &data, void *, void *match_data) {
+    return data == *(uintptr_t *)match_data;
+}
+
+// Compare the old per-node malloc queue against the pooled queue.
+TEST(cam_queue_bench, contention) {
+    uint64_t sum;
+
+    MallocQueue mallocQ;
+    int64_t malloc_ns = run_contention(mallocQ, false, false, sum);
+    ASSERT_EQ(expected_checksum(), sum);
+
+    QCameraQueueT<uintptr_t> pooledQ;
+    int64_t pooled_ns = run_contention(pooledQ, false, false, sum);
+    ASSERT_EQ(expected_checksum(), sum);
+
+    QCameraQueueT<uintptr_t> batchQ;
+    int64_t batch_ns = run_contention(batchQ, false, true, sum);
+    ASSERT_EQ(expected_checksum(), sum);
+
+    QCameraQueueT<uintptr_t> boundedQ(NULL, NULL, BOUNDED_CAPACITY);
+    int64_t bounded_ns = run_contention(boundedQ, true, true, sum);
+    ASSERT_EQ(expected_checksum(), sum);
+    ASSERT_EQ(0u, boundedQ.getCurrentSize());
+
+    printf("%d producers x %d items, ns/item: malloc %lld, pooled %lld, "
+            "pooled+dequeueAll %lld, bounded(%d)+dequeueAll %lld\n",
+            NUM_PRODUCERS, ITEMS_PER_PRODUCER, (long long)malloc_ns,
+            (long long)pooled_ns, (long long)batch_ns, BOUNDED_CAPACITY,
+            (long long)bounded_ns);
+}
+
+// Compare keyed removal against a linear match scan at a deep queue.
+TEST(cam_queue_bench, keyed_removal) {
+    QCameraQueueT<uintptr_t> queue(NULL, NULL, 0, item_key);
+    uintptr_t next = 1;
+    uintptr_t data;
+
+    for (int i = 0; i < KEYED_DEPTH; i++) {
+        ASSERT_TRUE(queue.enqueue(next++));
+    }
+
+    // remove from the middle of the queue, then refill
+    int64_t start = now_ns();
+    for (int i = 0; i < KEYED_ROUNDS; i++) {
+        uintptr_t victim = next - KEYED_DEPTH / 2;
+        ASSERT_EQ(1u, queue.flushNodesByKey((uint32_t)victim));
+        queue.enqueue(next++);
+    }
+    int64_t keyed_ns = (now_ns() - start) / KEYED_ROUNDS;
+
+    start = now_ns();
+    for (int i = 0; i < KEYED_ROUNDS; i++) {
+        uintptr_t victim = next - KEYED_DEPTH / 2;
+        ASSERT_EQ(1u, queue.flushNodes(match_item, &victim));
+        queue.enqueue(next++);
+    }
+    int64_t scan_ns = (now_ns() - start) / KEYED_ROUNDS;
+
+    ASSERT_EQ((uint32_t)KEYED_DEPTH, queue.getCurrentSize());
+    ASSERT_TRUE(queue.dequeueByKey((uint32_t)(next - 1), data));
+    ASSERT_EQ(next - 1, data);
+    ASSERT_FALSE(queue.dequeueByKey((uint32_t)(next - 1), data));
+
+    printf("depth %d, ns/removal: keyed %lld, scan %lld\n",
+            KEYED_DEPTH, (long long)keyed_ns, (long long)scan_ns);
+}
+
+// A bounded queue rejects enqueue when full and a flush releases waiters.
+TEST(cam_queue_bench, bounded_backpressure) {
+    QCameraQueueT<uintptr_t> queue(NULL, NULL, 2);
+    uintptr_t data;
+
+    ASSERT_TRUE(queue.enqueue(1));
+    ASSERT_TRUE(queue.enqueueWithPriority(2));
+    ASSERT_FALSE(queue.enqueue(3));
+    ASSERT_TRUE(queue.dequeue(data));
+    ASSERT_EQ(2u, data);
+    ASSERT_TRUE(queue.enqueue(3));
+
+    queue.flush();
+    ASSERT_FALSE(queue.enqueueWait(4));
+    ASSERT_TRUE(queue.isEmpty());
+}
@@ -43,9 +43,14 @@
 #define MM_JPEG_MAX_THREADS 30
 #define MM_JPEG_CIRQ_SIZE 30
 #define MM_JPEG_MAX_SESSION 10
+#define MAX_JPEG_CLIENT_NUM 8
+#define MM_JPEG_QUEUE_HASH_SIZE 32
+#define MM_JPEG_QUEUE_NODE_CACHE 32
 #define MAX_EXIF_TABLE_ENTRIES 50
+#define MM_JPEG_EXIF_ARENA_SIZE 512
 #define MAX_JPEG_SIZE 20000000
 #define MAX_OMX_HANDLES (5)
+#define MM_JPEGDEC_POOL_SIZE 8
 #define ASPECT_TOLERANCE 0.001
 
 
@@ -63,6 +68,24 @@ typedef enum {
 } mm_jpeg_abort_state_t;
 
 
+/** mm_jpeg_swenc_mode_t:
+ *  @MM_JPEG_SWENC_OFF: hardware encoder only
+ *  @MM_JPEG_SWENC_OVERFLOW: software encoder takes burst jobs when the
+ *                           hardware sessions are busy, and replaces the
+ *                           hardware encoder if it cannot be opened
+ *  @MM_JPEG_SWENC_FORCE: software encoder for every session
+ *
+ *  Use of the software encoder, from persist.camera.jpeg.swenc
+ **/
+typedef enum {
+  MM_JPEG_SWENC_OFF,
+  MM_JPEG_SWENC_OVERFLOW,
+  MM_JPEG_SWENC_FORCE,
+} mm_jpeg_swenc_mode_t;
+
+#define MM_JPEG_HW_ENC_COMP_NAME "OMX.qcom.image.jpeg.encoder"
+#define MM_JPEG_SW_ENC_COMP_NAME "OMX.qcom.image.jpeg.encoder_sw"
+
 /* define max num of supported concurrent jpeg jobs by OMX engine.
  * Current, only one per time */
 #define NUM_MAX_JPEG_CNCURRENT_JOBS 2
@@ -70,6 +93,10 @@ typedef enum {
 #define JOB_ID_MAGICVAL 0x1
 #define JOB_HIST_MAX 10000
 
+/* a queued job is promoted by one priority level per aging period,
+ * so that burst and reprocess jobs cannot starve */
+#define MM_JPEG_JOB_AGING_MS 300
+
 /** DUMP_TO_FILE:
  *  @filename: file name
  *  @p_addr: address of the buffer
@@ -247,15 +274,34 @@ typedef union {
   void* p;
 } mm_jpeg_q_data_t;
 
-  typedef struct {
+typedef struct {
   struct cam_list list;
   mm_jpeg_q_data_t data;
+  /* job index links, used by queues of mm_jpeg_job_q_node_t */
+  struct cam_list hash_list;
+  struct cam_list session_list;
+  uint32_t job_id;
+  uint32_t session_id;
 } mm_jpeg_q_node_t;
 
+/** mm_jpeg_queue_index_t:
+ *  @hash: nodes hashed by job id
+ *  @session: nodes of each session in queue order
+ *
+ *  Job index of a queue, for removal without walking the queue
+ **/
+typedef struct {
+  struct cam_list hash[MM_JPEG_QUEUE_HASH_SIZE];
+  struct cam_list session[MAX_JPEG_CLIENT_NUM][MM_JPEG_MAX_SESSION];
+} mm_jpeg_queue_index_t;
+
 typedef struct {
   mm_jpeg_q_node_t head; /* dummy head */
   uint32_t size;
   pthread_mutex_t lock;
+  struct cam_list free_nodes;   /* nodes kept for the next enqueue */
+  uint32_t num_free;
+  mm_jpeg_queue_index_t *index; /* job index, NULL for plain queues */
 } mm_jpeg_queue_t;
 
 typedef enum {
@@ -265,6 +311,63 @@ typedef enum {
   MM_JPEG_CMD_TYPE_MAX
 } mm_jpeg_cmd_type_t;
 
+/** mm_jpeg_exif_arena_t:
+ *  @data: payload storage
+ *  @used: bytes handed out
+ *
+ *  Bump allocator for the exif tag payloads of one job
+ **/
+typedef struct {
+  uint64_t data[MM_JPEG_EXIF_ARENA_SIZE / sizeof(uint64_t)];
+  size_t used;
+} mm_jpeg_exif_arena_t;
+
+/** mm_jpeg_port_key_t:
+ *  @dim: frame dimension
+ *  @stride: luma stride
+ *  @scanline: luma scanline
+ *  @format: color format
+ *  @buf_size: buffer size
+ *  @num_bufs: buffer count
+ *  @plane_len: luma and chroma plane lengths
+ *  @plane_offset: plane offsets
+ *
+ *  Port configuration of a cached session
+ **/
+typedef struct {
+  cam_dimension_t dim;
+  int32_t stride;
+  int32_t scanline;
+  mm_jpeg_color_format format;
+  size_t buf_size;
+  uint32_t num_bufs;
+  uint32_t plane_len[2];
+  uint32_t plane_offset[3];
+} mm_jpeg_port_key_t;
+
+/** mm_jpeg_session_key_t:
+ *  @main: main image input port
+ *  @thumb: thumbnail input port
+ *  @out: output port
+ *  @encode_thumbnail: thumbnail port is enabled
+ *  @rotation: main image rotation
+ *  @quality: main image quality
+ *  @thumb_quality: thumbnail quality
+ *  @burst_mode: burst mode
+ *
+ *  Configuration a cached OMX session was last set up with
+ **/
+typedef struct {
+  mm_jpeg_port_key_t main;
+  mm_jpeg_port_key_t thumb;
+  mm_jpeg_port_key_t out;
+  uint32_t encode_thumbnail;
+  uint32_t rotation;
+  uint32_t quality;
+  uint32_t thumb_quality;
+  uint32_t burst_mode;
+} mm_jpeg_session_key_t;
+
 typedef struct mm_jpeg_job_session {
   uint32_t client_hdl;           /* client handler */
   uint32_t jobId;                /* job ID */
@@ -301,6 +404,7 @@ typedef struct mm_jpeg_job_session {
 
   QEXIF_INFO_DATA exif_info_local[MAX_EXIF_TABLE_ENTRIES];  //all exif tags for JPEG encoder
   int exif_count_local;
+  mm_jpeg_exif_arena_t exif_arena;  // payloads of exif_info_local
 
   mm_jpeg_cirq_t cb_q;
   int32_t ebd_count;
@@ -337,6 +441,15 @@ typedef struct mm_jpeg_job_session {
 
   int thumb_from_main;
   uint32_t job_index;
+
+  /* session runs on the software encoder */
+  OMX_BOOL sw_encoder;
+
+  /* idle session kept with its OMX handle in Loaded state for reuse */
+  OMX_BOOL cached;
+  /* the component ports match cache_key */
+  OMX_BOOL ports_valid;
+  mm_jpeg_session_key_t cache_key;
 } mm_jpeg_job_session_t;
 
 typedef struct {
@@ -357,6 +470,8 @@ typedef struct {
     mm_jpeg_encode_job_info_t enc_info;
     mm_jpeg_decode_job_info_t dec_info;
   };
+  mm_jpeg_job_priority_t priority; /* scheduling priority */
+  uint64_t enq_time_ms;            /* time the job was queued */
 } mm_jpeg_job_q_node_t;
 
 typedef struct {
@@ -370,9 +485,20 @@ typedef struct {
   pthread_t pid;                  /* job cmd thread ID */
   cam_semaphore_t job_sem;        /* semaphore for job cmd thread */
   mm_jpeg_queue_t job_queue;      /* queue for job to do */
+  uint32_t last_client_idx;       /* client served last, for round robin */
 } mm_jpeg_job_cmd_thread_t;
 
-#define MAX_JPEG_CLIENT_NUM 8
+/** mm_jpegdec_pool_buf_t:
+ *  @ion_buf: ION buffer
+ *  @in_use: buffer is held by the client
+ *
+ *  Decoder output buffer kept for the next decode
+ **/
+typedef struct {
+  buffer_t ion_buf;
+  OMX_BOOL in_use;
+} mm_jpegdec_pool_buf_t;
+
 typedef struct mm_jpeg_obj_t {
   /* ClientMgr */
   int num_clients;                                /* num of clients */
@@ -396,6 +522,16 @@ typedef struct mm_jpeg_obj_t {
 
   uint32_t num_sessions;
 
+  mm_jpeg_swenc_mode_t swenc_mode;
+  /* jobs allowed to run at once, hardware plus software overflow */
+  uint32_t max_ongoing_jobs;
+
+  /* keep idle OMX sessions for the next session of the client */
+  uint32_t session_cache_enabled;
+  uint32_t num_cached_sessions;
+
+  /* decoder output buffers recycled between decodes */
+  mm_jpegdec_pool_buf_t dec_pool[MM_JPEGDEC_POOL_SIZE];
 } mm_jpeg_obj;
 
 /** mm_jpeg_pending_func_t:
@@ -440,6 +576,16 @@ extern int32_t mm_jpegdec_destroy_session_by_id(mm_jpeg_obj *my_obj,
 extern int32_t mm_jpegdec_abort_job(mm_jpeg_obj *my_obj,
   uint32_t jobId);
 
+extern void mm_jpegdec_release_cached_sessions(mm_jpeg_obj *my_obj,
+  uint32_t client_hdl);
+
+extern int32_t mm_jpegdec_get_buffer(mm_jpeg_obj *my_obj,
+  size_t size,
+  mm_jpeg_buf_t *p_buf);
+
+extern int32_t mm_jpegdec_put_buffer(mm_jpeg_obj *my_obj,
+  mm_jpeg_buf_t *p_buf);
+
 int32_t mm_jpegdec_process_decoding_job(mm_jpeg_obj *my_obj,
     mm_jpeg_job_q_node_t* job_node);
 
@@ -450,6 +596,7 @@ uint8_t mm_jpeg_util_get_index_by_handler(uint32_t handler);
 
 /* basic queue functions */
 extern int32_t mm_jpeg_queue_init(mm_jpeg_queue_t* queue);
+extern int32_t mm_jpeg_queue_init_indexed(mm_jpeg_queue_t* queue);
 extern int32_t mm_jpeg_queue_enq(mm_jpeg_queue_t* queue,
     mm_jpeg_q_data_t data);
 extern int32_t mm_jpeg_queue_enq_head(mm_jpeg_queue_t* queue,
@@ -459,12 +606,19 @@ extern int32_t mm_jpeg_queue_deinit(mm_jpeg_queue_t* queue);
 extern int32_t mm_jpeg_queue_flush(mm_jpeg_queue_t* queue);
 extern uint32_t mm_jpeg_queue_get_size(mm_jpeg_queue_t* queue);
 extern mm_jpeg_q_data_t mm_jpeg_queue_peek(mm_jpeg_queue_t* queue);
-extern int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
+extern mm_jpeg_q_node_t* mm_jpeg_queue_find_job_unlk(mm_jpeg_queue_t* queue,
+    uint32_t job_id);
+extern mm_jpeg_q_node_t* mm_jpeg_queue_find_session_unlk(
+    mm_jpeg_queue_t* queue, uint32_t session_id);
+extern mm_jpeg_q_data_t mm_jpeg_queue_remove_node_unlk(mm_jpeg_queue_t* queue,
+    mm_jpeg_q_node_t* node);
+extern int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info,
+  mm_jpeg_exif_arena_t *p_arena, exif_tag_id_t tagid,
   exif_tag_type_t type, uint32_t count, void *data);
-extern int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data);
+extern void mm_jpeg_exif_arena_reset(mm_jpeg_exif_arena_t *p_arena);
 extern int process_meta_data(metadata_buffer_t *p_meta,
-  QOMX_EXIF_INFO *exif_info, mm_jpeg_exif_params_t *p_cam3a_params,
-  cam_hal_version_t hal_version);
+  QOMX_EXIF_INFO *exif_info, mm_jpeg_exif_arena_t *p_arena,
+  mm_jpeg_exif_params_t *p_cam3a_params, cam_hal_version_t hal_version);
 
 OMX_ERRORTYPE mm_jpeg_session_change_state(mm_jpeg_job_session_t* p_session,
   OMX_STATETYPE new_state,
@@ -85,7 +85,8 @@ static inline int mm_jpeg_get_new_session_idx(mm_jpeg_obj *my_obj, int client_id
   int index = -1;
   for (i = 0; i < MM_JPEG_MAX_SESSION; i++) {
     pthread_mutex_lock(&my_obj->clnt_mgr[client_idx].lock);
-    if (!my_obj->clnt_mgr[client_idx].session[i].active) {
+    if (!my_obj->clnt_mgr[client_idx].session[i].active &&
+      !my_obj->clnt_mgr[client_idx].session[i].cached) {
       *pp_session = &my_obj->clnt_mgr[client_idx].session[i];
       my_obj->clnt_mgr[client_idx].session[i].active = OMX_TRUE;
       index = i;
@@ -97,6 +98,53 @@ static inline int mm_jpeg_get_new_session_idx(mm_jpeg_obj *my_obj, int client_id
   return index;
 }
 
+/** mm_jpeg_get_cached_session_idx:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @client_idx: client index
+ *    @sw_encoder: encoder type of the session
+ *    @p_key: wanted configuration, NULL takes any cached session
+ *    @pp_session: cached session
+ *
+ *  Return:
+ *       session index, -1 if no session is cached
+ *
+ *  Description:
+ *       Take a cached session of the client, preferring one
+ *       whose configuration matches @p_key
+ *
+ **/
+static inline int mm_jpeg_get_cached_session_idx(mm_jpeg_obj *my_obj,
+  int client_idx, OMX_BOOL sw_encoder, mm_jpeg_session_key_t *p_key,
+  mm_jpeg_job_session_t **pp_session)
+{
+  int i = 0;
+  int index = -1;
+  mm_jpeg_job_session_t *p_session;
+
+  pthread_mutex_lock(&my_obj->clnt_mgr[client_idx].lock);
+  for (i = 0; i < MM_JPEG_MAX_SESSION; i++) {
+    p_session = &my_obj->clnt_mgr[client_idx].session[i];
+    if (!p_session->cached || (p_session->sw_encoder != sw_encoder)) {
+      continue;
+    }
+    if ((index < 0) || (p_session->ports_valid && (NULL != p_key) &&
+      !memcmp(&p_session->cache_key, p_key, sizeof(*p_key)))) {
+      index = i;
+    }
+  }
+  if (index >= 0) {
+    p_session = &my_obj->clnt_mgr[client_idx].session[index];
+    p_session->cached = OMX_FALSE;
+    p_session->active = OMX_TRUE;
+    my_obj->num_cached_sessions--;
+    *pp_session = p_session;
+  }
+  pthread_mutex_unlock(&my_obj->clnt_mgr[client_idx].lock);
+  return index;
+}
+
 /** mm_jpeg_get_job_idx:
  *
  *  Arguments:
@@ -37,7 +37,9 @@
 #include <sys/prctl.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <time.h>
 #include <cutils/trace.h>
+#include <cutils/properties.h>
 #include <math.h>
 
 #include "mm_jpeg_dbg.h"
@@ -64,6 +66,9 @@
 #define MM_JPEG_CONCURRENT_SESSIONS_COUNT 1
 #endif
 
+/* idle sessions kept for reuse, enough for one burst session chain */
+#define MM_JPEG_MAX_CACHED_SESSIONS (MM_JPEG_CONCURRENT_SESSIONS_COUNT + 1)
+
 OMX_ERRORTYPE mm_jpeg_ebd(OMX_HANDLETYPE hComponent,
     OMX_PTR pAppData,
     OMX_BUFFERHEADERTYPE* pBuffer);
@@ -286,10 +291,13 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
 {
   OMX_ERRORTYPE rc = OMX_ErrorNone;
   mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
-  char *omx_lib = "OMX.qcom.image.jpeg.encoder";
+  char *omx_lib = MM_JPEG_HW_ENC_COMP_NAME;
+  OMX_BOOL reuse = (NULL != p_session->omx_handle) ? OMX_TRUE : OMX_FALSE;
 
-  pthread_mutex_init(&p_session->lock, NULL);
-  pthread_cond_init(&p_session->cond, NULL);
+  if (!reuse) {
+    pthread_mutex_init(&p_session->lock, NULL);
+    pthread_cond_init(&p_session->cond, NULL);
+  }
   cirq_reset(&p_session->cb_q);
   p_session->state_change_pending = OMX_FALSE;
   p_session->abort_state = MM_JPEG_ABORT_NONE;
@@ -299,6 +307,7 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
   p_session->encode_pid = -1;
   p_session->config = OMX_FALSE;
   p_session->exif_count_local = 0;
+  mm_jpeg_exif_arena_reset(&p_session->exif_arena);
   p_session->auto_out_buf = OMX_FALSE;
 
   p_session->omx_callbacks.EmptyBufferDone = mm_jpeg_ebd;
@@ -311,10 +320,32 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
   omx_lib = "OMX.qcom.image.jpeg.encoder_pipeline";
 #endif
 
+  if (reuse) {
+    /* cached handle in Loaded state, the ports are set up by configure */
+    CDBG_HIGH("%s:%d] reusing cached session, ports valid %d",
+      __func__, __LINE__, p_session->ports_valid);
+    return rc;
+  }
+
+  p_session->ports_valid = OMX_FALSE;
+  if (p_session->sw_encoder) {
+    omx_lib = MM_JPEG_SW_ENC_COMP_NAME;
+  }
+
   rc = OMX_GetHandle(&p_session->omx_handle,
       omx_lib,
       (void *)p_session,
       &p_session->omx_callbacks);
+  if ((OMX_ErrorNone != rc) && !p_session->sw_encoder &&
+    (MM_JPEG_SWENC_OFF != my_obj->swenc_mode)) {
+    CDBG_HIGH("%s:%d] %s unavailable (%d), using software encoder",
+      __func__, __LINE__, omx_lib, rc);
+    p_session->sw_encoder = OMX_TRUE;
+    rc = OMX_GetHandle(&p_session->omx_handle,
+        MM_JPEG_SW_ENC_COMP_NAME,
+        (void *)p_session,
+        &p_session->omx_callbacks);
+  }
   if (OMX_ErrorNone != rc) {
     CDBG_ERROR("%s:%d] OMX_GetHandle failed (%d)", __func__, __LINE__, rc);
     return rc;
@@ -395,6 +426,74 @@ void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
   CDBG_HIGH("%s:%d] Session destroy successful. X", __func__, __LINE__);
 }
 
+/** mm_jpeg_session_park:
+ *
+ *  Arguments:
+ *    @p_session: job session
+ *
+ *  Return:
+ *       OMX_TRUE if the session is cached
+ *
+ *  Description:
+ *       Return the session to Loaded state and keep its OMX
+ *       handle for the next session of the client. The caller
+ *       destroys the session if it cannot be cached.
+ *
+ **/
+static OMX_BOOL mm_jpeg_session_park(mm_jpeg_job_session_t *p_session)
+{
+  OMX_ERRORTYPE rc = OMX_ErrorNone;
+  OMX_STATETYPE state = OMX_StateInvalid;
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
+  uint8_t clnt_idx = mm_jpeg_util_get_index_by_handler(p_session->client_hdl);
+
+  /* the component keeps a pointer to the metadata key, which is freed
+   * with the session */
+  if (!my_obj->session_cache_enabled || (NULL == p_session->omx_handle) ||
+    !p_session->ports_valid || (NULL != p_session->meta_enc_key) ||
+    (clnt_idx >= MAX_JPEG_CLIENT_NUM) ||
+    (my_obj->num_cached_sessions >= MM_JPEG_MAX_CACHED_SESSIONS)) {
+    return OMX_FALSE;
+  }
+
+  rc = OMX_GetState(p_session->omx_handle, &state);
+  if ((OMX_ErrorNone == rc) &&
+    ((state == OMX_StateExecuting) || (state == OMX_StatePause))) {
+    rc = mm_jpeg_session_change_state(p_session, OMX_StateIdle, NULL);
+    if (OMX_ErrorNone == rc) {
+      rc = OMX_GetState(p_session->omx_handle, &state);
+    }
+  }
+
+  /* the buffers belong to the client and cannot stay registered */
+  if ((OMX_ErrorNone == rc) && (state == OMX_StateIdle)) {
+    rc = mm_jpeg_session_change_state(p_session, OMX_StateLoaded,
+      mm_jpeg_session_free_buffers);
+    if (OMX_ErrorNone == rc) {
+      rc = OMX_GetState(p_session->omx_handle, &state);
+    }
+  }
+
+  if ((OMX_ErrorNone != rc) || (OMX_StateLoaded != state) ||
+    (OMX_ErrorNone != p_session->error_flag)) {
+    CDBG_ERROR("%s:%d] cannot cache session, rc %d state %d error %d",
+      __func__, __LINE__, rc, state, p_session->error_flag);
+    return OMX_FALSE;
+  }
+
+  p_session->config = OMX_FALSE;
+  p_session->next_session = NULL;
+
+  pthread_mutex_lock(&my_obj->clnt_mgr[clnt_idx].lock);
+  p_session->cached = OMX_TRUE;
+  pthread_mutex_unlock(&my_obj->clnt_mgr[clnt_idx].lock);
+  my_obj->num_cached_sessions++;
+
+  CDBG_HIGH("%s:%d] session %x cached, %d cached sessions", __func__,
+    __LINE__, p_session->sessionId, my_obj->num_cached_sessions);
+  return OMX_TRUE;
+}
+
 
 
 /** mm_jpeg_session_config_main_buffer_offset:
@@ -718,10 +817,79 @@ int map_jpeg_format(mm_jpeg_color_format color_fmt)
   }
 }
 
+/** mm_jpeg_port_key_fill:
+ *
+ *  Arguments:
+ *    @p_key: port key
+ *    @p_buf: first buffer of the port
+ *    @p_dim: port dimension
+ *    @format: color format
+ *    @num_bufs: buffer count
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Fill the key of one port
+ *
+ **/
+static void mm_jpeg_port_key_fill(mm_jpeg_port_key_t *p_key,
+  mm_jpeg_buf_t *p_buf, cam_dimension_t *p_dim,
+  mm_jpeg_color_format format, uint32_t num_bufs)
+{
+  p_key->dim = *p_dim;
+  p_key->stride = p_buf->offset.mp[0].stride;
+  p_key->scanline = p_buf->offset.mp[0].scanline;
+  p_key->format = format;
+  p_key->buf_size = p_buf->buf_size;
+  p_key->num_bufs = num_bufs;
+  p_key->plane_len[0] = p_buf->offset.mp[0].len;
+  p_key->plane_len[1] = p_buf->offset.mp[1].len;
+  p_key->plane_offset[0] = p_buf->offset.mp[0].offset;
+  p_key->plane_offset[1] = p_buf->offset.mp[1].offset;
+  p_key->plane_offset[2] = p_buf->offset.mp[2].offset;
+}
+
+/** mm_jpeg_session_key_fill:
+ *
+ *  Arguments:
+ *    @p_params: encode params
+ *    @p_key: session key
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Fill the session configuration key used to match and
+ *       reconfigure cached sessions
+ *
+ **/
+static void mm_jpeg_session_key_fill(mm_jpeg_encode_params_t *p_params,
+  mm_jpeg_session_key_t *p_key)
+{
+  memset(p_key, 0, sizeof(*p_key));
+  mm_jpeg_port_key_fill(&p_key->main, &p_params->src_main_buf[0],
+    &p_params->main_dim.src_dim, p_params->color_format,
+    p_params->num_src_bufs);
+  if (p_params->encode_thumbnail) {
+    mm_jpeg_port_key_fill(&p_key->thumb, &p_params->src_thumb_buf[0],
+      &p_params->thumb_dim.src_dim, p_params->thumb_color_format,
+      p_params->num_tmb_bufs);
+  }
+  p_key->out.buf_size = p_params->dest_buf[0].buf_size;
+  p_key->out.num_bufs = p_params->num_dst_bufs;
+  p_key->encode_thumbnail = p_params->encode_thumbnail;
+  p_key->rotation = p_params->rotation;
+  p_key->quality = p_params->quality;
+  p_key->thumb_quality = p_params->thumb_quality;
+  p_key->burst_mode = p_params->burst_mode;
+}
+
 /** mm_jpeg_session_config_port:
  *
  *  Arguments:
  *    @p_session: job session
+ *    @p_key: configuration of the session
  *
  *  Return:
  *       OMX error values
@@ -730,11 +898,14 @@ int map_jpeg_format(mm_jpeg_color_format color_fmt)
  *       Configure OMX ports
  *
  **/
-OMX_ERRORTYPE mm_jpeg_session_config_ports(mm_jpeg_job_session_t* p_session)
+OMX_ERRORTYPE mm_jpeg_session_config_ports(mm_jpeg_job_session_t* p_session,
+  const mm_jpeg_session_key_t *p_key)
 {
   OMX_ERRORTYPE ret = OMX_ErrorNone;
   mm_jpeg_encode_params_t *p_params = &p_session->params;
   OMX_CONFIG_ROTATIONTYPE rotate;
+  const mm_jpeg_session_key_t *p_old =
+    p_session->ports_valid ? &p_session->cache_key : NULL;
 
   mm_jpeg_buf_t *p_src_buf =
     &p_params->src_main_buf[0];
@@ -743,22 +914,14 @@ OMX_ERRORTYPE mm_jpeg_session_config_ports(mm_jpeg_job_session_t* p_session)
   p_session->outputPort.nPortIndex = 1;
   p_session->inputTmbPort.nPortIndex = 2;
 
-  ret = OMX_GetParameter(p_session->omx_handle, OMX_IndexParamPortDefinition,
-    &p_session->inputPort);
-  if (ret) {
-    CDBG_ERROR("%s:%d] failed", __func__, __LINE__);
-    return ret;
-  }
-
-  ret = OMX_GetParameter(p_session->omx_handle, OMX_IndexParamPortDefinition,
-    &p_session->inputTmbPort);
-  if (ret) {
-    CDBG_ERROR("%s:%d] failed", __func__, __LINE__);
-    return ret;
+  /* a cached session only needs the ports that changed */
+  if (p_old && !memcmp(&p_old->main, &p_key->main, sizeof(p_key->main))) {
+    CDBG("%s:%d] main port unchanged", __func__, __LINE__);
+    goto config_thumb;
   }
 
   ret = OMX_GetParameter(p_session->omx_handle, OMX_IndexParamPortDefinition,
-    &p_session->outputPort);
+    &p_session->inputPort);
   if (ret) {
     CDBG_ERROR("%s:%d] failed", __func__, __LINE__);
     return ret;
@@ -784,6 +947,20 @@ OMX_ERRORTYPE mm_jpeg_session_config_ports(mm_jpeg_job_session_t* p_session)
     return ret;
   }
 
+config_thumb:
+  if (p_old && (p_old->encode_thumbnail == p_key->encode_thumbnail) &&
+    !memcmp(&p_old->thumb, &p_key->thumb, sizeof(p_key->thumb))) {
+    CDBG("%s:%d] thumbnail port unchanged", __func__, __LINE__);
+    goto config_out;
+  }
+
+  ret = OMX_GetParameter(p_session->omx_handle, OMX_IndexParamPortDefinition,
+    &p_session->inputTmbPort);
+  if (ret) {
+    CDBG_ERROR("%s:%d] failed", __func__, __LINE__);
+    return ret;
+  }
+
   if (p_session->params.encode_thumbnail) {
     mm_jpeg_buf_t *p_tmb_buf =
       &p_params->src_thumb_buf[0];
@@ -828,6 +1005,19 @@ OMX_ERRORTYPE mm_jpeg_session_config_ports(mm_jpeg_job_session_t* p_session)
     }
   }
 
+config_out:
+  if (p_old && !memcmp(&p_old->out, &p_key->out, sizeof(p_key->out))) {
+    CDBG("%s:%d] output port unchanged", __func__, __LINE__);
+    goto config_rotation;
+  }
+
+  ret = OMX_GetParameter(p_session->omx_handle, OMX_IndexParamPortDefinition,
+    &p_session->outputPort);
+  if (ret) {
+    CDBG_ERROR("%s:%d] failed", __func__, __LINE__);
+    return ret;
+  }
+
   p_session->outputPort.nBufferSize =
     p_params->dest_buf[0].buf_size;
   p_session->outputPort.nBufferCountActual = (OMX_U32)p_params->num_dst_bufs;
@@ -838,6 +1028,11 @@ OMX_ERRORTYPE mm_jpeg_session_config_ports(mm_jpeg_job_session_t* p_session)
     return ret;
   }
 
+config_rotation:
+  if (p_old && (p_old->rotation == p_key->rotation)) {
+    return ret;
+  }
+
   /* set rotation */
   memset(&rotate, 0, sizeof(rotate));
   rotate.nPortIndex = 1;
@@ -1154,21 +1349,30 @@ OMX_ERRORTYPE mm_jpeg_session_config_main_crop(mm_jpeg_job_session_t *p_session)
 OMX_ERRORTYPE mm_jpeg_session_config_main(mm_jpeg_job_session_t *p_session)
 {
   OMX_ERRORTYPE rc = OMX_ErrorNone;
+  mm_jpeg_session_key_t key;
+  OMX_BOOL main_valid;
+
+  mm_jpeg_session_key_fill(&p_session->params, &key);
+  main_valid = (p_session->ports_valid && !memcmp(&p_session->cache_key.main,
+    &key.main, sizeof(key.main))) ? OMX_TRUE : OMX_FALSE;
 
   /* config port */
   CDBG_HIGH("%s:%d] config port", __func__, __LINE__);
-  rc = mm_jpeg_session_config_ports(p_session);
+  rc = mm_jpeg_session_config_ports(p_session, &key);
+  p_session->ports_valid = OMX_FALSE;
   if (OMX_ErrorNone != rc) {
     CDBG_ERROR("%s: config port failed", __func__);
     return rc;
   }
 
   /* config buffer offset */
-  CDBG("%s:%d] config main buf offset", __func__, __LINE__);
-  rc = mm_jpeg_session_config_main_buffer_offset(p_session);
-  if (OMX_ErrorNone != rc) {
-    CDBG_ERROR("%s: config buffer offset failed", __func__);
-    return rc;
+  if (!main_valid) {
+    CDBG("%s:%d] config main buf offset", __func__, __LINE__);
+    rc = mm_jpeg_session_config_main_buffer_offset(p_session);
+    if (OMX_ErrorNone != rc) {
+      CDBG_ERROR("%s: config buffer offset failed", __func__);
+      return rc;
+    }
   }
 
   /* set the encoding mode */
@@ -1198,6 +1402,9 @@ OMX_ERRORTYPE mm_jpeg_session_config_main(mm_jpeg_job_session_t *p_session)
     return rc;
   }
 
+  p_session->cache_key = key;
+  p_session->ports_valid = OMX_TRUE;
+
   return rc;
 }
 
@@ -1256,8 +1463,10 @@ OMX_ERRORTYPE mm_jpeg_session_config_common(mm_jpeg_job_session_t *p_session)
   /*parse aditional exif data from the metadata*/
   exif_info.numOfEntries = 0;
   exif_info.exif_data = &p_session->exif_info_local[0];
+  mm_jpeg_exif_arena_reset(&p_session->exif_arena);
   process_meta_data(p_jobparams->p_metadata, &exif_info,
-    &p_jobparams->cam_exif_params, p_jobparams->hal_version);
+    &p_session->exif_arena, &p_jobparams->cam_exif_params,
+    p_jobparams->hal_version);
   /* After Parse metadata */
   p_session->exif_count_local = (int)exif_info.numOfEntries;
 
@@ -1416,7 +1625,9 @@ static OMX_ERRORTYPE mm_jpeg_configure_job_params(
   CDBG_ERROR("%s:%d] Work buffer info %d %p WorkBufSize: %d invalidate", __func__, __LINE__,
     work_buffer.fd, work_buffer.vaddr, work_buffer.length);
 
-  buffer_invalidate(&p_session->work_buffer);
+  if (!p_session->sw_encoder) {
+    buffer_invalidate(&p_session->work_buffer);
+  }
 
   ret = OMX_SetConfig(p_session->omx_handle, work_buffer_index,
     &work_buffer);
@@ -1709,6 +1920,124 @@ error:
 
 
 
+/** mm_jpeg_get_time_ms:
+ *
+ *  Arguments:
+ *    none
+ *
+ *  Return:
+ *       monotonic time in milliseconds
+ *
+ *  Description:
+ *       Time source for job aging
+ *
+ **/
+static uint64_t mm_jpeg_get_time_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/** mm_jpeg_jobmgr_pick_job:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @admit: OMX_TRUE if a new job can be started
+ *
+ *  Return:
+ *       job node removed from the todo queue, NULL if none is eligible
+ *
+ *  Description:
+ *       Picks the next job to run. The EXIT command is always taken.
+ *       Otherwise the job with the best aged priority wins; ties go to
+ *       the next client after the one served last, then to the oldest
+ *       job. Encode jobs whose session has no free OMX handle are
+ *       skipped so that they do not block other sessions.
+ *
+ **/
+static mm_jpeg_job_q_node_t *mm_jpeg_jobmgr_pick_job(mm_jpeg_obj *my_obj,
+  OMX_BOOL admit)
+{
+  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
+  mm_jpeg_queue_t *queue = &cmd_thread->job_queue;
+  mm_jpeg_q_node_t *node = NULL;
+  mm_jpeg_q_node_t *best = NULL;
+  mm_jpeg_job_q_node_t *data = NULL;
+  mm_jpeg_job_q_node_t *job_node = NULL;
+  mm_jpeg_job_session_t *p_session = NULL;
+  struct cam_list *head = NULL;
+  struct cam_list *pos = NULL;
+  uint32_t best_level = MM_JPEG_JOB_PRIO_MAX;
+  uint32_t best_dist = MAX_JPEG_CLIENT_NUM;
+  uint32_t best_client = 0;
+  uint32_t level, aging, dist, job_id, client_idx, session_idx;
+  uint64_t now = mm_jpeg_get_time_ms();
+
+  pthread_mutex_lock(&queue->lock);
+  head = &queue->head.list;
+  for (pos = head->next; pos != head; pos = pos->next) {
+    node = member_of(pos, mm_jpeg_q_node_t, list);
+    data = (mm_jpeg_job_q_node_t *)node->data.p;
+    if (NULL == data) {
+      continue;
+    }
+
+    if (MM_JPEG_CMD_TYPE_EXIT == data->type) {
+      best = node;
+      break;
+    }
+
+    if (OMX_FALSE == admit) {
+      continue;
+    }
+
+    if (MM_JPEG_CMD_TYPE_DECODE_JOB == data->type) {
+      job_id = data->dec_info.job_id;
+    } else {
+      job_id = data->enc_info.job_id;
+    }
+    client_idx = GET_CLIENT_IDX(job_id);
+    session_idx = GET_SESSION_IDX(job_id);
+
+    if ((MM_JPEG_CMD_TYPE_JOB == data->type) &&
+      (client_idx < MAX_JPEG_CLIENT_NUM) &&
+      (session_idx < MM_JPEG_MAX_SESSION)) {
+      p_session = &my_obj->clnt_mgr[client_idx].session[session_idx];
+      if ((NULL != p_session->session_handle_q) &&
+        (0 == mm_jpeg_queue_get_size(p_session->session_handle_q))) {
+        /* session busy, revisited when mm_jpegenc_job_done frees it */
+        continue;
+      }
+    }
+
+    level = (uint32_t)data->priority;
+    aging = (uint32_t)((now - data->enq_time_ms) / MM_JPEG_JOB_AGING_MS);
+    level = (aging >= level) ? 0 : (level - aging);
+    dist = (client_idx + MAX_JPEG_CLIENT_NUM - cmd_thread->last_client_idx - 1)
+      % MAX_JPEG_CLIENT_NUM;
+
+    if ((level < best_level) ||
+      ((level == best_level) && (dist < best_dist))) {
+      best = node;
+      best_level = level;
+      best_dist = dist;
+      best_client = client_idx;
+    }
+  }
+
+  if (NULL != best) {
+    job_node = (mm_jpeg_job_q_node_t *)best->data.p;
+    mm_jpeg_queue_remove_node_unlk(queue, best);
+    if (MM_JPEG_CMD_TYPE_EXIT != job_node->type) {
+      cmd_thread->last_client_idx = best_client;
+    }
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  return job_node;
+}
+
 /** mm_jpeg_jobmgr_thread:
  *
  *  Arguments:
@@ -1723,7 +2052,6 @@ error:
  **/
 static void *mm_jpeg_jobmgr_thread(void *data)
 {
-  mm_jpeg_q_data_t qdata;
   int rc = 0;
   int running = 1;
   uint32_t num_ongoing_jobs = 0;
@@ -1742,38 +2070,36 @@ static void *mm_jpeg_jobmgr_thread(void *data)
       }
     } while (rc != 0);
 
-    /* check ongoing q size */
-    num_ongoing_jobs = mm_jpeg_queue_get_size(&my_obj->ongoing_job_q);
-
-    CDBG("%s:%d] ongoing job  %d %d", __func__,
-      __LINE__, num_ongoing_jobs, MM_JPEG_CONCURRENT_SESSIONS_COUNT);
-    if (num_ongoing_jobs >= MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
-      CDBG_ERROR("%s:%d] ongoing job already reach max %d", __func__,
-        __LINE__, num_ongoing_jobs);
-      continue;
-    }
-
     pthread_mutex_lock(&my_obj->job_lock);
-    /* can go ahead with new work */
-    qdata = mm_jpeg_queue_deq(&cmd_thread->job_queue);
-    node = (mm_jpeg_job_q_node_t*)qdata.p;
-    if (node != NULL) {
-      switch (node->type) {
-      case MM_JPEG_CMD_TYPE_JOB:
-        rc = mm_jpeg_process_encoding_job(my_obj, node);
-        break;
-      case MM_JPEG_CMD_TYPE_DECODE_JOB:
-        rc = mm_jpegdec_process_decoding_job(my_obj, node);
-        break;
-      case MM_JPEG_CMD_TYPE_EXIT:
-      default:
-        /* free node */
-        free(node);
-        /* set running flag to false */
-        running = 0;
-        break;
+    /* start jobs until the engine is full or nothing is eligible. Every
+     * event that frees a slot or a session posts job_sem again, so jobs
+     * left in the queue here are revisited */
+    do {
+      num_ongoing_jobs = mm_jpeg_queue_get_size(&my_obj->ongoing_job_q);
+      CDBG("%s:%d] ongoing job  %d %d", __func__,
+        __LINE__, num_ongoing_jobs, my_obj->max_ongoing_jobs);
+
+      node = mm_jpeg_jobmgr_pick_job(my_obj,
+        (num_ongoing_jobs < my_obj->max_ongoing_jobs) ?
+        OMX_TRUE : OMX_FALSE);
+      if (node != NULL) {
+        switch (node->type) {
+        case MM_JPEG_CMD_TYPE_JOB:
+          rc = mm_jpeg_process_encoding_job(my_obj, node);
+          break;
+        case MM_JPEG_CMD_TYPE_DECODE_JOB:
+          rc = mm_jpegdec_process_decoding_job(my_obj, node);
+          break;
+        case MM_JPEG_CMD_TYPE_EXIT:
+        default:
+          /* free node */
+          free(node);
+          /* set running flag to false */
+          running = 0;
+          break;
+        }
       }
-    }
+    } while ((NULL != node) && running);
     pthread_mutex_unlock(&my_obj->job_lock);
 
   } while (running);
@@ -1798,7 +2124,7 @@ int32_t mm_jpeg_jobmgr_thread_launch(mm_jpeg_obj *my_obj)
   mm_jpeg_job_cmd_thread_t *job_mgr = &my_obj->job_mgr;
 
   cam_sem_init(&job_mgr->job_sem, 0);
-  mm_jpeg_queue_init(&job_mgr->job_queue);
+  mm_jpeg_queue_init_indexed(&job_mgr->job_queue);
 
   /* launch the thread */
   pthread_create(&job_mgr->pid,
@@ -1869,12 +2195,29 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
   uint32_t work_buf_size;
   unsigned int i = 0;
   unsigned int initial_workbufs_cnt = 1;
+  char prop[PROPERTY_VALUE_MAX];
+
+  /* 0: hardware only, 1: software overflow and fallback, 2: software only */
+  property_get("persist.camera.jpeg.swenc", prop, "0");
+  my_obj->swenc_mode = (mm_jpeg_swenc_mode_t)atoi(prop);
+  if (my_obj->swenc_mode > MM_JPEG_SWENC_FORCE) {
+    my_obj->swenc_mode = MM_JPEG_SWENC_OFF;
+  }
+  my_obj->max_ongoing_jobs = MM_JPEG_CONCURRENT_SESSIONS_COUNT;
+  if (MM_JPEG_SWENC_OVERFLOW == my_obj->swenc_mode) {
+    my_obj->max_ongoing_jobs++;
+  }
+  CDBG_HIGH("%s:%d] swenc mode %d", __func__, __LINE__, my_obj->swenc_mode);
+
+  property_get("persist.camera.jpeg.session_cache", prop, "1");
+  my_obj->session_cache_enabled = (uint32_t)atoi(prop);
+  my_obj->num_cached_sessions = 0;
 
   /* init locks */
   pthread_mutex_init(&my_obj->job_lock, NULL);
 
   /* init ongoing job queue */
-  rc = mm_jpeg_queue_init(&my_obj->ongoing_job_q);
+  rc = mm_jpeg_queue_init_indexed(&my_obj->ongoing_job_q);
   if (0 != rc) {
     CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
     pthread_mutex_destroy(&my_obj->job_lock);
@@ -2122,6 +2465,9 @@ int32_t mm_jpeg_start_job(mm_jpeg_obj *my_obj,
   node->enc_info.job_id = *job_id;
   node->enc_info.client_handle = p_session->client_hdl;
   node->type = MM_JPEG_CMD_TYPE_JOB;
+  node->priority = (p_jobparams->priority < MM_JPEG_JOB_PRIO_MAX) ?
+    p_jobparams->priority : MM_JPEG_JOB_PRIO_REPROCESS;
+  node->enq_time_ms = mm_jpeg_get_time_ms();
 
 
 
@@ -2258,6 +2604,8 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
   mm_jpeg_queue_t *p_session_handle_q, *p_out_buf_q;
   uint32_t work_bufs_need;
   char trace_tag[32];
+  mm_jpeg_session_key_t key;
+  OMX_BOOL sw_encoder;
 
   /* validate the parameters */
   if ((p_params->num_src_bufs > MM_JPEG_MAX_BUF)
@@ -2281,6 +2629,10 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
   if (work_bufs_need > MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
     work_bufs_need = MM_JPEG_CONCURRENT_SESSIONS_COUNT;
   }
+  if (p_params->burst_mode &&
+    (MM_JPEG_SWENC_OVERFLOW == my_obj->swenc_mode)) {
+    num_omx_sessions++;
+  }
   CDBG_HIGH("%s:%d] >>>> Work bufs need %d", __func__, __LINE__, work_bufs_need);
   work_buf_size = CEILING64((uint32_t)my_obj->max_pic_w) *
       CEILING64((uint32_t)my_obj->max_pic_h) * 3 / 2;
@@ -2326,9 +2678,26 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
     goto error1;
   }
 
+  mm_jpeg_session_key_fill(p_params, &key);
+
   for (i = 0; i < num_omx_sessions; i++) {
     uint32_t buf_idx = 0U;
-    session_idx = mm_jpeg_get_new_session_idx(my_obj, clnt_idx, &p_session);
+
+    /* the software session of a burst is last so the hardware sessions
+     * are used first */
+    sw_encoder = ((MM_JPEG_SWENC_FORCE == my_obj->swenc_mode) ||
+      (p_params->burst_mode &&
+      (MM_JPEG_SWENC_OVERFLOW == my_obj->swenc_mode) &&
+      (i == num_omx_sessions - 1))) ? OMX_TRUE : OMX_FALSE;
+
+    session_idx = -1;
+    if (my_obj->session_cache_enabled) {
+      session_idx = mm_jpeg_get_cached_session_idx(my_obj, clnt_idx,
+        sw_encoder, &key, &p_session);
+    }
+    if (session_idx < 0) {
+      session_idx = mm_jpeg_get_new_session_idx(my_obj, clnt_idx, &p_session);
+    }
     if (session_idx < 0 || NULL == p_session) {
       CDBG_ERROR("%s:%d] invalid session id (%d)", __func__, __LINE__, session_idx);
       goto error2;
@@ -2346,8 +2715,15 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
     }
     p_prev_session = p_session;
 
+    p_session->sw_encoder = sw_encoder;
+
     buf_idx = i;
-    if (buf_idx < MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
+    if (p_session->sw_encoder) {
+      /* the software encoder has no use for the ION work buffer */
+      memset(&p_session->work_buffer, 0, sizeof(p_session->work_buffer));
+      p_session->work_buffer.ion_fd = -1;
+      p_session->work_buffer.p_pmem_fd = -1;
+    } else if (buf_idx < MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
       p_session->work_buffer = my_obj->ionBuffer[buf_idx];
     } else {
       CDBG_ERROR("%s %d: Invalid Index, Setting buffer add to null", __func__, __LINE__);
@@ -2444,17 +2820,13 @@ error2:
 static int32_t mm_jpegenc_destroy_job(mm_jpeg_job_session_t *p_session)
 {
   mm_jpeg_encode_job_t *p_jobparams = &p_session->encode_job;
-  int i = 0, rc = 0;
+  int rc = 0;
 
-  CDBG_HIGH("%s:%d] Exif entry count %d %d", __func__, __LINE__,
+  CDBG_HIGH("%s:%d] Exif entry count %d %d arena %zu", __func__, __LINE__,
     (int)p_jobparams->exif_info.numOfEntries,
-    (int)p_session->exif_count_local);
-  for (i = 0; i < p_session->exif_count_local; i++) {
-    rc = releaseExifEntry(&p_session->exif_info_local[i]);
-    if (rc) {
-      CDBG_ERROR("%s:%d] Exif release failed (%d)", __func__, __LINE__, rc);
-    }
-  }
+    (int)p_session->exif_count_local, p_session->exif_arena.used);
+  /* the local exif payloads all live in the session arena */
+  mm_jpeg_exif_arena_reset(&p_session->exif_arena);
   p_session->exif_count_local = 0;
 
   return rc;
@@ -2489,9 +2861,13 @@ static void mm_jpegenc_job_done(mm_jpeg_job_session_t *p_session)
   }
   p_session->encoding = OMX_FALSE;
 
-  // Queue to available sessions
+  // Queue to available sessions, hardware sessions ahead of software ones
   qdata.p = p_session;
-  mm_jpeg_queue_enq(p_session->session_handle_q, qdata);
+  if (p_session->sw_encoder) {
+    mm_jpeg_queue_enq(p_session->session_handle_q, qdata);
+  } else {
+    mm_jpeg_queue_enq_head(p_session->session_handle_q, qdata);
+  }
 
   if (p_session->auto_out_buf) {
     //Queue out buf index
@@ -2523,7 +2899,7 @@ int32_t mm_jpeg_destroy_session(mm_jpeg_obj *my_obj,
   int32_t rc = 0;
   mm_jpeg_job_q_node_t *node = NULL;
   uint32_t session_id = 0;
-  mm_jpeg_job_session_t *p_cur_sess;
+  mm_jpeg_job_session_t *p_cur_sess, *p_next_sess;
   char trace_tag[32];
 
   if (NULL == p_session) {
@@ -2553,13 +2929,17 @@ int32_t mm_jpeg_destroy_session(mm_jpeg_obj *my_obj,
 
   /* abort the current session */
   mm_jpeg_session_abort(p_session);
-  mm_jpeg_session_destroy(p_session);
 
+  /* keep the OMX handles for the next session where possible */
   p_cur_sess = p_session;
-
   do {
+    p_next_sess = p_cur_sess->next_session;
+    if (!mm_jpeg_session_park(p_cur_sess)) {
+      p_cur_sess->next_session = NULL;
+      mm_jpeg_session_destroy(p_cur_sess);
+    }
     mm_jpeg_remove_session_idx(my_obj, p_cur_sess->sessionId);
-  } while (NULL != (p_cur_sess = p_cur_sess->next_session));
+  } while (NULL != (p_cur_sess = p_next_sess));
 
 
   pthread_mutex_unlock(&my_obj->job_lock);
@@ -2686,6 +3066,7 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
   int32_t rc = -1;
   uint8_t clnt_idx = 0;
   int i = 0;
+  mm_jpeg_job_session_t *p_session;
 
   /* check if valid client */
   clnt_idx = mm_jpeg_util_get_index_by_handler(client_hdl);
@@ -2707,6 +3088,16 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
         &my_obj->clnt_mgr[clnt_idx].session[i]);
   }
 
+  /* release the cached sessions of the client */
+  for (i = 0; i < MM_JPEG_MAX_SESSION; i++) {
+    p_session = &my_obj->clnt_mgr[clnt_idx].session[i];
+    if (OMX_TRUE == p_session->cached) {
+      p_session->cached = OMX_FALSE;
+      my_obj->num_cached_sessions--;
+      mm_jpeg_session_destroy(p_session);
+    }
+  }
+
   CDBG("%s:%d] ", __func__, __LINE__);
 
 #ifdef LOAD_ADSP_RPC_LIB
@@ -2862,26 +3253,41 @@ mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_client_id(
   mm_jpeg_job_q_node_t* job_node = NULL;
   struct cam_list *head = NULL;
   struct cam_list *pos = NULL;
+  uint32_t client_idx = GET_CLIENT_IDX(client_hdl);
+  uint32_t i;
 
   pthread_mutex_lock(&queue->lock);
-  head = &queue->head.list;
-  pos = head->next;
-  while(pos != head) {
-    node = member_of(pos, mm_jpeg_q_node_t, list);
-    data = (mm_jpeg_job_q_node_t *)node->data.p;
-
-    if (data && (data->enc_info.client_handle == client_hdl)) {
-      CDBG_HIGH("%s:%d] found matching client handle", __func__, __LINE__);
-      job_node = data;
-      cam_list_del_node(&node->list);
-      queue->size--;
-      free(node);
-      CDBG_HIGH("%s: queue size = %d", __func__, queue->size);
-      break;
+  if (NULL != queue->index) {
+    /* only the sessions of this client can hold its jobs */
+    for (i = 0; (i < MM_JPEG_MAX_SESSION) &&
+      (client_idx < MAX_JPEG_CLIENT_NUM) && (NULL == job_node); i++) {
+      head = &queue->index->session[client_idx][i];
+      for (pos = head->next; pos != head; pos = pos->next) {
+        node = member_of(pos, mm_jpeg_q_node_t, session_list);
+        data = (mm_jpeg_job_q_node_t *)node->data.p;
+        if (data->enc_info.client_handle == client_hdl) {
+          job_node = data;
+          break;
+        }
+      }
+    }
+  } else {
+    head = &queue->head.list;
+    for (pos = head->next; pos != head; pos = pos->next) {
+      node = member_of(pos, mm_jpeg_q_node_t, list);
+      data = (mm_jpeg_job_q_node_t *)node->data.p;
+      if (data && (data->enc_info.client_handle == client_hdl)) {
+        job_node = data;
+        break;
+      }
     }
-    pos = pos->next;
   }
 
+  if (NULL != job_node) {
+    CDBG_HIGH("%s:%d] found matching client handle", __func__, __LINE__);
+    mm_jpeg_queue_remove_node_unlk(queue, node);
+    CDBG_HIGH("%s: queue size = %d", __func__, queue->size);
+  }
   pthread_mutex_unlock(&queue->lock);
 
   return job_node;
@@ -2892,30 +3298,16 @@ mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_session_id(
   mm_jpeg_queue_t* queue, uint32_t session_id)
 {
   mm_jpeg_q_node_t* node = NULL;
-  mm_jpeg_job_q_node_t* data = NULL;
   mm_jpeg_job_q_node_t* job_node = NULL;
-  struct cam_list *head = NULL;
-  struct cam_list *pos = NULL;
 
   pthread_mutex_lock(&queue->lock);
-  head = &queue->head.list;
-  pos = head->next;
-  while(pos != head) {
-    node = member_of(pos, mm_jpeg_q_node_t, list);
-    data = (mm_jpeg_job_q_node_t *)node->data.p;
-
-    if (data && (data->enc_info.encode_job.session_id == session_id)) {
-      CDBG_HIGH("%s:%d] found matching session id", __func__, __LINE__);
-      job_node = data;
-      cam_list_del_node(&node->list);
-      queue->size--;
-      free(node);
-      CDBG_HIGH("%s: queue size = %d", __func__, queue->size);
-      break;
-    }
-    pos = pos->next;
+  node = mm_jpeg_queue_find_session_unlk(queue, session_id);
+  if (NULL != node) {
+    CDBG_HIGH("%s:%d] found matching session id", __func__, __LINE__);
+    job_node = (mm_jpeg_job_q_node_t *)
+      mm_jpeg_queue_remove_node_unlk(queue, node).p;
+    CDBG_HIGH("%s: queue size = %d", __func__, queue->size);
   }
-
   pthread_mutex_unlock(&queue->lock);
 
   return job_node;
@@ -2925,43 +3317,13 @@ mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_session_id(
 mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_job_id(
   mm_jpeg_queue_t* queue, uint32_t job_id)
 {
-  mm_jpeg_q_node_t* node = NULL;
-  mm_jpeg_job_q_node_t* data = NULL;
   mm_jpeg_job_q_node_t* job_node = NULL;
-  struct cam_list *head = NULL;
-  struct cam_list *pos = NULL;
-  uint32_t lq_job_id;
 
   pthread_mutex_lock(&queue->lock);
-  head = &queue->head.list;
-  pos = head->next;
-  while(pos != head) {
-    node = member_of(pos, mm_jpeg_q_node_t, list);
-    data = (mm_jpeg_job_q_node_t *)node->data.p;
-
-    if(NULL == data) {
-      CDBG_ERROR("%s:%d] Data is NULL", __func__, __LINE__);
-      pthread_mutex_unlock(&queue->lock);
-      return NULL;
-    }
-
-    if (data->type == MM_JPEG_CMD_TYPE_DECODE_JOB) {
-      lq_job_id = data->dec_info.job_id;
-    } else {
-      lq_job_id = data->enc_info.job_id;
-    }
-
-    if (data && (lq_job_id == job_id)) {
-      CDBG_HIGH("%s:%d] found matching job id", __func__, __LINE__);
-      job_node = data;
-      cam_list_del_node(&node->list);
-      queue->size--;
-      free(node);
-      break;
-    }
-    pos = pos->next;
+  job_node = mm_jpeg_queue_remove_job_unlk(queue, job_id);
+  if (NULL != job_node) {
+    CDBG_HIGH("%s:%d] found matching job id", __func__, __LINE__);
   }
-
   pthread_mutex_unlock(&queue->lock);
 
   return job_node;
@@ -2972,25 +3334,12 @@ mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_unlk(
   mm_jpeg_queue_t* queue, uint32_t job_id)
 {
   mm_jpeg_q_node_t* node = NULL;
-  mm_jpeg_job_q_node_t* data = NULL;
   mm_jpeg_job_q_node_t* job_node = NULL;
-  struct cam_list *head = NULL;
-  struct cam_list *pos = NULL;
 
-  head = &queue->head.list;
-  pos = head->next;
-  while(pos != head) {
-    node = member_of(pos, mm_jpeg_q_node_t, list);
-    data = (mm_jpeg_job_q_node_t *)node->data.p;
-
-    if (data && (data->enc_info.job_id == job_id)) {
-      job_node = data;
-      cam_list_del_node(&node->list);
-      queue->size--;
-      free(node);
-      break;
-    }
-    pos = pos->next;
+  node = mm_jpeg_queue_find_job_unlk(queue, job_id);
+  if (NULL != node) {
+    job_node = (mm_jpeg_job_q_node_t *)
+      mm_jpeg_queue_remove_node_unlk(queue, node).p;
   }
 
   return job_node;
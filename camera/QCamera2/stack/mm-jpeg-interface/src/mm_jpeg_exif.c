@@ -41,11 +41,54 @@
         ((a >= 0) ? (uint32_t)(a + 0.5) : (uint32_t)(a - 0.5))
 
 
+/** mm_jpeg_exif_arena_alloc:
+ *
+ *  Arguments:
+ *   @p_arena : exif arena of the job
+ *   @size    : payload size
+ *
+ *  Retrun     : payload address, NULL if the arena is full
+ *
+ *  Description:
+ *       Bump allocate a tag payload. All payloads of a job are
+ *       released at once by mm_jpeg_exif_arena_reset
+ *
+ **/
+static void *mm_jpeg_exif_arena_alloc(mm_jpeg_exif_arena_t *p_arena,
+  size_t size)
+{
+  uint8_t *p_base = (uint8_t *)p_arena->data;
+  size_t offset = (p_arena->used + 7) & ~(size_t)7;
+
+  if ((offset > sizeof(p_arena->data)) ||
+    (size > sizeof(p_arena->data) - offset)) {
+    return NULL;
+  }
+  p_arena->used = offset + size;
+  return p_base + offset;
+}
+
+/** mm_jpeg_exif_arena_reset:
+ *
+ *  Arguments:
+ *   @p_arena : exif arena of the job
+ *
+ *  Retrun     : none
+ *
+ *  Description:
+ *       Release all tag payloads of the job
+ *
+ **/
+void mm_jpeg_exif_arena_reset(mm_jpeg_exif_arena_t *p_arena)
+{
+  p_arena->used = 0;
+}
+
 /** addExifEntry:
  *
  *  Arguments:
  *   @exif_info : Exif info struct
- *   @p_session: job session
+ *   @p_arena : arena holding the tag payloads
  *   @tagid   : exif tag ID
  *   @type    : data type
  *   @count   : number of data in uint of its type
@@ -59,7 +102,8 @@
  *       Function to add an entry to exif data
  *
  **/
-int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
+int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info,
+  mm_jpeg_exif_arena_t *p_arena, exif_tag_id_t tagid,
   exif_tag_type_t type, uint32_t count, void *data)
 {
     int32_t rc = 0;
@@ -77,7 +121,7 @@ int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
     switch (type) {
     case EXIF_BYTE: {
       if (count > 1) {
-        uint8_t *values = (uint8_t *)malloc(count);
+        uint8_t *values = (uint8_t *)mm_jpeg_exif_arena_alloc(p_arena, count);
         if (values == NULL) {
           ALOGE("%s: No memory for byte array", __func__);
           rc = -1;
@@ -92,7 +136,7 @@ int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
     break;
     case EXIF_ASCII: {
       char *str = NULL;
-      str = (char *)malloc(count + 1);
+      str = (char *)mm_jpeg_exif_arena_alloc(p_arena, count + 1);
       if (str == NULL) {
         ALOGE("%s: No memory for ascii string", __func__);
         rc = -1;
@@ -105,7 +149,7 @@ int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
     break;
     case EXIF_SHORT: {
       if (count > 1) {
-        uint16_t *values = (uint16_t *)malloc(count * sizeof(uint16_t));
+        uint16_t *values = (uint16_t *)mm_jpeg_exif_arena_alloc(p_arena, count * sizeof(uint16_t));
         if (values == NULL) {
           ALOGE("%s: No memory for short array", __func__);
           rc = -1;
@@ -120,7 +164,7 @@ int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
     break;
     case EXIF_LONG: {
       if (count > 1) {
-        uint32_t *values = (uint32_t *)malloc(count * sizeof(uint32_t));
+        uint32_t *values = (uint32_t *)mm_jpeg_exif_arena_alloc(p_arena, count * sizeof(uint32_t));
         if (values == NULL) {
           ALOGE("%s: No memory for long array", __func__);
           rc = -1;
@@ -135,7 +179,7 @@ int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
     break;
     case EXIF_RATIONAL: {
       if (count > 1) {
-        rat_t *values = (rat_t *)malloc(count * sizeof(rat_t));
+        rat_t *values = (rat_t *)mm_jpeg_exif_arena_alloc(p_arena, count * sizeof(rat_t));
         if (values == NULL) {
           ALOGE("%s: No memory for rational array", __func__);
           rc = -1;
@@ -149,7 +193,7 @@ int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
     }
     break;
     case EXIF_UNDEFINED: {
-      uint8_t *values = (uint8_t *)malloc(count);
+      uint8_t *values = (uint8_t *)mm_jpeg_exif_arena_alloc(p_arena, count);
       if (values == NULL) {
         ALOGE("%s: No memory for undefined array", __func__);
         rc = -1;
@@ -161,7 +205,7 @@ int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
     break;
     case EXIF_SLONG: {
       if (count > 1) {
-        int32_t *values = (int32_t *)malloc(count * sizeof(int32_t));
+        int32_t *values = (int32_t *)mm_jpeg_exif_arena_alloc(p_arena, count * sizeof(int32_t));
         if (values == NULL) {
           ALOGE("%s: No memory for signed long array", __func__);
           rc = -1;
@@ -176,7 +220,7 @@ int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
     break;
     case EXIF_SRATIONAL: {
       if (count > 1) {
-        srat_t *values = (srat_t *)malloc(count * sizeof(srat_t));
+        srat_t *values = (srat_t *)mm_jpeg_exif_arena_alloc(p_arena, count * sizeof(srat_t));
         if (values == NULL) {
           ALOGE("%s: No memory for signed rational array", __func__);
           rc = -1;
@@ -196,93 +240,12 @@ int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
     return rc;
 }
 
-/** releaseExifEntry
- *
- *  Arguments:
- *   @p_exif_data : Exif info struct
- *
- *  Retrun     : int32_t type of status
- *               0  -- success
- *              none-zero failure code
- *
- *  Description:
- *       Function to release an entry from exif data
- *
- **/
-int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data)
-{
- switch (p_exif_data->tag_entry.type) {
-  case EXIF_BYTE: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._bytes != NULL) {
-      free(p_exif_data->tag_entry.data._bytes);
-      p_exif_data->tag_entry.data._bytes = NULL;
-    }
-  }
-  break;
-  case EXIF_ASCII: {
-    if (p_exif_data->tag_entry.data._ascii != NULL) {
-      free(p_exif_data->tag_entry.data._ascii);
-      p_exif_data->tag_entry.data._ascii = NULL;
-    }
-  }
-  break;
-  case EXIF_SHORT: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._shorts != NULL) {
-      free(p_exif_data->tag_entry.data._shorts);
-      p_exif_data->tag_entry.data._shorts = NULL;
-    }
-  }
-  break;
-  case EXIF_LONG: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._longs != NULL) {
-      free(p_exif_data->tag_entry.data._longs);
-      p_exif_data->tag_entry.data._longs = NULL;
-    }
-  }
-  break;
-  case EXIF_RATIONAL: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._rats != NULL) {
-      free(p_exif_data->tag_entry.data._rats);
-      p_exif_data->tag_entry.data._rats = NULL;
-    }
-  }
-  break;
-  case EXIF_UNDEFINED: {
-    if (p_exif_data->tag_entry.data._undefined != NULL) {
-      free(p_exif_data->tag_entry.data._undefined);
-      p_exif_data->tag_entry.data._undefined = NULL;
-    }
-  }
-  break;
-  case EXIF_SLONG: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._slongs != NULL) {
-      free(p_exif_data->tag_entry.data._slongs);
-      p_exif_data->tag_entry.data._slongs = NULL;
-    }
-  }
-  break;
-  case EXIF_SRATIONAL: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._srats != NULL) {
-      free(p_exif_data->tag_entry.data._srats);
-      p_exif_data->tag_entry.data._srats = NULL;
-    }
-  }
-  break;
-  } /*end of switch*/
-
-  return 0;
-}
-
 /** process_sensor_data:
  *
  *  Arguments:
  *   @p_sensor_params : ptr to sensor data
+ *   @exif_info : Exif info struct
+ *   @p_arena : arena holding the tag payloads
  *
  *  Return     : int32_t type of status
  *               NO_ERROR  -- success
@@ -294,7 +257,7 @@ int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data)
  *  Notes: this needs to be filled for the metadata
  **/
 int process_sensor_data(cam_sensor_params_t *p_sensor_params,
-  QOMX_EXIF_INFO *exif_info)
+  QOMX_EXIF_INFO *exif_info, mm_jpeg_exif_arena_t *p_arena)
 {
   int rc = 0;
   rat_t val_rat;
@@ -312,14 +275,14 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
     apex_value = (double)2.0 * log(p_sensor_params->aperture_value) / log(2.0);
     val_rat.num = (uint32_t)(apex_value * 100);
     val_rat.denom = 100;
-    rc = addExifEntry(exif_info, EXIFTAGID_APERTURE, EXIF_RATIONAL, 1, &val_rat);
+    rc = addExifEntry(exif_info, p_arena, EXIFTAGID_APERTURE, EXIF_RATIONAL, 1, &val_rat);
     if (rc) {
       ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
     }
 
     val_rat.num = (uint32_t)(p_sensor_params->aperture_value * 100);
     val_rat.denom = 100;
-    rc = addExifEntry(exif_info, EXIFTAGID_F_NUMBER, EXIF_RATIONAL, 1, &val_rat);
+    rc = addExifEntry(exif_info, p_arena, EXIFTAGID_F_NUMBER, EXIF_RATIONAL, 1, &val_rat);
     if (rc) {
       ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
     }
@@ -352,13 +315,13 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
   }
   val_short = (short)(flash_fired | (flash_mode_exif << 3));
 
-  rc = addExifEntry(exif_info, EXIFTAGID_FLASH, EXIF_SHORT, 1, &val_short);
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_FLASH, EXIF_SHORT, 1, &val_short);
   if (rc) {
     ALOGE("%s %d]: Error adding flash exif entry", __func__, __LINE__);
   }
   /* Sensing Method */
   val_short = (short) p_sensor_params->sensing_method;
-  rc = addExifEntry(exif_info, EXIFTAGID_SENSING_METHOD, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_SENSING_METHOD, EXIF_SHORT,
     sizeof(val_short)/2, &val_short);
   if (rc) {
     ALOGE("%s:%d]: Error adding flash Exif Entry", __func__, __LINE__);
@@ -367,7 +330,7 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
   /* Focal Length in 35 MM Film */
   val_short = (short)
     ((p_sensor_params->focal_length * p_sensor_params->crop_factor) + 0.5f);
-  rc = addExifEntry(exif_info, EXIFTAGID_FOCAL_LENGTH_35MM, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_FOCAL_LENGTH_35MM, EXIF_SHORT,
     1, &val_short);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -376,7 +339,7 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
   /* F Number */
   val_rat.num = (uint32_t)(p_sensor_params->f_number * 100);
   val_rat.denom = 100;
-  rc = addExifEntry(exif_info, EXIFTAGTYPE_F_NUMBER, EXIF_RATIONAL, 1, &val_rat);
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGTYPE_F_NUMBER, EXIF_RATIONAL, 1, &val_rat);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
   }
@@ -388,6 +351,8 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
  *
  *  Arguments:
  *   @p_3a_params : ptr to 3a data
+ *   @exif_info : Exif info struct
+ *   @p_arena : arena holding the tag payloads
  *
  *  Return     : int32_t type of status
  *               NO_ERROR  -- success
@@ -398,7 +363,8 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
  *
  *  Notes: this needs to be filled for the metadata
  **/
-int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
+int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info,
+  mm_jpeg_exif_arena_t *p_arena)
 {
   int rc = 0;
   srat_t val_srat;
@@ -424,7 +390,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
   CDBG("%s: numer %d denom %d %zd", __func__, val_rat.num, val_rat.denom,
       sizeof(val_rat) / (8));
 
-  rc = addExifEntry(exif_info, EXIFTAGID_EXPOSURE_TIME, EXIF_RATIONAL,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_EXPOSURE_TIME, EXIF_RATIONAL,
     (sizeof(val_rat)/(8)), &val_rat);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry Exposure time",
@@ -440,7 +406,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
     val_srat.num = 0;
     val_srat.denom = 0;
   }
-  rc = addExifEntry(exif_info, EXIFTAGID_SHUTTER_SPEED, EXIF_SRATIONAL,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_SHUTTER_SPEED, EXIF_SRATIONAL,
     (sizeof(val_srat)/(8)), &val_srat);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -449,7 +415,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
   /*ISO*/
   short val_short;
   val_short = (short)p_3a_params->iso_value;
-  rc = addExifEntry(exif_info, EXIFTAGID_ISO_SPEED_RATING, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_ISO_SPEED_RATING, EXIF_SHORT,
     sizeof(val_short)/2, &val_short);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -460,7 +426,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
     val_short = 0;
   else
     val_short = 1;
-  rc = addExifEntry(exif_info, EXIFTAGID_WHITE_BALANCE, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_WHITE_BALANCE, EXIF_SHORT,
     sizeof(val_short)/2, &val_short);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -468,7 +434,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
 
   /* Metering Mode   */
   val_short = (short) p_3a_params->metering_mode;
-  rc = addExifEntry(exif_info,EXIFTAGID_METERING_MODE, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena,EXIFTAGID_METERING_MODE, EXIF_SHORT,
      sizeof(val_short)/2, &val_short);
   if (rc) {
      ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -476,7 +442,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
 
   /*Exposure Program*/
    val_short = (short) p_3a_params->exposure_program;
-   rc = addExifEntry(exif_info,EXIFTAGID_EXPOSURE_PROGRAM, EXIF_SHORT,
+   rc = addExifEntry(exif_info, p_arena,EXIFTAGID_EXPOSURE_PROGRAM, EXIF_SHORT,
       sizeof(val_short)/2, &val_short);
    if (rc) {
       ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -484,7 +450,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
 
    /*Exposure Mode */
     val_short = (short) p_3a_params->exposure_mode;
-    rc = addExifEntry(exif_info,EXIFTAGID_EXPOSURE_MODE, EXIF_SHORT,
+    rc = addExifEntry(exif_info, p_arena,EXIFTAGID_EXPOSURE_MODE, EXIF_SHORT,
        sizeof(val_short)/2, &val_short);
     if (rc) {
        ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -493,7 +459,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
     /*Scenetype*/
      uint8_t val_undef;
      val_undef = (uint8_t) p_3a_params->scenetype;
-     rc = addExifEntry(exif_info,EXIFTAGID_SCENE_TYPE, EXIF_UNDEFINED,
+     rc = addExifEntry(exif_info, p_arena,EXIFTAGID_SCENE_TYPE, EXIF_UNDEFINED,
         sizeof(val_undef), &val_undef);
      if (rc) {
         ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -505,7 +471,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
     /* Brightness Value*/
      val_srat.num = (int32_t) (p_3a_params->brightness * 100.0f);
      val_srat.denom = 100;
-     rc = addExifEntry(exif_info,EXIFTAGID_BRIGHTNESS, EXIF_SRATIONAL,
+     rc = addExifEntry(exif_info, p_arena,EXIFTAGID_BRIGHTNESS, EXIF_SRATIONAL,
                  (sizeof(val_srat)/(8)), &val_srat);
      if (rc) {
         ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -519,6 +485,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
  *  Arguments:
  *   @p_meta : ptr to metadata
  *   @exif_info: Exif info struct
+ *   @p_arena: arena holding the tag payloads
  *   @mm_jpeg_exif_params: exif params
  *
  *  Return     : int32_t type of status
@@ -529,7 +496,8 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
  *       Extract exif data from the metadata
  **/
 int process_meta_data(metadata_buffer_t *p_meta, QOMX_EXIF_INFO *exif_info,
-  mm_jpeg_exif_params_t *p_cam_exif_params, cam_hal_version_t hal_version)
+  mm_jpeg_exif_arena_t *p_arena, mm_jpeg_exif_params_t *p_cam_exif_params,
+  cam_hal_version_t hal_version)
 {
   int rc = 0;
   cam_sensor_params_t p_sensor_params;
@@ -612,13 +580,13 @@ int process_meta_data(metadata_buffer_t *p_meta, QOMX_EXIF_INFO *exif_info,
     }
   }
   if ((hal_version != CAM_HAL_V1) || (p_sensor_params.sens_type != CAM_SENSOR_YUV)) {
-    rc = process_3a_data(&p_3a_params, exif_info);
+    rc = process_3a_data(&p_3a_params, exif_info, p_arena);
     if (rc) {
       ALOGE("%s %d: Failed to add 3a exif params", __func__, __LINE__);
     }
   }
 
-  rc = process_sensor_data(&p_sensor_params, exif_info);
+  rc = process_sensor_data(&p_sensor_params, exif_info, p_arena);
   if (rc) {
     ALOGE("%s %d: Failed to extract sensor params", __func__, __LINE__);
   }
@@ -631,7 +599,7 @@ int process_meta_data(metadata_buffer_t *p_meta, QOMX_EXIF_INFO *exif_info,
       val_short = (short) *scene_cap_type;
     }
 
-    rc = addExifEntry(exif_info, EXIFTAGID_SCENE_CAPTURE_TYPE, EXIF_SHORT,
+    rc = addExifEntry(exif_info, p_arena, EXIFTAGID_SCENE_CAPTURE_TYPE, EXIF_SHORT,
       sizeof(val_short)/2, &val_short);
     if (rc) {
       ALOGE("%s:%d]: Error adding ASD Exif Entry", __func__, __LINE__);
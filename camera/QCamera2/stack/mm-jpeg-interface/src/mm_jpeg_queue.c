@@ -31,28 +31,186 @@
 #include "mm_jpeg_dbg.h"
 #include "mm_jpeg.h"
 
+/* The low byte of a job id is the client index, shared by every job of a
+ * client. Hash on the job counter and session index above it. */
+#define MM_JPEG_QUEUE_HASH(id) \
+  ((GET_JOB_IDX(id) ^ GET_SESSION_IDX(id)) % MM_JPEG_QUEUE_HASH_SIZE)
+
+/** mm_jpeg_queue_node_get:
+ *
+ *  Arguments:
+ *    @queue: queue, locked
+ *
+ *  Return:
+ *       node, NULL if out of memory
+ *
+ *  Description:
+ *       Take a recycled node or allocate a new one
+ *
+ **/
+static mm_jpeg_q_node_t *mm_jpeg_queue_node_get(mm_jpeg_queue_t* queue)
+{
+    mm_jpeg_q_node_t* node = NULL;
+    struct cam_list *pos = queue->free_nodes.next;
+
+    if (pos != &queue->free_nodes) {
+        cam_list_del_node(pos);
+        queue->num_free--;
+        node = member_of(pos, mm_jpeg_q_node_t, list);
+    } else {
+        node = (mm_jpeg_q_node_t *)malloc(sizeof(mm_jpeg_q_node_t));
+        if (NULL == node) {
+            CDBG_ERROR("%s: No memory for mm_jpeg_q_node_t", __func__);
+            return NULL;
+        }
+    }
+
+    memset(node, 0, sizeof(mm_jpeg_q_node_t));
+    cam_list_init(&node->list);
+    cam_list_init(&node->hash_list);
+    cam_list_init(&node->session_list);
+    return node;
+}
+
+/** mm_jpeg_queue_node_put:
+ *
+ *  Arguments:
+ *    @queue: queue, locked
+ *    @node: unlinked node
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Keep the node for the next enqueue, up to
+ *       MM_JPEG_QUEUE_NODE_CACHE nodes
+ *
+ **/
+static void mm_jpeg_queue_node_put(mm_jpeg_queue_t* queue,
+    mm_jpeg_q_node_t* node)
+{
+    if (queue->num_free < MM_JPEG_QUEUE_NODE_CACHE) {
+        cam_list_add_tail_node(&node->list, &queue->free_nodes);
+        queue->num_free++;
+    } else {
+        free(node);
+    }
+}
+
+/** mm_jpeg_queue_index_add:
+ *
+ *  Arguments:
+ *    @queue: queue, locked
+ *    @node: node just linked into the queue
+ *    @at_head: node was put at the head of the queue
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Add a job node to the job id hash and to the list of its
+ *       session. Other nodes, e.g. the exit command, are not
+ *       indexed.
+ *
+ **/
+static void mm_jpeg_queue_index_add(mm_jpeg_queue_t* queue,
+    mm_jpeg_q_node_t* node, int at_head)
+{
+    mm_jpeg_job_q_node_t *job = (mm_jpeg_job_q_node_t *)node->data.p;
+    uint32_t client_idx, session_idx;
+    struct cam_list *p_list;
+
+    if ((NULL == queue->index) || (NULL == job)) {
+        return;
+    }
+
+    if (MM_JPEG_CMD_TYPE_DECODE_JOB == job->type) {
+        node->job_id = job->dec_info.job_id;
+        node->session_id = job->dec_info.decode_job.session_id;
+    } else if (MM_JPEG_CMD_TYPE_JOB == job->type) {
+        node->job_id = job->enc_info.job_id;
+        node->session_id = job->enc_info.encode_job.session_id;
+    } else {
+        return;
+    }
+
+    cam_list_add_tail_node(&node->hash_list,
+        &queue->index->hash[MM_JPEG_QUEUE_HASH(node->job_id)]);
+
+    client_idx = GET_CLIENT_IDX(node->session_id);
+    session_idx = GET_SESSION_IDX(node->session_id);
+    if ((client_idx < MAX_JPEG_CLIENT_NUM) &&
+        (session_idx < MM_JPEG_MAX_SESSION)) {
+        p_list = &queue->index->session[client_idx][session_idx];
+        if (at_head) {
+            cam_list_insert_before_node(&node->session_list, p_list->next);
+        } else {
+            cam_list_add_tail_node(&node->session_list, p_list);
+        }
+    }
+}
+
 int32_t mm_jpeg_queue_init(mm_jpeg_queue_t* queue)
 {
     pthread_mutex_init(&queue->lock, NULL);
     cam_list_init(&queue->head.list);
+    cam_list_init(&queue->free_nodes);
+    queue->num_free = 0;
+    queue->index = NULL;
     queue->size = 0;
     return 0;
 }
 
+/** mm_jpeg_queue_init_indexed:
+ *
+ *  Arguments:
+ *    @queue: queue of mm_jpeg_job_q_node_t
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Init a job queue that indexes its jobs by job id and
+ *       session id
+ *
+ **/
+int32_t mm_jpeg_queue_init_indexed(mm_jpeg_queue_t* queue)
+{
+    uint32_t i, j;
+
+    mm_jpeg_queue_init(queue);
+    queue->index = (mm_jpeg_queue_index_t *)malloc(sizeof(*queue->index));
+    if (NULL == queue->index) {
+        CDBG_ERROR("%s: No memory for queue index", __func__);
+        pthread_mutex_destroy(&queue->lock);
+        return -1;
+    }
+
+    for (i = 0; i < MM_JPEG_QUEUE_HASH_SIZE; i++) {
+        cam_list_init(&queue->index->hash[i]);
+    }
+    for (i = 0; i < MAX_JPEG_CLIENT_NUM; i++) {
+        for (j = 0; j < MM_JPEG_MAX_SESSION; j++) {
+            cam_list_init(&queue->index->session[i][j]);
+        }
+    }
+    return 0;
+}
+
 int32_t mm_jpeg_queue_enq(mm_jpeg_queue_t* queue, mm_jpeg_q_data_t data)
 {
-    mm_jpeg_q_node_t* node =
-        (mm_jpeg_q_node_t *)malloc(sizeof(mm_jpeg_q_node_t));
+    mm_jpeg_q_node_t* node = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    node = mm_jpeg_queue_node_get(queue);
     if (NULL == node) {
-        CDBG_ERROR("%s: No memory for mm_jpeg_q_node_t", __func__);
+        pthread_mutex_unlock(&queue->lock);
         return -1;
     }
-
-    memset(node, 0, sizeof(mm_jpeg_q_node_t));
     node->data = data;
 
-    pthread_mutex_lock(&queue->lock);
     cam_list_add_tail_node(&node->list, &queue->head.list);
+    mm_jpeg_queue_index_add(queue, node, 0);
     queue->size++;
     pthread_mutex_unlock(&queue->lock);
 
@@ -62,29 +220,153 @@ int32_t mm_jpeg_queue_enq(mm_jpeg_queue_t* queue, mm_jpeg_q_data_t data)
 
 int32_t mm_jpeg_queue_enq_head(mm_jpeg_queue_t* queue, mm_jpeg_q_data_t data)
 {
-  struct cam_list *head = NULL;
-  struct cam_list *pos = NULL;
-  mm_jpeg_q_node_t* node =
-        (mm_jpeg_q_node_t *)malloc(sizeof(mm_jpeg_q_node_t));
+    mm_jpeg_q_node_t* node = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    node = mm_jpeg_queue_node_get(queue);
     if (NULL == node) {
-        CDBG_ERROR("%s: No memory for mm_jpeg_q_node_t", __func__);
+        pthread_mutex_unlock(&queue->lock);
         return -1;
     }
-
-    memset(node, 0, sizeof(mm_jpeg_q_node_t));
     node->data = data;
 
-    head = &queue->head.list;
-    pos = head->next;
-
-    pthread_mutex_lock(&queue->lock);
-    cam_list_insert_before_node(&node->list, pos);
+    cam_list_insert_before_node(&node->list, queue->head.list.next);
+    mm_jpeg_queue_index_add(queue, node, 1);
     queue->size++;
     pthread_mutex_unlock(&queue->lock);
 
     return 0;
 }
 
+/** mm_jpeg_queue_remove_node_unlk:
+ *
+ *  Arguments:
+ *    @queue: queue, locked by the caller
+ *    @node: node in the queue
+ *
+ *  Return:
+ *       data of the node
+ *
+ *  Description:
+ *       Unlink the node from the queue and its index and recycle
+ *       it
+ *
+ **/
+mm_jpeg_q_data_t mm_jpeg_queue_remove_node_unlk(mm_jpeg_queue_t* queue,
+    mm_jpeg_q_node_t* node)
+{
+    mm_jpeg_q_data_t data = node->data;
+
+    cam_list_del_node(&node->list);
+    cam_list_del_node(&node->hash_list);
+    cam_list_del_node(&node->session_list);
+    queue->size--;
+    mm_jpeg_queue_node_put(queue, node);
+
+    return data;
+}
+
+/** mm_jpeg_queue_find_job_unlk:
+ *
+ *  Arguments:
+ *    @queue: job queue, locked by the caller
+ *    @job_id: job id
+ *
+ *  Return:
+ *       node of the job, NULL if not queued
+ *
+ *  Description:
+ *       Look up a job by id
+ *
+ **/
+mm_jpeg_q_node_t* mm_jpeg_queue_find_job_unlk(mm_jpeg_queue_t* queue,
+    uint32_t job_id)
+{
+    mm_jpeg_q_node_t* node = NULL;
+    mm_jpeg_job_q_node_t* data = NULL;
+    struct cam_list *head = NULL;
+    struct cam_list *pos = NULL;
+    uint32_t lq_job_id;
+
+    if (NULL != queue->index) {
+        head = &queue->index->hash[MM_JPEG_QUEUE_HASH(job_id)];
+        for (pos = head->next; pos != head; pos = pos->next) {
+            node = member_of(pos, mm_jpeg_q_node_t, hash_list);
+            if (node->job_id == job_id) {
+                return node;
+            }
+        }
+        return NULL;
+    }
+
+    head = &queue->head.list;
+    for (pos = head->next; pos != head; pos = pos->next) {
+        node = member_of(pos, mm_jpeg_q_node_t, list);
+        data = (mm_jpeg_job_q_node_t *)node->data.p;
+        if (NULL == data) {
+            continue;
+        }
+        if (data->type == MM_JPEG_CMD_TYPE_DECODE_JOB) {
+            lq_job_id = data->dec_info.job_id;
+        } else {
+            lq_job_id = data->enc_info.job_id;
+        }
+        if (lq_job_id == job_id) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/** mm_jpeg_queue_find_session_unlk:
+ *
+ *  Arguments:
+ *    @queue: job queue, locked by the caller
+ *    @session_id: session id
+ *
+ *  Return:
+ *       node of the first job of the session, NULL if none
+ *
+ *  Description:
+ *       Look up the oldest queued job of a session
+ *
+ **/
+mm_jpeg_q_node_t* mm_jpeg_queue_find_session_unlk(mm_jpeg_queue_t* queue,
+    uint32_t session_id)
+{
+    mm_jpeg_q_node_t* node = NULL;
+    mm_jpeg_job_q_node_t* data = NULL;
+    struct cam_list *head = NULL;
+    struct cam_list *pos = NULL;
+    uint32_t client_idx = GET_CLIENT_IDX(session_id);
+    uint32_t session_idx = GET_SESSION_IDX(session_id);
+
+    if (NULL != queue->index) {
+        if ((client_idx >= MAX_JPEG_CLIENT_NUM) ||
+            (session_idx >= MM_JPEG_MAX_SESSION)) {
+            return NULL;
+        }
+        head = &queue->index->session[client_idx][session_idx];
+        for (pos = head->next; pos != head; pos = pos->next) {
+            node = member_of(pos, mm_jpeg_q_node_t, session_list);
+            if (node->session_id == session_id) {
+                return node;
+            }
+        }
+        return NULL;
+    }
+
+    head = &queue->head.list;
+    for (pos = head->next; pos != head; pos = pos->next) {
+        node = member_of(pos, mm_jpeg_q_node_t, list);
+        data = (mm_jpeg_job_q_node_t *)node->data.p;
+        if (data && (data->enc_info.encode_job.session_id == session_id)) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
 mm_jpeg_q_data_t mm_jpeg_queue_deq(mm_jpeg_queue_t* queue)
 {
     mm_jpeg_q_data_t data;
@@ -99,16 +381,10 @@ mm_jpeg_q_data_t mm_jpeg_queue_deq(mm_jpeg_queue_t* queue)
     pos = head->next;
     if (pos != head) {
         node = member_of(pos, mm_jpeg_q_node_t, list);
-        cam_list_del_node(&node->list);
-        queue->size--;
+        data = mm_jpeg_queue_remove_node_unlk(queue, node);
     }
     pthread_mutex_unlock(&queue->lock);
 
-    if (NULL != node) {
-        data = node->data;
-        free(node);
-    }
-
     return data;
 }
 
@@ -126,7 +402,20 @@ uint32_t mm_jpeg_queue_get_size(mm_jpeg_queue_t* queue)
 
 int32_t mm_jpeg_queue_deinit(mm_jpeg_queue_t* queue)
 {
+    struct cam_list *pos = NULL;
+
     mm_jpeg_queue_flush(queue);
+
+    pthread_mutex_lock(&queue->lock);
+    while ((pos = queue->free_nodes.next) != &queue->free_nodes) {
+        cam_list_del_node(pos);
+        free(member_of(pos, mm_jpeg_q_node_t, list));
+    }
+    queue->num_free = 0;
+    free(queue->index);
+    queue->index = NULL;
+    pthread_mutex_unlock(&queue->lock);
+
     pthread_mutex_destroy(&queue->lock);
     return 0;
 }
@@ -134,31 +423,27 @@ int32_t mm_jpeg_queue_deinit(mm_jpeg_queue_t* queue)
 int32_t mm_jpeg_queue_flush(mm_jpeg_queue_t* queue)
 {
     mm_jpeg_q_node_t* node = NULL;
+    mm_jpeg_q_data_t data;
     struct cam_list *head = NULL;
     struct cam_list *pos = NULL;
 
     pthread_mutex_lock(&queue->lock);
     head = &queue->head.list;
-    pos = head->next;
 
-    while(pos != head) {
+    while ((pos = head->next) != head) {
         node = member_of(pos, mm_jpeg_q_node_t, list);
-        cam_list_del_node(&node->list);
-        queue->size--;
+        data = mm_jpeg_queue_remove_node_unlk(queue, node);
 
         /* for now we only assume there is no ptr inside data
          * so we free data directly */
-        if (NULL != node->data.p) {
-            free(node->data.p);
+        if (NULL != data.p) {
+            free(data.p);
         }
-        free(node);
-        pos = pos->next;
     }
     queue->size = 0;
     pthread_mutex_unlock(&queue->lock);
     return 0;
 }
-
 mm_jpeg_q_data_t mm_jpeg_queue_peek(mm_jpeg_queue_t* queue)
 {
     mm_jpeg_q_data_t data;
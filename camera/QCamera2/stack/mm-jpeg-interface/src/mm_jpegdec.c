@@ -34,12 +34,16 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <cutils/properties.h>
 
 #include "mm_jpeg_dbg.h"
 #include "mm_jpeg_interface.h"
 #include "mm_jpeg.h"
 #include "mm_jpeg_inlines.h"
 
+/* idle decode sessions kept for reuse */
+#define MM_JPEGDEC_MAX_CACHED_SESSIONS 2
+
 OMX_ERRORTYPE mm_jpegdec_ebd(OMX_HANDLETYPE hComponent,
   OMX_PTR pAppData,
   OMX_BUFFERHEADERTYPE *pBuffer);
@@ -199,8 +203,10 @@ OMX_ERRORTYPE mm_jpegdec_session_create(mm_jpeg_job_session_t* p_session)
 {
   OMX_ERRORTYPE rc = OMX_ErrorNone;
 
-  pthread_mutex_init(&p_session->lock, NULL);
-  pthread_cond_init(&p_session->cond, NULL);
+  if (NULL == p_session->omx_handle) {
+    pthread_mutex_init(&p_session->lock, NULL);
+    pthread_cond_init(&p_session->cond, NULL);
+  }
   cirq_reset(&p_session->cb_q);
   p_session->state_change_pending = OMX_FALSE;
   p_session->abort_state = MM_JPEG_ABORT_NONE;
@@ -215,6 +221,12 @@ OMX_ERRORTYPE mm_jpegdec_session_create(mm_jpeg_job_session_t* p_session)
   p_session->omx_callbacks.EventHandler = mm_jpegdec_event_handler;
   p_session->exif_count_local = 0;
 
+  if (NULL != p_session->omx_handle) {
+    /* cached handle in Loaded state, the ports are set up by the first job */
+    CDBG_HIGH("%s:%d] reusing cached decode session", __func__, __LINE__);
+    return rc;
+  }
+
   rc = OMX_GetHandle(&p_session->omx_handle,
     "OMX.qcom.image.jpeg.decoder",
     (void *)p_session,
@@ -242,6 +254,7 @@ OMX_ERRORTYPE mm_jpegdec_session_create(mm_jpeg_job_session_t* p_session)
 void mm_jpegdec_session_destroy(mm_jpeg_job_session_t* p_session)
 {
   OMX_ERRORTYPE rc = OMX_ErrorNone;
+  OMX_STATETYPE state = OMX_StateInvalid;
 
   CDBG("%s:%d] E", __func__, __LINE__);
   if (NULL == p_session->omx_handle) {
@@ -249,15 +262,19 @@ void mm_jpegdec_session_destroy(mm_jpeg_job_session_t* p_session)
     return;
   }
 
-  rc = mm_jpeg_session_change_state(p_session, OMX_StateIdle, NULL);
-  if (rc) {
-    CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
-  }
+  /* a cached handle is already in Loaded state */
+  OMX_GetState(p_session->omx_handle, &state);
+  if (OMX_StateLoaded != state) {
+    rc = mm_jpeg_session_change_state(p_session, OMX_StateIdle, NULL);
+    if (rc) {
+      CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+    }
 
-  rc = mm_jpeg_session_change_state(p_session, OMX_StateLoaded,
-    mm_jpegdec_session_free_buffers);
-  if (rc) {
-    CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+    rc = mm_jpeg_session_change_state(p_session, OMX_StateLoaded,
+      mm_jpegdec_session_free_buffers);
+    if (rc) {
+      CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+    }
   }
 
   rc = OMX_FreeHandle(p_session->omx_handle);
@@ -272,6 +289,69 @@ void mm_jpegdec_session_destroy(mm_jpeg_job_session_t* p_session)
   CDBG("%s:%d] X", __func__, __LINE__);
 }
 
+/** mm_jpegdec_session_park:
+ *
+ *  Arguments:
+ *    @p_session: job session
+ *
+ *  Return:
+ *       OMX_TRUE if the session is cached
+ *
+ *  Description:
+ *       Return an idle decode session to Loaded state and keep
+ *       its OMX handle for the next session of the client. The
+ *       caller destroys the session if it cannot be cached.
+ *
+ **/
+static OMX_BOOL mm_jpegdec_session_park(mm_jpeg_job_session_t *p_session)
+{
+  OMX_ERRORTYPE rc = OMX_ErrorNone;
+  OMX_STATETYPE state = OMX_StateInvalid;
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
+  uint8_t clnt_idx = mm_jpeg_util_get_index_by_handler(p_session->client_hdl);
+
+  if (!my_obj->session_cache_enabled || (NULL == p_session->omx_handle) ||
+    (clnt_idx >= MAX_JPEG_CLIENT_NUM) ||
+    (my_obj->num_cached_sessions >= MM_JPEGDEC_MAX_CACHED_SESSIONS)) {
+    return OMX_FALSE;
+  }
+
+  rc = OMX_GetState(p_session->omx_handle, &state);
+  if ((OMX_ErrorNone == rc) && (state == OMX_StateExecuting)) {
+    rc = mm_jpeg_session_change_state(p_session, OMX_StateIdle, NULL);
+    if (OMX_ErrorNone == rc) {
+      rc = OMX_GetState(p_session->omx_handle, &state);
+    }
+  }
+
+  /* the buffers belong to the client and cannot stay registered */
+  if ((OMX_ErrorNone == rc) && (state == OMX_StateIdle)) {
+    rc = mm_jpeg_session_change_state(p_session, OMX_StateLoaded,
+      mm_jpegdec_session_free_buffers);
+    if (OMX_ErrorNone == rc) {
+      rc = OMX_GetState(p_session->omx_handle, &state);
+    }
+  }
+
+  if ((OMX_ErrorNone != rc) || (OMX_StateLoaded != state)) {
+    CDBG_ERROR("%s:%d] cannot cache session, rc %d state %d",
+      __func__, __LINE__, rc, state);
+    return OMX_FALSE;
+  }
+
+  p_session->config = OMX_FALSE;
+  p_session->ports_valid = OMX_FALSE;
+
+  pthread_mutex_lock(&my_obj->clnt_mgr[clnt_idx].lock);
+  p_session->cached = OMX_TRUE;
+  pthread_mutex_unlock(&my_obj->clnt_mgr[clnt_idx].lock);
+  my_obj->num_cached_sessions++;
+
+  CDBG_HIGH("%s:%d] session %x cached, %d cached sessions", __func__,
+    __LINE__, p_session->sessionId, my_obj->num_cached_sessions);
+  return OMX_TRUE;
+}
+
 /** mm_jpeg_session_config_port:
  *
  *  Arguments:
@@ -838,7 +918,15 @@ int32_t mm_jpegdec_create_session(mm_jpeg_obj *my_obj,
     return rc;
   }
 
-  session_idx = mm_jpeg_get_new_session_idx(my_obj, clnt_idx, &p_session);
+  /* decode sessions are reconfigured per job, any cached one will do */
+  session_idx = -1;
+  if (my_obj->session_cache_enabled) {
+    session_idx = mm_jpeg_get_cached_session_idx(my_obj, clnt_idx,
+      OMX_FALSE, NULL, &p_session);
+  }
+  if (session_idx < 0) {
+    session_idx = mm_jpeg_get_new_session_idx(my_obj, clnt_idx, &p_session);
+  }
   if (session_idx < 0) {
     CDBG_ERROR("%s:%d] invalid session id (%d)", __func__, __LINE__, session_idx);
     return rc;
@@ -882,6 +970,7 @@ int32_t mm_jpegdec_destroy_session(mm_jpeg_obj *my_obj,
 {
   int32_t rc = 0;
   mm_jpeg_job_q_node_t *node = NULL;
+  OMX_BOOL busy;
 
   if (NULL == p_session) {
     CDBG_ERROR("%s:%d] invalid session", __func__, __LINE__);
@@ -890,6 +979,10 @@ int32_t mm_jpegdec_destroy_session(mm_jpeg_obj *my_obj,
   uint32_t session_id = p_session->sessionId;
   pthread_mutex_lock(&my_obj->job_lock);
 
+  pthread_mutex_lock(&p_session->lock);
+  busy = p_session->encoding;
+  pthread_mutex_unlock(&p_session->lock);
+
   /* abort job if in todo queue */
   CDBG("%s:%d] abort todo jobs", __func__, __LINE__);
   node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.job_queue, session_id);
@@ -906,9 +999,11 @@ int32_t mm_jpegdec_destroy_session(mm_jpeg_obj *my_obj,
     node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->ongoing_job_q, session_id);
   }
 
-  /* abort the current session */
+  /* abort the current session, keep the handle if it was idle */
   mm_jpeg_session_abort(p_session);
-  mm_jpegdec_session_destroy(p_session);
+  if (busy || !mm_jpegdec_session_park(p_session)) {
+    mm_jpegdec_session_destroy(p_session);
+  }
   mm_jpeg_remove_session_idx(my_obj, session_id);
   pthread_mutex_unlock(&my_obj->job_lock);
 
@@ -966,7 +1061,9 @@ OMX_ERRORTYPE mm_jpegdec_fbd(OMX_HANDLETYPE hComponent,
 {
   OMX_ERRORTYPE ret = OMX_ErrorNone;
   mm_jpeg_job_session_t *p_session = (mm_jpeg_job_session_t *) pAppData;
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
   mm_jpeg_output_t output_buf;
+  int i = 0;
 
   CDBG("%s:%d] count %d ", __func__, __LINE__, p_session->fbd_count);
 
@@ -978,6 +1075,16 @@ OMX_ERRORTYPE mm_jpegdec_fbd(OMX_HANDLETYPE hComponent,
   }
 
   p_session->fbd_count++;
+
+  /* pooled buffers are cached, drop stale lines before the client reads */
+  for (i = 0; i < MM_JPEGDEC_POOL_SIZE; i++) {
+    if (my_obj->dec_pool[i].in_use &&
+      (my_obj->dec_pool[i].ion_buf.addr == pBuffer->pBuffer)) {
+      buffer_invalidate(&my_obj->dec_pool[i].ion_buf);
+      break;
+    }
+  }
+
   if (NULL != p_session->dec_params.jpeg_cb) {
     p_session->job_status = JPEG_JOB_STATUS_DONE;
     output_buf.buf_filled_len = (uint32_t)pBuffer->nFilledLen;
@@ -1108,6 +1215,194 @@ abort_done:
 
   return rc;
 }
+
+/** mm_jpegdec_release_cached_sessions:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @client_hdl: client handle
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Free the OMX handles of the cached decode sessions of
+ *       the client
+ *
+ **/
+void mm_jpegdec_release_cached_sessions(mm_jpeg_obj *my_obj,
+  uint32_t client_hdl)
+{
+  int i = 0;
+  uint8_t clnt_idx = mm_jpeg_util_get_index_by_handler(client_hdl);
+  mm_jpeg_job_session_t *p_session;
+
+  if (clnt_idx >= MAX_JPEG_CLIENT_NUM) {
+    CDBG_ERROR("%s: invalid client with handler (%d)", __func__, client_hdl);
+    return;
+  }
+
+  pthread_mutex_lock(&my_obj->job_lock);
+  for (i = 0; i < MM_JPEG_MAX_SESSION; i++) {
+    p_session = &my_obj->clnt_mgr[clnt_idx].session[i];
+    if (OMX_TRUE == p_session->cached) {
+      p_session->cached = OMX_FALSE;
+      my_obj->num_cached_sessions--;
+      mm_jpegdec_session_destroy(p_session);
+    }
+  }
+  pthread_mutex_unlock(&my_obj->job_lock);
+}
+
+/** mm_jpegdec_get_buffer:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @size: minimum buffer size
+ *    @p_buf: filled with the buffer
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Get a decoder output buffer from the pool. The smallest
+ *       free buffer that fits is reused, otherwise a new ION
+ *       buffer is allocated in place of an unused slot.
+ *
+ **/
+int32_t mm_jpegdec_get_buffer(mm_jpeg_obj *my_obj,
+  size_t size,
+  mm_jpeg_buf_t *p_buf)
+{
+  int i = 0;
+  int best = -1;
+  int slot = -1;
+  mm_jpegdec_pool_buf_t *p_entry;
+
+  if ((0 == size) || (NULL == p_buf)) {
+    CDBG_ERROR("%s:%d] invalid parameters", __func__, __LINE__);
+    return -1;
+  }
+
+  for (i = 0; i < MM_JPEGDEC_POOL_SIZE; i++) {
+    p_entry = &my_obj->dec_pool[i];
+    if (p_entry->in_use) {
+      continue;
+    }
+    if (NULL == p_entry->ion_buf.addr) {
+      if (slot < 0) {
+        slot = i;
+      }
+    } else if (p_entry->ion_buf.size >= size) {
+      if ((best < 0) ||
+        (p_entry->ion_buf.size < my_obj->dec_pool[best].ion_buf.size)) {
+        best = i;
+      }
+    } else if ((slot < 0) || (NULL != my_obj->dec_pool[slot].ion_buf.addr)) {
+      /* too small, may be replaced if no slot is empty */
+      slot = i;
+    }
+  }
+
+  if (best < 0) {
+    if (slot < 0) {
+      CDBG_ERROR("%s:%d] no free pool buffer", __func__, __LINE__);
+      return -1;
+    }
+    p_entry = &my_obj->dec_pool[slot];
+    if (NULL != p_entry->ion_buf.addr) {
+      buffer_deallocate(&p_entry->ion_buf);
+    }
+    memset(&p_entry->ion_buf, 0x0, sizeof(buffer_t));
+    p_entry->ion_buf.size = size;
+    p_entry->ion_buf.addr = (uint8_t *)buffer_allocate(&p_entry->ion_buf, 1);
+    if (NULL == p_entry->ion_buf.addr) {
+      CDBG_ERROR("%s:%d] ION allocation of %zu bytes failed",
+        __func__, __LINE__, size);
+      memset(&p_entry->ion_buf, 0x0, sizeof(buffer_t));
+      return -1;
+    }
+    best = slot;
+    CDBG("%s:%d] allocated pool buffer %d size %zu", __func__, __LINE__,
+      best, size);
+  }
+
+  p_entry = &my_obj->dec_pool[best];
+  p_entry->in_use = OMX_TRUE;
+
+  memset(p_buf, 0x0, sizeof(mm_jpeg_buf_t));
+  p_buf->buf_vaddr = p_entry->ion_buf.addr;
+  p_buf->fd = p_entry->ion_buf.p_pmem_fd;
+  p_buf->buf_size = p_entry->ion_buf.size;
+  p_buf->format = MM_JPEG_FMT_YUV;
+  p_buf->index = (uint32_t)best;
+  return 0;
+}
+
+/** mm_jpegdec_put_buffer:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_buf: buffer from mm_jpegdec_get_buffer
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Return a decoder output buffer to the pool
+ *
+ **/
+int32_t mm_jpegdec_put_buffer(mm_jpeg_obj *my_obj,
+  mm_jpeg_buf_t *p_buf)
+{
+  mm_jpegdec_pool_buf_t *p_entry;
+
+  if ((NULL == p_buf) || (p_buf->index >= MM_JPEGDEC_POOL_SIZE)) {
+    CDBG_ERROR("%s:%d] invalid buffer", __func__, __LINE__);
+    return -1;
+  }
+
+  p_entry = &my_obj->dec_pool[p_buf->index];
+  if (!p_entry->in_use || (p_entry->ion_buf.addr != p_buf->buf_vaddr)) {
+    CDBG_ERROR("%s:%d] buffer %d is not from the pool", __func__, __LINE__,
+      p_buf->index);
+    return -1;
+  }
+
+  p_entry->in_use = OMX_FALSE;
+  return 0;
+}
+
+/** mm_jpegdec_release_pool:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Free the decoder output buffer pool
+ *
+ **/
+static void mm_jpegdec_release_pool(mm_jpeg_obj *my_obj)
+{
+  int i = 0;
+  mm_jpegdec_pool_buf_t *p_entry;
+
+  for (i = 0; i < MM_JPEGDEC_POOL_SIZE; i++) {
+    p_entry = &my_obj->dec_pool[i];
+    if (p_entry->in_use) {
+      CDBG_ERROR("%s:%d] pool buffer %d still held by the client",
+        __func__, __LINE__, i);
+    }
+    if (NULL != p_entry->ion_buf.addr) {
+      buffer_deallocate(&p_entry->ion_buf);
+    }
+    memset(p_entry, 0x0, sizeof(mm_jpegdec_pool_buf_t));
+  }
+}
+
 /** mm_jpegdec_init:
  *
  *  Arguments:
@@ -1123,12 +1418,17 @@ abort_done:
 int32_t mm_jpegdec_init(mm_jpeg_obj *my_obj)
 {
   int32_t rc = 0;
+  char prop[PROPERTY_VALUE_MAX];
+
+  property_get("persist.camera.jpegdec.session_cache", prop, "1");
+  my_obj->session_cache_enabled = (uint32_t)atoi(prop);
+  my_obj->num_cached_sessions = 0;
 
   /* init locks */
   pthread_mutex_init(&my_obj->job_lock, NULL);
 
   /* init ongoing job queue */
-  rc = mm_jpeg_queue_init(&my_obj->ongoing_job_q);
+  rc = mm_jpeg_queue_init_indexed(&my_obj->ongoing_job_q);
   if (0 != rc) {
     CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
     return -1;
@@ -1179,6 +1479,8 @@ int32_t mm_jpegdec_deinit(mm_jpeg_obj *my_obj)
   /* unload OMX engine */
   OMX_Deinit();
 
+  mm_jpegdec_release_pool(my_obj);
+
   /* deinit ongoing job and cb queue */
   rc = mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
   if (0 != rc) {
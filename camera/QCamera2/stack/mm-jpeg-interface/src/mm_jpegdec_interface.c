@@ -213,6 +213,7 @@ static int32_t mm_jpegdec_intf_close(uint32_t client_hdl)
     return rc;
   }
 
+  mm_jpegdec_release_cached_sessions(g_jpegdec_obj, client_hdl);
   rc = mm_jpeg_close(g_jpegdec_obj, client_hdl);
   g_jpegdec_obj->num_clients--;
   if(0 == rc) {
@@ -228,7 +229,74 @@ static int32_t mm_jpegdec_intf_close(uint32_t client_hdl)
   return rc;
 }
 
+/** mm_jpegdec_intf_get_buffer:
+ *
+ *  Arguments:
+ *    @size: minimum buffer size
+ *    @p_buf: filled with the buffer
+ *
+ *  Return:
+ *       0 success, failure otherwise
+ *
+ *  Description:
+ *       Get a pooled decoder output buffer
+ *
+ **/
+static int32_t mm_jpegdec_intf_get_buffer(size_t size, mm_jpeg_buf_t *p_buf)
+{
+  int32_t rc = -1;
+
+  if (0 == size || NULL == p_buf) {
+    CDBG_ERROR("%s:%d] invalid size or buffer", __func__, __LINE__);
+    return rc;
+  }
+
+  pthread_mutex_lock(&g_dec_intf_lock);
+  if (NULL == g_jpegdec_obj) {
+    /* mm_jpeg obj not exists, return error */
+    CDBG_ERROR("%s:%d] mm_jpeg is not opened yet", __func__, __LINE__);
+    pthread_mutex_unlock(&g_dec_intf_lock);
+    return rc;
+  }
+
+  rc = mm_jpegdec_get_buffer(g_jpegdec_obj, size, p_buf);
+  pthread_mutex_unlock(&g_dec_intf_lock);
+  return rc;
+}
 
+/** mm_jpegdec_intf_put_buffer:
+ *
+ *  Arguments:
+ *    @p_buf: buffer from get_buffer
+ *
+ *  Return:
+ *       0 success, failure otherwise
+ *
+ *  Description:
+ *       Return a decoder output buffer to the pool
+ *
+ **/
+static int32_t mm_jpegdec_intf_put_buffer(mm_jpeg_buf_t *p_buf)
+{
+  int32_t rc = -1;
+
+  if (NULL == p_buf) {
+    CDBG_ERROR("%s:%d] invalid buffer", __func__, __LINE__);
+    return rc;
+  }
+
+  pthread_mutex_lock(&g_dec_intf_lock);
+  if (NULL == g_jpegdec_obj) {
+    /* mm_jpeg obj not exists, return error */
+    CDBG_ERROR("%s:%d] mm_jpeg is not opened yet", __func__, __LINE__);
+    pthread_mutex_unlock(&g_dec_intf_lock);
+    return rc;
+  }
+
+  rc = mm_jpegdec_put_buffer(g_jpegdec_obj, p_buf);
+  pthread_mutex_unlock(&g_dec_intf_lock);
+  return rc;
+}
 
 /** jpegdec_open:
  *
@@ -283,6 +351,8 @@ uint32_t jpegdec_open(mm_jpegdec_ops_t *ops)
       ops->create_session = mm_jpegdec_intf_create_session;
       ops->destroy_session = mm_jpegdec_intf_destroy_session;
       ops->close = mm_jpegdec_intf_close;
+      ops->get_buffer = mm_jpegdec_intf_get_buffer;
+      ops->put_buffer = mm_jpegdec_intf_put_buffer;
     }
   } else {
     /* failed new client */
@@ -30,9 +30,17 @@
 #include "mm_jpeg_interface.h"
 #include "mm_jpeg_ionbuf.h"
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <stdlib.h>
+#include <time.h>
 
 #define MAX_NUM_BUFS (12)
+#define MM_JPEG_BENCH_MAX_RES (8)
+
+#define MIN(a,b)  (((a) < (b)) ? (a) : (b))
+#define MAX(a,b)  (((a) > (b)) ? (a) : (b))
+#define CLAMP(x, min, max) MIN(MAX((x), (min)), (max))
+#define ARR_SZ(a) (sizeof(a)/sizeof(a[0]))
 
 /** DUMP_TO_FILE:
  *  @filename: file name
@@ -200,6 +208,7 @@ int mm_jpeg_test_alloc(buffer_t *p_buffer, int use_pmem)
       CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
       return -1;
     }
+    p_buffer->p_pmem_fd = -1;
   }
   return ret;
 }
@@ -472,7 +481,662 @@ end:
   return 0;
 }
 
+/** mm_jpeg_bench_cfg_t:
+ *  @enabled: run the benchmark instead of the encode test
+ *  @json: print one JSON object per configuration
+ *  @recreate: create a new session for every round
+ *  @concurrency: number of sessions encoding in parallel
+ *  @burst: jobs per round of a session
+ *  @rounds: rounds per session
+ *  @num_res: number of synthetic frame sizes
+ *  @res: synthetic frame sizes
+ *  @num_fmt: number of color formats
+ *  @fmt: indices into color_formats
+ *  @num_files: number of input files, synthetic frames if 0
+ *  @files: input files
+ *
+ *  Benchmark configuration
+ **/
+typedef struct {
+  int enabled;
+  int json;
+  int recreate;
+  uint32_t concurrency;
+  uint32_t burst;
+  uint32_t rounds;
+  uint32_t num_res;
+  cam_dimension_t res[MM_JPEG_BENCH_MAX_RES];
+  uint32_t num_fmt;
+  int fmt[ARR_SZ(color_formats)];
+  uint32_t num_files;
+  char *files[MAX_NUM_BUFS];
+} mm_jpeg_bench_cfg_t;
+
+/** mm_jpeg_bench_done_t:
+ *  @job_id: job id
+ *  @end_us: completion time
+ *  @len: encoded size, 0 on error
+ *
+ *  Job completion reported by the encode callback
+ **/
+typedef struct {
+  uint32_t job_id;
+  uint64_t end_us;
+  size_t len;
+} mm_jpeg_bench_done_t;
+
+/** mm_jpeg_bench_worker_t:
+ *
+ *  One session of the benchmark, driven by its own thread. Jobs
+ *  cycle through num_bufs input/output slots so at most num_bufs
+ *  jobs of the session are in flight.
+ **/
+typedef struct {
+  pthread_t tid;
+  mm_jpeg_bench_cfg_t *p_cfg;
+  mm_jpeg_ops_t *p_ops;
+  uint32_t handle;
+  int width;
+  int height;
+  const mm_jpeg_intf_test_colfmt_t *p_fmt;
+  jpeg_test_input_t *p_input;
+  mm_jpeg_encode_params_t params;
+  mm_jpeg_job_t job;
+  buffer_t input[MAX_NUM_BUFS];
+  buffer_t output[MAX_NUM_BUFS];
+  uint32_t num_bufs;
+  /* job id and start time of the job using the slot, 0 if free */
+  uint32_t slot_job[MAX_NUM_BUFS];
+  uint64_t slot_start[MAX_NUM_BUFS];
+  uint32_t slots_busy;
+  /* completions queued by the callback */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  mm_jpeg_bench_done_t done[MAX_NUM_BUFS * 2];
+  uint32_t num_done;
+  /* results */
+  uint64_t *lat_us;
+  uint32_t num_lat;
+  uint32_t errors;
+  uint64_t bytes;
+  uint64_t setup_us;
+} mm_jpeg_bench_worker_t;
+
+static mm_jpeg_bench_cfg_t g_bench;
+
+static uint64_t mm_jpeg_bench_now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static int mm_jpeg_bench_cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/** mm_jpeg_bench_alloc:
+ *
+ *  Arguments:
+ *    @p_buffer: buffer with size set
+ *
+ *  Return:
+ *       0 or -ve values
+ *
+ *  Description:
+ *       Allocate an ION buffer, falling back to heap memory on
+ *       hosts without ION
+ *
+ **/
+static int mm_jpeg_bench_alloc(buffer_t *p_buffer)
+{
+  size_t size = p_buffer->size;
+
+  p_buffer->addr = (uint8_t *)buffer_allocate(p_buffer, 1);
+  if (NULL == p_buffer->addr) {
+    memset(p_buffer, 0x0, sizeof(buffer_t));
+    p_buffer->size = size;
+    return mm_jpeg_test_alloc(p_buffer, 0);
+  }
+  return 0;
+}
+
+/** mm_jpeg_bench_fill:
+ *
+ *  Arguments:
+ *    @p_addr: frame
+ *    @width: frame width
+ *    @height: frame height
+ *    @chroma_len: length of the chroma plane
+ *    @seed: noise seed
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Fill a synthetic frame: gradients with some noise so the
+ *       entropy coder sees realistic data
+ *
+ **/
+static void mm_jpeg_bench_fill(uint8_t *p_addr, int width, int height,
+  size_t chroma_len, uint32_t seed)
+{
+  int x, y;
+  size_t i;
+  int v;
+  uint32_t r = seed * 2654435761U + 1U;
+  uint8_t *p_c = p_addr + (size_t)width * (size_t)height;
+
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++) {
+      r = r * 1103515245U + 12345U;
+      v = ((x + y) * 255) / (width + height) + (int)((r >> 16) & 0x1f) - 16;
+      *p_addr++ = (uint8_t)CLAMP(v, 0, 255);
+    }
+  }
+  for (i = 0; i < chroma_len; i++) {
+    r = r * 1103515245U + 12345U;
+    p_c[i] = (uint8_t)(112 + ((i / (size_t)width) & 0x1f) +
+      ((r >> 16) & 0x3));
+  }
+}
+
+/** mm_jpeg_bench_callback:
+ *
+ *  Description:
+ *       Queue the completion for the worker thread. The job id
+ *       may not be known to the worker yet, so matching is done
+ *       there.
+ **/
+static void mm_jpeg_bench_callback(jpeg_job_status_t status,
+  uint32_t client_hdl,
+  uint32_t jobId,
+  mm_jpeg_output_t *p_output,
+  void *userData)
+{
+  mm_jpeg_bench_worker_t *p_wk = (mm_jpeg_bench_worker_t *)userData;
+  mm_jpeg_bench_done_t *p_done;
+
+  pthread_mutex_lock(&p_wk->lock);
+  if (p_wk->num_done < ARR_SZ(p_wk->done)) {
+    p_done = &p_wk->done[p_wk->num_done++];
+    p_done->job_id = jobId;
+    p_done->end_us = mm_jpeg_bench_now_us();
+    p_done->len = ((status == JPEG_JOB_STATUS_ERROR) || (NULL == p_output)) ?
+      0 : p_output->buf_filled_len;
+  }
+  pthread_cond_signal(&p_wk->cond);
+  pthread_mutex_unlock(&p_wk->lock);
+}
+
+/** mm_jpeg_bench_reap:
+ *
+ *  Arguments:
+ *    @p_wk: worker
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Wait for at least one completion and free the slots of
+ *       the completed jobs
+ *
+ **/
+static void mm_jpeg_bench_reap(mm_jpeg_bench_worker_t *p_wk)
+{
+  mm_jpeg_bench_done_t done[ARR_SZ(p_wk->done)];
+  uint32_t num_done, i, s;
+
+  pthread_mutex_lock(&p_wk->lock);
+  while (0 == p_wk->num_done) {
+    pthread_cond_wait(&p_wk->cond, &p_wk->lock);
+  }
+  num_done = p_wk->num_done;
+  memcpy(done, p_wk->done, num_done * sizeof(done[0]));
+  p_wk->num_done = 0;
+  pthread_mutex_unlock(&p_wk->lock);
+
+  for (i = 0; i < num_done; i++) {
+    for (s = 0; s < p_wk->num_bufs; s++) {
+      if (p_wk->slot_job[s] == done[i].job_id) {
+        break;
+      }
+    }
+    if (s == p_wk->num_bufs) {
+      CDBG_ERROR("%s:%d] unknown job %x", __func__, __LINE__, done[i].job_id);
+      continue;
+    }
+    if (done[i].len) {
+      p_wk->lat_us[p_wk->num_lat++] = done[i].end_us - p_wk->slot_start[s];
+      p_wk->bytes += done[i].len;
+    } else {
+      p_wk->errors++;
+    }
+    p_wk->slot_job[s] = 0;
+    p_wk->slots_busy--;
+  }
+}
+
+/** mm_jpeg_bench_init_worker:
+ *
+ *  Arguments:
+ *    @p_wk: worker
+ *    @seed: worker index, varies the synthetic frames
+ *
+ *  Return:
+ *       0 or -ve values
+ *
+ *  Description:
+ *       Allocate and fill the worker buffers and set up the
+ *       session parameters
+ *
+ **/
+static int mm_jpeg_bench_init_worker(mm_jpeg_bench_worker_t *p_wk,
+  uint32_t seed)
+{
+  mm_jpeg_encode_params_t *p_params = &p_wk->params;
+  mm_jpeg_encode_job_t *p_job = &p_wk->job.encode_job;
+  jpeg_test_input_t *p_input = p_wk->p_input;
+  size_t size = (size_t)p_wk->width * (size_t)p_wk->height;
+  size_t in_size = size * (size_t)p_wk->p_fmt->mult.numerator /
+    (size_t)p_wk->p_fmt->mult.denominator;
+  uint32_t i;
+  FILE *fp;
+
+  p_wk->num_bufs = MIN(p_wk->p_cfg->burst, (uint32_t)MAX_NUM_BUFS);
+  if (p_wk->p_cfg->num_files) {
+    p_wk->num_bufs = MIN(p_wk->num_bufs, p_wk->p_cfg->num_files);
+  }
+  pthread_mutex_init(&p_wk->lock, NULL);
+  pthread_cond_init(&p_wk->cond, NULL);
+
+  for (i = 0; i < p_wk->num_bufs; i++) {
+    p_wk->input[i].size = in_size;
+    p_wk->output[i].size = size * 3 / 2;
+    if (mm_jpeg_bench_alloc(&p_wk->input[i]) ||
+      mm_jpeg_bench_alloc(&p_wk->output[i])) {
+      CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+      return -1;
+    }
+
+    if (p_wk->p_cfg->num_files) {
+      fp = fopen(p_wk->p_cfg->files[i], "rb");
+      if (!fp || (fread(p_wk->input[i].addr, 1, in_size, fp) != in_size)) {
+        fprintf(stderr, "Cannot read %zu bytes from %s\n", in_size,
+          p_wk->p_cfg->files[i]);
+        if (fp) {
+          fclose(fp);
+        }
+        return -1;
+      }
+      fclose(fp);
+    } else {
+      mm_jpeg_bench_fill(p_wk->input[i].addr, p_wk->width, p_wk->height,
+        in_size - size, seed * MAX_NUM_BUFS + i);
+    }
+
+    p_params->src_main_buf[i].buf_size = in_size;
+    p_params->src_main_buf[i].buf_vaddr = p_wk->input[i].addr;
+    p_params->src_main_buf[i].fd = p_wk->input[i].p_pmem_fd;
+    p_params->src_main_buf[i].index = i;
+    p_params->src_main_buf[i].format = MM_JPEG_FMT_YUV;
+    p_params->src_main_buf[i].offset.mp[0].len = (uint32_t)size;
+    p_params->src_main_buf[i].offset.mp[0].stride = p_wk->width;
+    p_params->src_main_buf[i].offset.mp[0].scanline = p_wk->height;
+    p_params->src_main_buf[i].offset.mp[1].len = (uint32_t)(in_size - size);
+    p_params->src_thumb_buf[i] = p_params->src_main_buf[i];
+
+    p_params->dest_buf[i].buf_size = p_wk->output[i].size;
+    p_params->dest_buf[i].buf_vaddr = p_wk->output[i].addr;
+    p_params->dest_buf[i].fd = p_wk->output[i].p_pmem_fd;
+    p_params->dest_buf[i].index = i;
+  }
+
+  p_params->jpeg_cb = mm_jpeg_bench_callback;
+  p_params->userdata = p_wk;
+  p_params->color_format = p_wk->p_fmt->fmt;
+  p_params->thumb_color_format = p_wk->p_fmt->fmt;
+  p_params->num_src_bufs = p_wk->num_bufs;
+  p_params->num_dst_bufs = p_wk->num_bufs;
+  p_params->encode_thumbnail = p_input->encode_thumbnail;
+  p_params->num_tmb_bufs = p_input->encode_thumbnail ? p_wk->num_bufs : 0;
+  p_params->quality = (uint32_t)p_input->main_quality;
+  p_params->thumb_quality = (uint32_t)p_input->thumb_quality;
+  p_params->burst_mode = p_input->burst_mode;
+
+  p_wk->job.job_type = JPEG_JOB_TYPE_ENCODE;
+  p_job->main_dim.src_dim.width = p_wk->width;
+  p_job->main_dim.src_dim.height = p_wk->height;
+  p_job->main_dim.dst_dim.width = p_wk->width;
+  p_job->main_dim.dst_dim.height = p_wk->height;
+  p_job->main_dim.crop.width = p_wk->width;
+  p_job->main_dim.crop.height = p_wk->height;
+  p_params->main_dim = p_job->main_dim;
+
+  p_job->thumb_dim.src_dim.width = p_wk->width;
+  p_job->thumb_dim.src_dim.height = p_wk->height;
+  p_job->thumb_dim.dst_dim.width = p_input->tmb_width;
+  p_job->thumb_dim.dst_dim.height = p_input->tmb_height;
+  p_params->thumb_dim = p_job->thumb_dim;
+
+  p_job->qtable[0].eQuantizationTable = OMX_IMAGE_QuantizationTableLuma;
+  p_job->qtable[1].eQuantizationTable = OMX_IMAGE_QuantizationTableChroma;
+  p_job->qtable_set[0] = 1;
+  p_job->qtable_set[1] = 1;
+  for (i = 0; i < QUANT_SIZE; i++) {
+    p_job->qtable[0].nQuantizationMatrix[i] = DEFAULT_QTABLE_0[i];
+    p_job->qtable[1].nQuantizationMatrix[i] = DEFAULT_QTABLE_1[i];
+  }
+
+  p_wk->lat_us = (uint64_t *)calloc((size_t)p_wk->p_cfg->burst *
+    p_wk->p_cfg->rounds, sizeof(uint64_t));
+  if (NULL == p_wk->lat_us) {
+    CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+    return -1;
+  }
+  return 0;
+}
+
+static void mm_jpeg_bench_deinit_worker(mm_jpeg_bench_worker_t *p_wk)
+{
+  uint32_t i;
+
+  for (i = 0; i < p_wk->num_bufs; i++) {
+    mm_jpeg_test_free(&p_wk->input[i]);
+    mm_jpeg_test_free(&p_wk->output[i]);
+  }
+  free(p_wk->lat_us);
+  p_wk->lat_us = NULL;
+  pthread_mutex_destroy(&p_wk->lock);
+  pthread_cond_destroy(&p_wk->cond);
+}
+
+/** mm_jpeg_bench_session:
+ *
+ *  Arguments:
+ *    @data: worker
+ *
+ *  Return:
+ *       NULL
+ *
+ *  Description:
+ *       Worker thread: run the rounds of one session, creating
+ *       the session once or for every round
+ *
+ **/
+static void *mm_jpeg_bench_session(void *data)
+{
+  mm_jpeg_bench_worker_t *p_wk = (mm_jpeg_bench_worker_t *)data;
+  mm_jpeg_encode_job_t *p_job = &p_wk->job.encode_job;
+  uint32_t round, j, s;
+  uint32_t job_id;
+  uint64_t t0;
+  int rc;
+
+  p_job->session_id = 0;
+  for (round = 0; round < p_wk->p_cfg->rounds; round++) {
+    if (0 == p_job->session_id) {
+      t0 = mm_jpeg_bench_now_us();
+      p_wk->p_ops->create_session(p_wk->handle, &p_wk->params,
+        &p_job->session_id);
+      p_wk->setup_us += mm_jpeg_bench_now_us() - t0;
+      if (0 == p_job->session_id) {
+        CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+        p_wk->errors += p_wk->p_cfg->burst * (p_wk->p_cfg->rounds - round);
+        break;
+      }
+    }
+
+    for (j = 0; j < p_wk->p_cfg->burst; j++) {
+      while (p_wk->slots_busy == p_wk->num_bufs) {
+        mm_jpeg_bench_reap(p_wk);
+      }
+      for (s = 0; p_wk->slot_job[s]; s++)
+        ;
+
+      p_job->src_index = (int32_t)s;
+      p_job->dst_index = (int32_t)s;
+      p_job->thumb_index = s;
+      p_wk->slot_start[s] = mm_jpeg_bench_now_us();
+      rc = p_wk->p_ops->start_job(&p_wk->job, &job_id);
+      if (rc || !job_id) {
+        CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+        p_wk->errors++;
+        continue;
+      }
+      p_wk->slot_job[s] = job_id;
+      p_wk->slots_busy++;
+    }
+
+    while (p_wk->slots_busy) {
+      mm_jpeg_bench_reap(p_wk);
+    }
+
+    if (p_wk->p_cfg->recreate || (round == p_wk->p_cfg->rounds - 1)) {
+      t0 = mm_jpeg_bench_now_us();
+      p_wk->p_ops->destroy_session(p_job->session_id);
+      p_wk->setup_us += mm_jpeg_bench_now_us() - t0;
+      p_job->session_id = 0;
+    }
+  }
+  return NULL;
+}
+
+/** mm_jpeg_bench_run:
+ *
+ *  Arguments:
+ *    @p_input: encode settings
+ *    @width: frame width
+ *    @height: frame height
+ *    @p_fmt: color format
+ *
+ *  Return:
+ *       0 or -ve values
+ *
+ *  Description:
+ *       Benchmark one frame size and format and print the
+ *       latency percentiles, throughput and peak memory
+ *
+ **/
+static int mm_jpeg_bench_run(jpeg_test_input_t *p_input, int width,
+  int height, const mm_jpeg_intf_test_colfmt_t *p_fmt)
+{
+  mm_jpeg_bench_cfg_t *p_cfg = &g_bench;
+  mm_jpeg_bench_worker_t *p_wk;
+  mm_jpeg_ops_t ops;
+  mm_dimension pic_size;
+  uint32_t handle, i, num_lat = 0, errors = 0;
+  uint64_t *lat, bytes = 0, setup_us = 0, t0, wall_us;
+  double mp, p50, p90, p99, max;
+  struct rusage usage;
+  int rc = 0;
+
+  p_wk = (mm_jpeg_bench_worker_t *)calloc(p_cfg->concurrency, sizeof(*p_wk));
+  lat = (uint64_t *)calloc((size_t)p_cfg->concurrency * p_cfg->burst *
+    p_cfg->rounds, sizeof(uint64_t));
+  if (!p_wk || !lat) {
+    free(p_wk);
+    free(lat);
+    return -1;
+  }
+
+  memset(&pic_size, 0, sizeof(pic_size));
+  pic_size.w = (uint32_t)width;
+  pic_size.h = (uint32_t)height;
+  handle = jpeg_open(&ops, pic_size);
+  if (0 == handle) {
+    CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+    free(p_wk);
+    free(lat);
+    return -1;
+  }
+
+  for (i = 0; i < p_cfg->concurrency; i++) {
+    p_wk[i].p_cfg = p_cfg;
+    p_wk[i].p_ops = &ops;
+    p_wk[i].handle = handle;
+    p_wk[i].width = width;
+    p_wk[i].height = height;
+    p_wk[i].p_fmt = p_fmt;
+    p_wk[i].p_input = p_input;
+    if (mm_jpeg_bench_init_worker(&p_wk[i], i)) {
+      rc = -1;
+      break;
+    }
+  }
+
+  t0 = mm_jpeg_bench_now_us();
+  for (i = 0; (0 == rc) && (i < p_cfg->concurrency); i++) {
+    pthread_create(&p_wk[i].tid, NULL, mm_jpeg_bench_session, &p_wk[i]);
+  }
+  for (i = 0; (0 == rc) && (i < p_cfg->concurrency); i++) {
+    pthread_join(p_wk[i].tid, NULL);
+  }
+  wall_us = mm_jpeg_bench_now_us() - t0;
+
+  ops.close(handle);
+
+  for (i = 0; i < p_cfg->concurrency; i++) {
+    if (p_wk[i].lat_us) {
+      memcpy(&lat[num_lat], p_wk[i].lat_us,
+        p_wk[i].num_lat * sizeof(uint64_t));
+      num_lat += p_wk[i].num_lat;
+    }
+    errors += p_wk[i].errors;
+    bytes += p_wk[i].bytes;
+    setup_us += p_wk[i].setup_us;
+    mm_jpeg_bench_deinit_worker(&p_wk[i]);
+  }
+  free(p_wk);
+
+  if (rc) {
+    free(lat);
+    return rc;
+  }
+
+  qsort(lat, num_lat, sizeof(uint64_t), mm_jpeg_bench_cmp_u64);
+  p50 = num_lat ? (double)lat[(num_lat - 1) * 50 / 100] / 1000.0 : 0;
+  p90 = num_lat ? (double)lat[(num_lat - 1) * 90 / 100] / 1000.0 : 0;
+  p99 = num_lat ? (double)lat[(num_lat - 1) * 99 / 100] / 1000.0 : 0;
+  max = num_lat ? (double)lat[num_lat - 1] / 1000.0 : 0;
+  mp = (double)width * (double)height * (double)num_lat / 1000000.0;
+  getrusage(RUSAGE_SELF, &usage);
+  free(lat);
+
+  if (p_cfg->json) {
+    printf("{\"width\":%d,\"height\":%d,\"format\":\"%s\","
+      "\"source\":\"%s\",\"concurrency\":%u,\"burst\":%u,\"rounds\":%u,"
+      "\"sessions\":\"%s\",\"jobs\":%u,\"errors\":%u,"
+      "\"p50_ms\":%.3f,\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f,"
+      "\"wall_ms\":%.3f,\"setup_ms\":%.3f,\"mp_per_s\":%.3f,"
+      "\"avg_bytes\":%llu,\"peak_rss_kb\":%ld}\n",
+      width, height, p_fmt->str, p_cfg->num_files ? "file" : "synthetic",
+      p_cfg->concurrency, p_cfg->burst, p_cfg->rounds,
+      p_cfg->recreate ? "recreate" : "reuse", num_lat, errors,
+      p50, p90, p99, max, (double)wall_us / 1000.0,
+      (double)setup_us / 1000.0, mp * 1000000.0 / (double)wall_us,
+      (unsigned long long)(num_lat ? bytes / num_lat : 0),
+      usage.ru_maxrss);
+  } else {
+    printf("%dx%d %s: %u jobs %u errors, latency p50 %.2f p90 %.2f "
+      "p99 %.2f max %.2f ms, %.2f MP/s, session setup %.2f ms, "
+      "peak RSS %ld kB\n",
+      width, height, p_fmt->str, num_lat, errors, p50, p90, p99, max,
+      mp * 1000000.0 / (double)wall_us, (double)setup_us / 1000.0,
+      usage.ru_maxrss);
+  }
+  fflush(stdout);
+
+  return errors ? -1 : 0;
+}
+
+/** mm_jpeg_bench:
+ *
+ *  Arguments:
+ *    @p_input: encode settings
+ *
+ *  Return:
+ *       0 or -ve values
+ *
+ *  Description:
+ *       Run the benchmark for every frame size and format, or
+ *       for the input files at WIDTHxHEIGHT
+ *
+ **/
+static int mm_jpeg_bench(jpeg_test_input_t *p_input)
+{
+  mm_jpeg_bench_cfg_t *p_cfg = &g_bench;
+  uint32_t r, f;
+  int rc = 0;
+
+  if (0 == p_cfg->num_fmt) {
+    p_cfg->fmt[0] = 0;
+    p_cfg->num_fmt = 1;
+  }
+
+  if (p_cfg->num_files) {
+    return mm_jpeg_bench_run(p_input, p_input->width, p_input->height,
+      &p_input->col_fmt);
+  }
+
+  if (0 == p_cfg->num_res) {
+    p_cfg->res[0].width = p_input->width;
+    p_cfg->res[0].height = p_input->height;
+    p_cfg->num_res = 1;
+  }
+
+  for (r = 0; r < p_cfg->num_res; r++) {
+    for (f = 0; f < p_cfg->num_fmt; f++) {
+      rc |= mm_jpeg_bench_run(p_input, p_cfg->res[r].width,
+        p_cfg->res[r].height, &color_formats[p_cfg->fmt[f]]);
+    }
+  }
+  return rc;
+}
+
 #define MAX_FILE_CNT (20)
+
+/** mm_jpeg_test_parse_list:
+ *
+ *  Arguments:
+ *    @str: comma separated list
+ *    @p_cfg: benchmark configuration
+ *    @res: parse WIDTHxHEIGHT entries, format indices otherwise
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Parse the -S and -F lists of the benchmark
+ **/
+static void mm_jpeg_test_parse_list(char *str, mm_jpeg_bench_cfg_t *p_cfg,
+  int res)
+{
+  char *p_save = NULL;
+  char *tok;
+  int w, h, f;
+
+  for (tok = strtok_r(str, ",", &p_save); tok;
+    tok = strtok_r(NULL, ",", &p_save)) {
+    if (res) {
+      if ((2 == sscanf(tok, "%dx%d", &w, &h)) && (w > 0) && (h > 0) &&
+        (p_cfg->num_res < MM_JPEG_BENCH_MAX_RES)) {
+        p_cfg->res[p_cfg->num_res].width = w;
+        p_cfg->res[p_cfg->num_res].height = h;
+        p_cfg->num_res++;
+      }
+    } else {
+      f = atoi(tok);
+      if ((f >= 0) && (f < (int)ARR_SZ(color_formats)) &&
+        (p_cfg->num_fmt < ARR_SZ(p_cfg->fmt))) {
+        p_cfg->fmt[p_cfg->num_fmt++] = f;
+      }
+    }
+  }
+}
 static int mm_jpeg_test_get_input(int argc, char *argv[],
     jpeg_test_input_t *p_test)
 {
@@ -484,7 +1148,7 @@ static int mm_jpeg_test_get_input(int argc, char *argv[],
   char *in_files[MAX_FILE_CNT];
   char *out_files[MAX_FILE_CNT];
 
-  while ((c = getopt(argc, argv, "-I:O:W:H:F:BTx:y:Q:q:")) != -1) {
+  while ((c = getopt(argc, argv, "-I:O:W:H:F:BMTx:y:Q:q:bjrS:c:n:R:")) != -1) {
     switch (c) {
     case 'B':
       fprintf(stderr, "%-25s\n", "Using burst mode");
@@ -519,8 +1183,10 @@ static int mm_jpeg_test_get_input(int argc, char *argv[],
       fprintf(stderr, "%-25s%d\n", "Height: ", p_test->height);
       break;
     case 'F':
-      p_test->col_fmt = color_formats[atoi(optarg)];
+      p_test->col_fmt = color_formats[CLAMP(atoi(optarg), 0,
+        (int)ARR_SZ(color_formats) - 1)];
       fprintf(stderr, "%-25s%s\n", "Format: ", p_test->col_fmt.str);
+      mm_jpeg_test_parse_list(optarg, &g_bench, 0);
       break;
     case 'M':
       p_test->min_out_bufs = 1;
@@ -546,11 +1212,44 @@ static int mm_jpeg_test_get_input(int argc, char *argv[],
       p_test->thumb_quality = atoi(optarg);
       fprintf(stderr, "%-25s%d\n", "Thumb quality: ", p_test->thumb_quality);
       break;
+    case 'b':
+      g_bench.enabled = 1;
+      break;
+    case 'j':
+      g_bench.json = 1;
+      break;
+    case 'r':
+      g_bench.recreate = 1;
+      break;
+    case 'S':
+      mm_jpeg_test_parse_list(optarg, &g_bench, 1);
+      break;
+    case 'c':
+      g_bench.concurrency = (uint32_t)CLAMP(atoi(optarg), 1, 8);
+      break;
+    case 'n':
+      g_bench.burst = (uint32_t)MAX(atoi(optarg), 1);
+      break;
+    case 'R':
+      g_bench.rounds = (uint32_t)MAX(atoi(optarg), 1);
+      break;
     default:;
     }
   }
   fprintf(stderr, "Infiles: %zu Outfiles: %zu\n", in_file_cnt, out_file_cnt);
 
+  if (g_bench.enabled) {
+    /* the benchmark discards its output */
+    g_bench.num_files = (uint32_t)MIN(in_file_cnt, (size_t)MAX_NUM_BUFS);
+    for (i = 0; i < g_bench.num_files; i++) {
+      g_bench.files[i] = in_files[i];
+    }
+    g_bench.concurrency = MAX(g_bench.concurrency, 1U);
+    g_bench.burst = MAX(g_bench.burst, 1U);
+    g_bench.rounds = MAX(g_bench.rounds, 1U);
+    return 0;
+  }
+
   if (in_file_cnt > out_file_cnt) {
     fprintf(stderr, "%-25s\n", "Insufficient number of output files!");
     return 1;
@@ -601,6 +1300,18 @@ static void mm_jpeg_test_print_usage()
   fprintf(stderr, "  -B \t\tBurst mode. Utilize both encoder engines on"
           "supported targets\n");
   fprintf(stderr, "  -M \t\tUse minimum number of output buffers \n");
+  fprintf(stderr, "Benchmark:\n");
+  fprintf(stderr, "  -b \t\tRun the benchmark. Frames are synthetic unless "
+          "-I is given\n");
+  fprintf(stderr, "  -S WxH[,WxH]\t\tSynthetic frame sizes\n");
+  fprintf(stderr, "  -F FMT[,FMT]\t\tColor formats of the synthetic frames\n");
+  fprintf(stderr, "  -c COUNT\t\tSessions encoding in parallel (1-8)\n");
+  fprintf(stderr, "  -n COUNT\t\tJobs per session round\n");
+  fprintf(stderr, "  -R COUNT\t\tRounds per session\n");
+  fprintf(stderr, "  -r \t\tCreate a new session for every round\n");
+  fprintf(stderr, "  -j \t\tPrint one JSON object per configuration\n");
+  fprintf(stderr, "  Set persist.camera.jpeg.swenc=2 to measure the software "
+          "encoder\n");
   fprintf(stderr, "\n");
 }
 
@@ -637,7 +1348,11 @@ int main(int argc, char* argv[])
     mm_jpeg_test_print_usage();
     return 1;
   }
-  ret = encode_test(p_test_input);
+  if (g_bench.enabled) {
+    ret = mm_jpeg_bench(p_test_input);
+  } else {
+    ret = encode_test(p_test_input);
+  }
 
 exit:
   if (!ret) {
@@ -66,6 +66,7 @@ typedef struct {
   int height;
   char *out_filename;
   int format;
+  int batch_count;
 } jpeg_test_input_t;
 
 typedef struct {
@@ -84,6 +85,8 @@ typedef struct {
   mm_jpeg_decode_params_t params;
   mm_jpeg_job_t job;
   uint32_t session_id;
+  int batch;
+  int done;
 } mm_jpegdec_intf_test_t;
 
 typedef struct {
@@ -113,6 +116,17 @@ static void mm_jpegdec_decode_callback(jpeg_job_status_t status,
 {
   mm_jpegdec_intf_test_t *p_obj = (mm_jpegdec_intf_test_t *)userData;
 
+  if (p_obj->batch) {
+    if (status == JPEG_JOB_STATUS_ERROR) {
+      CDBG_ERROR("%s:%d] Decode error", __func__, __LINE__);
+    }
+    pthread_mutex_lock(&p_obj->lock);
+    p_obj->done = (status == JPEG_JOB_STATUS_ERROR) ? -1 : 1;
+    pthread_cond_signal(&p_obj->cond);
+    pthread_mutex_unlock(&p_obj->lock);
+    return;
+  }
+
   if (status == JPEG_JOB_STATUS_ERROR) {
     CDBG_ERROR("%s:%d] Decode error", __func__, __LINE__);
   } else {
@@ -246,10 +260,13 @@ static int decode_init(jpeg_test_input_t *p_input, mm_jpegdec_intf_test_t *p_obj
 
   chromaScale(p_input->format, &cScale);
   p_obj->output.size = (size_t)((double)size * cScale);
-  rc = mm_jpegdec_test_alloc(&p_obj->output, p_obj->use_ion);
-  if (rc) {
-    CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
-    return -1;
+  /* batch decodes take the output buffers from the decoder pool */
+  if (!p_obj->batch) {
+    rc = mm_jpegdec_test_alloc(&p_obj->output, p_obj->use_ion);
+    if (rc) {
+      CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+      return -1;
+    }
   }
 
   rc = mm_jpegdec_test_read(p_obj);
@@ -317,6 +334,7 @@ void omx_test_dec_print_usage()
   fprintf(stderr, "  -W WIDTH\t\tOutput image width\n");
   fprintf(stderr, "  -H HEIGHT\t\tOutput image height\n");
   fprintf(stderr, "Optional:\n");
+  fprintf(stderr, "  -N COUNT\t\tBenchmark COUNT pooled decodes\n");
   fprintf(stderr, "  -F FORMAT\t\tDefault image format:\n");
   fprintf(stderr, "\t\t\t\t%s (0), %s (1), %s (2) %s (3)\n"
     "%s (4), %s (5), %s (6) %s (7)\n",
@@ -334,7 +352,7 @@ static int mm_jpegdec_test_get_input(int argc, char *argv[],
 {
   int c;
 
-  while ((c = getopt(argc, argv, "I:O:W:H:F:")) != -1) {
+  while ((c = getopt(argc, argv, "I:O:W:H:F:N:")) != -1) {
     switch (c) {
     case 'O':
       p_test->out_filename = optarg;
@@ -353,6 +371,11 @@ static int mm_jpegdec_test_get_input(int argc, char *argv[],
       p_test->height = atoi(optarg);
       fprintf(stderr, "%-25s%d\n", "Default height", p_test->height);
       break;
+    case 'N':
+      p_test->batch_count = atoi(optarg);
+      fprintf(stderr, "%-25s%d\n", "Batch decode count",
+        p_test->batch_count);
+      break;
     case 'F': {
       int format = 0;
       format = atoi(optarg);
@@ -440,6 +463,120 @@ end:
   return 0;
 }
 
+/** decode_batch_test:
+ *
+ *  Arguments:
+ *    @p_input: test input
+ *
+ *  Return:
+ *       0 or -ve values
+ *
+ *  Description:
+ *       Decode the input batch_count times the way offline
+ *       reprocess does, one session per image with the output
+ *       taken from the decoder pool, and report the throughput
+ *
+ **/
+static int decode_batch_test(jpeg_test_input_t *p_input)
+{
+  int rc = 0;
+  int i = 0;
+  mm_jpegdec_intf_test_t jpeg_obj;
+  mm_jpeg_buf_t out_buf;
+  mm_jpeg_buf_t *p_dest;
+  struct timeval start, end, t0, t1;
+  uint64_t total_us, job_us, min_us = 0, max_us = 0;
+
+  memset(&jpeg_obj, 0x0, sizeof(jpeg_obj));
+  jpeg_obj.batch = 1;
+  rc = decode_init(p_input, &jpeg_obj);
+  if (rc) {
+    CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+    return -1;
+  }
+
+  jpeg_obj.handle = jpegdec_open(&jpeg_obj.ops);
+  if (jpeg_obj.handle == 0) {
+    CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+    goto end;
+  }
+
+  p_dest = &jpeg_obj.params.dest_buf[0];
+  gettimeofday(&start, NULL);
+  for (i = 0; i < p_input->batch_count; i++) {
+    gettimeofday(&t0, NULL);
+
+    rc = jpeg_obj.ops.get_buffer(jpeg_obj.output.size, &out_buf);
+    if (rc) {
+      CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+      break;
+    }
+    p_dest->buf_vaddr = out_buf.buf_vaddr;
+    p_dest->fd = out_buf.fd;
+    p_dest->buf_size = out_buf.buf_size;
+
+    rc = jpeg_obj.ops.create_session(jpeg_obj.handle, &jpeg_obj.params,
+      &jpeg_obj.job.decode_job.session_id);
+    if (jpeg_obj.job.decode_job.session_id == 0) {
+      CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+      jpeg_obj.ops.put_buffer(&out_buf);
+      rc = -1;
+      break;
+    }
+
+    jpeg_obj.done = 0;
+    jpeg_obj.job.job_type = JPEG_JOB_TYPE_DECODE;
+    rc = jpeg_obj.ops.start_job(&jpeg_obj.job, &jpeg_obj.job_id[0]);
+    if (0 == rc) {
+      pthread_mutex_lock(&jpeg_obj.lock);
+      while (0 == jpeg_obj.done) {
+        pthread_cond_wait(&jpeg_obj.cond, &jpeg_obj.lock);
+      }
+      rc = (jpeg_obj.done < 0) ? -1 : 0;
+      pthread_mutex_unlock(&jpeg_obj.lock);
+    }
+
+    if ((0 == rc) && (i == p_input->batch_count - 1)) {
+      DUMP_TO_FILE(jpeg_obj.out_filename, out_buf.buf_vaddr,
+        jpeg_obj.output.size);
+    }
+
+    jpeg_obj.ops.destroy_session(jpeg_obj.job.decode_job.session_id);
+    jpeg_obj.ops.put_buffer(&out_buf);
+    if (rc) {
+      CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
+      break;
+    }
+
+    gettimeofday(&t1, NULL);
+    job_us = TIME_IN_US(t1) - TIME_IN_US(t0);
+    if ((0 == i) || (job_us < min_us)) {
+      min_us = job_us;
+    }
+    if (job_us > max_us) {
+      max_us = job_us;
+    }
+  }
+  gettimeofday(&end, NULL);
+
+  if (i > 0) {
+    total_us = TIME_IN_US(end) - TIME_IN_US(start);
+    fprintf(stderr, "Decoded %d images in %llu ms\n", i,
+      (unsigned long long)(total_us / 1000));
+    fprintf(stderr, "Per image avg %llu us min %llu us max %llu us, "
+      "%.2f images/s\n",
+      (unsigned long long)(total_us / (uint64_t)i),
+      (unsigned long long)min_us, (unsigned long long)max_us,
+      (double)i * 1000000.0 / (double)total_us);
+  }
+
+  jpeg_obj.ops.close(jpeg_obj.handle);
+
+end:
+  mm_jpegdec_test_free(&jpeg_obj.input);
+  return rc;
+}
+
 /** main:
  *
  *  Arguments:
@@ -465,6 +602,10 @@ int main(int argc, char* argv[])
     return -1;
   }
 
+  if (dec_test_input.batch_count > 0) {
+    return decode_batch_test(&dec_test_input);
+  }
+
   return decode_test(&dec_test_input);
 }
 
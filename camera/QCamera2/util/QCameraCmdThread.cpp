@@ -30,6 +30,9 @@
 #include <utils/Errors.h>
 #include <utils/Log.h>
 #include <sys/prctl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
 #include "QCameraCmdThread.h"
 
 using namespace android;
@@ -46,11 +49,21 @@ namespace qcamera {
  * RETURN     : None
  *==========================================================================*/
 QCameraCmdThread::QCameraCmdThread() :
-    cmd_queue()
+    cmd_pid(0),
+    m_cmdHead(0),
+    m_cmdCount(0),
+    m_bCoalesce(false),
+    m_bWaiting(false)
 {
-    cmd_pid = 0;
+    pthread_condattr_t attr;
+
+    memset(m_cmds, 0, sizeof(m_cmds));
     cam_sem_init(&sync_sem, 0);
-    cam_sem_init(&cmd_sem, 0);
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&m_cond, &attr);
+    pthread_condattr_destroy(&attr);
 }
 
 /*===========================================================================
@@ -65,7 +78,8 @@ QCameraCmdThread::QCameraCmdThread() :
 QCameraCmdThread::~QCameraCmdThread()
 {
     cam_sem_destroy(&sync_sem);
-    cam_sem_destroy(&cmd_sem);
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_lock);
 }
 
 /*===========================================================================
@@ -111,6 +125,26 @@ int32_t QCameraCmdThread::setName(const char* name)
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : setCoalescing
+ *
+ * DESCRIPTION: enable or disable collapsing of pending DO_NEXT_JOB commands.
+ *              When enabled, back to back DO_NEXT_JOB are delivered as a
+ *              single command, so the cmd thread routine must drain its
+ *              job queues completely on every DO_NEXT_JOB.
+ *
+ * PARAMETERS :
+ *   @enable  : true to collapse DO_NEXT_JOB commands
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraCmdThread::setCoalescing(bool enable)
+{
+    pthread_mutex_lock(&m_lock);
+    m_bCoalesce = enable;
+    pthread_mutex_unlock(&m_lock);
+}
+
 /*===========================================================================
  * FUNCTION   : sendCmd
  *
@@ -129,26 +163,35 @@ int32_t QCameraCmdThread::setName(const char* name)
  *==========================================================================*/
 int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8_t priority)
 {
-    camera_cmd_t *node = (camera_cmd_t *)malloc(sizeof(camera_cmd_t));
-    if (NULL == node) {
-        ALOGE("%s: No memory for camera_cmd_t", __func__);
-        return NO_MEMORY;
-    }
-    memset(node, 0, sizeof(camera_cmd_t));
-    node->cmd = cmd;
+    pthread_mutex_lock(&m_lock);
+    camera_cmd_t *tail = (m_cmdCount > 0) ?
+            &m_cmds[(m_cmdHead + m_cmdCount - 1) % CAMERA_CMD_RING_SIZE] : NULL;
 
-    if (priority) {
-        if (!cmd_queue.enqueueWithPriority((void *)node)) {
-            free(node);
-            node = NULL;
+    if ((CAMERA_CMD_TYPE_DO_NEXT_JOB == cmd) && !priority &&
+            (NULL != tail) && (CAMERA_CMD_TYPE_DO_NEXT_JOB == tail->cmd)) {
+        // consumer has not reached the previous job yet, share its slot
+        tail->count++;
+    } else if (m_cmdCount < CAMERA_CMD_RING_SIZE) {
+        uint32_t idx;
+        if (priority) {
+            m_cmdHead = (m_cmdHead + CAMERA_CMD_RING_SIZE - 1) % CAMERA_CMD_RING_SIZE;
+            idx = m_cmdHead;
+        } else {
+            idx = (m_cmdHead + m_cmdCount) % CAMERA_CMD_RING_SIZE;
         }
+        m_cmds[idx].cmd = cmd;
+        m_cmds[idx].count = 1;
+        m_cmdCount++;
     } else {
-        if (!cmd_queue.enqueue((void *)node)) {
-            free(node);
-            node = NULL;
-        }
+        pthread_mutex_unlock(&m_lock);
+        ALOGE("%s: No free slot for cmd %d", __func__, cmd);
+        return NO_MEMORY;
+    }
+
+    if (m_bWaiting) {
+        pthread_cond_signal(&m_cond);
     }
-    cam_sem_post(&cmd_sem);
+    pthread_mutex_unlock(&m_lock);
 
     /* if is a sync call, need to wait until it returns */
     if (sync_cmd) {
@@ -157,6 +200,84 @@ int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : waitCmd
+ *
+ * DESCRIPTION: block the cmd thread until a command is available
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraCmdThread::waitCmd()
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&m_lock);
+    while ((0 == m_cmdCount) && (0 == rc)) {
+        m_bWaiting = true;
+        rc = pthread_cond_wait(&m_cond, &m_lock);
+        m_bWaiting = false;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    if (0 != rc) {
+        ALOGE("%s: wait error (%s)", __func__, strerror(rc));
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : waitCmd
+ *
+ * DESCRIPTION: block the cmd thread until a command is available or the
+ *              timeout expires. Meant for routines that need to wake up
+ *              periodically, e.g. to check for a stuck pipeline.
+ *
+ * PARAMETERS :
+ *   @timeout_ms : max time to wait in milliseconds
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- command available
+ *              TIMED_OUT -- no command within timeout
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraCmdThread::waitCmd(uint32_t timeout_ms)
+{
+    int rc = 0;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    while ((0 == m_cmdCount) && (0 == rc)) {
+        m_bWaiting = true;
+        rc = pthread_cond_timedwait(&m_cond, &m_lock, &ts);
+        m_bWaiting = false;
+    }
+    if (m_cmdCount > 0) {
+        rc = 0;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    if (ETIMEDOUT == rc) {
+        return TIMED_OUT;
+    } else if (0 != rc) {
+        ALOGE("%s: timed wait error (%s)", __func__, strerror(rc));
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
 /*===========================================================================
  * FUNCTION   : getCmd
  *
@@ -169,13 +290,23 @@ int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8
 camera_cmd_type_t QCameraCmdThread::getCmd()
 {
     camera_cmd_type_t cmd = CAMERA_CMD_TYPE_NONE;
-    camera_cmd_t *node = (camera_cmd_t *)cmd_queue.dequeue();
-    if (NULL == node) {
+
+    pthread_mutex_lock(&m_lock);
+    if (m_cmdCount > 0) {
+        camera_cmd_t *head = &m_cmds[m_cmdHead];
+        cmd = head->cmd;
+        if ((CAMERA_CMD_TYPE_DO_NEXT_JOB == cmd) && !m_bCoalesce &&
+                (head->count > 1)) {
+            head->count--;
+        } else {
+            m_cmdHead = (m_cmdHead + 1) % CAMERA_CMD_RING_SIZE;
+            m_cmdCount--;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    if (CAMERA_CMD_TYPE_NONE == cmd) {
         ALOGD("%s: No notify avail", __func__);
-        return CAMERA_CMD_TYPE_NONE;
-    } else {
-        cmd = node->cmd;
-        free(node);
     }
     return cmd;
 }
@@ -210,6 +341,12 @@ int32_t QCameraCmdThread::exit()
         ALOGD("%s: pthread dead already\n", __func__);
     }
     cmd_pid = 0;
+
+    /* drop commands the thread did not get to before exiting */
+    pthread_mutex_lock(&m_lock);
+    m_cmdHead = 0;
+    m_cmdCount = 0;
+    pthread_mutex_unlock(&m_lock);
     return rc;
 }
 
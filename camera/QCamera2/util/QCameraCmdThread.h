@@ -48,8 +48,12 @@ typedef enum
     CAMERA_CMD_TYPE_MAX
 } camera_cmd_type_t;
 
+// max number of distinct pending commands, DO_NEXT_JOB runs share one slot
+#define CAMERA_CMD_RING_SIZE 32
+
 typedef struct {
     camera_cmd_type_t cmd;
+    uint32_t count;        // number of DO_NEXT_JOB collapsed into this slot
 } camera_cmd_t;
 
 class QCameraCmdThread {
@@ -61,12 +65,22 @@ public:
     int32_t setName(const char* name);
     int32_t exit();
     int32_t sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8_t priority);
+    void setCoalescing(bool enable);
+    int32_t waitCmd();
+    int32_t waitCmd(uint32_t timeout_ms);
     camera_cmd_type_t getCmd();
 
-    QCameraQueue cmd_queue;      /* cmd queue */
     pthread_t cmd_pid;           /* cmd thread ID */
-    cam_semaphore_t cmd_sem;               /* semaphore for cmd thread */
     cam_semaphore_t sync_sem;              /* semaphore for synchronized call signal */
+
+private:
+    camera_cmd_t m_cmds[CAMERA_CMD_RING_SIZE]; /* pending cmd slots */
+    uint32_t m_cmdHead;          /* index of the oldest pending slot */
+    uint32_t m_cmdCount;         /* number of pending slots */
+    bool m_bCoalesce;            /* collapse pending DO_NEXT_JOB into one */
+    bool m_bWaiting;             /* cmd thread is blocked in waitCmd */
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_cond;
 };
 
 }; // namespace qcamera
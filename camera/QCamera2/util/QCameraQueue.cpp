@@ -43,13 +43,11 @@ namespace qcamera {
  * RETURN     : None
  *==========================================================================*/
 QCameraQueue::QCameraQueue()
+    : m_dataFn(NULL),
+      m_keyFn(NULL),
+      m_userData(NULL),
+      m_queue(releaseNode, this)
 {
-    pthread_mutex_init(&m_lock, NULL);
-    cam_list_init(&m_head.list);
-    m_size = 0;
-    m_dataFn = NULL;
-    m_userData = NULL;
-    m_active = true;
 }
 
 /*===========================================================================
@@ -64,13 +62,33 @@ QCameraQueue::QCameraQueue()
  * RETURN     : None
  *==========================================================================*/
 QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
+    : m_dataFn(data_rel_fn),
+      m_keyFn(NULL),
+      m_userData(user_data),
+      m_queue(releaseNode, this)
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraQueue
+ *
+ * DESCRIPTION: constructor of QCameraQueue with a keyed index, enabling
+ *              dequeueByKey and flushNodesByKey
+ *
+ * PARAMETERS :
+ *   @data_rel_fn : function ptr to release node data internal resource
+ *   @user_data   : user data ptr
+ *   @key_fn      : function ptr returning the lookup key of node data
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data,
+        key_data_fn key_fn)
+    : m_dataFn(data_rel_fn),
+      m_keyFn(key_fn),
+      m_userData(user_data),
+      m_queue(releaseNode, this, 0, (NULL != key_fn) ? nodeKey : NULL)
 {
-    pthread_mutex_init(&m_lock, NULL);
-    cam_list_init(&m_head.list);
-    m_size = 0;
-    m_dataFn = data_rel_fn;
-    m_userData = user_data;
-    m_active = true;
 }
 
 /*===========================================================================
@@ -85,7 +103,92 @@ QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
 QCameraQueue::~QCameraQueue()
 {
     flush();
-    pthread_mutex_destroy(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseNode
+ *
+ * DESCRIPTION: release function handed to the underlying queue. Calls the
+ *              user release function and frees the node data.
+ *
+ * PARAMETERS :
+ *   @data      : node data
+ *   @user_data : ptr to the owning QCameraQueue
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::releaseNode(void *&data, void *user_data)
+{
+    QCameraQueue *pme = (QCameraQueue *)user_data;
+    if (NULL != data) {
+        if (pme->m_dataFn) {
+            pme->m_dataFn(data, pme->m_userData);
+        }
+        free(data);
+        data = NULL;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : matchNode
+ *
+ * DESCRIPTION: adapts a legacy match_fn to the underlying queue
+ *
+ * PARAMETERS :
+ *   @data       : node data
+ *   @user_data  : ptr to the owning QCameraQueue
+ *   @match_data : legacy match_fn
+ *
+ * RETURN     : result of the legacy match function
+ *==========================================================================*/
+bool QCameraQueue::matchNode(void * const &data, void *user_data,
+        void *match_data)
+{
+    QCameraQueue *pme = (QCameraQueue *)user_data;
+    match_fn match = (match_fn)match_data;
+    return match(data, pme->m_userData);
+}
+
+typedef struct {
+    match_fn_data match;
+    void *spec_data;
+} qcamera_queue_match_t;
+
+/*===========================================================================
+ * FUNCTION   : matchNodeData
+ *
+ * DESCRIPTION: adapts a legacy match_fn_data to the underlying queue
+ *
+ * PARAMETERS :
+ *   @data       : node data
+ *   @user_data  : ptr to the owning QCameraQueue
+ *   @match_data : ptr to qcamera_queue_match_t
+ *
+ * RETURN     : result of the legacy match function
+ *==========================================================================*/
+bool QCameraQueue::matchNodeData(void * const &data, void *user_data,
+        void *match_data)
+{
+    QCameraQueue *pme = (QCameraQueue *)user_data;
+    qcamera_queue_match_t *m = (qcamera_queue_match_t *)match_data;
+    return m->match(data, pme->m_userData, m->spec_data);
+}
+
+/*===========================================================================
+ * FUNCTION   : nodeKey
+ *
+ * DESCRIPTION: adapts the legacy key function to the underlying queue
+ *
+ * PARAMETERS :
+ *   @data      : node data
+ *   @user_data : ptr to the owning QCameraQueue
+ *
+ * RETURN     : lookup key of node data
+ *==========================================================================*/
+uint32_t QCameraQueue::nodeKey(void * const &data, void *user_data)
+{
+    QCameraQueue *pme = (QCameraQueue *)user_data;
+    return pme->m_keyFn(data, pme->m_userData);
 }
 
 /*===========================================================================
@@ -99,9 +202,7 @@ QCameraQueue::~QCameraQueue()
  *==========================================================================*/
 void QCameraQueue::init()
 {
-    pthread_mutex_lock(&m_lock);
-    m_active = true;
-    pthread_mutex_unlock(&m_lock);
+    m_queue.init();
 }
 
 /*===========================================================================
@@ -115,13 +216,7 @@ void QCameraQueue::init()
  *==========================================================================*/
 bool QCameraQueue::isEmpty()
 {
-    bool flag = true;
-    pthread_mutex_lock(&m_lock);
-    if (m_size > 0) {
-        flag = false;
-    }
-    pthread_mutex_unlock(&m_lock);
-    return flag;
+    return m_queue.isEmpty();
 }
 
 /*===========================================================================
@@ -136,28 +231,7 @@ bool QCameraQueue::isEmpty()
  *==========================================================================*/
 bool QCameraQueue::enqueue(void *data)
 {
-    bool rc;
-    camera_q_node *node =
-        (camera_q_node *)malloc(sizeof(camera_q_node));
-    if (NULL == node) {
-        ALOGE("%s: No memory for camera_q_node", __func__);
-        return false;
-    }
-
-    memset(node, 0, sizeof(camera_q_node));
-    node->data = data;
-
-    pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        cam_list_add_tail_node(&node->list, &m_head.list);
-        m_size++;
-        rc = true;
-    } else {
-        free(node);
-        rc = false;
-    }
-    pthread_mutex_unlock(&m_lock);
-    return rc;
+    return m_queue.enqueue(data);
 }
 
 /*===========================================================================
@@ -173,34 +247,7 @@ bool QCameraQueue::enqueue(void *data)
  *==========================================================================*/
 bool QCameraQueue::enqueueWithPriority(void *data)
 {
-    bool rc;
-    camera_q_node *node =
-        (camera_q_node *)malloc(sizeof(camera_q_node));
-    if (NULL == node) {
-        ALOGE("%s: No memory for camera_q_node", __func__);
-        return false;
-    }
-
-    memset(node, 0, sizeof(camera_q_node));
-    node->data = data;
-
-    pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        struct cam_list *p_next = m_head.list.next;
-
-        m_head.list.next = &node->list;
-        p_next->prev = &node->list;
-        node->list.next = p_next;
-        node->list.prev = &m_head.list;
-
-        m_size++;
-        rc = true;
-    } else {
-        free(node);
-        rc = false;
-    }
-    pthread_mutex_unlock(&m_lock);
-    return rc;
+    return m_queue.enqueueWithPriority(data);
 }
 
 /*===========================================================================
@@ -214,25 +261,8 @@ bool QCameraQueue::enqueueWithPriority(void *data)
  *==========================================================================*/
 void* QCameraQueue::peek()
 {
-    camera_q_node* node = NULL;
-    void* data = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
-
-    pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        head = &m_head.list;
-        pos = head->next;
-        if (pos != head) {
-            node = member_of(pos, camera_q_node, list);
-        }
-    }
-    pthread_mutex_unlock(&m_lock);
-
-    if (NULL != node) {
-        data = node->data;
-    }
-
+    void *data = NULL;
+    m_queue.peek(data);
     return data;
 }
 
@@ -249,33 +279,62 @@ void* QCameraQueue::peek()
  *==========================================================================*/
 void* QCameraQueue::dequeue(bool bFromHead)
 {
-    camera_q_node* node = NULL;
-    void* data = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
+    void *data = NULL;
+    m_queue.dequeue(data, bFromHead);
+    return data;
+}
 
-    pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        head = &m_head.list;
-        if (bFromHead) {
-            pos = head->next;
-        } else {
-            pos = head->prev;
-        }
-        if (pos != head) {
-            node = member_of(pos, camera_q_node, list);
-            cam_list_del_node(&node->list);
-            m_size--;
-        }
-    }
-    pthread_mutex_unlock(&m_lock);
+/*===========================================================================
+ * FUNCTION   : dequeueByKey
+ *
+ * DESCRIPTION: dequeue the oldest data with the given key. Queue must have
+ *              been constructed with a key function.
+ *
+ * PARAMETERS :
+ *   @key     : lookup key
+ *
+ * RETURN     : data ptr. NULL if no data matches the key.
+ *==========================================================================*/
+void* QCameraQueue::dequeueByKey(uint32_t key)
+{
+    void *data = NULL;
+    m_queue.dequeueByKey(key, data);
+    return data;
+}
 
-    if (NULL != node) {
-        data = node->data;
-        free(node);
-    }
+/*===========================================================================
+ * FUNCTION   : updateKey
+ *
+ * DESCRIPTION: re-hash queued data whose key changed after enqueue
+ *
+ * PARAMETERS :
+ *   @data    : queued data ptr
+ *
+ * RETURN     : true -- success; false -- data not found in the queue
+ *==========================================================================*/
+bool QCameraQueue::updateKey(void *data)
+{
+    return m_queue.updateKey(data);
+}
 
-    return data;
+/*===========================================================================
+ * FUNCTION   : dequeueAll
+ *
+ * DESCRIPTION: dequeue up to max_items data ptrs from the head of the queue
+ *              in one go
+ *
+ * PARAMETERS :
+ *   @items     : array to be filled with data ptrs
+ *   @max_items : size of items array
+ *
+ * RETURN     : number of data ptrs dequeued
+ *==========================================================================*/
+int QCameraQueue::dequeueAll(void **items, int max_items)
+{
+    if (max_items <= 0) {
+        return 0;
+    }
+    return (int)m_queue.dequeueAll(items, (uint32_t)max_items);
 }
 
 /*===========================================================================
@@ -289,34 +348,7 @@ void* QCameraQueue::dequeue(bool bFromHead)
  * RETURN     : None
  *==========================================================================*/
 void QCameraQueue::flush(){
-    camera_q_node* node = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
-
-    pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        head = &m_head.list;
-        pos = head->next;
-
-        while(pos != head) {
-            node = member_of(pos, camera_q_node, list);
-            pos = pos->next;
-            cam_list_del_node(&node->list);
-            m_size--;
-
-            if (NULL != node->data) {
-                if (m_dataFn) {
-                    m_dataFn(node->data, m_userData);
-                }
-                free(node->data);
-            }
-            free(node);
-
-        }
-        m_size = 0;
-        m_active = false;
-    }
-    pthread_mutex_unlock(&m_lock);
+    m_queue.flush();
 }
 
 /*===========================================================================
@@ -331,37 +363,10 @@ void QCameraQueue::flush(){
  * RETURN     : None
  *==========================================================================*/
 void QCameraQueue::flushNodes(match_fn match){
-    camera_q_node* node = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
-
     if ( NULL == match ) {
         return;
     }
-
-    pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        head = &m_head.list;
-        pos = head->next;
-
-        while(pos != head) {
-            node = member_of(pos, camera_q_node, list);
-            pos = pos->next;
-            if ( match(node->data, m_userData) ) {
-                cam_list_del_node(&node->list);
-                m_size--;
-
-                if (NULL != node->data) {
-                    if (m_dataFn) {
-                        m_dataFn(node->data, m_userData);
-                    }
-                    free(node->data);
-                }
-                free(node);
-            }
-        }
-    }
-    pthread_mutex_unlock(&m_lock);
+    m_queue.flushNodes(matchNode, (void *)match);
 }
 
 /*===========================================================================
@@ -376,37 +381,30 @@ void QCameraQueue::flushNodes(match_fn match){
  * RETURN     : None
  *==========================================================================*/
 void QCameraQueue::flushNodes(match_fn_data match, void *match_data){
-    camera_q_node* node = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
+    qcamera_queue_match_t m;
 
     if ( NULL == match ) {
         return;
     }
+    m.match = match;
+    m.spec_data = match_data;
+    m_queue.flushNodes(matchNodeData, &m);
+}
 
-    pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        head = &m_head.list;
-        pos = head->next;
-
-        while(pos != head) {
-            node = member_of(pos, camera_q_node, list);
-            pos = pos->next;
-            if ( match(node->data, m_userData, match_data) ) {
-                cam_list_del_node(&node->list);
-                m_size--;
-
-                if (NULL != node->data) {
-                    if (m_dataFn) {
-                        m_dataFn(node->data, m_userData);
-                    }
-                    free(node->data);
-                }
-                free(node);
-            }
-        }
-    }
-    pthread_mutex_unlock(&m_lock);
+/*===========================================================================
+ * FUNCTION   : flushNodesByKey
+ *
+ * DESCRIPTION: flush all nodes with the given key without walking the
+ *              whole queue. Queue must have been constructed with a key
+ *              function.
+ *
+ * PARAMETERS :
+ *   @key     : lookup key
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::flushNodesByKey(uint32_t key){
+    m_queue.flushNodesByKey(key);
 }
 
 }; // namespace qcamera
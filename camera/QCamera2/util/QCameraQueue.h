@@ -30,19 +30,23 @@
 #ifndef __QCAMERA_QUEUE_H__
 #define __QCAMERA_QUEUE_H__
 
-#include <pthread.h>
-#include "cam_list.h"
+#include "QCameraQueueT.h"
 
 namespace qcamera {
 
 typedef bool (*match_fn_data)(void *data, void *user_data, void *match_data);
 typedef void (*release_data_fn)(void* data, void *user_data);
 typedef bool (*match_fn)(void *data, void *user_data);
+typedef uint32_t (*key_data_fn)(void *data, void *user_data);
 
+/* Legacy void* queue interface on top of QCameraQueueT. Flushed entries are
+ * passed to the release function and then freed. */
 class QCameraQueue {
 public:
     QCameraQueue();
     QCameraQueue(release_data_fn data_rel_fn, void *user_data);
+    QCameraQueue(release_data_fn data_rel_fn, void *user_data,
+            key_data_fn key_fn);
     virtual ~QCameraQueue();
     void init();
     bool enqueue(void *data);
@@ -52,22 +56,26 @@ public:
     void flush();
     void flushNodes(match_fn match);
     void flushNodes(match_fn_data match, void *spec_data);
+    void flushNodesByKey(uint32_t key);
     void* dequeue(bool bFromHead = true);
+    void* dequeueByKey(uint32_t key);
+    bool updateKey(void *data);
+    int dequeueAll(void **items, int max_items);
     void* peek();
     bool isEmpty();
-    int getCurrentSize() {return m_size;}
+    int getCurrentSize() {return (int)m_queue.getCurrentSize();}
 private:
-    typedef struct {
-        struct cam_list list;
-        void* data;
-    } camera_q_node;
+    static void releaseNode(void *&data, void *user_data);
+    static bool matchNode(void * const &data, void *user_data,
+            void *match_data);
+    static bool matchNodeData(void * const &data, void *user_data,
+            void *match_data);
+    static uint32_t nodeKey(void * const &data, void *user_data);
 
-    camera_q_node m_head; // dummy head
-    int m_size;
-    bool m_active;
-    pthread_mutex_t m_lock;
     release_data_fn m_dataFn;
+    key_data_fn m_keyFn;
     void * m_userData;
+    QCameraQueueT<void *> m_queue;
 };
 
 }; // namespace qcamera
@@ -0,0 +1,669 @@
+/* Copyright (c) 2012, The Linux Foundataion. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_QUEUE_T_H__
+#define __QCAMERA_QUEUE_T_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Log.h>
+#include "cam_list.h"
+
+namespace qcamera {
+
+// number of nodes allocated at once when the node pool runs dry
+#define QCAMERA_QUEUE_SLAB_NODES   32
+// number of hash buckets used by the keyed index (power of 2)
+#define QCAMERA_QUEUE_KEY_BUCKETS  64
+
+/* Mutex protected FIFO of T. Nodes are carved out of slabs that are kept
+ * on a free list for the lifetime of the queue, so steady state enqueue and
+ * dequeue never touch the heap. A non-zero capacity bounds the queue and
+ * preallocates all of its nodes; enqueue() then fails when the queue is full
+ * and enqueueWait() blocks until a consumer makes room. When a key function
+ * is given, nodes are additionally hashed by key so that dequeueByKey() and
+ * flushNodesByKey() do not need to walk the whole queue. */
+template <typename T>
+class QCameraQueueT {
+public:
+    typedef void (*release_fn)(T &data, void *user_data);
+    typedef bool (*match_fn)(const T &data, void *user_data, void *match_data);
+    typedef uint32_t (*key_fn)(const T &data, void *user_data);
+
+    QCameraQueueT(release_fn rel_fn = NULL, void *user_data = NULL,
+            uint32_t capacity = 0, key_fn key = NULL);
+    virtual ~QCameraQueueT();
+    void init();
+    bool enqueue(const T &data);
+    bool enqueueWithPriority(const T &data);
+    bool enqueueWait(const T &data);
+    /* This call will put queue into uninitialized state.
+     * Need to call init() in order to use the queue again */
+    void flush();
+    uint32_t flushNodes(match_fn match, void *match_data);
+    uint32_t flushNodesByKey(uint32_t key);
+    bool dequeue(T &data, bool bFromHead = true);
+    uint32_t dequeueAll(T *items, uint32_t max_items);
+    bool dequeueByKey(uint32_t key, T &data);
+    bool updateKey(const T &data);
+    bool peek(T &data);
+    bool isEmpty();
+    uint32_t getCurrentSize() {return m_size;}
+    uint32_t getCapacity() {return m_capacity;}
+
+private:
+    typedef struct {
+        struct cam_list list;    // queue order, or free list when unused
+        struct cam_list keyList; // hash bucket chain, only with key fn
+        uint32_t key;
+        T data;
+    } queue_node_t;
+
+    typedef struct queue_slab {
+        struct queue_slab *next;
+        queue_node_t nodes[QCAMERA_QUEUE_SLAB_NODES];
+    } queue_slab_t;
+
+    bool growPoolLocked();
+    queue_node_t *allocNodeLocked(const T &data);
+    void releaseNodeLocked(queue_node_t *node, bool bReleaseData);
+    bool enqueueLocked(const T &data, bool bPriority);
+    struct cam_list *bucketOf(uint32_t key)
+        {return &m_buckets[key & (QCAMERA_QUEUE_KEY_BUCKETS - 1)];}
+
+    struct cam_list m_head;     // dummy head of the queue
+    struct cam_list m_freeList; // unused nodes
+    struct cam_list m_buckets[QCAMERA_QUEUE_KEY_BUCKETS];
+    queue_slab_t *m_slabs;
+    uint32_t m_size;
+    uint32_t m_capacity;
+    bool m_active;
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_notFull;
+    release_fn m_dataFn;
+    key_fn m_keyFn;
+    void *m_userData;
+};
+
+/*===========================================================================
+ * FUNCTION   : QCameraQueueT
+ *
+ * DESCRIPTION: constructor of QCameraQueueT
+ *
+ * PARAMETERS :
+ *   @rel_fn    : function ptr to release node data internal resource
+ *   @user_data : user data ptr
+ *   @capacity  : max number of queued entries, 0 for unbounded
+ *   @key       : function ptr returning the lookup key of an entry,
+ *                NULL if keyed removal is not needed
+ *
+ * RETURN     : None
+ *==========================================================================*/
+template <typename T>
+QCameraQueueT<T>::QCameraQueueT(release_fn rel_fn, void *user_data,
+        uint32_t capacity, key_fn key)
+    : m_slabs(NULL),
+      m_size(0),
+      m_capacity(capacity),
+      m_active(true),
+      m_dataFn(rel_fn),
+      m_keyFn(key),
+      m_userData(user_data)
+{
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_notFull, NULL);
+    cam_list_init(&m_head);
+    cam_list_init(&m_freeList);
+    for (uint32_t i = 0; i < QCAMERA_QUEUE_KEY_BUCKETS; i++) {
+        cam_list_init(&m_buckets[i]);
+    }
+
+    // bounded queues never allocate after construction
+    pthread_mutex_lock(&m_lock);
+    for (uint32_t i = 0; i < m_capacity; i += QCAMERA_QUEUE_SLAB_NODES) {
+        if (!growPoolLocked()) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraQueueT
+ *
+ * DESCRIPTION: deconstructor of QCameraQueueT
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+template <typename T>
+QCameraQueueT<T>::~QCameraQueueT()
+{
+    flush();
+    while (NULL != m_slabs) {
+        queue_slab_t *slab = m_slabs;
+        m_slabs = slab->next;
+        delete slab;
+    }
+    pthread_cond_destroy(&m_notFull);
+    pthread_mutex_destroy(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : init
+ *
+ * DESCRIPTION: Put the queue to active state (ready to enqueue and dequeue)
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+template <typename T>
+void QCameraQueueT<T>::init()
+{
+    pthread_mutex_lock(&m_lock);
+    m_active = true;
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : isEmpty
+ *
+ * DESCRIPTION: return if the queue is empty or not
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true -- queue is empty; false -- not empty
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::isEmpty()
+{
+    bool flag;
+    pthread_mutex_lock(&m_lock);
+    flag = (0 == m_size);
+    pthread_mutex_unlock(&m_lock);
+    return flag;
+}
+
+/*===========================================================================
+ * FUNCTION   : growPoolLocked
+ *
+ * DESCRIPTION: add one slab of nodes to the free list. Must be called with
+ *              m_lock held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true -- success; false -- no memory
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::growPoolLocked()
+{
+    queue_slab_t *slab = new queue_slab_t;
+    if (NULL == slab) {
+        ALOGE("%s: No memory for queue slab", __func__);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < QCAMERA_QUEUE_SLAB_NODES; i++) {
+        cam_list_init(&slab->nodes[i].keyList);
+        cam_list_add_tail_node(&slab->nodes[i].list, &m_freeList);
+    }
+    slab->next = m_slabs;
+    m_slabs = slab;
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : allocNodeLocked
+ *
+ * DESCRIPTION: take a node from the free list and fill it. Must be called
+ *              with m_lock held.
+ *
+ * PARAMETERS :
+ *   @data    : data to be stored in the node
+ *
+ * RETURN     : node ptr. NULL if the queue is full or out of memory.
+ *==========================================================================*/
+template <typename T>
+typename QCameraQueueT<T>::queue_node_t *
+QCameraQueueT<T>::allocNodeLocked(const T &data)
+{
+    if ((m_capacity > 0) && (m_size >= m_capacity)) {
+        return NULL;
+    }
+
+    if ((m_freeList.next == &m_freeList) && !growPoolLocked()) {
+        return NULL;
+    }
+
+    queue_node_t *node = member_of(m_freeList.next, queue_node_t, list);
+    cam_list_del_node(&node->list);
+    node->data = data;
+    if (NULL != m_keyFn) {
+        node->key = m_keyFn(data, m_userData);
+        cam_list_add_tail_node(&node->keyList, bucketOf(node->key));
+    }
+    return node;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseNodeLocked
+ *
+ * DESCRIPTION: unlink a queued node and return it to the free list. Must be
+ *              called with m_lock held.
+ *
+ * PARAMETERS :
+ *   @node         : node to be released
+ *   @bReleaseData : if true, the release function is called on node data
+ *
+ * RETURN     : None
+ *==========================================================================*/
+template <typename T>
+void QCameraQueueT<T>::releaseNodeLocked(queue_node_t *node, bool bReleaseData)
+{
+    cam_list_del_node(&node->list);
+    cam_list_del_node(&node->keyList);
+    m_size--;
+
+    if (bReleaseData && (NULL != m_dataFn)) {
+        m_dataFn(node->data, m_userData);
+    }
+    cam_list_add_tail_node(&node->list, &m_freeList);
+
+    if (m_capacity > 0) {
+        pthread_cond_signal(&m_notFull);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : enqueueLocked
+ *
+ * DESCRIPTION: link data into the queue. Must be called with m_lock held.
+ *
+ * PARAMETERS :
+ *   @data      : data to be enqueued
+ *   @bPriority : if true, insert at the head of the queue
+ *
+ * RETURN     : true -- success; false -- failed
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::enqueueLocked(const T &data, bool bPriority)
+{
+    if (!m_active) {
+        return false;
+    }
+
+    queue_node_t *node = allocNodeLocked(data);
+    if (NULL == node) {
+        return false;
+    }
+
+    if (bPriority) {
+        cam_list_insert_before_node(&node->list, m_head.next);
+    } else {
+        cam_list_add_tail_node(&node->list, &m_head);
+    }
+    m_size++;
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : enqueue
+ *
+ * DESCRIPTION: enqueue data into the queue. Fails without blocking if a
+ *              bounded queue is full.
+ *
+ * PARAMETERS :
+ *   @data    : data to be enqueued
+ *
+ * RETURN     : true -- success; false -- failed
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::enqueue(const T &data)
+{
+    bool rc;
+    pthread_mutex_lock(&m_lock);
+    rc = enqueueLocked(data, false);
+    pthread_mutex_unlock(&m_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : enqueueWithPriority
+ *
+ * DESCRIPTION: enqueue data into queue with priority, will insert into the
+ *              head of the queue
+ *
+ * PARAMETERS :
+ *   @data    : data to be enqueued
+ *
+ * RETURN     : true -- success; false -- failed
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::enqueueWithPriority(const T &data)
+{
+    bool rc;
+    pthread_mutex_lock(&m_lock);
+    rc = enqueueLocked(data, true);
+    pthread_mutex_unlock(&m_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : enqueueWait
+ *
+ * DESCRIPTION: enqueue data into a bounded queue, blocking while the queue
+ *              is full. Behaves like enqueue() on unbounded queues.
+ *
+ * PARAMETERS :
+ *   @data    : data to be enqueued
+ *
+ * RETURN     : true -- success; false -- queue flushed or out of memory
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::enqueueWait(const T &data)
+{
+    bool rc;
+    pthread_mutex_lock(&m_lock);
+    while (m_active && (m_capacity > 0) && (m_size >= m_capacity)) {
+        pthread_cond_wait(&m_notFull, &m_lock);
+    }
+    rc = enqueueLocked(data, false);
+    pthread_mutex_unlock(&m_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : peek
+ *
+ * DESCRIPTION: return the head element without removing it
+ *
+ * PARAMETERS :
+ *   @data    : filled with the head element
+ *
+ * RETURN     : true -- data valid; false -- queue empty or inactive
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::peek(T &data)
+{
+    bool rc = false;
+    pthread_mutex_lock(&m_lock);
+    if (m_active && (m_head.next != &m_head)) {
+        data = member_of(m_head.next, queue_node_t, list)->data;
+        rc = true;
+    }
+    pthread_mutex_unlock(&m_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : dequeue
+ *
+ * DESCRIPTION: dequeue data from the queue
+ *
+ * PARAMETERS :
+ *   @data      : filled with the dequeued element
+ *   @bFromHead : if true, dequeue from the head
+ *                if false, dequeue from the tail
+ *
+ * RETURN     : true -- data valid; false -- queue empty or inactive
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::dequeue(T &data, bool bFromHead)
+{
+    bool rc = false;
+    pthread_mutex_lock(&m_lock);
+    if (m_active) {
+        struct cam_list *pos = bFromHead ? m_head.next : m_head.prev;
+        if (pos != &m_head) {
+            queue_node_t *node = member_of(pos, queue_node_t, list);
+            data = node->data;
+            releaseNodeLocked(node, false);
+            rc = true;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : dequeueAll
+ *
+ * DESCRIPTION: dequeue up to max_items elements from the head of the queue
+ *              under a single lock acquisition
+ *
+ * PARAMETERS :
+ *   @items     : array to be filled with dequeued elements
+ *   @max_items : size of items array
+ *
+ * RETURN     : number of elements dequeued
+ *==========================================================================*/
+template <typename T>
+uint32_t QCameraQueueT<T>::dequeueAll(T *items, uint32_t max_items)
+{
+    uint32_t count = 0;
+
+    if (NULL == items) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (m_active) {
+        while ((count < max_items) && (m_head.next != &m_head)) {
+            queue_node_t *node = member_of(m_head.next, queue_node_t, list);
+            items[count++] = node->data;
+            releaseNodeLocked(node, false);
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return count;
+}
+
+/*===========================================================================
+ * FUNCTION   : dequeueByKey
+ *
+ * DESCRIPTION: dequeue the oldest element with the given key. Only valid on
+ *              queues constructed with a key function.
+ *
+ * PARAMETERS :
+ *   @key     : lookup key
+ *   @data    : filled with the dequeued element
+ *
+ * RETURN     : true -- data valid; false -- no match
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::dequeueByKey(uint32_t key, T &data)
+{
+    bool rc = false;
+
+    if (NULL == m_keyFn) {
+        ALOGE("%s: Queue has no key function", __func__);
+        return false;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (m_active) {
+        struct cam_list *bucket = bucketOf(key);
+        for (struct cam_list *pos = bucket->next; pos != bucket;
+                pos = pos->next) {
+            queue_node_t *node = member_of(pos, queue_node_t, keyList);
+            if (node->key == key) {
+                data = node->data;
+                releaseNodeLocked(node, false);
+                rc = true;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : updateKey
+ *
+ * DESCRIPTION: re-hash a queued element whose key changed after it was
+ *              enqueued. The queue is searched from the tail since the
+ *              element is usually the one most recently added.
+ *
+ * PARAMETERS :
+ *   @data    : queued element
+ *
+ * RETURN     : true -- key updated; false -- element not found
+ *==========================================================================*/
+template <typename T>
+bool QCameraQueueT<T>::updateKey(const T &data)
+{
+    bool rc = false;
+
+    if (NULL == m_keyFn) {
+        ALOGE("%s: Queue has no key function", __func__);
+        return false;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    for (struct cam_list *pos = m_head.prev; pos != &m_head; pos = pos->prev) {
+        queue_node_t *node = member_of(pos, queue_node_t, list);
+        if (node->data == data) {
+            cam_list_del_node(&node->keyList);
+            node->key = m_keyFn(data, m_userData);
+            cam_list_add_tail_node(&node->keyList, bucketOf(node->key));
+            rc = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : flush
+ *
+ * DESCRIPTION: flush all nodes from the queue, queue will be empty after this
+ *              operation.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+template <typename T>
+void QCameraQueueT<T>::flush()
+{
+    pthread_mutex_lock(&m_lock);
+    if (m_active) {
+        while (m_head.next != &m_head) {
+            releaseNodeLocked(member_of(m_head.next, queue_node_t, list), true);
+        }
+        m_active = false;
+        // wake up producers blocked in enqueueWait
+        pthread_cond_broadcast(&m_notFull);
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : flushNodes
+ *
+ * DESCRIPTION: flush only specific nodes, depending on
+ *              the given matching function.
+ *
+ * PARAMETERS :
+ *   @match      : matching function
+ *   @match_data : data passed to the matching function
+ *
+ * RETURN     : number of nodes flushed
+ *==========================================================================*/
+template <typename T>
+uint32_t QCameraQueueT<T>::flushNodes(match_fn match, void *match_data)
+{
+    uint32_t count = 0;
+
+    if (NULL == match) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (m_active) {
+        struct cam_list *pos = m_head.next;
+        while (pos != &m_head) {
+            queue_node_t *node = member_of(pos, queue_node_t, list);
+            pos = pos->next;
+            if (match(node->data, m_userData, match_data)) {
+                releaseNodeLocked(node, true);
+                count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return count;
+}
+
+/*===========================================================================
+ * FUNCTION   : flushNodesByKey
+ *
+ * DESCRIPTION: flush all nodes with the given key, walking only the hash
+ *              bucket of the key. Only valid on queues constructed with a
+ *              key function.
+ *
+ * PARAMETERS :
+ *   @key     : lookup key
+ *
+ * RETURN     : number of nodes flushed
+ *==========================================================================*/
+template <typename T>
+uint32_t QCameraQueueT<T>::flushNodesByKey(uint32_t key)
+{
+    uint32_t count = 0;
+
+    if (NULL == m_keyFn) {
+        ALOGE("%s: Queue has no key function", __func__);
+        return 0;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (m_active) {
+        struct cam_list *bucket = bucketOf(key);
+        struct cam_list *pos = bucket->next;
+        while (pos != bucket) {
+            queue_node_t *node = member_of(pos, queue_node_t, keyList);
+            pos = pos->next;
+            if (node->key == key) {
+                releaseNodeLocked(node, true);
+                count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return count;
+}
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_QUEUE_T_H__ */
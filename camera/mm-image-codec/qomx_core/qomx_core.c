@@ -43,7 +43,8 @@ static const comp_info_t g_comp_info[] =
 {
   { "OMX.qcom.image.jpeg.encoder", "libqomx_jpegenc.so" },
   { "OMX.qcom.image.jpeg.decoder", "libqomx_jpegdec.so" },
-  { "OMX.qcom.image.jpeg.encoder_pipeline", "libqomx_jpegenc_pipe.so" }
+  { "OMX.qcom.image.jpeg.encoder_pipeline", "libqomx_jpegenc_pipe.so" },
+  { "OMX.qcom.image.jpeg.encoder_sw", "libqomx_jpegenc_sw.so" }
 };
 
 static int get_idx_from_handle(OMX_IN OMX_HANDLETYPE *ahComp, int *acompIndex,
@@ -0,0 +1,32 @@
+OMX_JPEGENC_SW_PATH := $(call my-dir)
+
+# ------------------------------------------------------------------------------
+#                Make the shared library (libqomx_jpegenc_sw)
+# ------------------------------------------------------------------------------
+
+include $(CLEAR_VARS)
+LOCAL_PATH := $(OMX_JPEGENC_SW_PATH)
+LOCAL_MODULE_TAGS := optional
+
+omx_jpegenc_sw_defines:= -Wall -Wextra -Werror \
+                         -Wno-unused-parameter \
+                         -O3
+
+LOCAL_CFLAGS := $(omx_jpegenc_sw_defines)
+
+OMX_HEADER_DIR := frameworks/native/include/media/openmax
+
+LOCAL_C_INCLUDES := $(OMX_HEADER_DIR)
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../qexif
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../qomx_core
+
+LOCAL_SRC_FILES := qomx_jpegenc_sw.c \
+                   qomx_jpegenc_sw_codec.c \
+                   qomx_jpegenc_sw_exif.c
+
+LOCAL_MODULE           := libqomx_jpegenc_sw
+LOCAL_PRELINK_MODULE   := false
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+
+LOCAL_32_BIT_ONLY := true
+include $(BUILD_SHARED_LIBRARY)
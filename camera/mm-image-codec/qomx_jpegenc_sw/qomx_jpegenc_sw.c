@@ -0,0 +1,1154 @@
+/*Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#define LOG_TAG "qomx_jpegenc_sw"
+#include <unistd.h>
+#include <utils/Log.h>
+
+#include "qomx_jpegenc_sw.h"
+
+#define SWENC_COMP_NAME "OMX.qcom.image.jpeg.encoder_sw"
+
+/** swenc_ext_index_t: supported extension indexes
+*    @name: extension name
+*    @index: index returned to the client
+**/
+typedef struct {
+  const char *name;
+  QOMX_IMAGE_EXT_INDEXTYPE index;
+} swenc_ext_index_t;
+
+static const swenc_ext_index_t g_ext_index[] = {
+  { QOMX_IMAGE_EXT_EXIF_NAME, QOMX_IMAGE_EXT_EXIF },
+  { QOMX_IMAGE_EXT_THUMBNAIL_NAME, QOMX_IMAGE_EXT_THUMBNAIL },
+  { QOMX_IMAGE_EXT_BUFFER_OFFSET_NAME, QOMX_IMAGE_EXT_BUFFER_OFFSET },
+  { QOMX_IMAGE_EXT_MOBICAT_NAME, QOMX_IMAGE_EXT_MOBICAT },
+  { QOMX_IMAGE_EXT_ENCODING_MODE_NAME, QOMX_IMAGE_EXT_ENCODING_MODE },
+  { QOMX_IMAGE_EXT_WORK_BUFFER_NAME, QOMX_IMAGE_EXT_WORK_BUFFER },
+  { QOMX_IMAGE_EXT_METADATA_NAME, QOMX_IMAGE_EXT_METADATA },
+  { QOMX_IMAGE_EXT_META_ENC_KEY_NAME, QOMX_IMAGE_EXT_META_ENC_KEY },
+  { QOMX_IMAGE_EXT_MEM_OPS_NAME, QOMX_IMAGE_EXT_MEM_OPS },
+  { QOMX_IMAGE_EXT_JPEG_SPEED_NAME, QOMX_IMAGE_EXT_JPEG_SPEED },
+};
+
+static qomx_jpegenc_sw_t *swenc_get_comp(OMX_HANDLETYPE hComp)
+{
+  if (NULL == hComp) {
+    return NULL;
+  }
+  return (qomx_jpegenc_sw_t *)((OMX_COMPONENTTYPE *)hComp)->pComponentPrivate;
+}
+
+/*==============================================================================
+* Function : swenc_post_msg
+* Parameters: p_comp, type, param, p_buf
+* Return Value : OMX_ERRORTYPE
+* Description: Queue a message to the component thread
+==============================================================================*/
+static OMX_ERRORTYPE swenc_post_msg(qomx_jpegenc_sw_t *p_comp,
+  qomx_swenc_msg_type_t type, OMX_U32 param, OMX_BUFFERHEADERTYPE *p_buf)
+{
+  qomx_swenc_msg_t *p_msg;
+
+  pthread_mutex_lock(&p_comp->lock);
+  if (p_comp->msg_count >= QOMX_SWENC_MSG_Q_SIZE) {
+    pthread_mutex_unlock(&p_comp->lock);
+    ALOGE("%s:%d] message queue full", __func__, __LINE__);
+    return OMX_ErrorInsufficientResources;
+  }
+  p_msg = &p_comp->msg_q[(p_comp->msg_head + p_comp->msg_count) %
+    QOMX_SWENC_MSG_Q_SIZE];
+  p_msg->type = type;
+  p_msg->param = param;
+  p_msg->p_buf = p_buf;
+  p_comp->msg_count++;
+  pthread_cond_signal(&p_comp->cond);
+  pthread_mutex_unlock(&p_comp->lock);
+  return OMX_ErrorNone;
+}
+
+static void swenc_event(qomx_jpegenc_sw_t *p_comp, OMX_EVENTTYPE event,
+  OMX_U32 data1, OMX_U32 data2)
+{
+  if (p_comp->callbacks.EventHandler) {
+    p_comp->callbacks.EventHandler(&p_comp->omx_comp, p_comp->app_data,
+      event, data1, data2, NULL);
+  }
+}
+
+/*==============================================================================
+* Function : swenc_ports_populated
+* Parameters: p_comp
+* Return Value : 1 if every enabled port has all its buffers
+* Description: Called with the component lock held
+==============================================================================*/
+static int swenc_ports_populated(qomx_jpegenc_sw_t *p_comp)
+{
+  uint32_t i;
+
+  for (i = 0; i < QOMX_SWENC_NUM_PORTS; i++) {
+    if (p_comp->ports[i].bEnabled &&
+      (p_comp->num_bufs[i] < p_comp->ports[i].nBufferCountActual)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int swenc_ports_empty(qomx_jpegenc_sw_t *p_comp)
+{
+  uint32_t i;
+
+  for (i = 0; i < QOMX_SWENC_NUM_PORTS; i++) {
+    if (p_comp->num_bufs[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*==============================================================================
+* Function : swenc_check_state
+* Parameters: p_comp
+* Return Value : None
+* Description: Complete a pending Loaded <-> Idle transition once the
+* buffers are allocated or freed
+==============================================================================*/
+static void swenc_check_state(qomx_jpegenc_sw_t *p_comp)
+{
+  OMX_STATETYPE done = OMX_StateInvalid;
+
+  pthread_mutex_lock(&p_comp->lock);
+  if ((OMX_StateLoaded == p_comp->state) &&
+    (OMX_StateIdle == p_comp->target_state) && swenc_ports_populated(p_comp)) {
+    done = p_comp->state = OMX_StateIdle;
+  } else if ((OMX_StateIdle == p_comp->state) &&
+    (OMX_StateLoaded == p_comp->target_state) && swenc_ports_empty(p_comp)) {
+    done = p_comp->state = OMX_StateLoaded;
+  }
+  pthread_mutex_unlock(&p_comp->lock);
+
+  if (OMX_StateInvalid != done) {
+    ALOGD("%s:%d] state %d", __func__, __LINE__, done);
+    swenc_event(p_comp, OMX_EventCmdComplete, OMX_CommandStateSet, done);
+  }
+}
+
+/*==============================================================================
+* Function : swenc_set_state
+* Parameters: p_comp, new_state
+* Return Value : None
+* Description: Handle a state change command in the component thread
+==============================================================================*/
+static void swenc_set_state(qomx_jpegenc_sw_t *p_comp, OMX_STATETYPE new_state)
+{
+  OMX_STATETYPE cur;
+  OMX_ERRORTYPE err = OMX_ErrorNone;
+  int complete = 0;
+
+  pthread_mutex_lock(&p_comp->lock);
+  cur = p_comp->state;
+  if (cur == new_state) {
+    err = OMX_ErrorSameState;
+  } else if ((OMX_StateLoaded == cur) && (OMX_StateIdle == new_state)) {
+    p_comp->target_state = new_state;
+  } else if ((OMX_StateIdle == cur) && (OMX_StateLoaded == new_state)) {
+    p_comp->target_state = new_state;
+  } else if ((OMX_StateIdle == cur) && (OMX_StateExecuting == new_state)) {
+    p_comp->abort = 0;
+    p_comp->state = p_comp->target_state = new_state;
+    complete = 1;
+  } else if ((OMX_StateExecuting == cur) && (OMX_StateIdle == new_state)) {
+    /* buffers of an unfinished job are dropped with the job, the
+     * thumbnail thread must be done with its input first */
+    while ((QOMX_SWENC_THUMB_QUEUED == p_comp->thumb_state) ||
+      (QOMX_SWENC_THUMB_BUSY == p_comp->thumb_state)) {
+      pthread_cond_wait(&p_comp->thumb_cond, &p_comp->lock);
+    }
+    p_comp->thumb_state = QOMX_SWENC_THUMB_IDLE;
+    p_comp->p_main_in = NULL;
+    p_comp->p_thumb_in = NULL;
+    p_comp->p_out = NULL;
+    p_comp->state = p_comp->target_state = new_state;
+    complete = 1;
+  } else {
+    err = OMX_ErrorIncorrectStateTransition;
+  }
+  pthread_mutex_unlock(&p_comp->lock);
+
+  if (OMX_ErrorNone != err) {
+    ALOGE("%s:%d] cannot move from %d to %d", __func__, __LINE__, cur,
+      new_state);
+    swenc_event(p_comp, OMX_EventError, err, err);
+  } else if (complete) {
+    ALOGD("%s:%d] state %d", __func__, __LINE__, new_state);
+    swenc_event(p_comp, OMX_EventCmdComplete, OMX_CommandStateSet, new_state);
+  } else {
+    swenc_check_state(p_comp);
+  }
+}
+
+/*==============================================================================
+* Function : swenc_fill_image
+* Parameters: p_img, p_port, p_base, p_offset, crop, out_w, out_h
+* Return Value : 0 on success, -1 for an unsupported format
+* Description: Describe an input buffer for the encoder
+==============================================================================*/
+static int swenc_fill_image(qomx_swenc_image_t *p_img,
+  const OMX_PARAM_PORTDEFINITIONTYPE *p_port, const uint8_t *p_base,
+  const QOMX_YUV_FRAME_INFO *p_offset, const OMX_CONFIG_RECTTYPE *p_crop,
+  OMX_U32 out_w, OMX_U32 out_h)
+{
+  const OMX_IMAGE_PORTDEFINITIONTYPE *p_fmt = &p_port->format.image;
+  uint32_t width = p_fmt->nFrameWidth;
+  uint32_t height = p_fmt->nFrameHeight;
+  uint32_t slice;
+  uint32_t cbcr_start;
+
+  p_img->stride = p_fmt->nStride ? (uint32_t)p_fmt->nStride : width;
+  slice = p_fmt->nSliceHeight ? p_fmt->nSliceHeight : height;
+  p_img->cr_first = 0;
+
+  switch ((int)p_fmt->eColorFormat) {
+  case OMX_QCOM_IMG_COLOR_FormatYVU420SemiPlanar:
+    p_img->cr_first = 1;
+    /* fall through */
+  case OMX_COLOR_FormatYUV420SemiPlanar:
+    p_img->h_shift = 1;
+    p_img->v_shift = 1;
+    break;
+  case OMX_QCOM_IMG_COLOR_FormatYVU422SemiPlanar:
+    p_img->cr_first = 1;
+    /* fall through */
+  case OMX_COLOR_FormatYUV422SemiPlanar:
+    p_img->h_shift = 1;
+    p_img->v_shift = 0;
+    break;
+  case OMX_QCOM_IMG_COLOR_FormatYVU422SemiPlanar_h1v2:
+    p_img->cr_first = 1;
+    /* fall through */
+  case OMX_QCOM_IMG_COLOR_FormatYUV422SemiPlanar_h1v2:
+    p_img->h_shift = 0;
+    p_img->v_shift = 1;
+    break;
+  case OMX_QCOM_IMG_COLOR_FormatYVU444SemiPlanar:
+    p_img->cr_first = 1;
+    /* fall through */
+  case OMX_QCOM_IMG_COLOR_FormatYUV444SemiPlanar:
+    p_img->h_shift = 0;
+    p_img->v_shift = 0;
+    break;
+  case OMX_COLOR_FormatMonochrome:
+    p_img->h_shift = 0;
+    p_img->v_shift = 0;
+    break;
+  default:
+    ALOGE("%s:%d] unsupported format %d", __func__, __LINE__,
+      p_fmt->eColorFormat);
+    return -1;
+  }
+
+  p_img->y = p_base + p_offset->yOffset;
+  if (OMX_COLOR_FormatMonochrome == p_fmt->eColorFormat) {
+    p_img->cbcr = NULL;
+    p_img->cbcr_stride = 0;
+  } else {
+    cbcr_start = p_offset->cbcrStartOffset[0] ?
+      p_offset->cbcrStartOffset[0] : (p_img->stride * slice);
+    p_img->cbcr = p_base + cbcr_start + p_offset->cbcrOffset[0];
+    p_img->cbcr_stride = (p_img->stride >> p_img->h_shift) * 2;
+  }
+
+  p_img->crop_x = 0;
+  p_img->crop_y = 0;
+  p_img->crop_w = width;
+  p_img->crop_h = height;
+  if (p_crop->nWidth && p_crop->nHeight && (p_crop->nLeft >= 0) &&
+    (p_crop->nTop >= 0) && ((uint32_t)p_crop->nLeft < width) &&
+    ((uint32_t)p_crop->nTop < height)) {
+    p_img->crop_x = (uint32_t)p_crop->nLeft;
+    p_img->crop_y = (uint32_t)p_crop->nTop;
+    p_img->crop_w = p_crop->nWidth;
+    p_img->crop_h = p_crop->nHeight;
+    /* the client rounds the crop up to even sizes */
+    if (p_img->crop_x + p_img->crop_w > width) {
+      p_img->crop_w = width - p_img->crop_x;
+    }
+    if (p_img->crop_y + p_img->crop_h > height) {
+      p_img->crop_h = height - p_img->crop_y;
+    }
+  }
+  p_img->scaled_w = (out_w && out_h) ? out_w : p_img->crop_w;
+  p_img->scaled_h = (out_w && out_h) ? out_h : p_img->crop_h;
+  p_img->qtable[0] = NULL;
+  p_img->qtable[1] = NULL;
+  return 0;
+}
+
+/*==============================================================================
+* Function : swenc_deliver
+* Parameters: p_comp, p_out, p_cfg
+* Return Value : OMX_ERRORTYPE
+* Description: Write the bitstream of the coded main image to the client
+* output buffer. The headers are in p_comp->stream, the coded slices are
+* written straight from the encoder so the image is copied only once.
+==============================================================================*/
+static OMX_ERRORTYPE swenc_deliver(qomx_jpegenc_sw_t *p_comp,
+  OMX_BUFFERHEADERTYPE *p_out, const qomx_swenc_config_t *p_cfg)
+{
+  omx_jpeg_ouput_buf_t *p_jpeg_out;
+  size_t hdr_len = p_comp->stream.len;
+  size_t len = hdr_len + qomx_swenc_codec_scan_size(&p_comp->codec);
+  uint8_t *p_dst;
+
+  if (NULL != p_cfg->mem_ops.get_memory) {
+    /* the output buffer only describes the memory to be allocated */
+    p_jpeg_out = (omx_jpeg_ouput_buf_t *)p_out->pBuffer;
+    p_jpeg_out->size = len;
+    p_jpeg_out->fd = -1;
+    p_jpeg_out->vaddr = NULL;
+    if (p_cfg->mem_ops.get_memory(p_jpeg_out) || !p_jpeg_out->vaddr) {
+      ALOGE("%s:%d] cannot get %zu bytes of output", __func__, __LINE__, len);
+      return OMX_ErrorInsufficientResources;
+    }
+    p_dst = (uint8_t *)p_jpeg_out->vaddr;
+  } else {
+    if (len > p_out->nAllocLen) {
+      ALOGE("%s:%d] output of %zu bytes does not fit in %d", __func__,
+        __LINE__, len, p_out->nAllocLen);
+      return OMX_ErrorOverflow;
+    }
+    p_dst = p_out->pBuffer;
+  }
+  memcpy(p_dst, p_comp->stream.data, hdr_len);
+  qomx_swenc_codec_write_scan(&p_comp->codec, p_dst + hdr_len);
+  p_out->nFilledLen = (OMX_U32)len;
+  p_out->nOffset = 0;
+  return OMX_ErrorNone;
+}
+
+/*==============================================================================
+* Function : swenc_thumb_thread
+* Parameters: data - component
+* Return Value : NULL
+* Description: Thumbnail thread. The thumbnail is encoded as soon as its
+* input arrives, while the component thread codes the main image.
+==============================================================================*/
+static void *swenc_thumb_thread(void *data)
+{
+  qomx_jpegenc_sw_t *p_comp = (qomx_jpegenc_sw_t *)data;
+  OMX_BUFFERHEADERTYPE *p_buf;
+  QOMX_THUMBNAIL_INFO *p_info = &p_comp->thumb_info;
+  OMX_CONFIG_RECTTYPE crop;
+  qomx_swenc_image_t img;
+  int rc;
+
+  while (1) {
+    pthread_mutex_lock(&p_comp->lock);
+    while (!p_comp->thumb_exit &&
+      (QOMX_SWENC_THUMB_QUEUED != p_comp->thumb_state)) {
+      pthread_cond_wait(&p_comp->thumb_cond, &p_comp->lock);
+    }
+    if (p_comp->thumb_exit) {
+      pthread_mutex_unlock(&p_comp->lock);
+      break;
+    }
+    p_comp->thumb_state = QOMX_SWENC_THUMB_BUSY;
+    p_buf = p_comp->p_thumb_job;
+    pthread_mutex_unlock(&p_comp->lock);
+
+    /* thumb_info and thumb_port are not touched until the job is done */
+    p_comp->thumb_stream.len = 0;
+    crop = p_info->crop_info;
+    if (p_info->input_width && p_info->input_height) {
+      p_comp->thumb_port.format.image.nFrameWidth = p_info->input_width;
+      p_comp->thumb_port.format.image.nFrameHeight = p_info->input_height;
+    }
+    rc = swenc_fill_image(&img, &p_comp->thumb_port, p_buf->pBuffer,
+      &p_info->tmbOffset, &crop,
+      p_info->scaling_enabled ? p_info->output_width : 0,
+      p_info->scaling_enabled ? p_info->output_height : 0);
+    if (0 == rc) {
+      img.rotation = p_info->rotation % 360;
+      img.quality = p_info->quality ? p_info->quality :
+        QOMX_SWENC_DEFAULT_QUALITY;
+      rc = qomx_swenc_codec_encode(&p_comp->thumb_codec, &img, NULL,
+        &p_comp->thumb_stream, &p_comp->abort);
+    }
+
+    pthread_mutex_lock(&p_comp->lock);
+    p_comp->thumb_rc = rc;
+    p_comp->thumb_state = QOMX_SWENC_THUMB_DONE;
+    pthread_cond_broadcast(&p_comp->thumb_cond);
+    pthread_mutex_unlock(&p_comp->lock);
+  }
+  return NULL;
+}
+
+/*==============================================================================
+* Function : swenc_start_thumb
+* Parameters: p_comp
+* Return Value : None
+* Description: Hand the thumbnail of the queued job to the thumbnail thread.
+* Called with the component lock held.
+==============================================================================*/
+static void swenc_start_thumb(qomx_jpegenc_sw_t *p_comp)
+{
+  if ((OMX_StateExecuting != p_comp->state) || !p_comp->p_thumb_in ||
+    !p_comp->ports[QOMX_SWENC_TMB_PORT].bEnabled || !p_comp->cfg.thumb_set ||
+    (QOMX_SWENC_THUMB_IDLE != p_comp->thumb_state)) {
+    return;
+  }
+  p_comp->p_thumb_job = p_comp->p_thumb_in;
+  p_comp->thumb_info = p_comp->cfg.thumb;
+  p_comp->thumb_port = p_comp->ports[QOMX_SWENC_TMB_PORT];
+  p_comp->thumb_rc = 0;
+  p_comp->thumb_state = QOMX_SWENC_THUMB_QUEUED;
+  pthread_cond_broadcast(&p_comp->thumb_cond);
+}
+
+/*==============================================================================
+* Function : swenc_wait_thumb
+* Parameters: p_comp
+* Return Value : 1 if thumb_stream holds the thumbnail of the job, else 0
+* Description: Wait for the thumbnail thread to finish the job thumbnail
+==============================================================================*/
+static int swenc_wait_thumb(qomx_jpegenc_sw_t *p_comp)
+{
+  int valid = 0;
+
+  pthread_mutex_lock(&p_comp->lock);
+  while ((QOMX_SWENC_THUMB_QUEUED == p_comp->thumb_state) ||
+    (QOMX_SWENC_THUMB_BUSY == p_comp->thumb_state)) {
+    pthread_cond_wait(&p_comp->thumb_cond, &p_comp->lock);
+  }
+  if (QOMX_SWENC_THUMB_DONE == p_comp->thumb_state) {
+    if (p_comp->thumb_rc) {
+      /* the main image is still usable without a thumbnail */
+      ALOGE("%s:%d] thumbnail encode failed", __func__, __LINE__);
+    } else {
+      valid = 1;
+    }
+  }
+  p_comp->thumb_state = QOMX_SWENC_THUMB_IDLE;
+  pthread_mutex_unlock(&p_comp->lock);
+  return valid;
+}
+
+/*==============================================================================
+* Function : swenc_try_encode
+* Parameters: p_comp
+* Return Value : None
+* Description: Encode the queued job once its input and output buffers
+* are all available. The main image is coded while the thumbnail thread
+* encodes the thumbnail, the exif segment is built from both afterwards.
+==============================================================================*/
+static void swenc_try_encode(qomx_jpegenc_sw_t *p_comp)
+{
+  OMX_BUFFERHEADERTYPE *p_main_in, *p_thumb_in, *p_out;
+  OMX_PARAM_PORTDEFINITIONTYPE main_port;
+  qomx_swenc_config_t *p_cfg;
+  qomx_swenc_image_t img;
+  OMX_ERRORTYPE err = OMX_ErrorNone;
+  int thumb_added = 0;
+  int thumb_valid;
+  int rc;
+
+  pthread_mutex_lock(&p_comp->lock);
+  if ((OMX_StateExecuting != p_comp->state) || !p_comp->p_main_in ||
+    !p_comp->p_out ||
+    (p_comp->ports[QOMX_SWENC_TMB_PORT].bEnabled && !p_comp->p_thumb_in)) {
+    pthread_mutex_unlock(&p_comp->lock);
+    return;
+  }
+  p_main_in = p_comp->p_main_in;
+  p_thumb_in = p_comp->ports[QOMX_SWENC_TMB_PORT].bEnabled ?
+    p_comp->p_thumb_in : NULL;
+  p_out = p_comp->p_out;
+  p_comp->p_main_in = p_comp->p_thumb_in = p_comp->p_out = NULL;
+  main_port = p_comp->ports[QOMX_SWENC_IN_PORT];
+  /* the client configures the next job as soon as this one is done */
+  p_cfg = &p_comp->job_cfg;
+  *p_cfg = p_comp->cfg;
+  p_comp->cfg.num_exif = 0;
+  pthread_mutex_unlock(&p_comp->lock);
+
+  if (swenc_fill_image(&img, &main_port, p_main_in->pBuffer,
+    &p_cfg->main_offset, &p_cfg->in_crop, p_cfg->out_crop.nWidth,
+    p_cfg->out_crop.nHeight)) {
+    err = OMX_ErrorUnsupportedSetting;
+  } else {
+    img.rotation = (uint32_t)p_cfg->rotation;
+    img.quality = p_cfg->quality;
+    img.qtable[0] = p_cfg->qtable_set[0] ? p_cfg->qtable[0] : NULL;
+    img.qtable[1] = p_cfg->qtable_set[1] ? p_cfg->qtable[1] : NULL;
+    if (qomx_swenc_codec_code(&p_comp->codec, &img, &p_comp->abort)) {
+      err = OMX_ErrorUndefined;
+    }
+  }
+
+  /* the thumbnail input must not be used once the job completes */
+  thumb_valid = swenc_wait_thumb(p_comp);
+  if (p_comp->abort) {
+    return;
+  }
+  if (OMX_ErrorNone != err) {
+    goto error;
+  }
+  if (!thumb_valid) {
+    p_comp->thumb_stream.len = 0;
+  }
+
+  if (qomx_swenc_exif_build(&p_comp->app1, p_cfg->exif, p_cfg->num_exif,
+    &p_comp->thumb_stream, &thumb_added)) {
+    ALOGE("%s:%d] exif dropped", __func__, __LINE__);
+    p_comp->app1.len = 0;
+  } else if (p_comp->thumb_stream.len && !thumb_added) {
+    swenc_event(p_comp, (OMX_EVENTTYPE)OMX_EVENT_THUMBNAIL_DROPPED, 0, 0);
+  }
+
+  rc = qomx_swenc_codec_headers(&p_comp->codec, &p_comp->app1,
+    &p_comp->stream);
+  if (rc) {
+    err = OMX_ErrorInsufficientResources;
+    goto error;
+  }
+
+  err = swenc_deliver(p_comp, p_out, p_cfg);
+  if (OMX_ErrorNone != err) {
+    goto error;
+  }
+
+  if (p_comp->callbacks.EmptyBufferDone) {
+    p_comp->callbacks.EmptyBufferDone(&p_comp->omx_comp, p_comp->app_data,
+      p_main_in);
+    if (NULL != p_thumb_in) {
+      p_comp->callbacks.EmptyBufferDone(&p_comp->omx_comp, p_comp->app_data,
+        p_thumb_in);
+    }
+  }
+  if (p_comp->callbacks.FillBufferDone) {
+    p_comp->callbacks.FillBufferDone(&p_comp->omx_comp, p_comp->app_data,
+      p_out);
+  }
+  return;
+
+error:
+  ALOGE("%s:%d] encode failed %d", __func__, __LINE__, err);
+  swenc_event(p_comp, OMX_EventError, err, err);
+}
+
+/*==============================================================================
+* Function : swenc_msg_thread
+* Parameters: data - component
+* Return Value : NULL
+* Description: Component thread. State changes and encoding run here so
+* that every callback is issued outside of the client calls.
+==============================================================================*/
+static void *swenc_msg_thread(void *data)
+{
+  qomx_jpegenc_sw_t *p_comp = (qomx_jpegenc_sw_t *)data;
+  qomx_swenc_msg_t msg;
+
+  while (1) {
+    pthread_mutex_lock(&p_comp->lock);
+    while (0 == p_comp->msg_count) {
+      pthread_cond_wait(&p_comp->cond, &p_comp->lock);
+    }
+    msg = p_comp->msg_q[p_comp->msg_head];
+    p_comp->msg_head = (p_comp->msg_head + 1) % QOMX_SWENC_MSG_Q_SIZE;
+    p_comp->msg_count--;
+    pthread_mutex_unlock(&p_comp->lock);
+
+    switch (msg.type) {
+    case QOMX_SWENC_MSG_STATE_SET:
+      swenc_set_state(p_comp, (OMX_STATETYPE)msg.param);
+      break;
+    case QOMX_SWENC_MSG_CHECK_STATE:
+      swenc_check_state(p_comp);
+      break;
+    case QOMX_SWENC_MSG_ETB:
+      pthread_mutex_lock(&p_comp->lock);
+      if (QOMX_SWENC_TMB_PORT == msg.p_buf->nInputPortIndex) {
+        p_comp->p_thumb_in = msg.p_buf;
+        swenc_start_thumb(p_comp);
+      } else {
+        p_comp->p_main_in = msg.p_buf;
+      }
+      pthread_mutex_unlock(&p_comp->lock);
+      swenc_try_encode(p_comp);
+      break;
+    case QOMX_SWENC_MSG_FTB:
+      pthread_mutex_lock(&p_comp->lock);
+      p_comp->p_out = msg.p_buf;
+      pthread_mutex_unlock(&p_comp->lock);
+      swenc_try_encode(p_comp);
+      break;
+    case QOMX_SWENC_MSG_EXIT:
+      return NULL;
+    default:
+      break;
+    }
+  }
+  return NULL;
+}
+
+/*==============================================================================
+* Function : swenc_send_command
+* Parameters: hComp, Cmd, nParam1, pCmdData
+* Return Value : OMX_ERRORTYPE
+* Description: State changes complete asynchronously from the component
+* thread. Port commands complete before returning since the client does not
+* wait for them.
+==============================================================================*/
+static OMX_ERRORTYPE swenc_send_command(OMX_HANDLETYPE hComp,
+  OMX_COMMANDTYPE Cmd, OMX_U32 nParam1, OMX_PTR pCmdData)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+  OMX_BOOL enable = OMX_FALSE;
+
+  if (NULL == p_comp) {
+    return OMX_ErrorBadParameter;
+  }
+
+  switch (Cmd) {
+  case OMX_CommandStateSet:
+    if ((OMX_StateIdle == (OMX_STATETYPE)nParam1)) {
+      /* stops the frame being encoded */
+      pthread_mutex_lock(&p_comp->lock);
+      if (OMX_StateExecuting == p_comp->state) {
+        p_comp->abort = 1;
+      }
+      pthread_mutex_unlock(&p_comp->lock);
+    }
+    return swenc_post_msg(p_comp, QOMX_SWENC_MSG_STATE_SET, nParam1, NULL);
+  case OMX_CommandPortEnable:
+    enable = OMX_TRUE;
+    /* fall through */
+  case OMX_CommandPortDisable:
+    if ((nParam1 >= QOMX_SWENC_NUM_PORTS) && (OMX_ALL != nParam1)) {
+      return OMX_ErrorBadPortIndex;
+    }
+    pthread_mutex_lock(&p_comp->lock);
+    if (OMX_ALL == nParam1) {
+      p_comp->ports[QOMX_SWENC_TMB_PORT].bEnabled = enable;
+    } else if (QOMX_SWENC_TMB_PORT == nParam1) {
+      p_comp->ports[nParam1].bEnabled = enable;
+    }
+    pthread_mutex_unlock(&p_comp->lock);
+    swenc_event(p_comp, OMX_EventCmdComplete, Cmd, nParam1);
+    return OMX_ErrorNone;
+  default:
+    ALOGE("%s:%d] unsupported command %d", __func__, __LINE__, Cmd);
+    return OMX_ErrorUnsupportedSetting;
+  }
+}
+
+/*==============================================================================
+* Function : swenc_set_index
+* Parameters: p_comp, nIndex, p_data
+* Return Value : OMX_ERRORTYPE
+* Description: Apply a parameter or config. The client sets some of the
+* extensions as parameters and others as configs, so both share this path.
+* Called with the component lock held.
+==============================================================================*/
+static OMX_ERRORTYPE swenc_set_index(qomx_jpegenc_sw_t *p_comp,
+  OMX_INDEXTYPE nIndex, OMX_PTR p_data)
+{
+  qomx_swenc_config_t *p_cfg = &p_comp->cfg;
+  OMX_PARAM_PORTDEFINITIONTYPE *p_port_def;
+  OMX_IMAGE_PARAM_QUANTIZATIONTABLETYPE *p_qtable;
+  QOMX_EXIF_INFO *p_exif;
+  OMX_S32 rotation;
+  uint32_t i, t;
+
+  switch ((int)nIndex) {
+  case OMX_IndexParamPortDefinition:
+    p_port_def = (OMX_PARAM_PORTDEFINITIONTYPE *)p_data;
+    if (p_port_def->nPortIndex >= QOMX_SWENC_NUM_PORTS) {
+      return OMX_ErrorBadPortIndex;
+    }
+    p_comp->ports[p_port_def->nPortIndex].nBufferCountActual =
+      p_port_def->nBufferCountActual;
+    p_comp->ports[p_port_def->nPortIndex].nBufferSize =
+      p_port_def->nBufferSize;
+    if (QOMX_SWENC_OUT_PORT != p_port_def->nPortIndex) {
+      p_comp->ports[p_port_def->nPortIndex].format.image =
+        p_port_def->format.image;
+    }
+    break;
+  case OMX_IndexConfigCommonRotate:
+    rotation = ((OMX_CONFIG_ROTATIONTYPE *)p_data)->nRotation % 360;
+    if (rotation < 0) {
+      rotation += 360;
+    }
+    if (rotation % 90) {
+      return OMX_ErrorUnsupportedSetting;
+    }
+    p_cfg->rotation = rotation;
+    break;
+  case OMX_IndexConfigCommonInputCrop:
+    p_cfg->in_crop = *(OMX_CONFIG_RECTTYPE *)p_data;
+    break;
+  case OMX_IndexConfigCommonOutputCrop:
+    p_cfg->out_crop = *(OMX_CONFIG_RECTTYPE *)p_data;
+    break;
+  case OMX_IndexParamQFactor:
+    p_cfg->quality = ((OMX_IMAGE_PARAM_QFACTORTYPE *)p_data)->nQFactor;
+    break;
+  case OMX_IndexParamQuantizationTable:
+    p_qtable = (OMX_IMAGE_PARAM_QUANTIZATIONTABLETYPE *)p_data;
+    t = (OMX_IMAGE_QuantizationTableLuma == p_qtable->eQuantizationTable) ?
+      0 : 1;
+    memcpy(p_cfg->qtable[t], p_qtable->nQuantizationMatrix, 64);
+    p_cfg->qtable_set[t] = OMX_TRUE;
+    break;
+  case QOMX_IMAGE_EXT_BUFFER_OFFSET:
+    p_cfg->main_offset = *(QOMX_YUV_FRAME_INFO *)p_data;
+    break;
+  case QOMX_IMAGE_EXT_THUMBNAIL:
+    p_cfg->thumb = *(QOMX_THUMBNAIL_INFO *)p_data;
+    p_cfg->thumb_set = OMX_TRUE;
+    break;
+  case QOMX_IMAGE_EXT_EXIF:
+    p_exif = (QOMX_EXIF_INFO *)p_data;
+    for (i = 0; i < p_exif->numOfEntries; i++) {
+      if (p_cfg->num_exif >= QOMX_SWENC_MAX_EXIF) {
+        ALOGE("%s:%d] exif table full", __func__, __LINE__);
+        break;
+      }
+      p_cfg->exif[p_cfg->num_exif++] = p_exif->exif_data[i];
+    }
+    break;
+  case QOMX_IMAGE_EXT_MEM_OPS:
+    p_cfg->mem_ops = *(QOMX_MEM_OPS *)p_data;
+    break;
+  case QOMX_IMAGE_EXT_ENCODING_MODE:
+  case QOMX_IMAGE_EXT_JPEG_SPEED:
+  case QOMX_IMAGE_EXT_WORK_BUFFER:
+  case QOMX_IMAGE_EXT_METADATA:
+  case QOMX_IMAGE_EXT_META_ENC_KEY:
+  case QOMX_IMAGE_EXT_MOBICAT:
+    /* hardware specific, nothing to do for the software path */
+    break;
+  default:
+    ALOGE("%s:%d] unsupported index 0x%x", __func__, __LINE__, nIndex);
+    return OMX_ErrorUnsupportedIndex;
+  }
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE swenc_set_parameter(OMX_HANDLETYPE hComp,
+  OMX_INDEXTYPE nIndex, OMX_PTR pComponentParameterStructure)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+  OMX_ERRORTYPE rc;
+
+  if ((NULL == p_comp) || (NULL == pComponentParameterStructure)) {
+    return OMX_ErrorBadParameter;
+  }
+  pthread_mutex_lock(&p_comp->lock);
+  rc = swenc_set_index(p_comp, nIndex, pComponentParameterStructure);
+  pthread_mutex_unlock(&p_comp->lock);
+  return rc;
+}
+
+static OMX_ERRORTYPE swenc_set_config(OMX_HANDLETYPE hComp,
+  OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+  return swenc_set_parameter(hComp, nIndex, pComponentConfigStructure);
+}
+
+static OMX_ERRORTYPE swenc_get_parameter(OMX_HANDLETYPE hComp,
+  OMX_INDEXTYPE nIndex, OMX_PTR pComponentParameterStructure)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+  OMX_PARAM_PORTDEFINITIONTYPE *p_port_def;
+
+  if ((NULL == p_comp) || (NULL == pComponentParameterStructure)) {
+    return OMX_ErrorBadParameter;
+  }
+  if (OMX_IndexParamPortDefinition != nIndex) {
+    return OMX_ErrorUnsupportedIndex;
+  }
+  p_port_def = (OMX_PARAM_PORTDEFINITIONTYPE *)pComponentParameterStructure;
+  if (p_port_def->nPortIndex >= QOMX_SWENC_NUM_PORTS) {
+    return OMX_ErrorBadPortIndex;
+  }
+  pthread_mutex_lock(&p_comp->lock);
+  *p_port_def = p_comp->ports[p_port_def->nPortIndex];
+  pthread_mutex_unlock(&p_comp->lock);
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE swenc_get_config(OMX_HANDLETYPE hComp,
+  OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+  return swenc_get_parameter(hComp, nIndex, pComponentConfigStructure);
+}
+
+static OMX_ERRORTYPE swenc_get_extension_index(OMX_HANDLETYPE hComp,
+  OMX_STRING cParameterName, OMX_INDEXTYPE *pIndexType)
+{
+  uint32_t i;
+
+  if ((NULL == cParameterName) || (NULL == pIndexType)) {
+    return OMX_ErrorBadParameter;
+  }
+  for (i = 0; i < sizeof(g_ext_index) / sizeof(g_ext_index[0]); i++) {
+    if (!strcmp(cParameterName, g_ext_index[i].name)) {
+      *pIndexType = (OMX_INDEXTYPE)g_ext_index[i].index;
+      return OMX_ErrorNone;
+    }
+  }
+  ALOGE("%s:%d] unknown extension %s", __func__, __LINE__, cParameterName);
+  return OMX_ErrorUnsupportedIndex;
+}
+
+static OMX_ERRORTYPE swenc_get_state(OMX_HANDLETYPE hComp,
+  OMX_STATETYPE *pState)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+
+  if ((NULL == p_comp) || (NULL == pState)) {
+    return OMX_ErrorBadParameter;
+  }
+  pthread_mutex_lock(&p_comp->lock);
+  *pState = p_comp->state;
+  pthread_mutex_unlock(&p_comp->lock);
+  return OMX_ErrorNone;
+}
+
+/*==============================================================================
+* Function : swenc_use_buffer
+* Parameters: hComp, ppBufferHdr, nPortIndex, pAppPrivate, nSizeBytes, pBuffer
+* Return Value : OMX_ERRORTYPE
+* Description: Register a client buffer. The Idle transition completes in
+* the component thread once all the buffers are registered.
+==============================================================================*/
+static OMX_ERRORTYPE swenc_use_buffer(OMX_HANDLETYPE hComp,
+  OMX_BUFFERHEADERTYPE **ppBufferHdr, OMX_U32 nPortIndex,
+  OMX_PTR pAppPrivate, OMX_U32 nSizeBytes, OMX_U8 *pBuffer)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+  OMX_BUFFERHEADERTYPE *p_hdr;
+
+  if ((NULL == p_comp) || (NULL == ppBufferHdr) || (NULL == pBuffer)) {
+    return OMX_ErrorBadParameter;
+  }
+  if (nPortIndex >= QOMX_SWENC_NUM_PORTS) {
+    return OMX_ErrorBadPortIndex;
+  }
+
+  p_hdr = (OMX_BUFFERHEADERTYPE *)calloc(1, sizeof(*p_hdr));
+  if (NULL == p_hdr) {
+    return OMX_ErrorInsufficientResources;
+  }
+  p_hdr->nSize = sizeof(*p_hdr);
+  p_hdr->pBuffer = pBuffer;
+  p_hdr->nAllocLen = nSizeBytes;
+  p_hdr->pAppPrivate = pAppPrivate;
+  if (QOMX_SWENC_OUT_PORT == nPortIndex) {
+    p_hdr->nOutputPortIndex = nPortIndex;
+  } else {
+    p_hdr->nInputPortIndex = nPortIndex;
+  }
+
+  pthread_mutex_lock(&p_comp->lock);
+  if (p_comp->num_bufs[nPortIndex] >= QOMX_SWENC_MAX_BUFS) {
+    pthread_mutex_unlock(&p_comp->lock);
+    free(p_hdr);
+    return OMX_ErrorInsufficientResources;
+  }
+  p_comp->p_bufs[nPortIndex][p_comp->num_bufs[nPortIndex]++] = p_hdr;
+  pthread_mutex_unlock(&p_comp->lock);
+
+  *ppBufferHdr = p_hdr;
+  return swenc_post_msg(p_comp, QOMX_SWENC_MSG_CHECK_STATE, 0, NULL);
+}
+
+static OMX_ERRORTYPE swenc_free_buffer(OMX_HANDLETYPE hComp,
+  OMX_U32 nPortIndex, OMX_BUFFERHEADERTYPE *pBuffer)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+  uint32_t i, num;
+
+  if ((NULL == p_comp) || (NULL == pBuffer)) {
+    return OMX_ErrorBadParameter;
+  }
+  if (nPortIndex >= QOMX_SWENC_NUM_PORTS) {
+    return OMX_ErrorBadPortIndex;
+  }
+
+  pthread_mutex_lock(&p_comp->lock);
+  num = p_comp->num_bufs[nPortIndex];
+  for (i = 0; i < num; i++) {
+    if (p_comp->p_bufs[nPortIndex][i] == pBuffer) {
+      p_comp->p_bufs[nPortIndex][i] = p_comp->p_bufs[nPortIndex][num - 1];
+      p_comp->num_bufs[nPortIndex]--;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&p_comp->lock);
+  if (i == num) {
+    return OMX_ErrorBadParameter;
+  }
+  free(pBuffer);
+  return swenc_post_msg(p_comp, QOMX_SWENC_MSG_CHECK_STATE, 0, NULL);
+}
+
+static OMX_ERRORTYPE swenc_empty_this_buffer(OMX_HANDLETYPE hComp,
+  OMX_BUFFERHEADERTYPE *pBuffer)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+
+  if ((NULL == p_comp) || (NULL == pBuffer)) {
+    return OMX_ErrorBadParameter;
+  }
+  return swenc_post_msg(p_comp, QOMX_SWENC_MSG_ETB, 0, pBuffer);
+}
+
+static OMX_ERRORTYPE swenc_fill_this_buffer(OMX_HANDLETYPE hComp,
+  OMX_BUFFERHEADERTYPE *pBuffer)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+
+  if ((NULL == p_comp) || (NULL == pBuffer)) {
+    return OMX_ErrorBadParameter;
+  }
+  return swenc_post_msg(p_comp, QOMX_SWENC_MSG_FTB, 0, pBuffer);
+}
+
+static OMX_ERRORTYPE swenc_set_callbacks(OMX_HANDLETYPE hComp,
+  OMX_CALLBACKTYPE *pCallbacks, OMX_PTR pAppData)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+
+  if ((NULL == p_comp) || (NULL == pCallbacks)) {
+    return OMX_ErrorBadParameter;
+  }
+  pthread_mutex_lock(&p_comp->lock);
+  p_comp->callbacks = *pCallbacks;
+  p_comp->app_data = pAppData;
+  pthread_mutex_unlock(&p_comp->lock);
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE swenc_get_component_version(OMX_HANDLETYPE hComp,
+  OMX_STRING pComponentName, OMX_VERSIONTYPE *pComponentVersion,
+  OMX_VERSIONTYPE *pSpecVersion, OMX_UUIDTYPE *pComponentUUID)
+{
+  return OMX_ErrorNotImplemented;
+}
+
+static OMX_ERRORTYPE swenc_component_tunnel_request(OMX_HANDLETYPE hComp,
+  OMX_U32 nPort, OMX_HANDLETYPE hTunneledComp, OMX_U32 nTunneledPort,
+  OMX_TUNNELSETUPTYPE *pTunnelSetup)
+{
+  return OMX_ErrorNotImplemented;
+}
+
+static OMX_ERRORTYPE swenc_allocate_buffer(OMX_HANDLETYPE hComp,
+  OMX_BUFFERHEADERTYPE **ppBuffer, OMX_U32 nPortIndex, OMX_PTR pAppPrivate,
+  OMX_U32 nSizeBytes)
+{
+  return OMX_ErrorNotImplemented;
+}
+
+static OMX_ERRORTYPE swenc_use_egl_image(OMX_HANDLETYPE hComp,
+  OMX_BUFFERHEADERTYPE **ppBufferHdr, OMX_U32 nPortIndex,
+  OMX_PTR pAppPrivate, void *eglImage)
+{
+  return OMX_ErrorNotImplemented;
+}
+
+static OMX_ERRORTYPE swenc_component_role_enum(OMX_HANDLETYPE hComp,
+  OMX_U8 *cRole, OMX_U32 nIndex)
+{
+  return OMX_ErrorNotImplemented;
+}
+
+/*==============================================================================
+* Function : swenc_component_deinit
+* Parameters: hComp
+* Return Value : OMX_ERRORTYPE
+* Description: Stop the component thread and free the component
+==============================================================================*/
+static OMX_ERRORTYPE swenc_component_deinit(OMX_HANDLETYPE hComp)
+{
+  qomx_jpegenc_sw_t *p_comp = swenc_get_comp(hComp);
+  uint32_t i, j;
+
+  if (NULL == p_comp) {
+    return OMX_ErrorBadParameter;
+  }
+
+  pthread_mutex_lock(&p_comp->lock);
+  p_comp->abort = 1;
+  pthread_mutex_unlock(&p_comp->lock);
+  /* the queue may be full of unprocessed work, wait for a free slot */
+  while (OMX_ErrorNone != swenc_post_msg(p_comp, QOMX_SWENC_MSG_EXIT, 0,
+    NULL)) {
+    usleep(1000);
+  }
+  pthread_join(p_comp->msg_pid, NULL);
+  pthread_mutex_lock(&p_comp->lock);
+  p_comp->thumb_exit = 1;
+  pthread_cond_broadcast(&p_comp->thumb_cond);
+  pthread_mutex_unlock(&p_comp->lock);
+  pthread_join(p_comp->thumb_pid, NULL);
+
+  for (i = 0; i < QOMX_SWENC_NUM_PORTS; i++) {
+    for (j = 0; j < p_comp->num_bufs[i]; j++) {
+      free(p_comp->p_bufs[i][j]);
+    }
+  }
+  qomx_swenc_codec_deinit(&p_comp->codec);
+  qomx_swenc_codec_deinit(&p_comp->thumb_codec);
+  qomx_swenc_buf_release(&p_comp->stream);
+  qomx_swenc_buf_release(&p_comp->thumb_stream);
+  qomx_swenc_buf_release(&p_comp->app1);
+  pthread_cond_destroy(&p_comp->thumb_cond);
+  pthread_cond_destroy(&p_comp->cond);
+  pthread_mutex_destroy(&p_comp->lock);
+  free(p_comp);
+  return OMX_ErrorNone;
+}
+
+static void swenc_init_port(OMX_PARAM_PORTDEFINITIONTYPE *p_port,
+  OMX_U32 index)
+{
+  memset(p_port, 0, sizeof(*p_port));
+  p_port->nSize = sizeof(*p_port);
+  p_port->nPortIndex = index;
+  p_port->eDir = (QOMX_SWENC_OUT_PORT == index) ? OMX_DirOutput : OMX_DirInput;
+  p_port->nBufferCountMin = 1;
+  p_port->nBufferCountActual = 1;
+  p_port->bEnabled = (QOMX_SWENC_TMB_PORT == index) ? OMX_FALSE : OMX_TRUE;
+  p_port->eDomain = OMX_PortDomainImage;
+  p_port->format.image.eCompressionFormat =
+    (QOMX_SWENC_OUT_PORT == index) ? OMX_IMAGE_CodingJPEG :
+    OMX_IMAGE_CodingUnused;
+  p_port->format.image.eColorFormat = (QOMX_SWENC_OUT_PORT == index) ?
+    OMX_COLOR_FormatUnused :
+    (OMX_COLOR_FORMATTYPE)OMX_QCOM_IMG_COLOR_FormatYVU420SemiPlanar;
+}
+
+/*==============================================================================
+* Function : getInstance
+* Parameters: None
+* Return Value : component object, NULL on failure
+* Description: Called by the OMX core to create a new component object
+==============================================================================*/
+void *getInstance(void)
+{
+  qomx_jpegenc_sw_t *p_comp;
+  uint32_t i;
+
+  p_comp = (qomx_jpegenc_sw_t *)calloc(1, sizeof(*p_comp));
+  if (NULL == p_comp) {
+    ALOGE("%s:%d] cannot allocate component", __func__, __LINE__);
+    return NULL;
+  }
+  pthread_mutex_init(&p_comp->lock, NULL);
+  pthread_cond_init(&p_comp->cond, NULL);
+  pthread_cond_init(&p_comp->thumb_cond, NULL);
+  p_comp->state = p_comp->target_state = OMX_StateLoaded;
+  for (i = 0; i < QOMX_SWENC_NUM_PORTS; i++) {
+    swenc_init_port(&p_comp->ports[i], i);
+  }
+  p_comp->cfg.quality = QOMX_SWENC_DEFAULT_QUALITY;
+  return p_comp;
+}
+
+/*==============================================================================
+* Function : create_component_fns
+* Parameters: p_obj - object from getInstance
+* Return Value : OMX component, NULL on failure
+* Description: Fill the OMX entry points and start the component threads
+==============================================================================*/
+void *create_component_fns(OMX_PTR p_obj)
+{
+  qomx_jpegenc_sw_t *p_comp = (qomx_jpegenc_sw_t *)p_obj;
+  OMX_COMPONENTTYPE *p_omx;
+  long num_cpus;
+
+  if (NULL == p_comp) {
+    return NULL;
+  }
+  p_omx = &p_comp->omx_comp;
+  p_omx->nSize = sizeof(*p_omx);
+  p_omx->pComponentPrivate = p_comp;
+  p_omx->GetComponentVersion = swenc_get_component_version;
+  p_omx->SendCommand = swenc_send_command;
+  p_omx->GetParameter = swenc_get_parameter;
+  p_omx->SetParameter = swenc_set_parameter;
+  p_omx->GetConfig = swenc_get_config;
+  p_omx->SetConfig = swenc_set_config;
+  p_omx->GetExtensionIndex = swenc_get_extension_index;
+  p_omx->GetState = swenc_get_state;
+  p_omx->ComponentTunnelRequest = swenc_component_tunnel_request;
+  p_omx->UseBuffer = swenc_use_buffer;
+  p_omx->AllocateBuffer = swenc_allocate_buffer;
+  p_omx->FreeBuffer = swenc_free_buffer;
+  p_omx->EmptyThisBuffer = swenc_empty_this_buffer;
+  p_omx->FillThisBuffer = swenc_fill_this_buffer;
+  p_omx->SetCallbacks = swenc_set_callbacks;
+  p_omx->ComponentDeInit = swenc_component_deinit;
+  p_omx->UseEGLImage = swenc_use_egl_image;
+  p_omx->ComponentRoleEnum = swenc_component_role_enum;
+
+  num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  qomx_swenc_codec_init(&p_comp->codec, (num_cpus > 0) ? (uint32_t)num_cpus : 1);
+  qomx_swenc_codec_init(&p_comp->thumb_codec, 1);
+
+  if (pthread_create(&p_comp->thumb_pid, NULL, swenc_thumb_thread, p_comp)) {
+    ALOGE("%s:%d] cannot start thumbnail thread", __func__, __LINE__);
+    goto error;
+  }
+  if (pthread_create(&p_comp->msg_pid, NULL, swenc_msg_thread, p_comp)) {
+    ALOGE("%s:%d] cannot start component thread", __func__, __LINE__);
+    pthread_mutex_lock(&p_comp->lock);
+    p_comp->thumb_exit = 1;
+    pthread_cond_broadcast(&p_comp->thumb_cond);
+    pthread_mutex_unlock(&p_comp->lock);
+    pthread_join(p_comp->thumb_pid, NULL);
+    goto error;
+  }
+  ALOGI("%s:%d] %s created", __func__, __LINE__, SWENC_COMP_NAME);
+  return p_omx;
+
+error:
+  qomx_swenc_codec_deinit(&p_comp->codec);
+  qomx_swenc_codec_deinit(&p_comp->thumb_codec);
+  pthread_cond_destroy(&p_comp->thumb_cond);
+  pthread_cond_destroy(&p_comp->cond);
+  pthread_mutex_destroy(&p_comp->lock);
+  free(p_comp);
+  return NULL;
+}
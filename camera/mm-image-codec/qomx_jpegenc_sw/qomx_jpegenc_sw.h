@@ -0,0 +1,312 @@
+/*Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifndef QOMX_JPEGENC_SW_H
+#define QOMX_JPEGENC_SW_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "OMX_Component.h"
+#include "qexif.h"
+#include "QOMX_JpegExtensions.h"
+
+#define QOMX_SWENC_NUM_PORTS 3
+#define QOMX_SWENC_IN_PORT 0
+#define QOMX_SWENC_OUT_PORT 1
+#define QOMX_SWENC_TMB_PORT 2
+
+#define QOMX_SWENC_MAX_BUFS 64
+#define QOMX_SWENC_MAX_EXIF 128
+#define QOMX_SWENC_MSG_Q_SIZE 32
+#define QOMX_SWENC_DEFAULT_QUALITY 85
+
+/* encoder worker threads including the component thread */
+#define QOMX_SWENC_MAX_THREADS 4
+
+/** qomx_swenc_buf_t: growable byte buffer
+*    @data: buffer address
+*    @size: allocated size
+*    @len: number of valid bytes
+**/
+typedef struct {
+  uint8_t *data;
+  size_t size;
+  size_t len;
+} qomx_swenc_buf_t;
+
+/** qomx_swenc_image_t: one image to be encoded
+*    @y: luma plane
+*    @cbcr: interleaved chroma plane, NULL for monochrome
+*    @stride: luma stride in bytes
+*    @cbcr_stride: chroma stride in bytes
+*    @h_shift: horizontal chroma subsampling shift
+*    @v_shift: vertical chroma subsampling shift
+*    @cr_first: chroma is in VU order
+*    @crop_x, @crop_y, @crop_w, @crop_h: source window in luma pixels
+*    @scaled_w, @scaled_h: output size before rotation
+*    @rotation: clockwise rotation 0, 90, 180 or 270
+*    @quality: 1 - 100, used when no custom table is given
+*    @qtable: custom quantization tables in natural order, or NULL
+**/
+typedef struct {
+  const uint8_t *y;
+  const uint8_t *cbcr;
+  uint32_t stride;
+  uint32_t cbcr_stride;
+  uint32_t h_shift;
+  uint32_t v_shift;
+  uint32_t cr_first;
+  uint32_t crop_x;
+  uint32_t crop_y;
+  uint32_t crop_w;
+  uint32_t crop_h;
+  uint32_t scaled_w;
+  uint32_t scaled_h;
+  uint32_t rotation;
+  uint32_t quality;
+  const uint8_t *qtable[2];
+} qomx_swenc_image_t;
+
+struct qomx_swenc_codec;
+
+/** qomx_swenc_slice_t: a run of MCU rows coded by one thread
+*    @codec: owning encoder
+*    @idx: slice index
+*    @first_row: first MCU row
+*    @num_rows: number of MCU rows
+*    @out: entropy coded data with restart markers
+*    @band: MCU row sample buffer
+*    @band_size: size of @band
+*    @rc: result of the slice
+**/
+typedef struct {
+  struct qomx_swenc_codec *codec;
+  uint32_t idx;
+  uint32_t first_row;
+  uint32_t num_rows;
+  qomx_swenc_buf_t out;
+  uint8_t *band;
+  size_t band_size;
+  int rc;
+} qomx_swenc_slice_t;
+
+/** qomx_swenc_codec_t: baseline JPEG encoder with a slice thread pool
+*    @lock: protects the pool state
+*    @work_cond: signalled when a new frame is dispatched
+*    @done_cond: signalled when a slice completes
+*    @pid: helper threads
+*    @num_threads: threads used per frame including the caller
+*    @generation: dispatch counter
+*    @pending: helper slices not yet finished
+*    @exit: helper threads should exit
+*    @num_slices: slices of the current frame
+*    @slices: per thread slice state
+*    @img: image of the current frame
+*    @abort: abort flag of the current frame
+*    @row_off, @col_off: luma sample offset tables
+*    @crow_off, @ccol_off: chroma sample offset tables
+*    @tab_size: entries allocated per table
+*    @linear_cols: luma rows are contiguous in the source
+*    @qdiv: quantizer divisors in zigzag order
+*    @width, @height: output size after rotation
+*    @mcus_x, @mcus_y: MCU grid
+*    @mono: encode a single component
+**/
+typedef struct qomx_swenc_codec {
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  pthread_t pid[QOMX_SWENC_MAX_THREADS - 1];
+  uint32_t num_threads;
+  uint32_t generation;
+  uint32_t pending;
+  int exit;
+  uint32_t num_slices;
+  qomx_swenc_slice_t slices[QOMX_SWENC_MAX_THREADS];
+  const qomx_swenc_image_t *img;
+  volatile int *abort;
+  uint32_t *row_off;
+  uint32_t *col_off;
+  uint32_t *crow_off;
+  uint32_t *ccol_off;
+  size_t tab_size;
+  int linear_cols;
+  int32_t qdiv[2][64];
+  uint8_t qtable[2][64];
+  uint32_t width;
+  uint32_t height;
+  uint32_t mcus_x;
+  uint32_t mcus_y;
+  int mono;
+} qomx_swenc_codec_t;
+
+typedef enum {
+  QOMX_SWENC_MSG_STATE_SET,
+  QOMX_SWENC_MSG_CHECK_STATE,
+  QOMX_SWENC_MSG_ETB,
+  QOMX_SWENC_MSG_FTB,
+  QOMX_SWENC_MSG_EXIT,
+} qomx_swenc_msg_type_t;
+
+typedef enum {
+  QOMX_SWENC_THUMB_IDLE,
+  QOMX_SWENC_THUMB_QUEUED,
+  QOMX_SWENC_THUMB_BUSY,
+  QOMX_SWENC_THUMB_DONE,
+} qomx_swenc_thumb_state_t;
+
+/** qomx_swenc_msg_t: component thread message
+*    @type: message type
+*    @param: new state for QOMX_SWENC_MSG_STATE_SET
+*    @p_buf: buffer for QOMX_SWENC_MSG_ETB/FTB
+**/
+typedef struct {
+  qomx_swenc_msg_type_t type;
+  OMX_U32 param;
+  OMX_BUFFERHEADERTYPE *p_buf;
+} qomx_swenc_msg_t;
+
+/** qomx_swenc_config_t: per job encode settings
+*    @main_offset: main image plane offsets
+*    @thumb: thumbnail settings
+*    @thumb_set: thumbnail settings are valid
+*    @in_crop: main image crop
+*    @out_crop: main image output size
+*    @rotation: main image rotation
+*    @quality: main image quality
+*    @qtable: custom quantization tables
+*    @qtable_set: custom table is valid
+*    @mem_ops: output memory callback
+*    @exif: exif tags of the job
+*    @num_exif: number of exif tags
+**/
+typedef struct {
+  QOMX_YUV_FRAME_INFO main_offset;
+  QOMX_THUMBNAIL_INFO thumb;
+  OMX_BOOL thumb_set;
+  OMX_CONFIG_RECTTYPE in_crop;
+  OMX_CONFIG_RECTTYPE out_crop;
+  OMX_S32 rotation;
+  OMX_U32 quality;
+  uint8_t qtable[2][64];
+  OMX_BOOL qtable_set[2];
+  QOMX_MEM_OPS mem_ops;
+  QEXIF_INFO_DATA exif[QOMX_SWENC_MAX_EXIF];
+  uint32_t num_exif;
+} qomx_swenc_config_t;
+
+/** qomx_jpegenc_sw_t: software JPEG encoder component
+*    @omx_comp: OMX component, must be the first member
+*    @callbacks: client callbacks
+*    @app_data: client data passed back in the callbacks
+*    @lock: protects the component state
+*    @cond: signalled when a message is posted
+*    @msg_pid: component thread
+*    @msg_q, @msg_head, @msg_count: message ring
+*    @state: current state
+*    @target_state: state being transitioned to
+*    @ports: port definitions
+*    @p_bufs, @num_bufs: buffer headers of each port
+*    @p_main_in, @p_thumb_in, @p_out: buffers of the queued job
+*    @cfg: settings of the next job
+*    @job_cfg: settings of the job being encoded
+*    @abort: abort the frame being encoded
+*    @codec: encoder
+*    @stream: main image headers
+*    @thumb_stream: thumbnail bitstream
+*    @app1: exif segment
+*    @thumb_pid: thumbnail thread
+*    @thumb_cond: signalled when the thumbnail job changes state
+*    @thumb_state: state of the thumbnail job
+*    @thumb_rc: result of the thumbnail job
+*    @thumb_exit: thumbnail thread should exit
+*    @p_thumb_job: thumbnail input of the job
+*    @thumb_info: thumbnail settings of the job
+*    @thumb_port: thumbnail port of the job
+*    @thumb_codec: single threaded thumbnail encoder
+**/
+typedef struct {
+  OMX_COMPONENTTYPE omx_comp;
+  OMX_CALLBACKTYPE callbacks;
+  OMX_PTR app_data;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t msg_pid;
+  qomx_swenc_msg_t msg_q[QOMX_SWENC_MSG_Q_SIZE];
+  uint32_t msg_head;
+  uint32_t msg_count;
+  OMX_STATETYPE state;
+  OMX_STATETYPE target_state;
+  OMX_PARAM_PORTDEFINITIONTYPE ports[QOMX_SWENC_NUM_PORTS];
+  OMX_BUFFERHEADERTYPE *p_bufs[QOMX_SWENC_NUM_PORTS][QOMX_SWENC_MAX_BUFS];
+  uint32_t num_bufs[QOMX_SWENC_NUM_PORTS];
+  OMX_BUFFERHEADERTYPE *p_main_in;
+  OMX_BUFFERHEADERTYPE *p_thumb_in;
+  OMX_BUFFERHEADERTYPE *p_out;
+  qomx_swenc_config_t cfg;
+  qomx_swenc_config_t job_cfg;
+  volatile int abort;
+  qomx_swenc_codec_t codec;
+  qomx_swenc_buf_t stream;
+  qomx_swenc_buf_t thumb_stream;
+  qomx_swenc_buf_t app1;
+  pthread_t thumb_pid;
+  pthread_cond_t thumb_cond;
+  qomx_swenc_thumb_state_t thumb_state;
+  int thumb_rc;
+  int thumb_exit;
+  OMX_BUFFERHEADERTYPE *p_thumb_job;
+  QOMX_THUMBNAIL_INFO thumb_info;
+  OMX_PARAM_PORTDEFINITIONTYPE thumb_port;
+  qomx_swenc_codec_t thumb_codec;
+} qomx_jpegenc_sw_t;
+
+int qomx_swenc_buf_reserve(qomx_swenc_buf_t *p_buf, size_t extra);
+void qomx_swenc_buf_release(qomx_swenc_buf_t *p_buf);
+
+int qomx_swenc_codec_init(qomx_swenc_codec_t *p_codec, uint32_t num_threads);
+void qomx_swenc_codec_deinit(qomx_swenc_codec_t *p_codec);
+int qomx_swenc_codec_code(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_image_t *p_img, volatile int *p_abort);
+int qomx_swenc_codec_headers(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_buf_t *p_app1, qomx_swenc_buf_t *p_out);
+size_t qomx_swenc_codec_scan_size(qomx_swenc_codec_t *p_codec);
+void qomx_swenc_codec_write_scan(qomx_swenc_codec_t *p_codec, uint8_t *p_dst);
+int qomx_swenc_codec_assemble(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_buf_t *p_app1, qomx_swenc_buf_t *p_out);
+int qomx_swenc_codec_encode(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_image_t *p_img, const qomx_swenc_buf_t *p_app1,
+  qomx_swenc_buf_t *p_out, volatile int *p_abort);
+
+int qomx_swenc_exif_build(qomx_swenc_buf_t *p_app1,
+  const QEXIF_INFO_DATA *p_exif, uint32_t num_exif,
+  const qomx_swenc_buf_t *p_thumb, int *p_thumb_added);
+
+#endif
@@ -0,0 +1,1275 @@
+/*Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#define LOG_TAG "qomx_jpegenc_sw"
+#include <utils/Log.h>
+
+#include "qomx_jpegenc_sw.h"
+
+#define SWENC_MIN_BUF_SIZE (64 * 1024)
+/* worst case of one 4:2:0 MCU including 0xFF stuffing */
+#define SWENC_MAX_MCU_BYTES 3072
+#define SWENC_MAX_HDR_BYTES 1024
+
+#define SWENC_CONST_BITS 13
+#define SWENC_PASS1_BITS 2
+#define SWENC_DESCALE(x, n) (((x) + (1 << ((n) - 1))) >> (n))
+
+#define SWENC_FIX_0_298631336 2446
+#define SWENC_FIX_0_390180644 3196
+#define SWENC_FIX_0_541196100 4433
+#define SWENC_FIX_0_765366865 6270
+#define SWENC_FIX_0_899976223 7373
+#define SWENC_FIX_1_175875602 9633
+#define SWENC_FIX_1_501321110 12299
+#define SWENC_FIX_1_847759065 15137
+#define SWENC_FIX_1_961570560 16069
+#define SWENC_FIX_2_053119869 16819
+#define SWENC_FIX_2_562915447 20995
+#define SWENC_FIX_3_072711026 25172
+
+/** swenc_huff_t: derived huffman code table
+*    @code: code of each symbol
+*    @size: code length of each symbol, 0 if unused
+**/
+typedef struct {
+  uint16_t code[256];
+  uint8_t size[256];
+} swenc_huff_t;
+
+/** swenc_bits_t: entropy coder output state
+*    @p: next output byte
+*    @acc: pending bits
+*    @nbits: number of pending bits
+**/
+typedef struct {
+  uint8_t *p;
+  uint64_t acc;
+  int nbits;
+} swenc_bits_t;
+
+enum {
+  SWENC_HUFF_DC_LUMA,
+  SWENC_HUFF_AC_LUMA,
+  SWENC_HUFF_DC_CHROMA,
+  SWENC_HUFF_AC_CHROMA,
+  SWENC_HUFF_MAX
+};
+
+/* natural order position of each zigzag index */
+static const uint8_t g_zigzag[64] = {
+  0, 1, 8, 16, 9, 2, 3, 10,
+  17, 24, 32, 25, 18, 11, 4, 5,
+  12, 19, 26, 33, 40, 48, 41, 34,
+  27, 20, 13, 6, 7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36,
+  29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46,
+  53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* ITU T.81 Annex K tables in natural order */
+static const uint8_t g_std_qtable[2][64] = {
+  {
+    16, 11, 10, 16, 24, 40, 51, 61,
+    12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,
+    14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77,
+    24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103, 99
+  },
+  {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+  }
+};
+
+static const uint8_t g_dc_luma_bits[16] =
+  { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t g_dc_chroma_bits[16] =
+  { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t g_dc_vals[12] =
+  { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t g_ac_luma_bits[16] =
+  { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t g_ac_luma_vals[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+  0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+  0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+  0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+  0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+  0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+  0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+  0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+  0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+  0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+  0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+  0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+  0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+  0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+static const uint8_t g_ac_chroma_bits[16] =
+  { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t g_ac_chroma_vals[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+  0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+  0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+  0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+  0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+  0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+  0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+  0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+  0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+  0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+  0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+  0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+  0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+  0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+  0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+  0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+static const uint8_t *g_huff_bits[SWENC_HUFF_MAX] = {
+  g_dc_luma_bits, g_ac_luma_bits, g_dc_chroma_bits, g_ac_chroma_bits
+};
+static const uint8_t *g_huff_vals[SWENC_HUFF_MAX] = {
+  g_dc_vals, g_ac_luma_vals, g_dc_vals, g_ac_chroma_vals
+};
+
+static swenc_huff_t g_huff[SWENC_HUFF_MAX];
+static pthread_once_t g_huff_once = PTHREAD_ONCE_INIT;
+
+/** swenc_build_huff_tables:
+ *
+ *  Arguments:
+ *    None
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Derive the code tables from the standard huffman tables
+ *
+ **/
+static void swenc_build_huff_tables(void)
+{
+  int t, len, i, k;
+  uint32_t code;
+
+  memset(g_huff, 0, sizeof(g_huff));
+  for (t = 0; t < SWENC_HUFF_MAX; t++) {
+    code = 0;
+    k = 0;
+    for (len = 1; len <= 16; len++) {
+      for (i = 0; i < g_huff_bits[t][len - 1]; i++) {
+        g_huff[t].code[g_huff_vals[t][k]] = (uint16_t)code;
+        g_huff[t].size[g_huff_vals[t][k]] = (uint8_t)len;
+        code++;
+        k++;
+      }
+      code <<= 1;
+    }
+  }
+}
+
+/** qomx_swenc_buf_reserve:
+ *
+ *  Arguments:
+ *    @p_buf: buffer
+ *    @extra: number of bytes needed after the valid data
+ *
+ *  Return:
+ *       0 for success, -1 if out of memory
+ *
+ *  Description:
+ *       Grow the buffer so that @extra more bytes fit. The memory is
+ *       kept across frames.
+ *
+ **/
+int qomx_swenc_buf_reserve(qomx_swenc_buf_t *p_buf, size_t extra)
+{
+  size_t size = p_buf->size ? p_buf->size : SWENC_MIN_BUF_SIZE;
+  uint8_t *data;
+
+  if (p_buf->len + extra <= p_buf->size) {
+    return 0;
+  }
+  while (size < p_buf->len + extra) {
+    size *= 2;
+  }
+  data = realloc(p_buf->data, size);
+  if (NULL == data) {
+    ALOGE("%s:%d] cannot grow buffer to %zu", __func__, __LINE__, size);
+    return -1;
+  }
+  p_buf->data = data;
+  p_buf->size = size;
+  return 0;
+}
+
+/** qomx_swenc_buf_release:
+ *
+ *  Arguments:
+ *    @p_buf: buffer
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Free the buffer memory
+ *
+ **/
+void qomx_swenc_buf_release(qomx_swenc_buf_t *p_buf)
+{
+  free(p_buf->data);
+  memset(p_buf, 0, sizeof(*p_buf));
+}
+
+static inline void swenc_put_bits(swenc_bits_t *p_bits, uint32_t code,
+  int size)
+{
+  uint8_t c;
+
+  p_bits->acc = (p_bits->acc << size) | code;
+  p_bits->nbits += size;
+  while (p_bits->nbits >= 8) {
+    c = (uint8_t)(p_bits->acc >> (p_bits->nbits - 8));
+    *p_bits->p++ = c;
+    if (0xFF == c) {
+      *p_bits->p++ = 0;
+    }
+    p_bits->nbits -= 8;
+  }
+}
+
+static inline void swenc_flush_bits(swenc_bits_t *p_bits)
+{
+  if (p_bits->nbits > 0) {
+    swenc_put_bits(p_bits, (1U << (8 - p_bits->nbits)) - 1,
+      8 - p_bits->nbits);
+  }
+  p_bits->acc = 0;
+  p_bits->nbits = 0;
+}
+
+static inline int swenc_num_bits(uint32_t v)
+{
+  return v ? (32 - __builtin_clz(v)) : 0;
+}
+
+/** swenc_fdct_quant:
+ *
+ *  Arguments:
+ *    @p_src: top left sample of the block
+ *    @stride: stride of @p_src
+ *    @p_qdiv: quantizer divisors in zigzag order
+ *    @p_zz: quantized coefficients in zigzag order
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Level shift, transform and quantize one 8x8 block. The
+ *       transform is the accurate integer DCT; its output is scaled
+ *       by 8, which is folded into the divisors.
+ *
+ **/
+static void swenc_fdct_quant(const uint8_t *p_src, uint32_t stride,
+  const int32_t *p_qdiv, int16_t *p_zz)
+{
+  int32_t ws[64];
+  int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  int32_t tmp10, tmp11, tmp12, tmp13;
+  int32_t z1, z2, z3, z4, z5;
+  int32_t *p;
+  int32_t v, q;
+  int i, j;
+
+  for (i = 0; i < 8; i++) {
+    for (j = 0; j < 8; j++) {
+      ws[i * 8 + j] = (int32_t)p_src[j] - 128;
+    }
+    p_src += stride;
+  }
+
+  /* rows */
+  for (i = 0, p = ws; i < 8; i++, p += 8) {
+    tmp0 = p[0] + p[7];
+    tmp7 = p[0] - p[7];
+    tmp1 = p[1] + p[6];
+    tmp6 = p[1] - p[6];
+    tmp2 = p[2] + p[5];
+    tmp5 = p[2] - p[5];
+    tmp3 = p[3] + p[4];
+    tmp4 = p[3] - p[4];
+
+    tmp10 = tmp0 + tmp3;
+    tmp13 = tmp0 - tmp3;
+    tmp11 = tmp1 + tmp2;
+    tmp12 = tmp1 - tmp2;
+
+    p[0] = (tmp10 + tmp11) * (1 << SWENC_PASS1_BITS);
+    p[4] = (tmp10 - tmp11) * (1 << SWENC_PASS1_BITS);
+
+    z1 = (tmp12 + tmp13) * SWENC_FIX_0_541196100;
+    p[2] = SWENC_DESCALE(z1 + tmp13 * SWENC_FIX_0_765366865,
+      SWENC_CONST_BITS - SWENC_PASS1_BITS);
+    p[6] = SWENC_DESCALE(z1 - tmp12 * SWENC_FIX_1_847759065,
+      SWENC_CONST_BITS - SWENC_PASS1_BITS);
+
+    z1 = tmp4 + tmp7;
+    z2 = tmp5 + tmp6;
+    z3 = tmp4 + tmp6;
+    z4 = tmp5 + tmp7;
+    z5 = (z3 + z4) * SWENC_FIX_1_175875602;
+
+    tmp4 *= SWENC_FIX_0_298631336;
+    tmp5 *= SWENC_FIX_2_053119869;
+    tmp6 *= SWENC_FIX_3_072711026;
+    tmp7 *= SWENC_FIX_1_501321110;
+    z1 *= -SWENC_FIX_0_899976223;
+    z2 *= -SWENC_FIX_2_562915447;
+    z3 *= -SWENC_FIX_1_961570560;
+    z4 *= -SWENC_FIX_0_390180644;
+
+    z3 += z5;
+    z4 += z5;
+
+    p[7] = SWENC_DESCALE(tmp4 + z1 + z3, SWENC_CONST_BITS - SWENC_PASS1_BITS);
+    p[5] = SWENC_DESCALE(tmp5 + z2 + z4, SWENC_CONST_BITS - SWENC_PASS1_BITS);
+    p[3] = SWENC_DESCALE(tmp6 + z2 + z3, SWENC_CONST_BITS - SWENC_PASS1_BITS);
+    p[1] = SWENC_DESCALE(tmp7 + z1 + z4, SWENC_CONST_BITS - SWENC_PASS1_BITS);
+  }
+
+  /* columns */
+  for (i = 0, p = ws; i < 8; i++, p++) {
+    tmp0 = p[0] + p[56];
+    tmp7 = p[0] - p[56];
+    tmp1 = p[8] + p[48];
+    tmp6 = p[8] - p[48];
+    tmp2 = p[16] + p[40];
+    tmp5 = p[16] - p[40];
+    tmp3 = p[24] + p[32];
+    tmp4 = p[24] - p[32];
+
+    tmp10 = tmp0 + tmp3;
+    tmp13 = tmp0 - tmp3;
+    tmp11 = tmp1 + tmp2;
+    tmp12 = tmp1 - tmp2;
+
+    p[0] = SWENC_DESCALE(tmp10 + tmp11, SWENC_PASS1_BITS);
+    p[32] = SWENC_DESCALE(tmp10 - tmp11, SWENC_PASS1_BITS);
+
+    z1 = (tmp12 + tmp13) * SWENC_FIX_0_541196100;
+    p[16] = SWENC_DESCALE(z1 + tmp13 * SWENC_FIX_0_765366865,
+      SWENC_CONST_BITS + SWENC_PASS1_BITS);
+    p[48] = SWENC_DESCALE(z1 - tmp12 * SWENC_FIX_1_847759065,
+      SWENC_CONST_BITS + SWENC_PASS1_BITS);
+
+    z1 = tmp4 + tmp7;
+    z2 = tmp5 + tmp6;
+    z3 = tmp4 + tmp6;
+    z4 = tmp5 + tmp7;
+    z5 = (z3 + z4) * SWENC_FIX_1_175875602;
+
+    tmp4 *= SWENC_FIX_0_298631336;
+    tmp5 *= SWENC_FIX_2_053119869;
+    tmp6 *= SWENC_FIX_3_072711026;
+    tmp7 *= SWENC_FIX_1_501321110;
+    z1 *= -SWENC_FIX_0_899976223;
+    z2 *= -SWENC_FIX_2_562915447;
+    z3 *= -SWENC_FIX_1_961570560;
+    z4 *= -SWENC_FIX_0_390180644;
+
+    z3 += z5;
+    z4 += z5;
+
+    p[56] = SWENC_DESCALE(tmp4 + z1 + z3, SWENC_CONST_BITS + SWENC_PASS1_BITS);
+    p[40] = SWENC_DESCALE(tmp5 + z2 + z4, SWENC_CONST_BITS + SWENC_PASS1_BITS);
+    p[24] = SWENC_DESCALE(tmp6 + z2 + z3, SWENC_CONST_BITS + SWENC_PASS1_BITS);
+    p[8] = SWENC_DESCALE(tmp7 + z1 + z4, SWENC_CONST_BITS + SWENC_PASS1_BITS);
+  }
+
+  for (i = 0; i < 64; i++) {
+    v = ws[g_zigzag[i]];
+    q = p_qdiv[i];
+    if (v < 0) {
+      v = -((-v + (q >> 1)) / q);
+    } else {
+      v = (v + (q >> 1)) / q;
+    }
+    p_zz[i] = (int16_t)v;
+  }
+}
+
+/** swenc_encode_block:
+ *
+ *  Arguments:
+ *    @p_bits: entropy coder
+ *    @p_zz: quantized coefficients in zigzag order
+ *    @p_last_dc: DC predictor of the component
+ *    @p_dc: DC code table
+ *    @p_ac: AC code table
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Huffman code one block
+ *
+ **/
+static void swenc_encode_block(swenc_bits_t *p_bits, const int16_t *p_zz,
+  int32_t *p_last_dc, const swenc_huff_t *p_dc, const swenc_huff_t *p_ac)
+{
+  int32_t t, t2;
+  int nbits, run = 0, k, sym;
+
+  t = t2 = p_zz[0] - *p_last_dc;
+  *p_last_dc = p_zz[0];
+  if (t < 0) {
+    t = -t;
+    t2--;
+  }
+  nbits = swenc_num_bits((uint32_t)t);
+  swenc_put_bits(p_bits, p_dc->code[nbits], p_dc->size[nbits]);
+  if (nbits) {
+    swenc_put_bits(p_bits, (uint32_t)t2 & ((1U << nbits) - 1), nbits);
+  }
+
+  for (k = 1; k < 64; k++) {
+    t = p_zz[k];
+    if (0 == t) {
+      run++;
+      continue;
+    }
+    while (run > 15) {
+      swenc_put_bits(p_bits, p_ac->code[0xF0], p_ac->size[0xF0]);
+      run -= 16;
+    }
+    t2 = t;
+    if (t < 0) {
+      t = -t;
+      t2--;
+    }
+    if (t > 1023) {
+      t = 1023;
+      t2 = (t2 < 0) ? -1024 : 1023;
+    }
+    nbits = swenc_num_bits((uint32_t)t);
+    sym = (run << 4) + nbits;
+    swenc_put_bits(p_bits, p_ac->code[sym], p_ac->size[sym]);
+    swenc_put_bits(p_bits, (uint32_t)t2 & ((1U << nbits) - 1), nbits);
+    run = 0;
+  }
+  if (run > 0) {
+    swenc_put_bits(p_bits, p_ac->code[0x00], p_ac->size[0x00]);
+  }
+}
+
+/** swenc_fetch_band:
+ *
+ *  Arguments:
+ *    @p_codec: encoder
+ *    @row: MCU row
+ *    @p_band: sample buffer
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Gather the samples of one MCU row. Crop, scaling and
+ *       rotation are all folded into the offset tables; edges are
+ *       replicated up to the MCU grid.
+ *
+ **/
+static void swenc_fetch_band(qomx_swenc_codec_t *p_codec, uint32_t row,
+  uint8_t *p_band)
+{
+  const qomx_swenc_image_t *p_img = p_codec->img;
+  uint32_t mcu = p_codec->mono ? 8 : 16;
+  uint32_t pw = p_codec->mcus_x * mcu;
+  uint32_t cw = pw / 2;
+  uint32_t ch = (p_codec->height + 1) / 2;
+  uint32_t i, x, oy;
+  const uint8_t *src;
+  uint8_t *dst, *cb, *cr;
+  uint32_t cb_idx = p_img->cr_first ? 1 : 0;
+  uint32_t cr_idx = 1 - cb_idx;
+
+  for (i = 0; i < mcu; i++) {
+    oy = row * mcu + i;
+    if (oy >= p_codec->height) {
+      oy = p_codec->height - 1;
+    }
+    src = p_img->y + p_codec->row_off[oy];
+    dst = p_band + i * pw;
+    if (p_codec->linear_cols) {
+      memcpy(dst, src + p_codec->col_off[0], p_codec->width);
+      memset(dst + p_codec->width, dst[p_codec->width - 1],
+        pw - p_codec->width);
+    } else {
+      for (x = 0; x < pw; x++) {
+        dst[x] = src[p_codec->col_off[x]];
+      }
+    }
+  }
+  if (p_codec->mono) {
+    return;
+  }
+
+  cb = p_band + 16 * pw;
+  cr = cb + 8 * cw;
+  for (i = 0; i < 8; i++) {
+    oy = row * 8 + i;
+    if (oy >= ch) {
+      oy = ch - 1;
+    }
+    src = p_img->cbcr + p_codec->crow_off[oy];
+    for (x = 0; x < cw; x++) {
+      cb[i * cw + x] = src[p_codec->ccol_off[x] + cb_idx];
+      cr[i * cw + x] = src[p_codec->ccol_off[x] + cr_idx];
+    }
+  }
+}
+
+/** swenc_encode_slice:
+ *
+ *  Arguments:
+ *    @p_codec: encoder
+ *    @p_slice: slice to code
+ *
+ *  Return:
+ *       0 for success, -1 on failure or abort
+ *
+ *  Description:
+ *       Code a run of MCU rows. Every MCU row is one restart
+ *       interval, so slices are independent and are concatenated
+ *       as is.
+ *
+ **/
+static int swenc_encode_slice(qomx_swenc_codec_t *p_codec,
+  qomx_swenc_slice_t *p_slice)
+{
+  uint32_t mcu = p_codec->mono ? 8 : 16;
+  uint32_t pw = p_codec->mcus_x * mcu;
+  uint32_t cw = pw / 2;
+  size_t band_size = p_codec->mono ? (8 * pw) : (24 * pw);
+  qomx_swenc_buf_t *p_out = &p_slice->out;
+  const swenc_huff_t *p_huff = g_huff;
+  swenc_bits_t bits;
+  int32_t last_dc[3];
+  int16_t zz[64];
+  uint32_t row, mx;
+  uint8_t *band, *cb, *cr;
+  size_t est;
+
+  p_out->len = 0;
+  if (band_size > p_slice->band_size) {
+    free(p_slice->band);
+    p_slice->band = malloc(band_size);
+    if (NULL == p_slice->band) {
+      p_slice->band_size = 0;
+      ALOGE("%s:%d] cannot allocate band", __func__, __LINE__);
+      return -1;
+    }
+    p_slice->band_size = band_size;
+  }
+  band = p_slice->band;
+  cb = band + 16 * pw;
+  cr = cb + 8 * cw;
+
+  /* one byte per pixel is ample for typical quality settings */
+  est = (size_t)p_slice->num_rows * mcu * pw;
+  if (qomx_swenc_buf_reserve(p_out, est / 2)) {
+    return -1;
+  }
+
+  for (row = p_slice->first_row;
+    row < p_slice->first_row + p_slice->num_rows; row++) {
+    if (*p_codec->abort) {
+      return -1;
+    }
+    swenc_fetch_band(p_codec, row, band);
+
+    if (qomx_swenc_buf_reserve(p_out, 2)) {
+      return -1;
+    }
+    if (row > 0) {
+      p_out->data[p_out->len++] = 0xFF;
+      p_out->data[p_out->len++] = (uint8_t)(0xD0 + ((row - 1) & 7));
+    }
+
+    memset(last_dc, 0, sizeof(last_dc));
+    bits.acc = 0;
+    bits.nbits = 0;
+    for (mx = 0; mx < p_codec->mcus_x; mx++) {
+      if (qomx_swenc_buf_reserve(p_out, SWENC_MAX_MCU_BYTES)) {
+        return -1;
+      }
+      bits.p = p_out->data + p_out->len;
+
+      if (p_codec->mono) {
+        swenc_fdct_quant(band + mx * 8, pw, p_codec->qdiv[0], zz);
+        swenc_encode_block(&bits, zz, &last_dc[0],
+          &p_huff[SWENC_HUFF_DC_LUMA], &p_huff[SWENC_HUFF_AC_LUMA]);
+      } else {
+        swenc_fdct_quant(band + mx * 16, pw, p_codec->qdiv[0], zz);
+        swenc_encode_block(&bits, zz, &last_dc[0],
+          &p_huff[SWENC_HUFF_DC_LUMA], &p_huff[SWENC_HUFF_AC_LUMA]);
+        swenc_fdct_quant(band + mx * 16 + 8, pw, p_codec->qdiv[0], zz);
+        swenc_encode_block(&bits, zz, &last_dc[0],
+          &p_huff[SWENC_HUFF_DC_LUMA], &p_huff[SWENC_HUFF_AC_LUMA]);
+        swenc_fdct_quant(band + 8 * pw + mx * 16, pw, p_codec->qdiv[0], zz);
+        swenc_encode_block(&bits, zz, &last_dc[0],
+          &p_huff[SWENC_HUFF_DC_LUMA], &p_huff[SWENC_HUFF_AC_LUMA]);
+        swenc_fdct_quant(band + 8 * pw + mx * 16 + 8, pw, p_codec->qdiv[0],
+          zz);
+        swenc_encode_block(&bits, zz, &last_dc[0],
+          &p_huff[SWENC_HUFF_DC_LUMA], &p_huff[SWENC_HUFF_AC_LUMA]);
+        swenc_fdct_quant(cb + mx * 8, cw, p_codec->qdiv[1], zz);
+        swenc_encode_block(&bits, zz, &last_dc[1],
+          &p_huff[SWENC_HUFF_DC_CHROMA], &p_huff[SWENC_HUFF_AC_CHROMA]);
+        swenc_fdct_quant(cr + mx * 8, cw, p_codec->qdiv[1], zz);
+        swenc_encode_block(&bits, zz, &last_dc[2],
+          &p_huff[SWENC_HUFF_DC_CHROMA], &p_huff[SWENC_HUFF_AC_CHROMA]);
+      }
+      p_out->len = (size_t)(bits.p - p_out->data);
+    }
+    bits.p = p_out->data + p_out->len;
+    swenc_flush_bits(&bits);
+    p_out->len = (size_t)(bits.p - p_out->data);
+  }
+  return 0;
+}
+
+/** swenc_worker_thread:
+ *
+ *  Arguments:
+ *    @data: slice owned by the thread
+ *
+ *  Return:
+ *       NULL
+ *
+ *  Description:
+ *       Helper thread coding one slice per dispatched frame
+ *
+ **/
+static void *swenc_worker_thread(void *data)
+{
+  qomx_swenc_slice_t *p_slice = (qomx_swenc_slice_t *)data;
+  qomx_swenc_codec_t *p_codec = p_slice->codec;
+  /* generation starts at 0, a thread started late still sees frame 1 */
+  uint32_t seen = 0;
+
+  pthread_mutex_lock(&p_codec->lock);
+  while (1) {
+    while (!p_codec->exit && (seen == p_codec->generation)) {
+      pthread_cond_wait(&p_codec->work_cond, &p_codec->lock);
+    }
+    if (p_codec->exit) {
+      break;
+    }
+    seen = p_codec->generation;
+    if (p_slice->idx < p_codec->num_slices) {
+      pthread_mutex_unlock(&p_codec->lock);
+      p_slice->rc = swenc_encode_slice(p_codec, p_slice);
+      pthread_mutex_lock(&p_codec->lock);
+    }
+    if (0 == --p_codec->pending) {
+      pthread_cond_signal(&p_codec->done_cond);
+    }
+  }
+  pthread_mutex_unlock(&p_codec->lock);
+  return NULL;
+}
+
+/** qomx_swenc_codec_init:
+ *
+ *  Arguments:
+ *    @p_codec: encoder
+ *    @num_threads: threads to use per frame including the caller
+ *
+ *  Return:
+ *       0 for success, -1 on failure
+ *
+ *  Description:
+ *       Initialize the encoder and start its helper threads
+ *
+ **/
+int qomx_swenc_codec_init(qomx_swenc_codec_t *p_codec, uint32_t num_threads)
+{
+  uint32_t i;
+
+  pthread_once(&g_huff_once, swenc_build_huff_tables);
+
+  memset(p_codec, 0, sizeof(*p_codec));
+  if (num_threads < 1) {
+    num_threads = 1;
+  } else if (num_threads > QOMX_SWENC_MAX_THREADS) {
+    num_threads = QOMX_SWENC_MAX_THREADS;
+  }
+  pthread_mutex_init(&p_codec->lock, NULL);
+  pthread_cond_init(&p_codec->work_cond, NULL);
+  pthread_cond_init(&p_codec->done_cond, NULL);
+
+  for (i = 0; i < QOMX_SWENC_MAX_THREADS; i++) {
+    p_codec->slices[i].codec = p_codec;
+    p_codec->slices[i].idx = i;
+  }
+  p_codec->num_threads = 1;
+  for (i = 1; i < num_threads; i++) {
+    if (pthread_create(&p_codec->pid[i - 1], NULL, swenc_worker_thread,
+      &p_codec->slices[i])) {
+      ALOGE("%s:%d] cannot start worker %d", __func__, __LINE__, i);
+      break;
+    }
+    p_codec->num_threads++;
+  }
+  ALOGI("%s:%d] %d threads", __func__, __LINE__, p_codec->num_threads);
+  return 0;
+}
+
+/** qomx_swenc_codec_deinit:
+ *
+ *  Arguments:
+ *    @p_codec: encoder
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Stop the helper threads and free the encoder memory
+ *
+ **/
+void qomx_swenc_codec_deinit(qomx_swenc_codec_t *p_codec)
+{
+  uint32_t i;
+
+  pthread_mutex_lock(&p_codec->lock);
+  p_codec->exit = 1;
+  pthread_cond_broadcast(&p_codec->work_cond);
+  pthread_mutex_unlock(&p_codec->lock);
+  for (i = 1; i < p_codec->num_threads; i++) {
+    pthread_join(p_codec->pid[i - 1], NULL);
+  }
+
+  for (i = 0; i < QOMX_SWENC_MAX_THREADS; i++) {
+    qomx_swenc_buf_release(&p_codec->slices[i].out);
+    free(p_codec->slices[i].band);
+  }
+  free(p_codec->row_off);
+  pthread_cond_destroy(&p_codec->work_cond);
+  pthread_cond_destroy(&p_codec->done_cond);
+  pthread_mutex_destroy(&p_codec->lock);
+  memset(p_codec, 0, sizeof(*p_codec));
+}
+
+/** swenc_axis_offset:
+ *
+ *  Arguments:
+ *    @p_img: image
+ *    @src_y: the output axis runs along the source rows
+ *    @reverse: the output axis runs backwards
+ *    @o: output coordinate
+ *    @chroma: return a chroma plane offset
+ *
+ *  Return:
+ *       contribution of the coordinate to the source offset
+ *
+ *  Description:
+ *       Map an output coordinate through rotation, scaling and crop
+ *
+ **/
+static uint32_t swenc_axis_offset(const qomx_swenc_image_t *p_img,
+  int src_y, int reverse, uint32_t o, int chroma)
+{
+  uint32_t len = src_y ? p_img->scaled_h : p_img->scaled_w;
+  uint32_t start = src_y ? p_img->crop_y : p_img->crop_x;
+  uint32_t span = src_y ? p_img->crop_h : p_img->crop_w;
+  uint32_t u = reverse ? (len - 1 - o) : o;
+  uint32_t s = start + (uint32_t)(((uint64_t)u * span + span / 2) / len);
+
+  if (s >= start + span) {
+    s = start + span - 1;
+  }
+  if (src_y) {
+    return chroma ? (s >> p_img->v_shift) * p_img->cbcr_stride :
+      s * p_img->stride;
+  }
+  return chroma ? (s >> p_img->h_shift) * 2 : s;
+}
+
+/** swenc_setup_frame:
+ *
+ *  Arguments:
+ *    @p_codec: encoder
+ *    @p_img: image
+ *
+ *  Return:
+ *       0 for success, -1 on failure
+ *
+ *  Description:
+ *       Compute the frame geometry, quantizers and offset tables
+ *
+ **/
+static int swenc_setup_frame(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_image_t *p_img)
+{
+  uint32_t mcu, pw, ph, i, t, o;
+  uint32_t quality, scale, val;
+  int row_y, row_rev, col_y, col_rev;
+  size_t need;
+
+  switch (p_img->rotation) {
+  case 0:
+    row_y = 1; row_rev = 0; col_y = 0; col_rev = 0;
+    break;
+  case 90:
+    row_y = 0; row_rev = 0; col_y = 1; col_rev = 1;
+    break;
+  case 180:
+    row_y = 1; row_rev = 1; col_y = 0; col_rev = 1;
+    break;
+  case 270:
+    row_y = 0; row_rev = 1; col_y = 1; col_rev = 0;
+    break;
+  default:
+    ALOGE("%s:%d] invalid rotation %d", __func__, __LINE__,
+      p_img->rotation);
+    return -1;
+  }
+
+  if (!p_img->scaled_w || !p_img->scaled_h || !p_img->crop_w ||
+    !p_img->crop_h || (NULL == p_img->y)) {
+    ALOGE("%s:%d] invalid image", __func__, __LINE__);
+    return -1;
+  }
+
+  p_codec->mono = (NULL == p_img->cbcr);
+  p_codec->width = row_y ? p_img->scaled_w : p_img->scaled_h;
+  p_codec->height = row_y ? p_img->scaled_h : p_img->scaled_w;
+  mcu = p_codec->mono ? 8 : 16;
+  p_codec->mcus_x = (p_codec->width + mcu - 1) / mcu;
+  p_codec->mcus_y = (p_codec->height + mcu - 1) / mcu;
+  if ((p_codec->width > 65535) || (p_codec->height > 65535) ||
+    (p_codec->mcus_x > 65535)) {
+    ALOGE("%s:%d] image too large %dx%d", __func__, __LINE__,
+      p_codec->width, p_codec->height);
+    return -1;
+  }
+  pw = p_codec->mcus_x * mcu;
+  ph = p_codec->mcus_y * mcu;
+
+  /* quantizers */
+  quality = p_img->quality;
+  if (quality < 1) {
+    quality = 1;
+  } else if (quality > 100) {
+    quality = 100;
+  }
+  scale = (quality < 50) ? (5000 / quality) : (200 - quality * 2);
+  for (t = 0; t < 2; t++) {
+    for (i = 0; i < 64; i++) {
+      if (NULL != p_img->qtable[t]) {
+        val = p_img->qtable[t][i];
+      } else {
+        val = (g_std_qtable[t][i] * scale + 50) / 100;
+      }
+      if (val < 1) {
+        val = 1;
+      } else if (val > 255) {
+        val = 255;
+      }
+      p_codec->qtable[t][i] = (uint8_t)val;
+    }
+    for (i = 0; i < 64; i++) {
+      p_codec->qdiv[t][i] = (int32_t)p_codec->qtable[t][g_zigzag[i]] * 8;
+    }
+  }
+
+  /* offset tables */
+  need = (ph > pw) ? ph : pw;
+  if (need > p_codec->tab_size) {
+    free(p_codec->row_off);
+    p_codec->row_off = malloc(4 * need * sizeof(uint32_t));
+    if (NULL == p_codec->row_off) {
+      p_codec->tab_size = 0;
+      ALOGE("%s:%d] cannot allocate tables", __func__, __LINE__);
+      return -1;
+    }
+    p_codec->tab_size = need;
+  }
+  p_codec->col_off = p_codec->row_off + p_codec->tab_size;
+  p_codec->crow_off = p_codec->col_off + p_codec->tab_size;
+  p_codec->ccol_off = p_codec->crow_off + p_codec->tab_size;
+
+  for (i = 0; i < p_codec->height; i++) {
+    p_codec->row_off[i] = swenc_axis_offset(p_img, row_y, row_rev, i, 0);
+  }
+  for (i = 0; i < pw; i++) {
+    o = (i < p_codec->width) ? i : (p_codec->width - 1);
+    p_codec->col_off[i] = swenc_axis_offset(p_img, col_y, col_rev, o, 0);
+  }
+  p_codec->linear_cols = (0 == p_img->rotation) &&
+    (p_img->scaled_w == p_img->crop_w);
+
+  if (!p_codec->mono) {
+    for (i = 0; i < (p_codec->height + 1) / 2; i++) {
+      o = (2 * i < p_codec->height) ? (2 * i) : (p_codec->height - 1);
+      p_codec->crow_off[i] = swenc_axis_offset(p_img, row_y, row_rev, o, 1);
+    }
+    for (i = 0; i < pw / 2; i++) {
+      o = (2 * i < p_codec->width) ? (2 * i) : (p_codec->width - 1);
+      p_codec->ccol_off[i] = swenc_axis_offset(p_img, col_y, col_rev, o, 1);
+    }
+  }
+  return 0;
+}
+
+static inline void swenc_put16(qomx_swenc_buf_t *p_out, uint32_t v)
+{
+  p_out->data[p_out->len++] = (uint8_t)(v >> 8);
+  p_out->data[p_out->len++] = (uint8_t)v;
+}
+
+/** swenc_write_headers:
+ *
+ *  Arguments:
+ *    @p_codec: encoder
+ *    @p_app1: exif segment or NULL
+ *    @p_out: output bitstream
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Write the markers preceding the entropy coded data. Space
+ *       must have been reserved by the caller.
+ *
+ **/
+static void swenc_write_headers(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_buf_t *p_app1, qomx_swenc_buf_t *p_out)
+{
+  static const uint8_t jfif[] = {
+    0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00,
+    0x00, 0x01, 0x00, 0x01, 0x00, 0x00
+  };
+  uint32_t ncomp = p_codec->mono ? 1 : 3;
+  uint32_t ntab = p_codec->mono ? 1 : 2;
+  uint32_t t, i, len;
+
+  swenc_put16(p_out, 0xFFD8);
+  if ((NULL != p_app1) && p_app1->len) {
+    memcpy(p_out->data + p_out->len, p_app1->data, p_app1->len);
+    p_out->len += p_app1->len;
+  } else if (NULL == p_app1) {
+    /* bare stream, used for exif thumbnails */
+  } else {
+    memcpy(p_out->data + p_out->len, jfif, sizeof(jfif));
+    p_out->len += sizeof(jfif);
+  }
+
+  swenc_put16(p_out, 0xFFDB);
+  swenc_put16(p_out, 2 + 65 * ntab);
+  for (t = 0; t < ntab; t++) {
+    p_out->data[p_out->len++] = (uint8_t)t;
+    for (i = 0; i < 64; i++) {
+      p_out->data[p_out->len++] = p_codec->qtable[t][g_zigzag[i]];
+    }
+  }
+
+  swenc_put16(p_out, 0xFFC0);
+  swenc_put16(p_out, 8 + 3 * ncomp);
+  p_out->data[p_out->len++] = 8;
+  swenc_put16(p_out, p_codec->height);
+  swenc_put16(p_out, p_codec->width);
+  p_out->data[p_out->len++] = (uint8_t)ncomp;
+  for (i = 0; i < ncomp; i++) {
+    p_out->data[p_out->len++] = (uint8_t)(i + 1);
+    p_out->data[p_out->len++] = (p_codec->mono || i) ? 0x11 : 0x22;
+    p_out->data[p_out->len++] = i ? 1 : 0;
+  }
+
+  swenc_put16(p_out, 0xFFC4);
+  len = 2;
+  for (t = 0; t < 2 * ntab; t++) {
+    len += 17 + ((t & 1) ? 162 : 12);
+  }
+  swenc_put16(p_out, len);
+  for (t = 0; t < 2 * ntab; t++) {
+    p_out->data[p_out->len++] = (uint8_t)(((t & 1) << 4) | (t >> 1));
+    memcpy(p_out->data + p_out->len, g_huff_bits[t], 16);
+    p_out->len += 16;
+    memcpy(p_out->data + p_out->len, g_huff_vals[t], (t & 1) ? 162 : 12);
+    p_out->len += (t & 1) ? 162 : 12;
+  }
+
+  if (p_codec->mcus_y > 1) {
+    swenc_put16(p_out, 0xFFDD);
+    swenc_put16(p_out, 4);
+    swenc_put16(p_out, p_codec->mcus_x);
+  }
+
+  swenc_put16(p_out, 0xFFDA);
+  swenc_put16(p_out, 6 + 2 * ncomp);
+  p_out->data[p_out->len++] = (uint8_t)ncomp;
+  for (i = 0; i < ncomp; i++) {
+    p_out->data[p_out->len++] = (uint8_t)(i + 1);
+    p_out->data[p_out->len++] = i ? 0x11 : 0x00;
+  }
+  p_out->data[p_out->len++] = 0;
+  p_out->data[p_out->len++] = 63;
+  p_out->data[p_out->len++] = 0;
+}
+
+/** qomx_swenc_codec_code:
+ *
+ *  Arguments:
+ *    @p_codec: encoder
+ *    @p_img: image to encode
+ *    @p_abort: checked between MCU rows
+ *
+ *  Return:
+ *       0 for success, -1 on failure or abort
+ *
+ *  Description:
+ *       Entropy code an image. The MCU rows are split into one
+ *       slice per thread and coded in parallel. The slices are kept
+ *       in the encoder until qomx_swenc_codec_assemble.
+ *
+ **/
+int qomx_swenc_codec_code(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_image_t *p_img, volatile int *p_abort)
+{
+  uint32_t i, rows, first = 0;
+
+  if (swenc_setup_frame(p_codec, p_img)) {
+    return -1;
+  }
+
+  p_codec->num_slices = p_codec->num_threads;
+  if (p_codec->num_slices > p_codec->mcus_y) {
+    p_codec->num_slices = p_codec->mcus_y;
+  }
+  for (i = 0; i < p_codec->num_slices; i++) {
+    rows = p_codec->mcus_y / p_codec->num_slices +
+      ((i < p_codec->mcus_y % p_codec->num_slices) ? 1 : 0);
+    p_codec->slices[i].first_row = first;
+    p_codec->slices[i].num_rows = rows;
+    p_codec->slices[i].rc = 0;
+    first += rows;
+  }
+  p_codec->img = p_img;
+  p_codec->abort = p_abort;
+
+  if (p_codec->num_threads > 1) {
+    pthread_mutex_lock(&p_codec->lock);
+    p_codec->generation++;
+    p_codec->pending = p_codec->num_threads - 1;
+    pthread_cond_broadcast(&p_codec->work_cond);
+    pthread_mutex_unlock(&p_codec->lock);
+  }
+
+  p_codec->slices[0].rc = swenc_encode_slice(p_codec, &p_codec->slices[0]);
+
+  if (p_codec->num_threads > 1) {
+    pthread_mutex_lock(&p_codec->lock);
+    while (p_codec->pending) {
+      pthread_cond_wait(&p_codec->done_cond, &p_codec->lock);
+    }
+    pthread_mutex_unlock(&p_codec->lock);
+  }
+
+  for (i = 0; i < p_codec->num_slices; i++) {
+    if (p_codec->slices[i].rc) {
+      ALOGE("%s:%d] encode failed, abort %d", __func__, __LINE__, *p_abort);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/** qomx_swenc_codec_headers:
+ *
+ *  Arguments:
+ *    @p_codec: encoder holding the slices of a coded image
+ *    @p_app1: application segment to embed. An empty buffer selects
+ *            a JFIF header, NULL writes no application segment.
+ *    @p_out: output bitstream
+ *
+ *  Return:
+ *       0 for success, -1 if out of memory
+ *
+ *  Description:
+ *       Write the markers preceding the entropy coded data of the
+ *       last image coded by qomx_swenc_codec_code. The application
+ *       segment is only needed here, so it can be built while the
+ *       image is being coded.
+ *
+ **/
+int qomx_swenc_codec_headers(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_buf_t *p_app1, qomx_swenc_buf_t *p_out)
+{
+  size_t total = SWENC_MAX_HDR_BYTES + 2;
+
+  if (NULL != p_app1) {
+    total += p_app1->len;
+  }
+  p_out->len = 0;
+  if (qomx_swenc_buf_reserve(p_out, total)) {
+    return -1;
+  }
+  swenc_write_headers(p_codec, p_app1, p_out);
+  return 0;
+}
+
+/** qomx_swenc_codec_scan_size:
+ *
+ *  Arguments:
+ *    @p_codec: encoder holding the slices of a coded image
+ *
+ *  Return:
+ *       size of the entropy coded data including the EOI marker
+ *
+ *  Description:
+ *       Size needed by qomx_swenc_codec_write_scan
+ *
+ **/
+size_t qomx_swenc_codec_scan_size(qomx_swenc_codec_t *p_codec)
+{
+  size_t total = 2;
+  uint32_t i;
+
+  for (i = 0; i < p_codec->num_slices; i++) {
+    total += p_codec->slices[i].out.len;
+  }
+  return total;
+}
+
+/** qomx_swenc_codec_write_scan:
+ *
+ *  Arguments:
+ *    @p_codec: encoder holding the slices of a coded image
+ *    @p_dst: destination of qomx_swenc_codec_scan_size bytes
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Write the coded slices and the EOI marker. The destination
+ *       can be the client buffer, which saves copying the whole
+ *       bitstream once more.
+ *
+ **/
+void qomx_swenc_codec_write_scan(qomx_swenc_codec_t *p_codec, uint8_t *p_dst)
+{
+  uint32_t i;
+
+  for (i = 0; i < p_codec->num_slices; i++) {
+    memcpy(p_dst, p_codec->slices[i].out.data, p_codec->slices[i].out.len);
+    p_dst += p_codec->slices[i].out.len;
+  }
+  p_dst[0] = 0xFF;
+  p_dst[1] = 0xD9;
+}
+
+/** qomx_swenc_codec_assemble:
+ *
+ *  Arguments:
+ *    @p_codec: encoder holding the slices of a coded image
+ *    @p_app1: application segment, see qomx_swenc_codec_headers
+ *    @p_out: output bitstream
+ *
+ *  Return:
+ *       0 for success, -1 if out of memory
+ *
+ *  Description:
+ *       Write the complete bitstream of the last coded image
+ *
+ **/
+int qomx_swenc_codec_assemble(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_buf_t *p_app1, qomx_swenc_buf_t *p_out)
+{
+  size_t scan_size = qomx_swenc_codec_scan_size(p_codec);
+
+  if (qomx_swenc_codec_headers(p_codec, p_app1, p_out) ||
+    qomx_swenc_buf_reserve(p_out, scan_size)) {
+    return -1;
+  }
+  qomx_swenc_codec_write_scan(p_codec, p_out->data + p_out->len);
+  p_out->len += scan_size;
+  return 0;
+}
+
+/** qomx_swenc_codec_encode:
+ *
+ *  Arguments:
+ *    @p_codec: encoder
+ *    @p_img: image to encode
+ *    @p_app1: application segment to embed, see
+ *            qomx_swenc_codec_assemble
+ *    @p_out: output bitstream
+ *    @p_abort: checked between MCU rows
+ *
+ *  Return:
+ *       0 for success, -1 on failure or abort
+ *
+ *  Description:
+ *       Encode a baseline JPEG
+ *
+ **/
+int qomx_swenc_codec_encode(qomx_swenc_codec_t *p_codec,
+  const qomx_swenc_image_t *p_img, const qomx_swenc_buf_t *p_app1,
+  qomx_swenc_buf_t *p_out, volatile int *p_abort)
+{
+  if (qomx_swenc_codec_code(p_codec, p_img, p_abort)) {
+    return -1;
+  }
+  return qomx_swenc_codec_assemble(p_codec, p_app1, p_out);
+}
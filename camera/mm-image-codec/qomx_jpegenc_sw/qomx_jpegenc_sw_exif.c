@@ -0,0 +1,480 @@
+/*Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#define LOG_TAG "qomx_jpegenc_sw"
+#include <utils/Log.h>
+
+#include "qomx_jpegenc_sw.h"
+
+#define SWENC_EXIF_OFFSET(id) (((id) >> 16) & 0xFFFF)
+#define SWENC_EXIF_TAG(id) ((id) & 0xFFFF)
+
+#define SWENC_TAG_COMPRESSION 0x0103
+#define SWENC_TAG_JPEG_IF 0x0201
+#define SWENC_TAG_JPEG_IF_LEN 0x0202
+#define SWENC_TAG_EXIF_IFD 0x8769
+#define SWENC_TAG_GPS_IFD 0x8825
+
+/* "Exif\0\0" header plus the TIFF header */
+#define SWENC_EXIF_HDR_SIZE 6
+#define SWENC_TIFF_HDR_SIZE 8
+#define SWENC_APP1_MAX_LEN 0xFFFF
+
+enum {
+  SWENC_IFD_0,
+  SWENC_IFD_EXIF,
+  SWENC_IFD_GPS,
+  SWENC_IFD_1,
+  SWENC_IFD_MAX
+};
+
+/** swenc_exif_entry_t: one directory entry
+*    @tag: TIFF tag number
+*    @type: exif data type
+*    @count: number of values
+*    @data: values, NULL if the value is @value
+*    @value: LONG value of generated entries
+**/
+typedef struct {
+  uint16_t tag;
+  uint16_t type;
+  uint32_t count;
+  const void *data;
+  uint32_t value;
+} swenc_exif_entry_t;
+
+/** swenc_exif_ifd_t: one image file directory
+*    @entries: directory entries
+*    @num: number of entries
+*    @offset: offset from the TIFF header
+*    @size: size of the directory and its values
+**/
+typedef struct {
+  swenc_exif_entry_t entries[QOMX_SWENC_MAX_EXIF + 3];
+  uint32_t num;
+  uint32_t offset;
+  uint32_t size;
+} swenc_exif_ifd_t;
+
+static uint32_t swenc_exif_type_size(uint32_t type)
+{
+  switch (type) {
+  case EXIF_SHORT:
+    return 2;
+  case EXIF_LONG:
+  case EXIF_SLONG:
+    return 4;
+  case EXIF_RATIONAL:
+  case EXIF_SRATIONAL:
+    return 8;
+  default:
+    return 1;
+  }
+}
+
+/** swenc_exif_classify:
+ *
+ *  Arguments:
+ *    @tag_id: exif tag id
+ *
+ *  Return:
+ *       directory of the tag, -1 if the tag is generated here
+ *
+ *  Description:
+ *       Find the directory a tag belongs to from its offset
+ *
+ **/
+static int swenc_exif_classify(exif_tag_id_t tag_id)
+{
+  uint32_t offset = SWENC_EXIF_OFFSET(tag_id);
+
+  if (offset < NEW_SUBFILE_TYPE) {
+    return SWENC_IFD_GPS;
+  }
+  if (offset < TN_IMAGE_WIDTH) {
+    if ((JPEG_INTERCHANGE_FORMAT == offset) ||
+      (JPEG_INTERCHANGE_FORMAT_LENGTH == offset) ||
+      (EXIF_IFD == offset) || (GPS_IFD == offset)) {
+      return -1;
+    }
+    return SWENC_IFD_0;
+  }
+  if (offset < EXPOSURE_TIME) {
+    /* the thumbnail directory describes our own thumbnail */
+    return -1;
+  }
+  if (INTEROP == offset) {
+    return -1;
+  }
+  return SWENC_IFD_EXIF;
+}
+
+/** swenc_exif_data:
+ *
+ *  Arguments:
+ *    @p_entry: exif tag
+ *
+ *  Return:
+ *       address of the tag values
+ *
+ *  Description:
+ *       Single values are stored in place, others by reference
+ *
+ **/
+static const void *swenc_exif_data(const exif_tag_entry_t *p_entry)
+{
+  int single = (1 == p_entry->count);
+
+  switch (p_entry->type) {
+  case EXIF_BYTE:
+    return single ? (const void *)&p_entry->data._byte :
+      (const void *)p_entry->data._bytes;
+  case EXIF_ASCII:
+    return p_entry->data._ascii;
+  case EXIF_SHORT:
+    return single ? (const void *)&p_entry->data._short :
+      (const void *)p_entry->data._shorts;
+  case EXIF_LONG:
+    return single ? (const void *)&p_entry->data._long :
+      (const void *)p_entry->data._longs;
+  case EXIF_RATIONAL:
+    return single ? (const void *)&p_entry->data._rat :
+      (const void *)p_entry->data._rats;
+  case EXIF_UNDEFINED:
+    return p_entry->data._undefined;
+  case EXIF_SLONG:
+    return single ? (const void *)&p_entry->data._slong :
+      (const void *)p_entry->data._slongs;
+  case EXIF_SRATIONAL:
+    return single ? (const void *)&p_entry->data._srat :
+      (const void *)p_entry->data._srats;
+  default:
+    return NULL;
+  }
+}
+
+static inline void swenc_le16(uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void swenc_le32(uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+/** swenc_exif_add:
+ *
+ *  Arguments:
+ *    @p_ifd: directory
+ *    @tag: TIFF tag number
+ *    @type: data type
+ *    @count: number of values
+ *    @data: values, NULL to use @value
+ *    @value: LONG value
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Insert an entry keeping the directory sorted by tag. A tag
+ *       set twice keeps the later value.
+ *
+ **/
+static void swenc_exif_add(swenc_exif_ifd_t *p_ifd, uint16_t tag,
+  uint16_t type, uint32_t count, const void *data, uint32_t value)
+{
+  swenc_exif_entry_t *p_entry;
+  uint32_t i = p_ifd->num;
+
+  while ((i > 0) && (p_ifd->entries[i - 1].tag > tag)) {
+    i--;
+  }
+  if ((i > 0) && (p_ifd->entries[i - 1].tag == tag)) {
+    p_entry = &p_ifd->entries[i - 1];
+  } else {
+    if (p_ifd->num >= QOMX_SWENC_MAX_EXIF + 3) {
+      return;
+    }
+    memmove(&p_ifd->entries[i + 1], &p_ifd->entries[i],
+      (p_ifd->num - i) * sizeof(p_ifd->entries[0]));
+    p_ifd->num++;
+    p_entry = &p_ifd->entries[i];
+  }
+  p_entry->tag = tag;
+  p_entry->type = type;
+  p_entry->count = count;
+  p_entry->data = data;
+  p_entry->value = value;
+}
+
+static uint32_t swenc_exif_ifd_size(const swenc_exif_ifd_t *p_ifd)
+{
+  uint32_t i, size = 2 + 12 * p_ifd->num + 4;
+  uint32_t len;
+
+  for (i = 0; i < p_ifd->num; i++) {
+    len = p_ifd->entries[i].count *
+      swenc_exif_type_size(p_ifd->entries[i].type);
+    if (len > 4) {
+      size += (len + 1) & ~1U;
+    }
+  }
+  return size;
+}
+
+/** swenc_exif_put_values:
+ *
+ *  Arguments:
+ *    @p_dst: destination
+ *    @p_entry: directory entry
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Write the values of an entry in little endian order
+ *
+ **/
+static void swenc_exif_put_values(uint8_t *p_dst,
+  const swenc_exif_entry_t *p_entry)
+{
+  const uint8_t *src = (const uint8_t *)p_entry->data;
+  uint32_t i;
+
+  if (NULL == src) {
+    swenc_le32(p_dst, p_entry->value);
+    return;
+  }
+  switch (p_entry->type) {
+  case EXIF_SHORT:
+    for (i = 0; i < p_entry->count; i++) {
+      swenc_le16(p_dst + 2 * i, ((const uint16_t *)src)[i]);
+    }
+    break;
+  case EXIF_LONG:
+  case EXIF_SLONG:
+  case EXIF_RATIONAL:
+  case EXIF_SRATIONAL:
+    for (i = 0; i < p_entry->count *
+      (swenc_exif_type_size(p_entry->type) / 4); i++) {
+      swenc_le32(p_dst + 4 * i, ((const uint32_t *)src)[i]);
+    }
+    break;
+  default:
+    memcpy(p_dst, src, p_entry->count);
+    break;
+  }
+}
+
+/** swenc_exif_write_ifd:
+ *
+ *  Arguments:
+ *    @p_tiff: TIFF header address
+ *    @p_ifd: directory
+ *    @next: offset of the next directory, 0 if none
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Write a directory followed by the values that do not fit
+ *       in the entries
+ *
+ **/
+static void swenc_exif_write_ifd(uint8_t *p_tiff,
+  const swenc_exif_ifd_t *p_ifd, uint32_t next)
+{
+  const swenc_exif_entry_t *p_entry;
+  uint8_t *p = p_tiff + p_ifd->offset;
+  uint32_t data_off = p_ifd->offset + 2 + 12 * p_ifd->num + 4;
+  uint32_t i, len;
+
+  swenc_le16(p, p_ifd->num);
+  p += 2;
+  for (i = 0; i < p_ifd->num; i++, p += 12) {
+    p_entry = &p_ifd->entries[i];
+    len = p_entry->count * swenc_exif_type_size(p_entry->type);
+    swenc_le16(p, p_entry->tag);
+    swenc_le16(p + 2, p_entry->type);
+    swenc_le32(p + 4, p_entry->count);
+    if (len <= 4) {
+      memset(p + 8, 0, 4);
+      swenc_exif_put_values(p + 8, p_entry);
+    } else {
+      swenc_le32(p + 8, data_off);
+      swenc_exif_put_values(p_tiff + data_off, p_entry);
+      if (len & 1) {
+        p_tiff[data_off + len] = 0;
+      }
+      data_off += (len + 1) & ~1U;
+    }
+  }
+  swenc_le32(p, next);
+}
+
+/** qomx_swenc_exif_build:
+ *
+ *  Arguments:
+ *    @p_app1: output APP1 segment
+ *    @p_exif: exif tags of the job
+ *    @num_exif: number of tags
+ *    @p_thumb: encoded thumbnail or NULL
+ *    @p_thumb_added: set if the thumbnail was embedded
+ *
+ *  Return:
+ *       0 for success, -1 on failure
+ *
+ *  Description:
+ *       Build the exif APP1 segment. The thumbnail is dropped if
+ *       the segment would exceed the marker size limit.
+ *
+ **/
+int qomx_swenc_exif_build(qomx_swenc_buf_t *p_app1,
+  const QEXIF_INFO_DATA *p_exif, uint32_t num_exif,
+  const qomx_swenc_buf_t *p_thumb, int *p_thumb_added)
+{
+  swenc_exif_ifd_t ifd[SWENC_IFD_MAX];
+  const exif_tag_entry_t *p_entry;
+  uint32_t i, tiff_len, seg_len;
+  int has_thumb = (NULL != p_thumb) && (p_thumb->len > 0);
+  int idx;
+  uint8_t *p;
+
+  *p_thumb_added = 0;
+  for (i = 0; i < SWENC_IFD_MAX; i++) {
+    ifd[i].num = 0;
+  }
+
+  for (i = 0; i < num_exif; i++) {
+    p_entry = &p_exif[i].tag_entry;
+    idx = swenc_exif_classify(p_exif[i].tag_id);
+    if ((idx < 0) || (0 == p_entry->count) ||
+      (NULL == swenc_exif_data(p_entry))) {
+      continue;
+    }
+    swenc_exif_add(&ifd[idx], (uint16_t)SWENC_EXIF_TAG(p_exif[i].tag_id),
+      (uint16_t)p_entry->type, p_entry->count, swenc_exif_data(p_entry), 0);
+  }
+  if (ifd[SWENC_IFD_EXIF].num) {
+    swenc_exif_add(&ifd[SWENC_IFD_0], SWENC_TAG_EXIF_IFD, EXIF_LONG, 1,
+      NULL, 0);
+  }
+  if (ifd[SWENC_IFD_GPS].num) {
+    swenc_exif_add(&ifd[SWENC_IFD_0], SWENC_TAG_GPS_IFD, EXIF_LONG, 1,
+      NULL, 0);
+  }
+
+  while (1) {
+    ifd[SWENC_IFD_1].num = 0;
+    if (has_thumb) {
+      swenc_exif_add(&ifd[SWENC_IFD_1], SWENC_TAG_COMPRESSION, EXIF_SHORT, 1,
+        NULL, 6);
+      swenc_exif_add(&ifd[SWENC_IFD_1], SWENC_TAG_JPEG_IF, EXIF_LONG, 1,
+        NULL, 0);
+      swenc_exif_add(&ifd[SWENC_IFD_1], SWENC_TAG_JPEG_IF_LEN, EXIF_LONG, 1,
+        NULL, (uint32_t)p_thumb->len);
+    }
+
+    tiff_len = SWENC_TIFF_HDR_SIZE;
+    for (i = 0; i < SWENC_IFD_MAX; i++) {
+      ifd[i].offset = tiff_len;
+      ifd[i].size = 0;
+      if (ifd[i].num || (SWENC_IFD_0 == i)) {
+        ifd[i].size = swenc_exif_ifd_size(&ifd[i]);
+      }
+      tiff_len += ifd[i].size;
+    }
+    if (has_thumb) {
+      tiff_len += (uint32_t)p_thumb->len;
+    }
+    seg_len = 2 + SWENC_EXIF_HDR_SIZE + tiff_len;
+    if (seg_len <= SWENC_APP1_MAX_LEN) {
+      break;
+    }
+    if (!has_thumb) {
+      ALOGE("%s:%d] exif too large %d", __func__, __LINE__, seg_len);
+      return -1;
+    }
+    ALOGE("%s:%d] thumbnail of %zu bytes dropped", __func__, __LINE__,
+      p_thumb->len);
+    has_thumb = 0;
+  }
+
+  /* patch the directory pointers now that the layout is known */
+  for (i = 0; i < ifd[SWENC_IFD_0].num; i++) {
+    if (SWENC_TAG_EXIF_IFD == ifd[SWENC_IFD_0].entries[i].tag) {
+      ifd[SWENC_IFD_0].entries[i].value = ifd[SWENC_IFD_EXIF].offset;
+    } else if (SWENC_TAG_GPS_IFD == ifd[SWENC_IFD_0].entries[i].tag) {
+      ifd[SWENC_IFD_0].entries[i].value = ifd[SWENC_IFD_GPS].offset;
+    }
+  }
+  if (has_thumb) {
+    /* Compression, JPEGInterchangeFormat, JPEGInterchangeFormatLength */
+    ifd[SWENC_IFD_1].entries[1].value = ifd[SWENC_IFD_1].offset +
+      ifd[SWENC_IFD_1].size;
+  }
+
+  p_app1->len = 0;
+  if (qomx_swenc_buf_reserve(p_app1, 2 + seg_len)) {
+    return -1;
+  }
+  p = p_app1->data;
+  p[0] = 0xFF;
+  p[1] = 0xE1;
+  p[2] = (uint8_t)(seg_len >> 8);
+  p[3] = (uint8_t)seg_len;
+  memcpy(p + 4, "Exif\0\0", SWENC_EXIF_HDR_SIZE);
+  p += 4 + SWENC_EXIF_HDR_SIZE;
+
+  p[0] = 'I';
+  p[1] = 'I';
+  swenc_le16(p + 2, 42);
+  swenc_le32(p + 4, ifd[SWENC_IFD_0].offset);
+
+  swenc_exif_write_ifd(p, &ifd[SWENC_IFD_0],
+    has_thumb ? ifd[SWENC_IFD_1].offset : 0);
+  if (ifd[SWENC_IFD_EXIF].num) {
+    swenc_exif_write_ifd(p, &ifd[SWENC_IFD_EXIF], 0);
+  }
+  if (ifd[SWENC_IFD_GPS].num) {
+    swenc_exif_write_ifd(p, &ifd[SWENC_IFD_GPS], 0);
+  }
+  if (has_thumb) {
+    swenc_exif_write_ifd(p, &ifd[SWENC_IFD_1], 0);
+    memcpy(p + ifd[SWENC_IFD_1].offset + ifd[SWENC_IFD_1].size,
+      p_thumb->data, p_thumb->len);
+  }
+  p_app1->len = 2 + seg_len;
+  *p_thumb_added = has_thumb;
+  return 0;
+}